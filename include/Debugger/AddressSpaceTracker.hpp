@@ -0,0 +1,68 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_ADDRESSSPACETRACKER_HPP
+#define XENDBG_ADDRESSSPACETRACKER_HPP
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <Xen/Common.hpp>
+#include <Xen/Domain.hpp>
+
+namespace xd::dbg {
+
+  // An address space the guest has switched to, identified by the base of
+  // its top-level page table
+  struct AddressSpace {
+    xen::Address root;
+    uint64_t num_switches; // Times a vCPU has switched to it
+    uint64_t last_switch_ns; // Monotonic; 0 if only seen when tracking began
+  };
+
+  // Follows CR3 writes so that each vCPU's paging mode is known without
+  // reading its context. Guests reuse the pages of dead processes' page
+  // tables, so an address space here may have since been replaced.
+  class AddressSpaceTracker {
+  public:
+    using AddressSpaces = std::unordered_map<xen::Address, AddressSpace>;
+
+    // Starts from the paging mode each vCPU is in now, indexed by vCPU ID
+    explicit AddressSpaceTracker(const std::vector<xen::PagingMode> &vcpu_modes);
+
+    void did_switch(xen::VCPU_ID vcpu_id, const xen::PagingMode &mode);
+
+    std::optional<xen::PagingMode> get_paging_mode(xen::VCPU_ID vcpu_id) const;
+    const std::vector<xen::PagingMode> &get_vcpu_modes() const { return _vcpu_modes; };
+    const AddressSpaces &get_address_spaces() const { return _address_spaces; };
+    uint64_t get_num_switches() const { return _num_switches; };
+
+  private:
+    std::vector<xen::PagingMode> _vcpu_modes;
+    AddressSpaces _address_spaces;
+    uint64_t _num_switches;
+  };
+
+}
+
+#endif //XENDBG_ADDRESSSPACETRACKER_HPP
@@ -0,0 +1,108 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_CFITABLE_HPP
+#define XENDBG_CFITABLE_HPP
+
+#include <array>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Xen/Common.hpp>
+
+// DWARF numbers 0-16 cover the x86-64 GPRs and RIP, and 0-8 the i386 ones
+#define CFI_NUM_REGISTERS 17
+
+namespace xd::dbg {
+
+  class CFIParseException : public std::runtime_error {
+  public:
+    explicit CFIParseException(const std::string &msg)
+      : std::runtime_error(msg) {};
+  };
+
+  struct CFIRule {
+    enum class Type {
+      Undefined, SameValue, Offset, ValOffset, Register, Unsupported
+    };
+
+    Type type;
+    int64_t value;
+  };
+
+  // The unwind rules in effect at one PC
+  struct CFIRow {
+    uint64_t cfa_register;
+    int64_t cfa_offset;
+    bool cfa_is_expression;
+    uint64_t return_address_register;
+    std::array<CFIRule, CFI_NUM_REGISTERS> registers;
+  };
+
+  // Call frame information from an ELF's .eh_frame and .debug_frame,
+  // parsed once into a table of FDEs sorted by start address. Lookups are
+  // a binary search; only the matching FDE's instructions are evaluated.
+  class CFITable {
+  public:
+    CFITable()
+      : _address_size(sizeof(uint64_t)) {};
+
+    static CFITable from_elf(const std::string &path);
+
+    std::optional<CFIRow> get_row(xen::Address pc) const;
+
+    size_t get_num_fdes() const { return _fdes.size(); };
+    bool empty() const { return _fdes.empty(); };
+
+  private:
+    struct CIE {
+      uint64_t code_alignment;
+      int64_t data_alignment;
+      uint64_t return_address_register;
+      uint8_t pointer_encoding;
+      bool has_augmentation_data;
+      size_t instructions_offset, instructions_length;
+    };
+
+    struct FDE {
+      uint64_t pc_begin, pc_end;
+      size_t cie;
+      size_t instructions_offset, instructions_length;
+    };
+
+    std::vector<unsigned char> _data;
+    std::vector<CIE> _cies;
+    std::vector<FDE> _fdes;
+    size_t _address_size;
+
+    void parse_section(const char *data, size_t size, xen::Address address,
+        bool is_eh_frame);
+    std::optional<CIE> parse_cie(const unsigned char *section, size_t size,
+        xen::Address address, size_t offset, size_t base, bool is_eh_frame) const;
+    bool execute(const CIE &cie, size_t offset, size_t length, uint64_t pc_begin,
+        xen::Address pc, CFIRow &row, const CFIRow *initial) const;
+  };
+
+}
+
+#endif //XENDBG_CFITABLE_HPP
@@ -0,0 +1,100 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_CHECKPOINTSTORE_HPP
+#define XENDBG_CHECKPOINTSTORE_HPP
+
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <Registers/RegistersX86Any.hpp>
+#include <Xen/Common.hpp>
+#include <Xen/Domain.hpp>
+
+#include "PageStore.hpp"
+#include "StopReason.hpp"
+
+namespace xd::dbg {
+
+  class NoSuchCheckpointException : public std::runtime_error {
+  public:
+    explicit NoSuchCheckpointException(size_t id)
+      : std::runtime_error(std::to_string(id)) {};
+  };
+
+  using CheckpointID = size_t;
+
+  struct Checkpoint {
+    CheckpointID id;
+    StopReason stop_reason;
+    std::vector<reg::RegistersX86Any> vcpu_contexts;
+
+    // The first checkpoint holds every page of the guest; each subsequent
+    // one holds only the pages dirtied since its predecessor.
+    std::unordered_map<xen_pfn_t, PageStore::Page> pages;
+  };
+
+  class CheckpointStore {
+  public:
+    using GFNSet = std::unordered_set<xen_pfn_t>;
+    using MaskPageFn = std::function<void(xen_pfn_t gfn, unsigned char *page)>;
+
+    explicit CheckpointStore(xen::Domain &domain);
+    ~CheckpointStore();
+
+    CheckpointStore(const CheckpointStore &other) = delete;
+    CheckpointStore& operator=(const CheckpointStore &other) = delete;
+
+    // 'written' holds pages the debugger itself wrote through foreign
+    // mappings, which the hypervisor's dirty log does not see. 'mask' is
+    // applied to each captured page before it is stored.
+    const Checkpoint &create(StopReason stop_reason, const GFNSet &written,
+        const MaskPageFn &mask);
+
+    // Returns the GFNs that were actually rewritten.
+    std::vector<xen_pfn_t> restore(CheckpointID id, const GFNSet &written);
+
+    void clear();
+
+    const std::vector<Checkpoint> &get_checkpoints() const { return _checkpoints; };
+    const Checkpoint &get_checkpoint(CheckpointID id) const;
+    std::optional<CheckpointID> get_previous(CheckpointID id) const;
+    size_t get_num_stored_pages() const { return _page_store.get_num_pages(); };
+
+  private:
+    xen::Domain &_domain;
+    PageStore _page_store;
+    std::vector<Checkpoint> _checkpoints;
+    CheckpointID _next_id;
+    bool _is_logging_dirty;
+
+    std::vector<Checkpoint>::iterator find(CheckpointID id);
+    GFNSet collect_dirty(const GFNSet &written) const;
+    void capture_pages(const std::vector<xen_pfn_t> &gfns, const MaskPageFn &mask,
+        std::unordered_map<xen_pfn_t, PageStore::Page> &pages);
+  };
+
+}
+
+#endif //XENDBG_CHECKPOINTSTORE_HPP
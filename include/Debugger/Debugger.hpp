@@ -23,6 +23,7 @@
 #define XENDBG_DEBUGGER_HPP
 
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <sys/mman.h>
 #include <vector>
@@ -34,8 +35,15 @@
 #include <Util/overloaded.hpp>
 #include <Xen/Common.hpp>
 #include <Xen/Domain.hpp>
+#include <Xen/MemoryMap.hpp>
 
+#include "AddressSpaceTracker.hpp"
+#include "CheckpointStore.hpp"
+#include "EventTrace.hpp"
+#include "Kallsyms.hpp"
+#include "MarkerTrace.hpp"
 #include "StopReason.hpp"
+#include "Unwinder.hpp"
 
 #define X86_INT3 0xCC
 #define X86_MAX_INSTRUCTION_SIZE 0x10
@@ -55,6 +63,13 @@ namespace xd::dbg {
     {};
   };
 
+  class NoReturnAddressException : public std::runtime_error {
+  public:
+    explicit NoReturnAddressException(const std::string &msg)
+      : std::runtime_error(msg)
+    {};
+  };
+
   using MaskedMemory = std::unique_ptr<unsigned char>;
 
   class Debugger : public std::enable_shared_from_this<Debugger> {
@@ -76,9 +91,26 @@ namespace xd::dbg {
     virtual void continue_() = 0;
     virtual void single_step() = 0;
 
+    // Lets every vCPU run without stepping, e.g. while sampling the guest,
+    // and stops them all again as a debug event would. A breakpoint under
+    // the current vCPU is lifted until the pause, so as not to be hit at once.
+    void resume();
+    void pause();
+
     void insert_breakpoint(xen::Address address);
     BreakpointMap::iterator remove_breakpoint(xen::Address address);
 
+    // Steps over a call by running to its return site under a temporary
+    // breakpoint, in a single continue; any other instruction is single-
+    // stepped. Returns the return site if the instruction was a call.
+    std::optional<xen::Address> step_over();
+    // Runs until the current function returns to its caller, and returns
+    // the return address. Stops at the same site in deeper recursive
+    // frames are resumed without being reported.
+    xen::Address finish();
+    bool has_return_breakpoint() const { return _return_breakpoint.has_value(); };
+    void clear_return_breakpoint();
+
     virtual void insert_watchpoint(xen::Address address, uint32_t bytes, WatchpointType type);
     virtual void remove_watchpoint(xen::Address address, uint32_t bytes, WatchpointType type);
 
@@ -90,22 +122,121 @@ namespace xd::dbg {
     void write_memory_retaining_breakpoints(
         xen::Address address, size_t length, void *data);
 
+    // Guest-physical access; breakpoints are not masked
+    std::vector<unsigned char> read_physical_memory(
+        xen_pfn_t gfn, size_t offset, size_t length);
+    void write_physical_memory(
+        xen_pfn_t gfn, size_t offset, const std::vector<unsigned char> &data);
+
+    // Excludes the temporary breakpoint of a step over or finish
+    size_t get_num_breakpoints() const;
+    size_t get_num_memory_maps() const { return _memory_maps.size(); };
+
     xen::VCPU_ID get_vcpu_id() { return _vcpu_id; };
     void set_vcpu_id(xen::VCPU_ID vcpu_id) { _vcpu_id = vcpu_id; };
 
     void did_stop(StopReason reason);
 
+    // Counted over the debugger's lifetime. Stops in deeper recursive frames
+    // that are resumed without being reported aren't counted as stops.
+    uint64_t get_num_stops() const { return _num_stops; };
+    uint64_t get_num_breakpoint_hits() const { return _num_breakpoint_hits; };
+
+    // Fetched on first use after each stop and cached until the next, so
+    // stops that only touch the integer registers never read them
+    const reg::x86::ExtendedRegisters &get_extended_registers(xen::VCPU_ID vcpu_id);
+    void set_extended_registers(const reg::x86::ExtendedRegisters &regs, xen::VCPU_ID vcpu_id);
+
+    // Without reading the vCPU's context if address spaces are tracked
+    xen::PagingMode get_paging_mode(xen::VCPU_ID vcpu_id) const;
+
+    virtual void set_track_address_spaces(bool enabled);
+    const AddressSpaceTracker *get_address_space_tracker() const { return _address_space_tracker.get(); };
+
+    // Cached per address space until the guest next runs
+    const xen::MemoryMap &get_memory_map(xen::VCPU_ID vcpu_id);
+    void invalidate_memory_maps() { _memory_maps.clear(); };
+
+    // Loads CFI from the given ELF; without it, backtraces follow frame pointers
+    void load_unwind_info(const std::string &path);
+    std::vector<StackFrame> backtrace(xen::VCPU_ID vcpu_id) const;
+    size_t get_num_unwind_entries() const { return _unwinder.get_cfi().get_num_fdes(); };
+
+    // Recovers the kernel's symbols from the kallsyms tables in guest
+    // memory, for guests without a matching vmlinux; sorted by address
+    const std::vector<KernelSymbol> &load_kernel_symbols(Kallsyms::Stats *stats = nullptr);
+    const std::vector<KernelSymbol> &get_kernel_symbols() const { return _kernel_symbols; };
+
+    const Checkpoint &create_checkpoint();
+    void restore_checkpoint(CheckpointID id);
+    void clear_checkpoints();
+    const std::vector<Checkpoint> &get_checkpoints() const;
+    std::optional<CheckpointID> get_current_checkpoint() const { return _current_checkpoint; };
+    size_t get_num_checkpoint_pages() const;
+
+    // Both return false if the start of the recorded history was reached
+    bool reverse_step();
+    bool reverse_continue();
+
+    void set_auto_checkpoint(bool enabled) { _auto_checkpoint = enabled; };
+    bool get_auto_checkpoint() const { return _auto_checkpoint; };
+
+    virtual void set_guest_request_mode(GuestRequestMode mode);
+    GuestRequestMode get_guest_request_mode() const { return _guest_request_mode; };
+    const MarkerTrace &get_markers() const { return _markers; };
+    void clear_markers() { _markers.clear(); };
+
+    virtual void start_trace(const EventTraceConfig &config, const std::string &path);
+    // Returns the finished trace, whose file is closed once it is destroyed
+    virtual std::unique_ptr<EventTrace> stop_trace();
+    virtual const EventTrace *get_trace() const { return nullptr; };
+
   protected:
     BreakpointMap _breakpoints;
+    MarkerTrace _markers;
+    GuestRequestMode _guest_request_mode;
+    std::unique_ptr<AddressSpaceTracker> _address_space_tracker;
+    uint64_t _num_breakpoint_hits;
+
+    // Starts tracking afresh from each vCPU's current context
+    void reset_address_space_tracker();
 
   private:
+    struct ReturnBreakpoint {
+      xen::VCPU_ID vcpu_id;
+      xen::Address address;
+      xen::Address min_sp;
+      bool is_temporary;
+    };
+
     xen::Domain &_domain;
+    Unwinder _unwinder;
+    std::optional<ReturnBreakpoint> _return_breakpoint;
+    std::optional<xen::Address> _lifted_breakpoint;
+    std::unordered_map<xen::VCPU_ID, reg::x86::ExtendedRegisters> _extended_registers;
+    std::vector<KernelSymbol> _kernel_symbols;
 
     OnStopFn _on_stop;
 
     xen::VCPU_ID _vcpu_id;
     bool _is_attached;
     StopReason _last_stop_reason;
+    uint64_t _num_stops;
+
+    std::unique_ptr<CheckpointStore> _checkpoints;
+    CheckpointStore::GFNSet _written_gfns;
+    std::optional<CheckpointID> _current_checkpoint;
+    bool _auto_checkpoint;
+
+    std::unordered_map<uint64_t, xen::MemoryMap> _memory_maps;
+
+    void did_write(xen::Address address, size_t length);
+    std::optional<size_t> get_call_length(xen::Address address);
+    void run_to_return(xen::VCPU_ID vcpu_id, xen::Address address, xen::Address min_sp);
+    bool is_stop_in_deeper_frame(const StopReason &reason);
+    xen::XenForeignMemory::MappedMemory<unsigned char> map_physical_memory(
+        xen_pfn_t gfn, size_t offset, size_t length, int prot);
+    void try_auto_checkpoint();
   };
 
 }
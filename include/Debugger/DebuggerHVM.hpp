@@ -33,6 +33,7 @@
 #include <Xen/DomainHVM.hpp>
 
 #include "Debugger.hpp"
+#include "WatchpointMap.hpp"
 
 namespace xd::dbg {
 
@@ -52,15 +53,30 @@ namespace xd::dbg {
     void insert_watchpoint(xen::Address address, uint32_t bytes, WatchpointType type) override;
     void remove_watchpoint(xen::Address address, uint32_t bytes, WatchpointType type) override;
 
+    void set_guest_request_mode(GuestRequestMode mode) override;
+
+    void start_trace(const EventTraceConfig &config, const std::string &path) override;
+    std::unique_ptr<EventTrace> stop_trace() override;
+    const EventTrace *get_trace() const override { return _trace.get(); };
+
+    void set_track_address_spaces(bool enabled) override;
+
   private:
     xen::DomainHVM _domain;
     std::shared_ptr<xen::HVMMonitor> _monitor;
+    WatchpointMap _watchpoints;
+    std::unique_ptr<EventTrace> _trace;
+    EventTraceConfig _trace_config;
 
     std::optional<xen::Address> _last_single_step_breakpoint_addr;
     bool _is_continuing;
     bool _non_stop_mode;
+    int _word_size;
 
     void on_event(vm_event_st event);
+    void record_marker(const vm_event_st &event);
+    void monitor_trace_events(const EventTraceConfig &config, bool enable);
+    void monitor_cr3_writes(bool enable);
   };
 
 }
@@ -0,0 +1,115 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_EVENTTRACE_HPP
+#define XENDBG_EVENTTRACE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Xen/BridgeHeaders/vm_event.h>
+#include <Xen/Common.hpp>
+
+#define EVENT_TRACE_MAGIC "XDTRACE"
+#define EVENT_TRACE_VERSION 1
+#define EVENT_TRACE_DEFAULT_CAPACITY 4096
+#define EVENT_TRACE_FLUSH_INTERVAL std::chrono::seconds(1)
+
+namespace xd::dbg {
+
+  class EventTraceException : public std::runtime_error {
+  public:
+    explicit EventTraceException(const std::string &msg)
+      : std::runtime_error(msg) {};
+  };
+
+  // Which hypervisor events to trace. Xen can only report MSR writes for
+  // MSRs that are individually subscribed to.
+  struct EventTraceConfig {
+    bool cpuid;
+    bool descriptor_access;
+    std::vector<uint32_t> msrs;
+    std::vector<uint16_t> ctrlregs; // VM_EVENT_X86_*
+
+    // From a comma-separated list of "cpuid", "msr", "cr" and "desc". "msr"
+    // selects a default set of MSRs that kernels commonly write.
+    static EventTraceConfig parse(const std::string &classes);
+  };
+
+  // The file is a header followed by fixed-size records, both little-endian.
+  struct EventTraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t domid;
+    uint64_t start_ns;
+  };
+
+  struct EventTraceRecord {
+    uint64_t timestamp_ns;
+    uint64_t rip;
+    uint64_t new_value; // CR/MSR value written, CPUID eax result
+    uint64_t old_value; // CR/MSR value before the write
+    uint32_t vcpu_id;
+    uint32_t reason;    // VM_EVENT_REASON_*
+    uint32_t index;     // CR index, MSR, CPUID leaf or VM_EVENT_DESC_*
+    uint32_t subindex;  // CPUID subleaf, or whether a descriptor was written
+  };
+
+  // Records are batched in a fixed ring and written out whenever it fills
+  // or a second has passed. Events only ever arrive on the event loop, so
+  // the ring needs no synchronisation.
+  class EventTrace {
+  public:
+    using Counts = std::map<uint32_t, uint64_t>;
+
+    EventTrace(const std::string &path, xen::DomID domid,
+        size_t capacity = EVENT_TRACE_DEFAULT_CAPACITY);
+    ~EventTrace();
+
+    EventTrace(const EventTrace &other) = delete;
+    EventTrace& operator=(const EventTrace &other) = delete;
+
+    void record(const vm_event_request_t &event);
+    void flush();
+
+    const Counts &get_counts() const { return _counts; };
+    uint64_t get_num_records() const { return _num_records; };
+    std::chrono::nanoseconds get_duration() const;
+
+    static const char *reason_name(uint32_t reason);
+
+  private:
+    std::ofstream _file;
+    std::vector<EventTraceRecord> _ring;
+    size_t _num_buffered;
+    uint64_t _num_records;
+    Counts _counts;
+    std::chrono::steady_clock::time_point _start, _last_flush;
+  };
+
+}
+
+#endif //XENDBG_EVENTTRACE_HPP
@@ -0,0 +1,82 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_KALLSYMS_HPP
+#define XENDBG_KALLSYMS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Xen/Common.hpp>
+#include <Xen/Domain.hpp>
+
+namespace xd::dbg {
+
+  class KallsymsException : public std::runtime_error {
+  public:
+    explicit KallsymsException(const std::string &msg)
+      : std::runtime_error(msg) {};
+  };
+
+  struct KernelSymbol {
+    xen::Address address;
+    char type;
+    std::string name;
+  };
+
+  // Recovers a Linux guest's symbol table from the compressed kallsyms
+  // tables in its memory, for guests with no matching vmlinux on hand.
+  //
+  // The kernel image's mappings are found with a single page table walk and
+  // copied out in large batches of frames, after which the tables are
+  // located and decoded entirely from that snapshot: the token table is
+  // found by its run of single-digit tokens, and the markers, names and
+  // symbol count are found relative to it. Both the older layout, with the
+  // offsets before the names, and the newer one, with them after the token
+  // index, are supported, as are absolute address tables.
+  class Kallsyms {
+  public:
+    struct Stats {
+      size_t num_pages;
+      std::chrono::microseconds read_time;
+      std::chrono::microseconds decode_time;
+    };
+
+    // Symbols are sorted by address
+    static std::vector<KernelSymbol> read(const xen::Domain &domain,
+        const xen::PagingMode &paging_mode, Stats *stats = nullptr);
+
+    // Decodes the tables from a copy of the memory at address; word_size is
+    // the guest's pointer size
+    static std::vector<KernelSymbol> decode(const unsigned char *data, size_t size,
+        xen::Address address, size_t word_size);
+
+    // The nearest symbol at or below the address, or nullptr if there is none
+    static const KernelSymbol *lookup(const std::vector<KernelSymbol> &symbols,
+        xen::Address address);
+  };
+
+}
+
+#endif //XENDBG_KALLSYMS_HPP
@@ -0,0 +1,132 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_LINETABLE_HPP
+#define XENDBG_LINETABLE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Xen/Common.hpp>
+
+// Decoded units kept in memory at once; older ones are re-decoded on demand
+#define LINE_TABLE_MAX_CACHED_UNITS 64
+
+namespace xd::util {
+  class ElfFile;
+}
+
+namespace xd::dbg {
+
+  class LineTableException : public std::runtime_error {
+  public:
+    explicit LineTableException(const std::string &msg)
+      : std::runtime_error(msg) {};
+  };
+
+  struct SourceLocation {
+    std::string file;
+    uint32_t line;
+
+    bool operator==(const SourceLocation &other) const {
+      return line == other.line && file == other.file;
+    };
+    bool operator!=(const SourceLocation &other) const {
+      return !(*this == other);
+    };
+  };
+
+  // The .debug_line programs of an ELF, decoded lazily. Opening the file
+  // only locates the section; the first lookup runs every unit's program
+  // once to build a sorted index of address ranges, and a unit's rows are
+  // only materialized when an address inside it is looked up. At most
+  // LINE_TABLE_MAX_CACHED_UNITS decoded units are kept.
+  class LineTable {
+  public:
+    struct Stats {
+      bool is_indexed;
+      size_t num_units;
+      size_t num_sequences;
+      size_t index_bytes;
+      size_t num_cached_units;
+      size_t num_cached_rows;
+      size_t cached_bytes;
+      std::chrono::microseconds index_build_time;
+    };
+
+    static LineTable from_elf(const std::string &path);
+
+    std::optional<SourceLocation> lookup(xen::Address address) const;
+
+    bool empty() const { return _unit_offsets.empty(); };
+    Stats get_stats() const;
+
+  private:
+    struct Row {
+      uint64_t address;
+      uint32_t file;
+      uint32_t line;
+      bool end_sequence;
+    };
+
+    struct Sequence {
+      uint64_t begin, end;
+      uint32_t unit;
+    };
+
+    struct Unit {
+      std::vector<std::string> files;
+      std::vector<Row> rows;
+      uint64_t last_used;
+    };
+
+    std::shared_ptr<const util::ElfFile> _elf;
+    const unsigned char *_debug_line;
+    size_t _debug_line_size;
+    const char *_debug_str, *_debug_line_str;
+    size_t _debug_str_size, _debug_line_str_size;
+    size_t _address_size;
+    std::vector<size_t> _unit_offsets;
+
+    mutable bool _is_indexed;
+    mutable std::vector<Sequence> _sequences;
+    mutable std::chrono::microseconds _index_build_time;
+    mutable std::unordered_map<uint32_t, Unit> _units;
+    mutable uint64_t _lookup_counter;
+
+    LineTable();
+
+    void build_index() const;
+    const Unit &get_unit(uint32_t unit) const;
+    void run_program(size_t offset, std::vector<std::string> *files,
+        const std::function<void(const Row&)> &on_row) const;
+  };
+
+}
+
+#endif //XENDBG_LINETABLE_HPP
@@ -0,0 +1,75 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_MARKERTRACE_HPP
+#define XENDBG_MARKERTRACE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <Xen/Common.hpp>
+
+#define MARKER_TRACE_DEFAULT_CAPACITY 4096
+
+namespace xd::dbg {
+
+  // What to do when the guest issues HVMOP_guest_request_vm_event
+  enum class GuestRequestMode {
+    Marker, // Record and let the guest run on
+    Stop,   // Stop as if at a breakpoint
+  };
+
+  // A guest request recorded in Marker mode. Guests pass a marker ID and up to
+  // two arguments in registers the hypercall itself leaves unused: rdx, r10
+  // and r8 for 64-bit guests, or edx, esi and edi for 32-bit guests.
+  struct Marker {
+    uint64_t timestamp_ns; // Monotonic, taken when the event is read
+    xen::VCPU_ID vcpu_id;
+    xen::Address rip;
+    uint64_t cr3;
+    uint64_t id;
+    uint64_t args[2];
+  };
+
+  // Fixed-capacity ring; once full, the oldest markers are overwritten.
+  class MarkerTrace {
+  public:
+    explicit MarkerTrace(size_t capacity = MARKER_TRACE_DEFAULT_CAPACITY);
+
+    void record(const Marker &marker);
+    void clear() { _num_recorded = 0; };
+
+    // Oldest first
+    std::vector<Marker> get_markers() const;
+
+    size_t get_capacity() const { return _ring.size(); };
+    size_t get_num_markers() const { return std::min(_num_recorded, _ring.size()); };
+    size_t get_num_dropped() const { return _num_recorded - get_num_markers(); };
+
+  private:
+    std::vector<Marker> _ring;
+    size_t _num_recorded;
+  };
+
+}
+
+#endif //XENDBG_MARKERTRACE_HPP
@@ -0,0 +1,59 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_PAGESTORE_HPP
+#define XENDBG_PAGESTORE_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+#include <Xen/Common.hpp>
+
+namespace xd::dbg {
+
+  // Content-addressed store for guest page snapshots. Identical pages are
+  // shared between checkpoints; a page is freed once no checkpoint holds it.
+  class PageStore {
+  public:
+    using PageData = std::array<unsigned char, XC_PAGE_SIZE>;
+    using Page = std::shared_ptr<const PageData>;
+
+    PageStore();
+
+    Page intern(const void *data);
+
+    size_t get_num_pages() const { return _pages->size(); };
+    size_t get_num_bytes() const { return get_num_pages() * XC_PAGE_SIZE; };
+
+  private:
+    // Shared with each page's deleter, which erases the page's entry; the
+    // deleter holds it weakly, so pages may outlive the store
+    using Index = std::unordered_multimap<uint64_t, std::weak_ptr<const PageData>>;
+    std::shared_ptr<Index> _pages;
+
+    static uint64_t hash(const void *data);
+  };
+
+}
+
+#endif //XENDBG_PAGESTORE_HPP
@@ -0,0 +1,97 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_SAMPLER_HPP
+#define XENDBG_SAMPLER_HPP
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <uvw.hpp>
+
+#include <Xen/Common.hpp>
+#include <Xen/Domain.hpp>
+
+namespace xd::dbg {
+
+  // Periodically samples the instruction pointer of every vCPU while the
+  // guest runs. With a non-zero depth, each sample also follows the frame
+  // pointer chain, which requires briefly pausing the domain so that the
+  // stack is consistent; otherwise only the register read is done, which
+  // Xen performs without our holding the domain paused.
+  class Sampler {
+  public:
+    using Stack = std::vector<xen::Address>;
+    using SymbolizeFn = std::function<std::string(xen::Address)>;
+    using Duration = std::chrono::nanoseconds;
+
+    Sampler(uvw::Loop &loop, const xen::Domain &domain,
+        size_t frequency, size_t max_depth);
+    ~Sampler();
+
+    void start();
+    void stop();
+    void take_sample();
+
+    size_t get_num_samples() const { return _num_samples; };
+    Duration get_total_pause_time() const { return _total_pause_time; };
+    Duration get_max_pause_time() const { return _max_pause_time; };
+
+    // One line per distinct stack, outermost frame first, in the format
+    // consumed by flamegraph.pl
+    void write_folded(std::ostream &out, const SymbolizeFn &symbolize) const;
+
+  private:
+    struct StackKey {
+      uint64_t cr3;
+      Stack stack;
+
+      bool operator<(const StackKey &other) const {
+        return std::tie(cr3, stack) < std::tie(other.cr3, other.stack);
+      }
+    };
+
+    const xen::Domain &_domain;
+    std::shared_ptr<uvw::TimerHandle> _timer;
+    size_t _frequency, _max_depth;
+
+    // Read once per run rather than per sample
+    xen::VCPU_ID _max_vcpu_id;
+    size_t _word_size;
+
+    std::map<StackKey, size_t> _stacks;
+    size_t _num_samples;
+    Duration _total_pause_time, _max_pause_time;
+
+    Stack unwind(const xen::PagingMode &paging_mode, xen::Address ip, xen::Address fp,
+        size_t word_size) const;
+  };
+
+}
+
+#endif //XENDBG_SAMPLER_HPP
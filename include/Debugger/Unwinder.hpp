@@ -0,0 +1,82 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_UNWINDER_HPP
+#define XENDBG_UNWINDER_HPP
+
+#include <array>
+#include <bitset>
+#include <vector>
+
+#include <Xen/Common.hpp>
+#include <Xen/Domain.hpp>
+#include <Xen/PageCache.hpp>
+
+#include "CFITable.hpp"
+
+#define UNWIND_MAX_FRAMES 64
+
+namespace xd::dbg {
+
+  struct StackFrame {
+    xen::Address pc;
+    xen::Address sp;
+    bool from_cfi;
+  };
+
+  // Unwinds a vCPU's stack using CFI where it covers the PC, and the frame
+  // pointer chain elsewhere. A backtrace costs one register fetch; stack
+  // memory is read through a page cache that lives only as long as the
+  // backtrace, so each stack page is mapped once.
+  class Unwinder {
+  public:
+    explicit Unwinder(const xen::Domain &domain)
+      : _domain(domain) {};
+
+    void set_cfi(CFITable cfi) { _cfi = std::move(cfi); };
+    const CFITable &get_cfi() const { return _cfi; };
+
+    std::vector<StackFrame> backtrace(xen::VCPU_ID vcpu_id,
+        size_t max_frames = UNWIND_MAX_FRAMES) const;
+
+  private:
+    struct Registers {
+      std::array<uint64_t, CFI_NUM_REGISTERS> values;
+      std::bitset<CFI_NUM_REGISTERS> valid;
+    };
+
+    struct Layout {
+      size_t word_size;
+      size_t sp, fp, pc;
+    };
+
+    const xen::Domain &_domain;
+    CFITable _cfi;
+
+    bool step_cfi(const Layout &layout, const Registers &regs, bool is_caller,
+        xen::PageCache &pages, Registers &next) const;
+    bool step_frame_pointer(const Layout &layout, const Registers &regs,
+        xen::PageCache &pages, Registers &next) const;
+  };
+
+}
+
+#endif //XENDBG_UNWINDER_HPP
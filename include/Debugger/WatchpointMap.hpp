@@ -0,0 +1,90 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_WATCHPOINTMAP_HPP
+#define XENDBG_WATCHPOINTMAP_HPP
+
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Xen/Common.hpp>
+#include <Xen/Domain.hpp>
+
+#include "WatchpointType.hpp"
+
+namespace xd::dbg {
+
+  // Watchpoints are set by virtual address, but mem_access restrictions and
+  // the events they raise are by GFN. This keeps the reverse mapping from
+  // each watched GFN back to the virtual pages that were watched, so a stop
+  // can be reported at the address the client actually asked for.
+  class WatchpointMap {
+  public:
+    // Supplies the debugger's (possibly tracked) paging mode, so that
+    // translation needn't refetch the vCPU's context
+    using GetPagingModeFn = std::function<xen::PagingMode(xen::VCPU_ID)>;
+
+    WatchpointMap(xen::Domain &domain, GetPagingModeFn get_paging_mode)
+      : _domain(domain), _get_paging_mode(std::move(get_paging_mode)) {};
+
+    void insert(xen::Address address, uint32_t bytes, WatchpointType type,
+        xen::VCPU_ID vcpu_id);
+    void remove(xen::Address address, uint32_t bytes, WatchpointType type);
+    void clear();
+
+    // Translation happens only when the watchpoint is inserted; if a GFN
+    // has no known mapping (e.g. the guest has since remapped the page),
+    // the watchpoints are re-translated once and the lookup is retried.
+    std::optional<xen::Address> find(xen_pfn_t gfn, size_t offset, xen::VCPU_ID vcpu_id);
+
+  private:
+    struct Watchpoint {
+      xen::Address address;
+      uint32_t bytes;
+      WatchpointType type;
+      xen::VCPU_ID vcpu_id;
+      uint64_t cr3;
+      std::vector<std::pair<xen::Address, xen_pfn_t>> pages;
+    };
+
+    struct Mapping {
+      xen::Address virtual_page;
+      uint64_t cr3;
+    };
+
+    xen::Domain &_domain;
+    GetPagingModeFn _get_paging_mode;
+    std::vector<Watchpoint> _watchpoints;
+    std::unordered_multimap<xen_pfn_t, Mapping> _reverse;
+
+    void translate(Watchpoint &watchpoint) const;
+    void rebuild_reverse();
+    void refresh();
+    void apply_access(xen_pfn_t gfn) const;
+    std::optional<xen::Address> lookup(xen_pfn_t gfn, size_t offset, uint64_t cr3) const;
+  };
+
+}
+
+#endif //XENDBG_WATCHPOINTMAP_HPP
@@ -24,10 +24,13 @@
 
 #include <functional>
 #include <memory>
+#include <optional>
 
 #include <uvw.hpp>
 
 #include "GDBPacketQueue.hpp"
+#include "GDBPacketStats.hpp"
+#include "GDBTrace.hpp"
 #include "GDBServer/GDBRequest/GDBRequest.hpp"
 #include "GDBServer/GDBResponse/GDBResponse.hpp"
 
@@ -53,6 +56,14 @@ namespace xd::gdb {
     void enable_error_strings() { _error_strings = true; };
     void disable_ack_mode() { _ack_mode = false; };
 
+    // Time each packet from its arrival until its handler returns
+    void set_packet_stats(std::shared_ptr<GDBPacketStats> stats) { _packet_stats = std::move(stats); };
+    std::shared_ptr<GDBPacketStats> get_packet_stats() const { return _packet_stats; };
+    void set_trace(std::shared_ptr<GDBTrace> trace, xen::DomID domid) {
+      _trace = std::move(trace);
+      _trace_domid = domid;
+    };
+
     void stop();
     void read(OnReceiveFn on_receive, OnCloseFn on_close, OnErrorFn on_error);
 
@@ -67,7 +78,16 @@ namespace xd::gdb {
     OnErrorFn _on_error;
     OnReceiveFn _on_receive;
 
-    static req::GDBRequest parse_packet(const GDBPacket &packet);
+    std::shared_ptr<GDBPacketStats> _packet_stats;
+    std::shared_ptr<GDBTrace> _trace;
+    xen::DomID _trace_domid;
+    std::optional<GDBPacketTiming> _timing; // Of the packet being handled
+
+    void receive(const GDBPacket &raw_packet, uint64_t received);
+    void finish_timing(const std::string &type, const GDBPacket &raw_packet);
+
+    // Sets type to the prefix that identified the packet
+    static req::GDBRequest parse_packet(const GDBPacket &packet, std::string &type);
   };
 
 }
@@ -0,0 +1,77 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_GDBMONITOR_HPP
+#define XENDBG_GDBMONITOR_HPP
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Debugger/Debugger.hpp>
+
+#include "GDBPacketStats.hpp"
+
+namespace xd::gdb {
+
+  class MonitorCommandException : public std::runtime_error {
+  public:
+    explicit MonitorCommandException(const std::string &msg)
+      : std::runtime_error(msg) {};
+  };
+
+  // Server-side commands reached through qRcmd ("monitor" in GDB,
+  // "process plugin packet monitor" in LLDB). Each command does all of
+  // its work here and returns its complete output, so the client needs
+  // only a single round trip.
+  class GDBMonitor {
+  public:
+    explicit GDBMonitor(dbg::Debugger &debugger,
+        std::shared_ptr<GDBPacketStats> packet_stats = nullptr)
+      : _debugger(debugger), _packet_stats(std::move(packet_stats)) {};
+
+    std::string run(const std::string &command);
+
+  private:
+    using Args = std::vector<std::string>;
+
+    dbg::Debugger &_debugger;
+    std::shared_ptr<GDBPacketStats> _packet_stats;
+
+    std::string help() const;
+    std::string phys(const Args &args);
+    std::string translate(const Args &args);
+    std::string stats(const Args &args) const;
+    std::string packets(const Args &args);
+    std::string backtrace(const Args &args);
+    std::string unwind_info(const Args &args);
+    std::string markers(const Args &args);
+    std::string trace(const Args &args);
+    std::string processes(const Args &args);
+    std::string kallsyms(const Args &args);
+
+    std::string symbolize(xen::Address address) const;
+  };
+
+}
+
+#endif //XENDBG_GDBMONITOR_HPP
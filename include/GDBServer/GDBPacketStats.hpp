@@ -0,0 +1,90 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_GDBPACKETSTATS_HPP
+#define XENDBG_GDBPACKETSTATS_HPP
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+
+#define GDB_PACKET_STATS_NUM_BUCKETS 40
+
+namespace xd::gdb {
+
+  // Latencies in nanoseconds, in power-of-two buckets
+  class LatencyHistogram {
+  public:
+    void add(uint64_t ns);
+
+    uint64_t get_count() const { return _count; };
+    uint64_t get_total_ns() const { return _total_ns; };
+    uint64_t get_max_ns() const { return _max_ns; };
+    uint64_t get_mean_ns() const { return _count ? _total_ns / _count : 0; };
+
+    // Upper bound of the bucket holding the given fraction of samples
+    uint64_t get_percentile_ns(double fraction) const;
+
+  private:
+    uint64_t _count = 0;
+    uint64_t _total_ns = 0;
+    uint64_t _max_ns = 0;
+    std::array<uint64_t, GDB_PACKET_STATS_NUM_BUCKETS> _buckets{};
+  };
+
+  // When each stage of handling a packet happened, in XenStats clock ticks.
+  // Responses are sent from within the handler, so sending overlaps with
+  // handling; send_begin is when the first response started going out.
+  struct GDBPacketTiming {
+    uint64_t received;
+    uint64_t parsed;
+    uint64_t handled;
+    uint64_t send_begin;
+    uint64_t send_ticks;
+    size_t num_sent;
+  };
+
+  // Per packet type (e.g. "m", "qRegisterInfo") latency of each stage
+  class GDBPacketStats {
+  public:
+    struct TypeStats {
+      LatencyHistogram parse;   // received -> parsed
+      LatencyHistogram handle;  // parsed -> first response, or done
+      LatencyHistogram send;    // writing responses out
+      LatencyHistogram total;   // received -> done
+    };
+
+    void record(const std::string &type, const GDBPacketTiming &timing);
+    void reset() { _types.clear(); };
+
+    const std::map<std::string, TypeStats> &get_types() const { return _types; };
+
+    void print(std::ostream &out) const;
+
+  private:
+    std::map<std::string, TypeStats> _types;
+  };
+
+}
+
+#endif //XENDBG_GDBPACKETSTATS_HPP
@@ -79,6 +79,28 @@ namespace xd::gdb::req {
     uint64_t _address;
   };
 
+  class QueryMonitorCommandRequest : public GDBRequestBase {
+  public:
+    explicit QueryMonitorCommandRequest(const std::string &data);
+
+    const std::string &get_command() const { return _command; };
+
+  private:
+    std::string _command;
+  };
+
+  class QueryXferMemoryMapReadRequest : public GDBRequestBase {
+  public:
+    explicit QueryXferMemoryMapReadRequest(const std::string &data);
+
+    size_t get_offset() const { return _offset; };
+    size_t get_length() const { return _length; };
+
+  private:
+    size_t _offset;
+    size_t _length;
+  };
+
 }
 
 #endif //XENDBG_GDBQUERYREQUEST_HPP
@@ -22,8 +22,9 @@
 #ifndef XENDBG_GDBREGISTERREQUEST_HPP
 #define XENDBG_GDBREGISTERREQUEST_HPP
 
-#include <variant>
-#include <vector>
+#include <algorithm>
+#include <array>
+#include <bitset>
 
 #include <Registers/RegistersX86_32.hpp>
 #include <Registers/RegistersX86_64.hpp>
@@ -56,38 +57,47 @@ namespace xd::gdb::req {
 
   class RegisterWriteRequest : public GDBRequestBase {
   public:
+    // Wide enough for a vector register
+    static constexpr size_t MAX_WIDTH = 0x20;
+
     explicit RegisterWriteRequest(const std::string &data);
 
     uint16_t get_register_id() const { return _register_id; };
+    // The first eight bytes, zero-extended
     uint64_t get_value() const { return _value; };
+    const unsigned char *get_bytes() const { return _bytes.data(); };
+    size_t get_width() const { return _width; };
     size_t get_thread_id() const { return _thread_id; };
 
   private:
     uint16_t _register_id;
+    std::array<unsigned char, MAX_WIDTH> _bytes;
+    size_t _width;
     uint64_t _value;
     size_t _thread_id;
   };
 
   class GeneralRegistersBatchWriteRequest : public GDBRequestBase {
-  private:
-    using Value = std::variant<uint64_t, uint32_t, uint16_t, uint8_t>;
-    using Values =  std::vector<std::pair<size_t, Value>>;
-
   public:
+    // Large enough for the register context of either word size
+    static constexpr size_t MAX_SIZE = std::max(
+        xd::reg::x86_64::RegistersX86_64::size,
+        xd::reg::x86_32::RegistersX86_32::size);
+
     explicit GeneralRegistersBatchWriteRequest(const std::string &data);
 
-    const Values& get_values() const { return _values; };
+    size_t get_size() const { return _size; };
+    size_t get_thread_id() const { return _thread_id; };
+
+    // Overwrites the bytes of a packed context ('g' layout) that the
+    // packet specifies, leaving those sent as "xx"
+    void apply(unsigned char *buffer) const;
 
   private:
-    Values _values;
-
-    template <typename Metadata_t>
-    std::optional<typename Metadata_t::Register::Value> read_word(
-        const Metadata_t&)
-    {
-      using RegisterValue = typename Metadata_t::Register::Value;
-      return read_word_unsigned_opt<RegisterValue>();
-    }
+    std::array<unsigned char, MAX_SIZE> _bytes;
+    std::bitset<MAX_SIZE> _specified;
+    size_t _size;
+    size_t _thread_id;
   };
 
 }
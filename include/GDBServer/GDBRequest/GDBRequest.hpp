@@ -118,6 +118,8 @@ namespace xd::gdb::req {
     QueryProcessInfoRequest,
     QueryRegisterInfoRequest,
     QueryMemoryRegionInfoRequest,
+    QueryXferMemoryMapReadRequest,
+    QueryMonitorCommandRequest,
     StopReasonRequest,
     KillRequest,
     SetThreadRequest,
@@ -131,6 +133,8 @@ namespace xd::gdb::req {
     ContinueSignalRequest,
     StepRequest,
     StepSignalRequest,
+    ReverseContinueRequest,
+    ReverseStepRequest,
     BreakpointInsertRequest,
     BreakpointRemoveRequest,
     RestartRequest,
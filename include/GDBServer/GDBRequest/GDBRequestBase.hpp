@@ -83,7 +83,7 @@ namespace xd::gdb::req {
 
     bool check_string(const std::string &s) {
       bool found = ((size_t)(_data.end() - _it) >= s.size()) &&
-                   std::equal(s.begin(), s.end(), _it, _data.end());
+                   std::equal(s.begin(), s.end(), _it);
 
       if (found)
         _it += s.size();
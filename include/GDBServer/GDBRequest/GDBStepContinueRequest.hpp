@@ -44,6 +44,9 @@ namespace xd::gdb::req {
   DECLARE_SIGNAL_REQUESTS(ContinueRequest, 'c', ContinueSignalRequest, 'C');
   DECLARE_SIGNAL_REQUESTS(StepRequest, 's', StepSignalRequest, 'S');
 
+  DECLARE_SIMPLE_REQUEST(ReverseContinueRequest, "bc");
+  DECLARE_SIMPLE_REQUEST(ReverseStepRequest, "bs");
+
 }
 
 #endif //XENDBG_GDBSTEPCONTINUEREQUEST_HPP
@@ -28,6 +28,7 @@
 #include <GDBServer/GDBResponse/GDBResponse.hpp>
 #include <Registers/RegistersX86_32.hpp>
 #include <Registers/RegistersX86_64.hpp>
+#include <Registers/RegistersX86Extended.hpp>
 #include <Xen/Domain.hpp>
 
 namespace xd::gdb {
@@ -83,6 +84,13 @@ namespace xd::gdb {
     GDBConnection &_connection;
 
     std::vector<size_t> get_thread_ids() const;
+    void send_reverse_stop_reply(bool in_history) const;
+
+    // x87/SSE/AVX registers are numbered after the integer registers, and
+    // placed after them in the 'g' layout without ever being sent in it,
+    // so a client reads them individually only when it needs them
+    const reg::x86::ExtendedRegisterInfo *find_extended_register(
+        size_t id, size_t *packet_offset = nullptr) const;
 
   public:
     // Default to a "not supported" response
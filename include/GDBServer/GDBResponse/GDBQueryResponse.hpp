@@ -153,13 +153,44 @@ namespace xd::gdb::rsp {
     std::string _error;
   };
 
+  class QueryXferResponse : public GDBResponse {
+  public:
+    QueryXferResponse(std::string data, bool is_last)
+      : _data(std::move(data)), _is_last(is_last)
+    {};
+
+    std::string to_string() const override {
+      return (_is_last ? "l" : "m") + _data;
+    };
+
+  private:
+    std::string _data;
+    bool _is_last;
+  };
+
+  class ConsoleOutputResponse : public GDBResponse {
+  public:
+    explicit ConsoleOutputResponse(std::string output)
+      : _output(std::move(output))
+    {};
+
+    std::string to_string() const override {
+      return "O" + hexify(_output);
+    };
+
+  private:
+    std::string _output;
+  };
+
   class QueryRegisterInfoResponse : public GDBResponse {
   public:
     QueryRegisterInfoResponse(
         std::string name, size_t width, size_t offset,
-          size_t gcc_register_id)
+          size_t gcc_register_id, std::string encoding = "uint",
+          std::string format = "hex", std::string set = "General Purpose Registers")
       : _name(std::move(name)), _width(width), _offset(offset),
-        _gcc_register_id(gcc_register_id)
+        _gcc_register_id(gcc_register_id), _encoding(std::move(encoding)),
+        _format(std::move(format)), _set(std::move(set))
     {};
 
     std::string to_string() const override;
@@ -169,6 +200,9 @@ namespace xd::gdb::rsp {
     size_t _width;
     size_t _offset;
     size_t _gcc_register_id;
+    std::string _encoding;
+    std::string _format;
+    std::string _set;
   };
 
 }
@@ -42,6 +42,17 @@ namespace xd::gdb::rsp {
     int _width;
   };
 
+  class RegisterBytesReadResponse : public GDBResponse {
+  public:
+    RegisterBytesReadResponse(const unsigned char *data, size_t length)
+      : _hex(hex_encode(data, length)) {};
+
+    std::string to_string() const override { return _hex; };
+
+  private:
+    std::string _hex;
+  };
+
   class GeneralRegistersBatchReadResponse : public GDBResponse {
   public:
     explicit GeneralRegistersBatchReadResponse(xd::reg::RegistersX86Any registers)
@@ -49,11 +60,6 @@ namespace xd::gdb::rsp {
 
     std::string to_string() const override;
 
-    template <typename Reg_t>
-    static void write_register(std::stringstream &ss, const Reg_t&reg) {
-      ss << std::setw(2*sizeof(typename Reg_t::Value)) << reg;
-    }
-
   private:
     xd::reg::RegistersX86Any _registers;
   };
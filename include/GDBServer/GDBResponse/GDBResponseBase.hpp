@@ -45,6 +45,18 @@ namespace xd::gdb::rsp {
       ss << std::setw(2) << (unsigned)byte;
     }
 
+    // One pass into a string sized up front, without stream formatting
+    std::string hex_encode(const unsigned char *data, size_t length) {
+      static constexpr char digits[] = "0123456789abcdef";
+
+      std::string s(2*length, '0');
+      for (size_t i = 0; i < length; ++i) {
+        s[2*i] = digits[data[i] >> 4];
+        s[2*i + 1] = digits[data[i] & 0xF];
+      }
+      return s;
+    }
+
     std::string hexify(const std::string& s) {
       std::stringstream ss;
       ss << std::hex << std::setfill('0');
@@ -0,0 +1,93 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_GDBTRACE_HPP
+#define XENDBG_GDBTRACE_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Xen/XenStats.hpp>
+
+#define GDB_TRACE_FLUSH_EVENTS 4096
+#define GDB_TRACE_MAX_PACKET_CHARS 64
+
+namespace xd::gdb {
+
+  class GDBTraceException : public std::runtime_error {
+  public:
+    explicit GDBTraceException(const std::string &msg)
+      : std::runtime_error(msg) {};
+  };
+
+  // Writes spans as Chrome trace-event JSON, which chrome://tracing and
+  // Perfetto can open. Spans are timed with the XenStats clock; while a
+  // trace is open, every Xen call is added to it too, so that calls made
+  // while handling a packet show up nested under that packet's span.
+  // Only one trace can be open at a time.
+  class GDBTrace {
+  public:
+    explicit GDBTrace(const std::string &path);
+    ~GDBTrace();
+
+    GDBTrace(const GDBTrace&) = delete;
+    GDBTrace& operator=(const GDBTrace&) = delete;
+
+    // args, if given, is the body of a JSON object
+    void add_span(std::string name, const char *category, uint64_t begin,
+        uint64_t end, std::string args = "");
+
+    void flush();
+
+    // Writes out the end of the file. Spans added afterwards are dropped.
+    void close();
+
+  private:
+    struct Span {
+      std::string name;
+      const char *category;
+      uint64_t begin;
+      uint64_t end;
+      std::string args;
+    };
+
+    static GDBTrace *_instance;
+
+    std::mutex _mutex;
+    std::ofstream _file;
+    uint64_t _start;
+    long _pid, _tid;
+    bool _is_empty;
+    std::vector<Span> _spans;
+
+    void flush_locked();
+
+    static void on_xen_call(xen::XenOp op, xen::DomID domid, uint64_t begin,
+        uint64_t end, bool error);
+  };
+
+}
+
+#endif //XENDBG_GDBTRACE_HPP
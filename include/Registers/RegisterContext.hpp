@@ -22,8 +22,16 @@
 #ifndef XENDBG_REGISTER_CONTEXT_HPP
 #define XENDBG_REGISTER_CONTEXT_HPP
 
+#include <array>
+#include <cstring>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#include "RegisterTable.hpp"
 
 namespace xd::reg {
   namespace {
@@ -169,6 +177,10 @@ namespace xd::reg {
     static void find_metadata_by_id(size_t, FoundFn, NotFoundFn nff) {
       nff();
     }
+
+    static std::optional<size_t> find_id_by_name(std::string_view) {
+      return std::nullopt;
+    }
   };
 
   template <size_t _id, size_t _base, typename Register_t, typename... Registers_t>
@@ -191,6 +203,11 @@ namespace xd::reg {
     using Next = _RegisterContext<
           _id+1, _base+sizeof(typename Register_t::Value),
           Registers_t...>;
+    using Table = RegisterTable<_id, _base, Register_t, Registers_t...>;
+    using Indices = std::make_index_sequence<Table::count>;
+
+    template <size_t index>
+    using RegisterAt = std::tuple_element_t<index, std::tuple<Register_t, Registers_t...>>;
 
     const Register_t &_get() const {
       return _register;
@@ -218,6 +235,7 @@ namespace xd::reg {
     static constexpr auto id = _id;
     static constexpr auto base = _base;
     static constexpr size_t size = sizeof(typename Register_t::Value) + Next::size;
+    static constexpr size_t num_registers = Table::count;
 
     template <typename Reg_t>
     static constexpr size_t offset_of =
@@ -245,6 +263,43 @@ namespace xd::reg {
       Reg_t::gcc_id
     };
 
+  private:
+    template <size_t index>
+    static constexpr RegisterMetadataReference<RegisterAt<index>> _metadata_at = {
+      Table::infos[index].id,
+      Table::infos[index].width,
+      Table::infos[index].offset,
+      RegisterAt<index>::name,
+      RegisterAt<index>::alt_name,
+      RegisterAt<index>::gcc_id
+    };
+
+    template <size_t index, typename Context_t, typename FoundFn>
+    static void _found_at(Context_t &context, FoundFn &ff) {
+      ff(_metadata_at<index>, context.template get<RegisterAt<index>>());
+    }
+
+    template <size_t index, typename FoundFn>
+    static void _found_metadata_at(FoundFn &ff) {
+      ff(_metadata_at<index>);
+    }
+
+    // One entry per register, so a lookup by ID is a single indirect call
+    template <typename Context_t, typename FoundFn, size_t... indices>
+    static constexpr auto _make_dispatch(std::index_sequence<indices...>) {
+      return std::array<void (*)(Context_t&, FoundFn&), sizeof...(indices)>{
+        &_found_at<indices, Context_t, FoundFn>...
+      };
+    }
+
+    template <typename FoundFn, size_t... indices>
+    static constexpr auto _make_metadata_dispatch(std::index_sequence<indices...>) {
+      return std::array<void (*)(FoundFn&), sizeof...(indices)>{
+        &_found_metadata_at<indices, FoundFn>...
+      };
+    }
+
+  public:
     template <typename Reg_t>
     const Reg_t &get() const {
       const _get_impl<const This, Reg_t> getter(*this);
@@ -274,9 +329,11 @@ namespace xd::reg {
     };
 
     static bool is_valid_id(size_t target_id) {
-      return (id == target_id)
-        ? true
-        : Next::is_valid_id(target_id-1);
+      return Table::find(target_id) != nullptr;
+    }
+
+    static std::optional<size_t> find_id_by_name(std::string_view name) {
+      return Table::find_id(name);
     }
 
     template <typename MatchFn, typename FoundFn, typename NotFoundFn>
@@ -296,25 +353,46 @@ namespace xd::reg {
     }
 
     template <typename FoundFn, typename NotFoundFn>
-    void find_by_id(size_t id, FoundFn ff, NotFoundFn nff) const {
-      find([&](const auto &md) {
-        return md.id == id;
-      }, ff, nff);
+    void find_by_id(size_t target_id, FoundFn ff, NotFoundFn nff) const {
+      static constexpr auto dispatch = _make_dispatch<const This, FoundFn>(Indices{});
+      if (target_id - id < dispatch.size())
+        dispatch[target_id - id](*this, ff);
+      else
+        nff();
     }
 
     template <typename FoundFn, typename NotFoundFn>
-    void find_by_id(size_t id, FoundFn ff, NotFoundFn nff) {
-      find([&](const auto &md) {
-        return md.id == id;
-      }, ff, nff);
+    void find_by_id(size_t target_id, FoundFn ff, NotFoundFn nff) {
+      static constexpr auto dispatch = _make_dispatch<This, FoundFn>(Indices{});
+      if (target_id - id < dispatch.size())
+        dispatch[target_id - id](*this, ff);
+      else
+        nff();
     }
 
     template <typename FoundFn, typename NotFoundFn>
-    static void find_metadata_by_id(size_t id, FoundFn ff, NotFoundFn nff) {
-      if (id == 0)
-        ff(metadata_of<Register_t>);
+    void find_by_name(std::string_view name, FoundFn ff, NotFoundFn nff) const {
+      if (const auto target_id = Table::find_id(name))
+        find_by_id(*target_id, ff, nff);
       else
-        Next::find_metadata_by_id(id-1, ff, nff);
+        nff();
+    }
+
+    template <typename FoundFn, typename NotFoundFn>
+    void find_by_name(std::string_view name, FoundFn ff, NotFoundFn nff) {
+      if (const auto target_id = Table::find_id(name))
+        find_by_id(*target_id, ff, nff);
+      else
+        nff();
+    }
+
+    template <typename FoundFn, typename NotFoundFn>
+    static void find_metadata_by_id(size_t target_id, FoundFn ff, NotFoundFn nff) {
+      static constexpr auto dispatch = _make_metadata_dispatch<FoundFn>(Indices{});
+      if (target_id - id < dispatch.size())
+        dispatch[target_id - id](ff);
+      else
+        nff();
     }
 
     void clear() {
@@ -323,6 +401,24 @@ namespace xd::reg {
       });
     }
 
+    // Packs the values in register order at their metadata offsets, which
+    // is the layout of a GDB 'g' packet. Offsets are compile-time
+    // constants, so each register is a single fixed-size copy.
+    void serialize(unsigned char *buffer) const {
+      for_each([buffer](const auto &md, const auto &reg) {
+        const typename std::decay_t<decltype(reg)>::Value value = reg;
+        std::memcpy(buffer + md.offset - base, &value, sizeof(value));
+      });
+    }
+
+    void deserialize(const unsigned char *buffer) {
+      for_each([buffer](const auto &md, auto &reg) {
+        typename std::decay_t<decltype(reg)>::Value value;
+        std::memcpy(&value, buffer + md.offset - base, sizeof(value));
+        reg = value;
+      });
+    }
+
   private:
     Register_t _register;
   };
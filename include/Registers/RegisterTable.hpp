@@ -0,0 +1,145 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_REGISTER_TABLE_HPP
+#define XENDBG_REGISTER_TABLE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace xd::reg {
+
+  struct RegisterInfo {
+    size_t id;
+    size_t width;
+    size_t offset;
+    size_t gcc_id;
+    const char *name;
+  };
+
+  namespace {
+    constexpr size_t _register_name_length(const char *name) {
+      size_t length = 0;
+      while (name[length])
+        ++length;
+      return length;
+    }
+
+    // FNV-1a, perturbed by a seed until no two names collide
+    constexpr uint32_t _hash_register_name(const char *name, size_t length, uint32_t seed) {
+      uint32_t hash = 2166136261u ^ seed;
+      for (size_t i = 0; i < length; ++i) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+      }
+      return hash;
+    }
+
+    constexpr size_t _register_name_slots(size_t count) {
+      size_t slots = 1;
+      while (slots < 4*count)
+        slots <<= 1;
+      return slots;
+    }
+
+    template <size_t first_id, size_t first_offset, typename... Registers_t>
+    constexpr std::array<RegisterInfo, sizeof...(Registers_t)> _make_register_infos() {
+      constexpr size_t widths[] = { sizeof(typename Registers_t::Value)... };
+      constexpr size_t gcc_ids[] = { Registers_t::gcc_id... };
+      constexpr const char *names[] = { Registers_t::name... };
+
+      std::array<RegisterInfo, sizeof...(Registers_t)> infos{};
+      size_t offset = first_offset;
+      for (size_t i = 0; i < infos.size(); ++i) {
+        infos[i] = RegisterInfo{first_id + i, widths[i], offset, gcc_ids[i], names[i]};
+        offset += widths[i];
+      }
+      return infos;
+    }
+
+    template <size_t num_slots, size_t count>
+    constexpr uint32_t _find_register_name_seed(const std::array<RegisterInfo, count> &infos) {
+      for (uint32_t seed = 0;; ++seed) {
+        std::array<bool, num_slots> used{};
+        bool collides = false;
+        for (size_t i = 0; i < count && !collides; ++i) {
+          const auto name = infos[i].name;
+          const auto slot = _hash_register_name(name, _register_name_length(name), seed)
+            & (num_slots - 1);
+          collides = used[slot];
+          used[slot] = true;
+        }
+        if (!collides)
+          return seed;
+      }
+    }
+
+    template <size_t num_slots, size_t count>
+    constexpr std::array<size_t, num_slots> _make_register_name_slots(
+        const std::array<RegisterInfo, count> &infos, uint32_t seed)
+    {
+      std::array<size_t, num_slots> slots{};
+      for (auto &slot : slots)
+        slot = count;
+      for (size_t i = 0; i < count; ++i) {
+        const auto name = infos[i].name;
+        slots[_hash_register_name(name, _register_name_length(name), seed)
+          & (num_slots - 1)] = i;
+      }
+      return slots;
+    }
+  }
+
+  // Flat tables over a run of registers, built at compile time: metadata
+  // indexed by ID, and a perfect hash from names to IDs, so neither kind
+  // of lookup walks the register list.
+  template <size_t first_id, size_t first_offset, typename... Registers_t>
+  struct RegisterTable {
+    static constexpr size_t count = sizeof...(Registers_t);
+    static constexpr auto infos =
+      _make_register_infos<first_id, first_offset, Registers_t...>();
+
+    static constexpr size_t num_name_slots = _register_name_slots(count);
+    static constexpr auto name_seed =
+      _find_register_name_seed<num_name_slots>(infos);
+    static constexpr auto name_slots =
+      _make_register_name_slots<num_name_slots>(infos, name_seed);
+
+    static const RegisterInfo *find(size_t id) {
+      return (id - first_id < count) ? &infos[id - first_id] : nullptr;
+    }
+
+    static std::optional<size_t> find_id(std::string_view name) {
+      const auto slot = _hash_register_name(name.data(), name.size(), name_seed)
+        & (num_name_slots - 1);
+      const auto index = name_slots[slot];
+      if (index < count && name == infos[index].name)
+        return infos[index].id;
+      return std::nullopt;
+    }
+  };
+
+}
+
+#endif //XENDBG_REGISTER_TABLE_HPP
@@ -0,0 +1,103 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_REGISTERSX86EXTENDED_HPP
+#define XENDBG_REGISTERSX86EXTENDED_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#define X86_FXSAVE_SIZE 0x200
+#define X86_YMM_HI_SIZE 0x10
+// Offset of the AVX component in the XSAVE area, in both the standard and
+// the compacted format, since it is the first extended component
+#define X86_XSAVE_AVX_OFFSET 0x240
+
+namespace xd::reg::x86 {
+
+  // x87 and SSE state in the FXSAVE layout, followed by the upper halves
+  // of the YMM registers as laid out in the XSAVE area's AVX component.
+  // This is far larger than the integer context, so it is only fetched
+  // when a client asks for one of these registers.
+  struct ExtendedRegisters {
+    static constexpr size_t MAX_YMM = 16;
+    static constexpr size_t YMM_HI_OFFSET = X86_FXSAVE_SIZE;
+    static constexpr size_t SIZE = X86_FXSAVE_SIZE + MAX_YMM*X86_YMM_HI_SIZE;
+
+    std::array<uint8_t, SIZE> bytes;
+    bool has_ymm;
+  };
+
+  struct ExtendedRegisterInfo {
+    const char *name;
+    size_t width;
+    size_t offset;  // into ExtendedRegisters::bytes
+    bool is_vector;
+    bool is_ymm;
+    const char *set;
+  };
+
+  namespace {
+    constexpr const char *EXTENDED_REGISTER_NAMES[] = {
+      "fctrl", "fstat", "ftag", "fop", "fioff", "fiseg", "fooff", "foseg",
+      "mxcsr", "mxcsrmask",
+      "st0", "st1", "st2", "st3", "st4", "st5", "st6", "st7",
+      "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+      "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15",
+      "ymm0h", "ymm1h", "ymm2h", "ymm3h", "ymm4h", "ymm5h", "ymm6h", "ymm7h",
+      "ymm8h", "ymm9h", "ymm10h", "ymm11h", "ymm12h", "ymm13h", "ymm14h", "ymm15h",
+    };
+
+    // 32-bit guests have only eight XMM/YMM registers
+    template <size_t num_vector_registers>
+    constexpr auto _make_extended_register_infos() {
+      constexpr auto FPU_SET = "Floating Point Registers";
+      constexpr auto AVX_SET = "Advanced Vector Extensions";
+
+      std::array<ExtendedRegisterInfo, 18 + 2*num_vector_registers> infos{};
+      size_t i = 0;
+
+      constexpr size_t control_widths[] = { 2, 2, 1, 2, 4, 2, 4, 2, 4, 4 };
+      constexpr size_t control_offsets[] = { 0, 2, 4, 6, 8, 12, 16, 20, 24, 28 };
+      for (size_t j = 0; j < 10; ++j, ++i)
+        infos[i] = { EXTENDED_REGISTER_NAMES[i], control_widths[j],
+          control_offsets[j], false, false, FPU_SET };
+
+      for (size_t j = 0; j < 8; ++j, ++i)
+        infos[i] = { EXTENDED_REGISTER_NAMES[10 + j], 10, 32 + 16*j, true, false, FPU_SET };
+      for (size_t j = 0; j < num_vector_registers; ++j, ++i)
+        infos[i] = { EXTENDED_REGISTER_NAMES[18 + j], 16, 160 + 16*j, true, false, FPU_SET };
+      for (size_t j = 0; j < num_vector_registers; ++j, ++i)
+        infos[i] = { EXTENDED_REGISTER_NAMES[34 + j], X86_YMM_HI_SIZE,
+          ExtendedRegisters::YMM_HI_OFFSET + X86_YMM_HI_SIZE*j, true, true, AVX_SET };
+
+      return infos;
+    }
+  }
+
+  // Numbered after the integer registers, in this order
+  constexpr auto EXTENDED_REGISTERS_64 = _make_extended_register_infos<16>();
+  constexpr auto EXTENDED_REGISTERS_32 = _make_extended_register_infos<8>();
+
+}
+
+#endif //XENDBG_REGISTERSX86EXTENDED_HPP
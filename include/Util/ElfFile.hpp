@@ -0,0 +1,78 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_UTIL_ELFFILE_HPP
+#define XENDBG_UTIL_ELFFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace xd::util {
+
+  class ElfFileException : public std::runtime_error {
+  public:
+    explicit ElfFileException(const std::string &msg)
+      : std::runtime_error(msg) {};
+  };
+
+  // A read-only mapping of an ELF file. Only the headers are read up front;
+  // section contents are paged in by the kernel as they are touched, so
+  // reading one section of a large file costs only that section.
+  class ElfFile {
+  public:
+    struct Section {
+      std::string name;
+      uint32_t type;
+      uint64_t address;
+      const char *data; // nullptr for SHT_NOBITS
+      size_t size;
+      uint32_t link;
+      size_t entry_size;
+    };
+
+    explicit ElfFile(const std::string &path);
+
+    bool is_64_bit() const { return _is_64_bit; };
+    const std::vector<Section> &get_sections() const { return _sections; };
+    std::optional<Section> get_section(const std::string &name) const;
+
+    // Hex-encoded NT_GNU_BUILD_ID, if the file has one
+    std::optional<std::string> get_build_id() const;
+
+  private:
+    std::unique_ptr<char, std::function<void(char*)>> _data;
+    size_t _size;
+    bool _is_64_bit;
+    std::vector<Section> _sections;
+
+    template <typename Ehdr_t, typename Shdr_t>
+    void read_sections();
+  };
+
+}
+
+#endif //XENDBG_UTIL_ELFFILE_HPP
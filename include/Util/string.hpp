@@ -22,6 +22,9 @@
 #ifndef XENDBG_UTIL_STRING_HPP
 #define XENDBG_UTIL_STRING_HPP
 
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
 #include <string>
 
 namespace xd::util::string {
@@ -85,6 +88,46 @@ namespace xd::util::string {
     return is_prefix(target.begin(), target.end(), begin, end);
   }
 
+  // For embedding in a JSON string literal
+  inline std::string escape_json(const std::string &s) {
+    static const char hex[] = "0123456789abcdef";
+
+    std::string escaped;
+    escaped.reserve(s.size());
+    for (const unsigned char c : s) {
+      if (c == '"' || c == '\\') {
+        escaped += '\\';
+        escaped += c;
+      } else if (c == '\n') {
+        escaped += "\\n";
+      } else if (c == '\t') {
+        escaped += "\\t";
+      } else if (c < 0x20) {
+        escaped += "\\u00";
+        escaped += hex[c >> 4];
+        escaped += hex[c & 0xf];
+      } else {
+        escaped += c;
+      }
+    }
+    return escaped;
+  }
+
+  // e.g. "850ns", "12.3us", "1.5ms"
+  inline std::string format_duration_ns(uint64_t ns) {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    if (ns < 1000)
+      ss << ns << "ns";
+    else if (ns < 1000000)
+      ss << (double)ns / 1e3 << "us";
+    else if (ns < 1000000000)
+      ss << (double)ns / 1e6 << "ms";
+    else
+      ss << (double)ns / 1e9 << "s";
+    return ss.str();
+  }
+
   template <typename It_t>
   It_t expect(const std::string& target, It_t begin, It_t end) {
     const auto first_non_ws = skip_whitespace(begin, end);
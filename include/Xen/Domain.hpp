@@ -26,6 +26,7 @@
 #include <vector>
 
 #include <Registers/RegistersX86Any.hpp>
+#include <Registers/RegistersX86Extended.hpp>
 
 #include "Common.hpp"
 #include "PagePermissions.hpp"
@@ -37,6 +38,13 @@ namespace xd::xen {
 
   class Xen;
 
+  // levels == 0 means paging is disabled, i.e. virtual == physical
+  struct PagingMode {
+    size_t levels;
+    Address root;
+    uint64_t cr3;
+  };
+
   class Domain {
   public:
     Domain(DomID domid, std::shared_ptr<Xen> xen);
@@ -59,15 +67,29 @@ namespace xd::xen {
     virtual void set_singlestep(bool enabled, VCPU_ID vcpu_id) const = 0;
 
     Address translate_foreign_address(Address vaddr, VCPU_ID vcpu_id) const;
+    // Walks the given page tables itself, so a caller that already knows
+    // the paging mode needn't have Xen refetch the vCPU's context. Both
+    // return the frame, or 0 if the address isn't mapped.
+    Address translate_foreign_address(Address vaddr, const PagingMode &paging_mode) const;
     MemInfo map_meminfo() const;
+    PagingMode get_paging_mode(VCPU_ID vcpu_id) const;
+    // From a context already fetched, without asking Xen for anything else
+    virtual PagingMode get_paging_mode(const xd::reg::RegistersX86Any &regs) const = 0;
+    static PagingMode get_hvm_paging_mode(uint64_t cr0, uint64_t cr3,
+        uint64_t cr4, uint64_t msr_efer);
     std::optional<PageTableEntry> get_page_table_entry(Address address, VCPU_ID vcpu_id) const;
 
-    void set_mem_access(xenmem_access_t access, Address start_address, Address size) const;
+    void set_mem_access(xenmem_access_t access, xen_pfn_t first_pfn, uint32_t nr) const;
     xenmem_access_t get_mem_access(Address pfn) const;
 
     virtual xd::reg::RegistersX86Any get_cpu_context(VCPU_ID vcpu_id) const = 0;
     virtual void set_cpu_context(xd::reg::RegistersX86Any regs, VCPU_ID vcpu_id) const = 0;
 
+    // x87/SSE/AVX state, kept apart so that integer context fetches don't
+    // pay for it. Only the FXSAVE part is written back.
+    virtual xd::reg::x86::ExtendedRegisters get_extended_context(VCPU_ID vcpu_id) const = 0;
+    virtual void set_extended_context(const xd::reg::x86::ExtendedRegisters &regs, VCPU_ID vcpu_id) const = 0;
+
     void pause_vcpu(VCPU_ID vcpu_id);
     void unpause_vcpu(VCPU_ID vcpu_id);
     void pause_vcpus_except(VCPU_ID vcpu_id);
@@ -82,6 +104,9 @@ namespace xd::xen {
 
     xen_pfn_t get_max_gpfn() const;
 
+    void set_log_dirty(bool enabled) const;
+    std::vector<xen_pfn_t> get_and_clear_dirty_pages() const;
+
     XenCall::DomctlUnion hypercall_domctl(uint32_t command, XenCall::InitFn init = {}, XenCall::CleanupFn cleanup = {}) const;
 
     template <typename Memory_t>
@@ -90,11 +115,24 @@ namespace xd::xen {
           *this, translate_foreign_address(address, 0), address % XC_PAGE_SIZE, size, prot);
     };
 
+    template <typename Memory_t>
+    XenForeignMemory::MappedMemory<Memory_t> map_memory(Address address, size_t size, int prot,
+        const PagingMode &paging_mode) const
+    {
+      return get_xenforeignmemory().map_by_mfn<Memory_t>(
+          *this, translate_foreign_address(address, paging_mode), address % XC_PAGE_SIZE, size, prot);
+    };
+
     template <typename Memory_t>
     XenForeignMemory::MappedMemory<Memory_t> map_memory_by_mfn(Address mfn, Address offset, size_t size, int prot) const {
       return get_xenforeignmemory().map_by_mfn<Memory_t>(*this, mfn, offset, size, prot);
     };
 
+    template <typename Memory_t>
+    XenForeignMemory::MappedMemory<Memory_t> map_memory_by_mfns(const std::vector<xen_pfn_t> &mfns, int prot, std::vector<int> &errors) const {
+      return get_xenforeignmemory().map_by_mfns<Memory_t>(*this, mfns, prot, errors);
+    };
+
     void set_access_required(bool required);
 
     /*
@@ -33,6 +33,11 @@ namespace xd::xen {
 
     reg::RegistersX86Any get_cpu_context(VCPU_ID vcpu_id) const override;
     void set_cpu_context(reg::RegistersX86Any regs, VCPU_ID vcpu_id) const override;
+    PagingMode get_paging_mode(const reg::RegistersX86Any &regs) const override;
+    using Domain::get_paging_mode;
+
+    reg::x86::ExtendedRegisters get_extended_context(VCPU_ID vcpu_id) const override;
+    void set_extended_context(const reg::x86::ExtendedRegisters &regs, VCPU_ID vcpu_id) const override;
 
     void set_singlestep(bool enabled, VCPU_ID vcpu_id) const override;
 
@@ -46,6 +51,7 @@ namespace xd::xen {
 
     MonitorCapabilities monitor_get_capabilities();
     void monitor_mov_to_msr(uint32_t msr, bool enable);
+    void monitor_write_ctrlreg(uint16_t index, bool enable, bool sync, bool on_change_only);
     void monitor_singlestep(bool enable);
     void monitor_software_breakpoint(bool enable);
     void monitor_debug_exceptions(bool enable, bool sync);
@@ -32,6 +32,11 @@ namespace xd::xen {
 
     reg::RegistersX86Any get_cpu_context(VCPU_ID vcpu_id) const override;
     void set_cpu_context(reg::RegistersX86Any regs, VCPU_ID vcpu_id) const override;
+    PagingMode get_paging_mode(const reg::RegistersX86Any &regs) const override;
+    using Domain::get_paging_mode;
+
+    reg::x86::ExtendedRegisters get_extended_context(VCPU_ID vcpu_id) const override;
+    void set_extended_context(const reg::x86::ExtendedRegisters &regs, VCPU_ID vcpu_id) const override;
 
     void set_singlestep(bool enabled, VCPU_ID vcpu_id) const override;
 
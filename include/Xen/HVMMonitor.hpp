@@ -52,6 +52,11 @@ namespace xd::xen {
       _on_event = std::move(callback);
     };
 
+    // Synchronous guest requests hold the issuing VCPU until the response;
+    // asynchronous ones let it run on immediately.
+    void set_guest_request_sync(bool sync);
+    bool get_guest_request_sync() const { return _guest_request_sync; };
+
   private:
     static void unmap_ring_page(void *ring_page);
 
@@ -66,6 +71,7 @@ namespace xd::xen {
     std::shared_ptr<uvw::PollHandle> _poll;
 
     OnEventFn _on_event;
+    bool _guest_request_sync;
 
   private:
     vm_event_request_t get_request();
@@ -0,0 +1,71 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_MEMORYMAP_HPP
+#define XENDBG_MEMORYMAP_HPP
+
+#include <map>
+#include <optional>
+
+#include "Common.hpp"
+#include "PagePermissions.hpp"
+
+namespace xd::xen {
+
+  class Domain;
+  struct PagingMode;
+
+  struct MemoryRegion {
+    Address start;
+    size_t size;
+    PagePermissions permissions;
+    bool user;
+
+    Address end() const { return start + size; };
+  };
+
+  // Regions in a single address space never overlap, so an ordered map
+  // keyed by start address answers stabbing queries in O(log n).
+  class MemoryMap {
+  public:
+    MemoryMap()
+      : _cr3(0) {};
+
+    static MemoryMap read(const Domain &domain, const PagingMode &paging_mode);
+
+    // Regions must be added in ascending order; a region that continues
+    // the previous one with the same permissions is merged into it.
+    void add(Address start, size_t size, PagePermissions permissions, bool user);
+
+    std::optional<MemoryRegion> find(Address address) const;
+    std::optional<MemoryRegion> find_next(Address address) const;
+
+    const std::map<Address, MemoryRegion> &get_regions() const { return _regions; };
+    uint64_t get_cr3() const { return _cr3; };
+
+  private:
+    std::map<Address, MemoryRegion> _regions;
+    uint64_t _cr3;
+  };
+
+}
+
+#endif //XENDBG_MEMORYMAP_HPP
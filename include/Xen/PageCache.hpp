@@ -0,0 +1,67 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_PAGECACHE_HPP
+#define XENDBG_PAGECACHE_HPP
+
+#include <unordered_map>
+
+#include "Common.hpp"
+#include "Domain.hpp"
+#include "XenForeignMemory.hpp"
+
+namespace xd::xen {
+
+  // Reads guest-virtual memory through one vCPU's address space, mapping
+  // each page at most once for as long as the cache lives. Meant to be
+  // short-lived, e.g. for the duration of a single stack walk, so that
+  // mappings never outlive a consistent view of the guest. Pages are
+  // translated through the given paging mode, without refetching any
+  // vCPU's context.
+  class PageCache {
+  public:
+    PageCache(const Domain &domain, PagingMode paging_mode)
+      : _domain(domain), _paging_mode(paging_mode) {};
+
+    bool read(Address address, void *data, size_t size);
+
+    template <typename Value_t>
+    bool read(Address address, Value_t &value) {
+      return read(address, &value, sizeof(Value_t));
+    }
+
+    // Reads a little-endian word of word_size bytes, zero-extended
+    bool read_word(Address address, size_t word_size, uint64_t &word);
+
+    void clear() { _pages.clear(); };
+    size_t get_num_pages() const { return _pages.size(); };
+
+  private:
+    const Domain &_domain;
+    PagingMode _paging_mode;
+    std::unordered_map<Address, XenForeignMemory::MappedMemory<unsigned char>> _pages;
+
+    const unsigned char *get_page(Address page);
+  };
+
+}
+
+#endif //XENDBG_PAGECACHE_HPP
@@ -0,0 +1,97 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_PAGETABLEWALKER_HPP
+#define XENDBG_PAGETABLEWALKER_HPP
+
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "Common.hpp"
+#include "PagePermissions.hpp"
+#include "PageTableEntry.hpp"
+
+namespace xd::xen {
+
+  class Domain;
+  struct PagingMode;
+
+  struct PageTableLeaf {
+    Address virtual_address;
+    size_t size;
+    xen_pfn_t frame;
+    PagePermissions permissions;
+    bool user;
+  };
+
+  struct PageTableWalkStep {
+    size_t level;
+    Address table;
+    size_t index;
+    PageTableEntry entry;
+  };
+
+  // Every entry visited while translating one address, from the top level
+  // down; the last step is either the leaf or the first non-present entry
+  struct PageTableWalk {
+    size_t levels;
+    uint64_t cr3;
+    std::vector<PageTableWalkStep> steps;
+    std::optional<Address> physical_address;
+  };
+
+  // Enumerates every present leaf mapping of a vCPU's address space, in
+  // ascending virtual address order. Each table is mapped exactly once,
+  // and the children of a table are mapped together in a single call.
+  class PageTableWalker {
+  public:
+    using OnLeafFn = std::function<void(const PageTableLeaf&)>;
+
+    explicit PageTableWalker(const Domain &domain)
+      : _domain(domain) {};
+
+    // Either may be given the paging mode of any address space, not only
+    // one that a vCPU is currently running in
+    void walk(const PagingMode &paging_mode, const OnLeafFn &on_leaf);
+    PageTableWalk translate(Address address, const PagingMode &paging_mode);
+
+  private:
+    const Domain &_domain;
+    size_t _levels;
+
+    struct Inherited {
+      Address base;
+      bool write, execute, user;
+    };
+
+    void walk_table(const unsigned char *table, size_t num_entries, size_t level,
+        Inherited inherited, const OnLeafFn &on_leaf);
+
+    size_t get_entry_size() const { return _levels == 2 ? sizeof(uint32_t) : sizeof(uint64_t); };
+    size_t get_shift(size_t level) const;
+    bool can_be_large(size_t level) const;
+    Address make_canonical(Address address) const;
+  };
+
+}
+
+#endif //XENDBG_PAGETABLEWALKER_HPP
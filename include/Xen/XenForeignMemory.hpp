@@ -33,6 +33,7 @@
 
 #include "Common.hpp"
 #include "XenException.hpp"
+#include "XenStats.hpp"
 
 struct xenforeignmemory_handle;
 
@@ -54,10 +55,29 @@ namespace xd::xen {
       auto fmem = _xen_foreign_memory;
       auto mem = map_by_mfn_raw(domain, base_mfn, offset, size, prot);
       auto num_pages = size / XC_PAGE_SIZE;
+      auto domid = domain.get_domid();
 
-      return std::shared_ptr<Memory_t>((Memory_t*)mem, [fmem, mem, num_pages](void *memory) {
+      return std::shared_ptr<Memory_t>((Memory_t*)mem, [fmem, mem, num_pages, domid](void *memory) {
         if (memory)
-          xenforeignmemory_unmap(fmem.get(), mem, num_pages);
+          XEN_STATS_MEASURE(ForeignUnmap, domid,
+              xenforeignmemory_unmap(fmem.get(), mem, num_pages));
+      });
+    }
+
+    // Maps an arbitrary (non-contiguous) set of frames in a single call.
+    // Frames that fail to map are reported via errors rather than throwing,
+    // so that callers can skip holes in the guest's physical address space.
+    template <typename Memory_t, typename Domain_t>
+    MappedMemory<Memory_t> map_by_mfns(const Domain_t &domain, const std::vector<xen_pfn_t> &mfns, int prot, std::vector<int> &errors) const {
+      auto fmem = _xen_foreign_memory;
+      auto mem = map_by_mfns_raw(domain, mfns, prot, errors);
+      auto num_pages = mfns.size();
+      auto domid = domain.get_domid();
+
+      return std::shared_ptr<Memory_t>((Memory_t*)mem, [fmem, mem, num_pages, domid](void *memory) {
+        if (memory)
+          XEN_STATS_MEASURE(ForeignUnmap, domid,
+              xenforeignmemory_unmap(fmem.get(), mem, num_pages));
       });
     }
 
@@ -65,6 +85,7 @@ namespace xd::xen {
     std::shared_ptr<xenforeignmemory_handle> _xen_foreign_memory;
 
     void *map_by_mfn_raw(const Domain &domain, Address base_mfn, Address offset, size_t size, int prot) const;
+    void *map_by_mfns_raw(const Domain &domain, const std::vector<xen_pfn_t> &mfns, int prot, std::vector<int> &errors) const;
   };
 
 }
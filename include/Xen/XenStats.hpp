@@ -0,0 +1,187 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_XENSTATS_HPP
+#define XENDBG_XENSTATS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "Common.hpp"
+
+#define XEN_STATS_NUM_BUCKETS 40
+#define XEN_STATS_NO_DOMAIN ((xd::xen::DomID)-1)
+
+// Evaluates a call into Xen through XenStats::measure
+#define XEN_STATS_MEASURE(op, domid, ...) \
+  xd::xen::XenStats::measure(xd::xen::XenOp::op, (domid), [&]() { return __VA_ARGS__; })
+
+namespace xd::xen {
+
+  // Every kind of call xendbg makes into Xen's libraries. Calls that only
+  // touch local state (e.g. fetching a handle's fd) aren't measured.
+  enum class XenOp : uint8_t {
+    Domctl,
+    GetDomainInfo,
+    GetVersion,
+    GetGuestWidth,
+    SetDebugging,
+    DebugControl,
+    Pause,
+    Unpause,
+    Shutdown,
+    Destroy,
+    MaximumGPFN,
+    TranslateAddress,
+    MapMemInfo,
+    SetMemAccess,
+    GetMemAccess,
+    SetAccessRequired,
+    ShadowControl,
+    HVMGetContext,
+    HVMGetContextPartial,
+    HVMSetContext,
+    VCPUGetContext,
+    VCPUSetContext,
+    MonitorEnable,
+    MonitorDisable,
+    MonitorControl,
+    ForeignMap,
+    ForeignUnmap,
+    InjectEvent,
+    EvtchnPending,
+    EvtchnUnmask,
+    EvtchnBind,
+    EvtchnUnbind,
+    EvtchnNotify,
+    XenStoreRead,
+    XenStoreWatch,
+    COUNT
+  };
+
+  const char *get_xen_op_name(XenOp op);
+
+  // Counts and times calls into Xen, per thread, operation and domain.
+  // Latencies go into histograms with power-of-two buckets of TSC ticks,
+  // so recording a call is two timestamp reads and a handful of relaxed
+  // atomic stores to memory that only the calling thread writes. Readers
+  // sum over all threads, and may see a call half-recorded.
+  class XenStats {
+  public:
+    struct Summary {
+      XenOp op;
+      DomID domid;
+      uint64_t count;
+      uint64_t errors;
+      uint64_t total_ns;
+      uint64_t max_ns;
+      std::array<uint64_t, XEN_STATS_NUM_BUCKETS> buckets; // by upper bound
+
+      // Upper bound of the bucket holding the given fraction of calls
+      uint64_t get_percentile_ns(double fraction) const;
+      static uint64_t get_bucket_upper_bound_ns(size_t bucket);
+    };
+
+    // Called after every measured call, with the TSC at either end of it
+    using CallObserver = void (*)(XenOp op, DomID domid, uint64_t begin,
+        uint64_t end, bool error);
+
+    static bool is_enabled() { return _enabled.load(std::memory_order_relaxed); };
+    static void set_enabled(bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); };
+
+    // Runs f, a call into Xen, and records how long it took. A negative or
+    // null result counts as an error. An observer is still called when
+    // recording is disabled.
+    template <typename F>
+    static auto measure(XenOp op, DomID domid, F &&f) -> decltype(f()) {
+      if (!is_enabled() && !_observer.load(std::memory_order_relaxed))
+        return f();
+
+      const auto begin = read_clock();
+      if constexpr (std::is_void_v<decltype(f())>) {
+        f();
+        record(op, domid, begin, read_clock(), false);
+      } else {
+        auto ret = f();
+        record(op, domid, begin, read_clock(), is_error(ret));
+        return ret;
+      }
+    }
+
+    // Sums every thread's counters, optionally for a single domain. Only
+    // operations that were called at least once are returned.
+    static std::vector<Summary> collect(std::optional<DomID> domid = std::nullopt);
+    static void reset(std::optional<DomID> domid = std::nullopt);
+
+    static void print(std::ostream &out, const std::vector<Summary> &summaries);
+
+    // Writes a report of all domains to stderr whenever the process gets
+    // signum. Must be called before any other thread is started, as the
+    // signal is blocked in every thread but the one that waits for it.
+    static void dump_on_signal(int signum);
+
+    static void set_call_observer(CallObserver observer) {
+      _observer.store(observer, std::memory_order_relaxed);
+    };
+
+    // The clock calls are timed with, for callers that want to line their
+    // own timings up with them
+    static uint64_t read_clock() {
+#if defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static uint64_t ticks_to_ns(uint64_t ticks);
+
+  private:
+    static std::atomic<bool> _enabled;
+    static std::atomic<CallObserver> _observer;
+
+    template <typename T>
+    static bool is_error(const T &ret) {
+      if constexpr (std::is_pointer_v<T>)
+        return ret == nullptr;
+      else if constexpr (std::is_signed_v<T>)
+        return ret < 0;
+      else
+        return false;
+    }
+
+    static void record(XenOp op, DomID domid, uint64_t begin, uint64_t end, bool error);
+  };
+
+}
+
+#endif //XENDBG_XENSTATS_HPP
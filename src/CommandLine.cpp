@@ -19,6 +19,12 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <fstream>
+#include <iostream>
+
+#include <GDBServer/GDBTrace.hpp>
+#include <Xen/XenStats.hpp>
+
 #include "REPL/DebuggerREPL.hpp"
 
 #include "CommandLine.hpp"
@@ -32,23 +38,45 @@ using xd::xen::DomID;
 using xd::xen::XenException;
 
 CommandLine::CommandLine()
-    : _app{APP_NAME_AND_VERSION}, _port(0)
+    : _app{APP_NAME_AND_VERSION}, _port(0), _metrics_port(0)
 {
   auto non_stop_mode = _app.add_flag(
           "-n,--non-stop-mode",
           "Enable non-stop mode (HVM only), making step, continue, "
           "breakpoints, etc. only apply to the current thread.");
 
+  auto record = _app.add_flag(
+          "-r,--record",
+          "Take a checkpoint at every stop (HVM only), enabling reverse "
+          "continue/step. The first checkpoint copies all of guest memory.");
+
   auto debug = _app.add_flag(
       "-d,--debug",
       "Enable debug logging.");
 
+  auto no_xen_stats = _app.add_flag(
+      "--no-xen-stats",
+      "Don't count and time calls into Xen. Otherwise, they are shown by "
+      "'info stats' or 'monitor stats', and dumped to stderr on SIGUSR1.");
+
   auto server_mode = _app.add_option(
       "-s,--server", _port,
       "Start as an LLDB stub server on the given port. "
       "If omitted, xendbg will run as a standalone REPL.")
     ->type_name("PORT");
 
+  auto metrics = _app.add_option(
+      "-m,--metrics", _metrics_port,
+      "Serve Prometheus metrics for every domain over HTTP on the given "
+      "port, at the same address as the stub servers.")
+    ->type_name("PORT");
+
+  auto trace = _app.add_option(
+      "-t,--trace", _trace_file,
+      "Write a Chrome/Perfetto trace of every packet handled, with the "
+      "calls into Xen made for each, to the given file.")
+    ->type_name("FILE");
+
   _ip = "127.0.0.1";
   auto server_ip = _app.add_option(
           "-i,--ip", _ip,
@@ -64,15 +92,50 @@ CommandLine::CommandLine()
       "up and shut down.")
     ->type_name("DOMAIN");
 
+  auto batch = _app.add_option(
+      "-b,--batch", _batch_file,
+      "Run the REPL commands in the given file ('-' for stdin) without "
+      "prompting, then exit. 'repeat <count>' ... 'end' repeats the "
+      "commands between them.")
+    ->type_name("FILE");
+
+  auto json = _app.add_flag(
+      "-j,--json",
+      "In batch mode, write each command's output as a line of JSON.");
+
   server_ip->needs(server_mode);
+  record->needs(server_mode);
+  trace->needs(server_mode);
+  metrics->needs(server_mode);
+  batch->excludes(server_mode);
+  json->needs(batch);
 
-  _app.callback([this, non_stop_mode, server_mode, attach, debug] {
+  _app.callback([this, non_stop_mode, record, trace, metrics, server_mode, attach, debug, batch, json, no_xen_stats] {
+    if (no_xen_stats->count())
+      xen::XenStats::set_enabled(false);
     if (debug->count()) {
       spdlog::get(LOGNAME_CONSOLE)->set_level(spdlog::level::debug);
       spdlog::get(LOGNAME_ERROR)->set_level(spdlog::level::debug);
+    } else if (batch->count()) {
+      // Keep stdout to the commands' own output
+      spdlog::get(LOGNAME_CONSOLE)->set_level(spdlog::level::warn);
     }
     if (server_mode->count()) {
-      xd::ServerModeController server(_ip, _port, non_stop_mode->count() > 0);
+      std::shared_ptr<gdb::GDBTrace> packet_trace;
+      if (trace->count()) {
+        try {
+          packet_trace = std::make_shared<gdb::GDBTrace>(_trace_file);
+        } catch (const gdb::GDBTraceException &e) {
+          std::cerr << "Failed to start trace: " << e.what() << std::endl;
+          exit(1);
+        }
+      }
+
+      xd::ServerModeController server(_ip, _port, non_stop_mode->count() > 0,
+          record->count() > 0, std::move(packet_trace));
+      if (metrics->count())
+        server.serve_metrics(_metrics_port);
+
       if (attach->count()) {
         if (!_domain.empty() &&
             std::all_of(_domain.begin(), _domain.end(),
@@ -90,6 +153,17 @@ CommandLine::CommandLine()
     } else {
       try {
         dbg::DebuggerREPL repl(non_stop_mode->count() > 0);
+        if (batch->count()) {
+          if (_batch_file == "-")
+            exit(repl.run_batch(std::cin, json->count() > 0));
+
+          std::ifstream file(_batch_file);
+          if (!file) {
+            std::cerr << "Failed to open " << _batch_file << std::endl;
+            exit(1);
+          }
+          exit(repl.run_batch(file, json->count() > 0));
+        }
         repl.run();
       } catch (const xen::XenException &e) {
         std::cerr << "Xen error: " << e.what() << std::endl;
@@ -42,8 +42,8 @@ namespace xd {
     CLI::App _app;
 
   private:
-    uint16_t _port;
-    std::string _ip, _domain;
+    uint16_t _port, _metrics_port;
+    std::string _ip, _domain, _batch_file, _trace_file;
   };
 
 }
@@ -23,9 +23,13 @@
 
 using xd::DebugSession;
 
-DebugSession::DebugSession(uvw::Loop &loop, std::shared_ptr<dbg::Debugger> debugger)
+DebugSession::DebugSession(uvw::Loop &loop, std::shared_ptr<dbg::Debugger> debugger,
+    std::shared_ptr<gdb::GDBTrace> trace)
 : _debugger(std::move(debugger)),
-  _gdb_server(std::make_shared<gdb::GDBServer>(loop))
+  _packet_stats(std::make_shared<gdb::GDBPacketStats>()),
+  _trace(std::move(trace)),
+  _gdb_server(std::make_shared<gdb::GDBServer>(loop)),
+  _port(0)
 {
 };
 
@@ -41,9 +45,13 @@ void DebugSession::stop() {
 }
 
 void DebugSession::run(const std::string& address_str, uint16_t port, OnErrorFn on_error) {
+  _port = port;
   _gdb_server->listen(address_str, port,
     [this, on_error](auto &server, auto connection) {
       _gdb_connection = connection;
+      _gdb_connection->set_packet_stats(_packet_stats);
+      if (_trace)
+        _gdb_connection->set_trace(_trace, _debugger->get_domain().get_domid());
       _request_handler.emplace(*_debugger, *_gdb_connection);
 
       _debugger->on_stop([this, connection](auto reason) {
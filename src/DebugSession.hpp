@@ -28,7 +28,9 @@
 #include <uvw.hpp>
 
 #include <Globals.hpp>
+#include <GDBServer/GDBPacketStats.hpp>
 #include <GDBServer/GDBServer.hpp>
+#include <GDBServer/GDBTrace.hpp>
 
 #include "GDBServer/GDBRequestHandler.hpp"
 #include "GDBServer/GDBServer.hpp"
@@ -39,17 +41,28 @@ namespace xd {
   public:
     using OnErrorFn = std::function<void(const uvw::ErrorEvent&)>;
 
-    DebugSession(uvw::Loop &loop, std::shared_ptr<dbg::Debugger> debugger);
+    DebugSession(uvw::Loop &loop, std::shared_ptr<dbg::Debugger> debugger,
+        std::shared_ptr<gdb::GDBTrace> trace = nullptr);
     ~DebugSession();
 
     void stop();
     void run(const std::string& address_str, uint16_t port, OnErrorFn on_error);
 
+    const dbg::Debugger &get_debugger() const { return *_debugger; };
+    uint16_t get_port() const { return _port; };
+    bool has_client() const { return _request_handler.has_value(); };
+
+    // Kept across connections, so that a client reconnecting doesn't reset them
+    const gdb::GDBPacketStats &get_packet_stats() const { return *_packet_stats; };
+
   private:
     std::shared_ptr<dbg::Debugger> _debugger;
+    std::shared_ptr<gdb::GDBPacketStats> _packet_stats;
+    std::shared_ptr<gdb::GDBTrace> _trace;
     std::shared_ptr<gdb::GDBServer> _gdb_server;
     std::shared_ptr<gdb::GDBConnection> _gdb_connection;
     std::optional<gdb::GDBRequestHandler> _request_handler;
+    uint16_t _port;
   };
 
 }
@@ -0,0 +1,57 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <chrono>
+
+#include <Debugger/AddressSpaceTracker.hpp>
+
+using xd::dbg::AddressSpace;
+using xd::dbg::AddressSpaceTracker;
+using xd::xen::PagingMode;
+
+AddressSpaceTracker::AddressSpaceTracker(const std::vector<PagingMode> &vcpu_modes)
+  : _vcpu_modes(vcpu_modes), _num_switches(0)
+{
+  for (const auto &mode : _vcpu_modes)
+    _address_spaces.emplace(mode.root, AddressSpace{mode.root, 0, 0});
+}
+
+void AddressSpaceTracker::did_switch(xen::VCPU_ID vcpu_id, const PagingMode &mode) {
+  if (vcpu_id >= _vcpu_modes.size())
+    return;
+
+  _vcpu_modes[vcpu_id] = mode;
+
+  const auto now = std::chrono::steady_clock::now().time_since_epoch();
+  auto &address_space = _address_spaces.emplace(
+      mode.root, AddressSpace{mode.root, 0, 0}).first->second;
+  ++address_space.num_switches;
+  address_space.last_switch_ns =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+
+  ++_num_switches;
+}
+
+std::optional<PagingMode> AddressSpaceTracker::get_paging_mode(xen::VCPU_ID vcpu_id) const {
+  if (vcpu_id >= _vcpu_modes.size())
+    return std::nullopt;
+  return _vcpu_modes[vcpu_id];
+}
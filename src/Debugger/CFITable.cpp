@@ -0,0 +1,528 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include <Debugger/CFITable.hpp>
+#include <Util/ElfFile.hpp>
+
+#define DW_EH_PE_omit     0xff
+#define DW_EH_PE_absptr   0x00
+#define DW_EH_PE_uleb128  0x01
+#define DW_EH_PE_udata2   0x02
+#define DW_EH_PE_udata4   0x03
+#define DW_EH_PE_udata8   0x04
+#define DW_EH_PE_sleb128  0x09
+#define DW_EH_PE_sdata2   0x0a
+#define DW_EH_PE_sdata4   0x0b
+#define DW_EH_PE_sdata8   0x0c
+#define DW_EH_PE_pcrel    0x10
+
+#define DW_CFA_advance_loc        0x40
+#define DW_CFA_offset             0x80
+#define DW_CFA_restore            0xc0
+#define DW_CFA_nop                0x00
+#define DW_CFA_set_loc            0x01
+#define DW_CFA_advance_loc1       0x02
+#define DW_CFA_advance_loc2       0x03
+#define DW_CFA_advance_loc4       0x04
+#define DW_CFA_offset_extended    0x05
+#define DW_CFA_restore_extended   0x06
+#define DW_CFA_undefined          0x07
+#define DW_CFA_same_value         0x08
+#define DW_CFA_register           0x09
+#define DW_CFA_remember_state     0x0a
+#define DW_CFA_restore_state      0x0b
+#define DW_CFA_def_cfa            0x0c
+#define DW_CFA_def_cfa_register   0x0d
+#define DW_CFA_def_cfa_offset     0x0e
+#define DW_CFA_def_cfa_expression 0x0f
+#define DW_CFA_expression         0x10
+#define DW_CFA_offset_extended_sf 0x11
+#define DW_CFA_def_cfa_sf         0x12
+#define DW_CFA_def_cfa_offset_sf  0x13
+#define DW_CFA_val_offset         0x14
+#define DW_CFA_val_offset_sf      0x15
+#define DW_CFA_val_expression     0x16
+#define DW_CFA_GNU_args_size      0x2e
+#define DW_CFA_GNU_negative_offset_extended 0x2f
+
+using xd::dbg::CFIParseException;
+using xd::dbg::CFIRow;
+using xd::dbg::CFIRule;
+using xd::dbg::CFITable;
+using xd::xen::Address;
+
+namespace {
+
+  class Cursor {
+  public:
+    Cursor(const unsigned char *begin, size_t size, Address address, size_t address_size)
+      : _begin(begin), _it(begin), _end(begin + size),
+        _address(address), _address_size(address_size) {};
+
+    size_t offset() const { return _it - _begin; };
+    bool at_end() const { return _it >= _end; };
+    void seek(size_t offset) { _it = _begin + offset; };
+
+    template <typename Value_t>
+    Value_t read() {
+      expect(sizeof(Value_t));
+      Value_t value;
+      std::memcpy(&value, _it, sizeof(Value_t));
+      _it += sizeof(Value_t);
+      return value;
+    }
+
+    uint64_t read_uleb128() {
+      uint64_t value = 0;
+      size_t shift = 0;
+      uint8_t byte;
+      do {
+        byte = read<uint8_t>();
+        if (shift < 64)
+          value |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+      } while (byte & 0x80);
+      return value;
+    }
+
+    int64_t read_sleb128() {
+      int64_t value = 0;
+      size_t shift = 0;
+      uint8_t byte;
+      do {
+        byte = read<uint8_t>();
+        if (shift < 64)
+          value |= (int64_t)(byte & 0x7f) << shift;
+        shift += 7;
+      } while (byte & 0x80);
+      if (shift < 64 && (byte & 0x40))
+        value |= -((int64_t)1 << shift);
+      return value;
+    }
+
+    std::string read_string() {
+      std::string s;
+      for (char c; (c = (char)read<uint8_t>());)
+        s.push_back(c);
+      return s;
+    }
+
+    uint64_t read_address() {
+      return (_address_size == sizeof(uint32_t)) ? read<uint32_t>() : read<uint64_t>();
+    }
+
+    uint64_t read_encoded(uint8_t encoding) {
+      if (encoding == DW_EH_PE_omit)
+        return 0;
+
+      const auto field_address = _address + offset();
+
+      uint64_t value;
+      switch (encoding & 0x0f) {
+        case DW_EH_PE_absptr:  value = read_address(); break;
+        case DW_EH_PE_uleb128: value = read_uleb128(); break;
+        case DW_EH_PE_udata2:  value = read<uint16_t>(); break;
+        case DW_EH_PE_udata4:  value = read<uint32_t>(); break;
+        case DW_EH_PE_udata8:  value = read<uint64_t>(); break;
+        case DW_EH_PE_sleb128: value = read_sleb128(); break;
+        case DW_EH_PE_sdata2:  value = (int64_t)read<int16_t>(); break;
+        case DW_EH_PE_sdata4:  value = (int64_t)read<int32_t>(); break;
+        case DW_EH_PE_sdata8:  value = read<int64_t>(); break;
+        default:
+          throw CFIParseException("Unsupported pointer format");
+      }
+
+      switch (encoding & 0x70) {
+        case 0:
+          break;
+        case DW_EH_PE_pcrel:
+          value += field_address;
+          break;
+        default:
+          throw CFIParseException("Unsupported pointer application");
+      }
+
+      if (_address_size == sizeof(uint32_t))
+        value &= 0xffffffff;
+      return value;
+    }
+
+  private:
+    const unsigned char *_begin, *_it, *_end;
+    Address _address;
+    size_t _address_size;
+
+    void expect(size_t n) {
+      if ((size_t)(_end - _it) < n)
+        throw CFIParseException("Truncated CFI entry");
+    }
+  };
+
+}
+
+CFITable CFITable::from_elf(const std::string &path) {
+  CFITable table;
+  try {
+    const util::ElfFile elf(path);
+    table._address_size = elf.is_64_bit() ? sizeof(uint64_t) : sizeof(uint32_t);
+
+    for (const auto &section : elf.get_sections()) {
+      if ((section.name == ".eh_frame" || section.name == ".debug_frame") && section.data)
+        table.parse_section(section.data, section.size, section.address,
+            section.name == ".eh_frame");
+    }
+  } catch (const util::ElfFileException &e) {
+    throw CFIParseException(e.what());
+  }
+
+  std::sort(table._fdes.begin(), table._fdes.end(),
+    [](const auto &a, const auto &b) {
+      return a.pc_begin < b.pc_begin;
+    });
+
+  return table;
+}
+
+void CFITable::parse_section(const char *data, size_t size, Address address,
+    bool is_eh_frame)
+{
+  const auto base = _data.size();
+  _data.insert(_data.end(), data, data + size);
+  const auto section = _data.data() + base;
+
+  // Maps a CIE's offset in this section to its index in _cies
+  std::unordered_map<size_t, std::optional<size_t>> cie_indices;
+
+  Cursor cursor(section, size, address, _address_size);
+  while (!cursor.at_end()) {
+    uint64_t length = cursor.read<uint32_t>();
+    if (!length) {
+      if (is_eh_frame)
+        break;
+      continue;
+    }
+
+    const bool is_64 = (length == 0xffffffff);
+    if (is_64)
+      length = cursor.read<uint64_t>();
+
+    const auto id_offset = cursor.offset();
+    const auto entry_end = id_offset + length;
+    if (entry_end > size)
+      break;
+
+    const uint64_t id = is_64 ? cursor.read<uint64_t>() : cursor.read<uint32_t>();
+    const bool is_cie = is_eh_frame
+      ? (id == 0)
+      : (id == (is_64 ? ~0ull : 0xffffffffull));
+
+    if (!is_cie) {
+      try {
+        const auto cie_offset = is_eh_frame ? id_offset - id : id;
+
+        auto it = cie_indices.find(cie_offset);
+        if (it == cie_indices.end()) {
+          const auto cie = parse_cie(section, size, address, cie_offset, base, is_eh_frame);
+          std::optional<size_t> index;
+          if (cie) {
+            index = _cies.size();
+            _cies.push_back(*cie);
+          }
+          it = cie_indices.emplace(cie_offset, index).first;
+        }
+
+        if (it->second) {
+          const auto &cie = _cies[*it->second];
+          const auto pc_begin = cursor.read_encoded(cie.pointer_encoding);
+          const auto pc_range = cursor.read_encoded(cie.pointer_encoding & 0x0f);
+          if (cie.has_augmentation_data) {
+            const auto augmentation_length = cursor.read_uleb128();
+            cursor.seek(cursor.offset() + augmentation_length);
+          }
+
+          if (pc_begin && cursor.offset() <= entry_end)
+            _fdes.push_back(FDE{pc_begin, pc_begin + pc_range, *it->second,
+                base + cursor.offset(), entry_end - cursor.offset()});
+        }
+      } catch (const CFIParseException &) {
+        // Skip entries we can't interpret; the unwinder falls back to
+        // frame pointers for the code they would have covered
+      }
+    }
+
+    cursor.seek(entry_end);
+  }
+}
+
+std::optional<CFITable::CIE> CFITable::parse_cie(const unsigned char *section,
+    size_t size, Address address, size_t offset, size_t base, bool is_eh_frame) const
+{
+  if (offset >= size)
+    return std::nullopt;
+
+  Cursor cursor(section, size, address, _address_size);
+  cursor.seek(offset);
+
+  uint64_t length = cursor.read<uint32_t>();
+  const bool is_64 = (length == 0xffffffff);
+  if (is_64)
+    length = cursor.read<uint64_t>();
+  const auto entry_end = cursor.offset() + length;
+  if (entry_end > size)
+    return std::nullopt;
+
+  cursor.seek(cursor.offset() + (is_64 ? sizeof(uint64_t) : sizeof(uint32_t)));
+
+  const auto version = cursor.read<uint8_t>();
+  const auto augmentation = cursor.read_string();
+
+  if (augmentation.find("eh") != std::string::npos)
+    cursor.read_address();
+  if (!is_eh_frame && version >= 4) {
+    cursor.read<uint8_t>(); // address_size
+    cursor.read<uint8_t>(); // segment_size
+  }
+
+  CIE cie;
+  cie.code_alignment = cursor.read_uleb128();
+  cie.data_alignment = cursor.read_sleb128();
+  cie.return_address_register = (version == 1)
+    ? cursor.read<uint8_t>()
+    : cursor.read_uleb128();
+  cie.pointer_encoding = DW_EH_PE_absptr;
+  cie.has_augmentation_data = !augmentation.empty() && augmentation[0] == 'z';
+
+  if (cie.has_augmentation_data) {
+    const auto augmentation_length = cursor.read_uleb128();
+    const auto augmentation_end = cursor.offset() + augmentation_length;
+
+    for (const auto c : augmentation.substr(1)) {
+      if (c == 'R') {
+        cie.pointer_encoding = cursor.read<uint8_t>();
+      } else if (c == 'P') {
+        const auto encoding = cursor.read<uint8_t>();
+        cursor.read_encoded(encoding & 0x7f);
+      } else if (c == 'L') {
+        cursor.read<uint8_t>();
+      } else if (c != 'S' && c != 'B') {
+        break;
+      }
+    }
+    cursor.seek(augmentation_end);
+  } else if (!augmentation.empty() && augmentation != "eh") {
+    return std::nullopt;
+  }
+
+  if (cursor.offset() > entry_end)
+    return std::nullopt;
+
+  cie.instructions_offset = base + cursor.offset();
+  cie.instructions_length = entry_end - cursor.offset();
+  return cie;
+}
+
+std::optional<CFIRow> CFITable::get_row(Address pc) const {
+  auto it = std::upper_bound(_fdes.begin(), _fdes.end(), pc,
+    [](const auto pc, const auto &fde) {
+      return pc < fde.pc_begin;
+    });
+
+  if (it == _fdes.begin())
+    return std::nullopt;
+  --it;
+  if (pc >= it->pc_end)
+    return std::nullopt;
+
+  const auto &cie = _cies[it->cie];
+
+  CFIRow initial;
+  initial.cfa_register = CFI_NUM_REGISTERS;
+  initial.cfa_offset = 0;
+  initial.cfa_is_expression = false;
+  initial.return_address_register = cie.return_address_register;
+  initial.registers.fill(CFIRule{CFIRule::Type::SameValue, 0});
+
+  if (!execute(cie, cie.instructions_offset, cie.instructions_length,
+        it->pc_begin, ~0ull, initial, nullptr))
+  {
+    return std::nullopt;
+  }
+
+  auto row = initial;
+  if (!execute(cie, it->instructions_offset, it->instructions_length,
+        it->pc_begin, pc, row, &initial))
+  {
+    return std::nullopt;
+  }
+
+  return row;
+}
+
+bool CFITable::execute(const CIE &cie, size_t offset, size_t length,
+    uint64_t pc_begin, Address pc, CFIRow &row, const CFIRow *initial) const
+{
+  Cursor cursor(_data.data() + offset, length, 0, _address_size);
+  std::vector<CFIRow> states;
+  auto loc = pc_begin;
+
+  const auto set = [&row](uint64_t reg, CFIRule::Type type, int64_t value) {
+    if (reg < CFI_NUM_REGISTERS)
+      row.registers[reg] = CFIRule{type, value};
+  };
+  const auto restore = [&](uint64_t reg) {
+    if (initial && reg < CFI_NUM_REGISTERS)
+      row.registers[reg] = initial->registers[reg];
+  };
+  const auto advance = [&](uint64_t delta) {
+    loc += delta * cie.code_alignment;
+    return loc <= pc;
+  };
+
+  try {
+    while (!cursor.at_end()) {
+      const auto op = cursor.read<uint8_t>();
+      const auto high = op & 0xc0;
+      const auto low = op & 0x3f;
+
+      if (high == DW_CFA_advance_loc) {
+        if (!advance(low))
+          return true;
+        continue;
+      } else if (high == DW_CFA_offset) {
+        set(low, CFIRule::Type::Offset, (int64_t)cursor.read_uleb128() * cie.data_alignment);
+        continue;
+      } else if (high == DW_CFA_restore) {
+        restore(low);
+        continue;
+      }
+
+      switch (op) {
+        case DW_CFA_nop:
+          break;
+        case DW_CFA_set_loc:
+          // Relative encodings would need the instruction's own address
+          if (cie.pointer_encoding != DW_EH_PE_absptr)
+            return false;
+          loc = cursor.read_address();
+          if (loc > pc)
+            return true;
+          break;
+        case DW_CFA_advance_loc1:
+          if (!advance(cursor.read<uint8_t>()))
+            return true;
+          break;
+        case DW_CFA_advance_loc2:
+          if (!advance(cursor.read<uint16_t>()))
+            return true;
+          break;
+        case DW_CFA_advance_loc4:
+          if (!advance(cursor.read<uint32_t>()))
+            return true;
+          break;
+        case DW_CFA_offset_extended: {
+          const auto reg = cursor.read_uleb128();
+          set(reg, CFIRule::Type::Offset, (int64_t)cursor.read_uleb128() * cie.data_alignment);
+        } break;
+        case DW_CFA_restore_extended:
+          restore(cursor.read_uleb128());
+          break;
+        case DW_CFA_undefined:
+          set(cursor.read_uleb128(), CFIRule::Type::Undefined, 0);
+          break;
+        case DW_CFA_same_value:
+          set(cursor.read_uleb128(), CFIRule::Type::SameValue, 0);
+          break;
+        case DW_CFA_register: {
+          const auto reg = cursor.read_uleb128();
+          set(reg, CFIRule::Type::Register, cursor.read_uleb128());
+        } break;
+        case DW_CFA_remember_state:
+          states.push_back(row);
+          break;
+        case DW_CFA_restore_state:
+          if (states.empty())
+            return false;
+          row = states.back();
+          states.pop_back();
+          break;
+        case DW_CFA_def_cfa:
+          row.cfa_register = cursor.read_uleb128();
+          row.cfa_offset = cursor.read_uleb128();
+          row.cfa_is_expression = false;
+          break;
+        case DW_CFA_def_cfa_register:
+          row.cfa_register = cursor.read_uleb128();
+          row.cfa_is_expression = false;
+          break;
+        case DW_CFA_def_cfa_offset:
+          row.cfa_offset = cursor.read_uleb128();
+          break;
+        case DW_CFA_def_cfa_expression:
+          cursor.seek(cursor.offset() + cursor.read_uleb128());
+          row.cfa_is_expression = true;
+          break;
+        case DW_CFA_expression:
+        case DW_CFA_val_expression: {
+          const auto reg = cursor.read_uleb128();
+          cursor.seek(cursor.offset() + cursor.read_uleb128());
+          set(reg, CFIRule::Type::Unsupported, 0);
+        } break;
+        case DW_CFA_offset_extended_sf: {
+          const auto reg = cursor.read_uleb128();
+          set(reg, CFIRule::Type::Offset, cursor.read_sleb128() * cie.data_alignment);
+        } break;
+        case DW_CFA_def_cfa_sf:
+          row.cfa_register = cursor.read_uleb128();
+          row.cfa_offset = cursor.read_sleb128() * cie.data_alignment;
+          row.cfa_is_expression = false;
+          break;
+        case DW_CFA_def_cfa_offset_sf:
+          row.cfa_offset = cursor.read_sleb128() * cie.data_alignment;
+          break;
+        case DW_CFA_val_offset: {
+          const auto reg = cursor.read_uleb128();
+          set(reg, CFIRule::Type::ValOffset, (int64_t)cursor.read_uleb128() * cie.data_alignment);
+        } break;
+        case DW_CFA_val_offset_sf: {
+          const auto reg = cursor.read_uleb128();
+          set(reg, CFIRule::Type::ValOffset, cursor.read_sleb128() * cie.data_alignment);
+        } break;
+        case DW_CFA_GNU_args_size:
+          cursor.read_uleb128();
+          break;
+        case DW_CFA_GNU_negative_offset_extended: {
+          const auto reg = cursor.read_uleb128();
+          set(reg, CFIRule::Type::Offset, -(int64_t)cursor.read_uleb128() * cie.data_alignment);
+        } break;
+        default:
+          return false;
+      }
+    }
+  } catch (const CFIParseException &) {
+    return false;
+  }
+
+  return true;
+}
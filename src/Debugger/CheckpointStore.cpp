@@ -0,0 +1,224 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <sys/mman.h>
+
+#include <spdlog/spdlog.h>
+
+#include <Globals.hpp>
+#include <Debugger/CheckpointStore.hpp>
+#include <Xen/XenException.hpp>
+
+#define CHECKPOINT_MAP_BATCH_PAGES 1024
+
+using xd::dbg::Checkpoint;
+using xd::dbg::CheckpointID;
+using xd::dbg::CheckpointStore;
+using xd::dbg::NoSuchCheckpointException;
+using xd::dbg::PageStore;
+using xd::xen::XenException;
+
+CheckpointStore::CheckpointStore(xen::Domain &domain)
+  : _domain(domain), _next_id(0), _is_logging_dirty(false)
+{
+}
+
+CheckpointStore::~CheckpointStore() {
+  try {
+    clear();
+  } catch (const XenException &e) {
+    spdlog::get(LOGNAME_ERROR)->warn("Failed to disable log-dirty mode: {0}", e.what());
+  }
+}
+
+const Checkpoint &CheckpointStore::create(StopReason stop_reason,
+    const GFNSet &written, const MaskPageFn &mask)
+{
+  Checkpoint checkpoint{_next_id++, stop_reason, {}, {}};
+
+  const auto max_vcpu_id = _domain.get_dominfo().max_vcpu_id;
+  for (xen::VCPU_ID vcpu_id = 0; vcpu_id <= max_vcpu_id; ++vcpu_id)
+    checkpoint.vcpu_contexts.push_back(_domain.get_cpu_context(vcpu_id));
+
+  std::vector<xen_pfn_t> gfns;
+  if (_checkpoints.empty()) {
+    // Start logging before taking the baseline so that every later write
+    // is accounted for by some delta
+    if (!_is_logging_dirty) {
+      _domain.set_log_dirty(true);
+      _is_logging_dirty = true;
+    }
+    _domain.get_and_clear_dirty_pages();
+
+    const auto max_gpfn = _domain.get_max_gpfn();
+    gfns.reserve(max_gpfn + 1);
+    for (xen_pfn_t gfn = 0; gfn <= max_gpfn; ++gfn)
+      gfns.push_back(gfn);
+  } else {
+    const auto dirty = collect_dirty(written);
+    gfns.assign(dirty.begin(), dirty.end());
+  }
+
+  capture_pages(gfns, mask, checkpoint.pages);
+
+  spdlog::get(LOGNAME_CONSOLE)->debug(
+      "Checkpoint {0:d}: {1:d} pages captured, {2:d} unique pages stored.",
+      checkpoint.id, checkpoint.pages.size(), _page_store.get_num_pages());
+
+  _checkpoints.push_back(std::move(checkpoint));
+  return _checkpoints.back();
+}
+
+std::vector<xen_pfn_t> CheckpointStore::restore(CheckpointID id, const GFNSet &written) {
+  const auto target = find(id);
+
+  // Only pages written since the target checkpoint can differ from it
+  auto dirty = collect_dirty(written);
+  for (auto it = std::next(target); it != _checkpoints.end(); ++it)
+    for (const auto &[gfn, page] : it->pages)
+      dirty.insert(gfn);
+
+  // The newest copy of each page at or before the target is its content
+  // as of the target
+  std::vector<xen_pfn_t> gfns;
+  std::vector<PageStore::Page> pages;
+  for (const auto gfn : dirty) {
+    for (auto it = std::make_reverse_iterator(std::next(target)); it != _checkpoints.rend(); ++it) {
+      const auto found = it->pages.find(gfn);
+      if (found != it->pages.end()) {
+        gfns.push_back(gfn);
+        pages.push_back(found->second);
+        break;
+      }
+    }
+  }
+
+  std::vector<xen_pfn_t> restored;
+  std::vector<int> errors;
+  for (size_t base = 0; base < gfns.size(); base += CHECKPOINT_MAP_BATCH_PAGES) {
+    const auto end = std::min(gfns.size(), base + CHECKPOINT_MAP_BATCH_PAGES);
+    const std::vector<xen_pfn_t> batch(gfns.begin() + base, gfns.begin() + end);
+    const auto mem = _domain.map_memory_by_mfns<unsigned char>(
+        batch, PROT_READ | PROT_WRITE, errors);
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+      if (errors[i])
+        continue;
+
+      const auto dest = mem.get() + i * XC_PAGE_SIZE;
+      const auto &src = *pages[base + i];
+      if (std::memcmp(dest, src.data(), XC_PAGE_SIZE)) {
+        std::memcpy(dest, src.data(), XC_PAGE_SIZE);
+        restored.push_back(batch[i]);
+      }
+    }
+  }
+
+  for (size_t vcpu_id = 0; vcpu_id < target->vcpu_contexts.size(); ++vcpu_id)
+    _domain.set_cpu_context(target->vcpu_contexts.at(vcpu_id), vcpu_id);
+
+  spdlog::get(LOGNAME_CONSOLE)->debug(
+      "Restored checkpoint {0:d}: {1:d} candidate pages, {2:d} rewritten.",
+      id, gfns.size(), restored.size());
+
+  _checkpoints.erase(std::next(target), _checkpoints.end());
+
+  // Everything written up to now is reflected in the restored state
+  _domain.get_and_clear_dirty_pages();
+
+  return restored;
+}
+
+void CheckpointStore::clear() {
+  _checkpoints.clear();
+  if (_is_logging_dirty) {
+    _is_logging_dirty = false;
+    _domain.set_log_dirty(false);
+  }
+}
+
+const Checkpoint &CheckpointStore::get_checkpoint(CheckpointID id) const {
+  const auto it = std::find_if(_checkpoints.begin(), _checkpoints.end(),
+    [id](const auto &checkpoint) {
+      return checkpoint.id == id;
+    });
+
+  if (it == _checkpoints.end())
+    throw NoSuchCheckpointException(id);
+
+  return *it;
+}
+
+std::optional<CheckpointID> CheckpointStore::get_previous(CheckpointID id) const {
+  std::optional<CheckpointID> previous;
+  for (const auto &checkpoint : _checkpoints) {
+    if (checkpoint.id == id)
+      return previous;
+    previous = checkpoint.id;
+  }
+  throw NoSuchCheckpointException(id);
+}
+
+std::vector<Checkpoint>::iterator CheckpointStore::find(CheckpointID id) {
+  const auto it = std::find_if(_checkpoints.begin(), _checkpoints.end(),
+    [id](const auto &checkpoint) {
+      return checkpoint.id == id;
+    });
+
+  if (it == _checkpoints.end())
+    throw NoSuchCheckpointException(id);
+
+  return it;
+}
+
+CheckpointStore::GFNSet CheckpointStore::collect_dirty(const GFNSet &written) const {
+  auto dirty = written;
+  for (const auto gfn : _domain.get_and_clear_dirty_pages())
+    dirty.insert(gfn);
+  return dirty;
+}
+
+void CheckpointStore::capture_pages(const std::vector<xen_pfn_t> &gfns,
+    const MaskPageFn &mask, std::unordered_map<xen_pfn_t, PageStore::Page> &pages)
+{
+  PageStore::PageData buffer;
+  std::vector<int> errors;
+
+  for (size_t base = 0; base < gfns.size(); base += CHECKPOINT_MAP_BATCH_PAGES) {
+    const auto end = std::min(gfns.size(), base + CHECKPOINT_MAP_BATCH_PAGES);
+    const std::vector<xen_pfn_t> batch(gfns.begin() + base, gfns.begin() + end);
+    const auto mem = _domain.map_memory_by_mfns<unsigned char>(batch, PROT_READ, errors);
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+      // Holes in the guest physmap fail to map; there's nothing to save
+      if (errors[i])
+        continue;
+
+      std::memcpy(buffer.data(), mem.get() + i * XC_PAGE_SIZE, XC_PAGE_SIZE);
+      if (mask)
+        mask(batch[i], buffer.data());
+      pages[batch[i]] = _page_store.intern(buffer.data());
+    }
+  }
+}
@@ -19,15 +19,34 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <algorithm>
+#include <array>
+#include <numeric>
+
+#include <capstone/capstone.h>
+
 #include <Debugger/Debugger.hpp>
 
 using xd::xen::Address;
 using xd::xen::Domain;
+using xd::xen::XenException;
+using xd::dbg::AddressSpaceTracker;
+using xd::dbg::CFITable;
+using xd::dbg::Checkpoint;
+using xd::dbg::CheckpointID;
+using xd::dbg::CheckpointStore;
 using xd::dbg::Debugger;
+using xd::dbg::EventTrace;
+using xd::dbg::EventTraceConfig;
+using xd::dbg::GuestRequestMode;
+using xd::dbg::NoReturnAddressException;
+using xd::dbg::StopReason;
 
 Debugger::Debugger(xen::Domain &domain)
-    : _domain(domain), _vcpu_id(0), _is_attached(false),
-      _last_stop_reason(StopReasonBreakpoint(SIGSTOP, 0))
+    : _guest_request_mode(GuestRequestMode::Marker), _num_breakpoint_hits(0),
+      _domain(domain), _unwinder(domain), _vcpu_id(0), _is_attached(false),
+      _last_stop_reason(StopReasonBreakpoint(SIGSTOP, 0)), _num_stops(0),
+      _auto_checkpoint(false)
 {
 }
 
@@ -39,23 +58,292 @@ Debugger::~Debugger() {
 void Debugger::attach() {
   _is_attached = true;
   _domain.pause();
+
+  // Gives reverse execution somewhere to return to before the first stop
+  try_auto_checkpoint();
 }
 
 void Debugger::detach() {
   _domain.pause();
   cleanup();
+  _checkpoints.reset();
   _domain.unpause_all_vcpus();
   _domain.unpause();
   _is_attached = false;
 }
 
+void Debugger::resume() {
+  invalidate_memory_maps();
+  _extended_registers.clear();
+  _current_checkpoint = std::nullopt;
+
+  const auto context = _domain.get_cpu_context(_vcpu_id);
+  const auto instr_ptr = reg::read_register<reg::x86_32::eip, reg::x86_64::rip>(context);
+  if (_breakpoints.count(instr_ptr)) {
+    _lifted_breakpoint = instr_ptr;
+    remove_breakpoint(instr_ptr);
+  }
+
+  // NOTE: The *domain* must be paused before individual VCPUs are paused/unpaused
+  _domain.pause();
+  _domain.unpause_all_vcpus();
+  _domain.unpause();
+}
+
+void Debugger::pause() {
+  _domain.pause();
+  _domain.pause_all_vcpus();
+  _domain.unpause();
+
+  if (_lifted_breakpoint) {
+    insert_breakpoint(*_lifted_breakpoint);
+    _lifted_breakpoint = std::nullopt;
+  }
+}
+
 void Debugger::did_stop(StopReason reason) {
+  _extended_registers.clear();
+  if (_return_breakpoint && is_stop_in_deeper_frame(reason)) {
+    continue_();
+    return;
+  }
+
+  ++_num_stops;
   _last_stop_reason = reason;
+  _current_checkpoint = std::nullopt;
+  try_auto_checkpoint();
   if (_on_stop)
     _on_stop(reason);
 }
 
+const xd::reg::x86::ExtendedRegisters &Debugger::get_extended_registers(xen::VCPU_ID vcpu_id) {
+  auto it = _extended_registers.find(vcpu_id);
+  if (it == _extended_registers.end())
+    it = _extended_registers.emplace(vcpu_id, _domain.get_extended_context(vcpu_id)).first;
+  return it->second;
+}
+
+void Debugger::set_extended_registers(const reg::x86::ExtendedRegisters &regs, xen::VCPU_ID vcpu_id) {
+  _domain.set_extended_context(regs, vcpu_id);
+  _extended_registers[vcpu_id] = regs;
+}
+
+xd::xen::PagingMode Debugger::get_paging_mode(xen::VCPU_ID vcpu_id) const {
+  if (_address_space_tracker) {
+    if (const auto mode = _address_space_tracker->get_paging_mode(vcpu_id))
+      return *mode;
+  }
+  return _domain.get_paging_mode(vcpu_id);
+}
+
+void Debugger::set_track_address_spaces(bool enabled) {
+  throw FeatureNotSupportedException("address space tracking");
+}
+
+void Debugger::reset_address_space_tracker() {
+  const auto max_vcpu_id = _domain.get_dominfo().max_vcpu_id;
+
+  std::vector<xen::PagingMode> vcpu_modes;
+  for (xen::VCPU_ID id = 0; id <= max_vcpu_id; ++id)
+    vcpu_modes.push_back(_domain.get_paging_mode(id));
+
+  _address_space_tracker = std::make_unique<AddressSpaceTracker>(vcpu_modes);
+}
+
+const xd::xen::MemoryMap &Debugger::get_memory_map(xen::VCPU_ID vcpu_id) {
+  const auto paging_mode = get_paging_mode(vcpu_id);
+
+  auto it = _memory_maps.find(paging_mode.cr3);
+  if (it == _memory_maps.end()) {
+    it = _memory_maps.emplace(paging_mode.cr3,
+        xen::MemoryMap::read(_domain, paging_mode)).first;
+  }
+
+  return it->second;
+}
+
+void Debugger::load_unwind_info(const std::string &path) {
+  _unwinder.set_cfi(CFITable::from_elf(path));
+  spdlog::get(LOGNAME_CONSOLE)->info("Loaded {0:d} CFI entries from {1}",
+      _unwinder.get_cfi().get_num_fdes(), path);
+}
+
+const std::vector<xd::dbg::KernelSymbol> &Debugger::load_kernel_symbols(Kallsyms::Stats *stats) {
+  _kernel_symbols = Kallsyms::read(_domain, get_paging_mode(_vcpu_id), stats);
+  spdlog::get(LOGNAME_CONSOLE)->info("Read {0:d} kernel symbols from guest memory",
+      _kernel_symbols.size());
+  return _kernel_symbols;
+}
+
+std::vector<xd::dbg::StackFrame> Debugger::backtrace(xen::VCPU_ID vcpu_id) const {
+  return _unwinder.backtrace(vcpu_id);
+}
+
+const Checkpoint &Debugger::create_checkpoint() {
+  // Foreign mappings are by GFN, which only matches the dirty log for HVM
+  if (!_domain.get_dominfo().hvm)
+    throw FeatureNotSupportedException("checkpoints on PV guests");
+
+  if (!_checkpoints)
+    _checkpoints = std::make_unique<CheckpointStore>(_domain);
+
+  // Snapshots hold the original bytes under our breakpoints
+  std::unordered_multimap<xen_pfn_t, std::pair<size_t, uint8_t>> bp_pages;
+  const auto paging_mode = get_paging_mode(_vcpu_id);
+  for (const auto [address, orig_byte] : _breakpoints)
+    bp_pages.emplace(_domain.translate_foreign_address(address, paging_mode),
+        std::make_pair(address % XC_PAGE_SIZE, orig_byte));
+
+  const auto &checkpoint = _checkpoints->create(_last_stop_reason, _written_gfns,
+    [&bp_pages](xen_pfn_t gfn, unsigned char *page) {
+      const auto [begin, end] = bp_pages.equal_range(gfn);
+      for (auto it = begin; it != end; ++it)
+        page[it->second.first] = it->second.second;
+    });
+
+  _written_gfns.clear();
+  _current_checkpoint = checkpoint.id;
+
+  return checkpoint;
+}
+
+void Debugger::restore_checkpoint(CheckpointID id) {
+  if (!_checkpoints)
+    throw NoSuchCheckpointException(id);
+
+  const auto restored_list = _checkpoints->restore(id, _written_gfns);
+  const std::unordered_set<xen_pfn_t> restored(restored_list.begin(), restored_list.end());
+
+  // The vCPUs' CR3s were restored too, so the tracked modes are stale
+  invalidate_memory_maps();
+  _extended_registers.clear();
+  if (_address_space_tracker)
+    reset_address_space_tracker();
+
+  // Restored pages hold the original bytes; put our breakpoints back
+  const auto paging_mode = get_paging_mode(_vcpu_id);
+  for (auto &[address, orig_byte] : _breakpoints) {
+    const auto gfn = _domain.translate_foreign_address(address, paging_mode);
+    if (!restored.count(gfn))
+      continue;
+
+    const auto mem_handle = _domain.map_memory_by_mfn<uint8_t>(
+        gfn, address % XC_PAGE_SIZE, sizeof(uint8_t), PROT_READ | PROT_WRITE);
+    const auto mem = mem_handle.get();
+
+    orig_byte = *mem;
+    *mem = X86_INT3;
+  }
+
+  _written_gfns.clear();
+  _current_checkpoint = id;
+  _last_stop_reason = _checkpoints->get_checkpoint(id).stop_reason;
+}
+
+void Debugger::clear_checkpoints() {
+  _checkpoints.reset();
+  _written_gfns.clear();
+  _current_checkpoint = std::nullopt;
+}
+
+const std::vector<Checkpoint> &Debugger::get_checkpoints() const {
+  static const std::vector<Checkpoint> none;
+  return _checkpoints ? _checkpoints->get_checkpoints() : none;
+}
+
+size_t Debugger::get_num_checkpoint_pages() const {
+  return _checkpoints ? _checkpoints->get_num_stored_pages() : 0;
+}
+
+bool Debugger::reverse_step() {
+  const auto &checkpoints = get_checkpoints();
+  if (checkpoints.empty())
+    return false;
+
+  // If nothing has run since the current checkpoint, step past it
+  const auto target = _current_checkpoint
+    ? _checkpoints->get_previous(*_current_checkpoint)
+    : checkpoints.back().id;
+
+  if (!target)
+    return false;
+
+  restore_checkpoint(*target);
+  return true;
+}
+
+bool Debugger::reverse_continue() {
+  const auto is_at_breakpoint = [this](const Checkpoint &checkpoint) {
+    const auto vcpu_id = std::visit(util::overloaded {
+      [](const auto &reason) {
+        return reason.vcpu_id;
+      }
+    }, checkpoint.stop_reason);
+
+    if (vcpu_id >= checkpoint.vcpu_contexts.size())
+      return false;
+
+    const auto ip = reg::read_register<reg::x86_32::eip, reg::x86_64::rip>(
+        checkpoint.vcpu_contexts.at(vcpu_id));
+    return _breakpoints.count(ip) > 0;
+  };
+
+  const auto &checkpoints = get_checkpoints();
+  if (checkpoints.empty())
+    return false;
+
+  // Pick the target before restoring anything, as each restore rewrites
+  // guest memory and discards the checkpoints after it
+  auto it = checkpoints.rbegin();
+  if (_current_checkpoint) {
+    it = std::find_if(checkpoints.rbegin(), checkpoints.rend(),
+      [this](const auto &checkpoint) {
+        return checkpoint.id == *_current_checkpoint;
+      });
+    if (it != checkpoints.rend())
+      ++it;
+  }
+
+  for (; it != checkpoints.rend(); ++it) {
+    if (is_at_breakpoint(*it)) {
+      restore_checkpoint(it->id);
+      return true;
+    }
+  }
+
+  // Nothing was hit, so stop at the start of the recorded history
+  if (_current_checkpoint != checkpoints.front().id)
+    restore_checkpoint(checkpoints.front().id);
+  return false;
+}
+
+void Debugger::try_auto_checkpoint() {
+  if (!_auto_checkpoint)
+    return;
+
+  try {
+    create_checkpoint();
+  } catch (const XenException &e) {
+    spdlog::get(LOGNAME_ERROR)->error("Failed to create checkpoint: {0}", e.what());
+  } catch (const FeatureNotSupportedException &e) {
+    spdlog::get(LOGNAME_ERROR)->error("Failed to create checkpoint: {0}", e.what());
+  }
+}
+
+void Debugger::did_write(Address address, size_t length) {
+  if (!_checkpoints || !length)
+    return;
+
+  const auto paging_mode = get_paging_mode(_vcpu_id);
+  const auto first_page = address & XC_PAGE_MASK;
+  const auto last_page = (address + length - 1) & XC_PAGE_MASK;
+  for (auto page = first_page; page <= last_page; page += XC_PAGE_SIZE)
+    _written_gfns.insert(_domain.translate_foreign_address(page, paging_mode));
+}
+
 void Debugger::cleanup() {
+  _return_breakpoint = std::nullopt;
+  _extended_registers.clear();
   for (auto it = _breakpoints.cbegin(); it != _breakpoints.cend();)
     it = remove_breakpoint(it->first);
 }
@@ -63,6 +351,14 @@ void Debugger::cleanup() {
 void Debugger::insert_breakpoint(Address address) {
   spdlog::get(LOGNAME_CONSOLE)->debug("Inserting breakpoint at {0:x}", address);
 
+  // The user wants to keep a breakpoint that is only there temporarily
+  if (_return_breakpoint && _return_breakpoint->address == address &&
+      _return_breakpoint->is_temporary && _breakpoints.count(address))
+  {
+    _return_breakpoint->is_temporary = false;
+    return;
+  }
+
   if (_breakpoints.count(address)) {
     spdlog::get(LOGNAME_ERROR)->info(
         "[!]: Tried to insert breakpoint where one already exists. "
@@ -73,13 +369,14 @@ void Debugger::insert_breakpoint(Address address) {
   }
 
   const auto mem_handle = _domain.map_memory<uint8_t>(
-      address, sizeof(uint8_t), PROT_READ | PROT_WRITE);
+      address, sizeof(uint8_t), PROT_READ | PROT_WRITE, get_paging_mode(_vcpu_id));
   const auto mem = mem_handle.get();
 
   const auto orig_bytes = *mem;
 
   _breakpoints[address] = orig_bytes;
   *mem = X86_INT3;
+  did_write(address, sizeof(uint8_t));
 }
 
 Debugger::BreakpointMap::iterator Debugger::remove_breakpoint(Address address) {
@@ -95,15 +392,123 @@ Debugger::BreakpointMap::iterator Debugger::remove_breakpoint(Address address) {
   }
 
   const auto mem_handle = _domain.map_memory<uint8_t>(
-      address, sizeof(uint8_t), PROT_WRITE);
+      address, sizeof(uint8_t), PROT_WRITE, get_paging_mode(_vcpu_id));
   const auto mem = mem_handle.get();
 
   const auto orig_bytes = _breakpoints.at(address);
   *mem = orig_bytes;
+  did_write(address, sizeof(uint8_t));
 
   return _breakpoints.erase(_breakpoints.find(address));
 }
 
+size_t Debugger::get_num_breakpoints() const {
+  const auto num_temporary = (_return_breakpoint && _return_breakpoint->is_temporary) ? 1 : 0;
+  return _breakpoints.size() - num_temporary;
+}
+
+std::optional<size_t> Debugger::get_call_length(Address address) {
+  // An instruction may straddle a page boundary; the next page need not be mapped
+  std::array<unsigned char, X86_MAX_INSTRUCTION_SIZE> code;
+  auto length = std::min<size_t>(code.size(), XC_PAGE_SIZE - (address % XC_PAGE_SIZE));
+  memcpy(code.data(), read_memory_masking_breakpoints(address, length).get(), length);
+  if (length < code.size()) {
+    try {
+      const auto rest = code.size() - length;
+      memcpy(code.data() + length,
+          read_memory_masking_breakpoints(address + length, rest).get(), rest);
+      length = code.size();
+    } catch (const XenException &) {
+    }
+  }
+
+  csh capstone;
+  const auto mode = (_domain.get_word_size() == sizeof(uint64_t)) ? CS_MODE_64 : CS_MODE_32;
+  if (cs_open(CS_ARCH_X86, mode, &capstone) != CS_ERR_OK)
+    throw CapstoneException("Failed to open Capstone handle!");
+  cs_option(capstone, CS_OPT_DETAIL, CS_OPT_ON);
+
+  cs_insn *insn;
+  std::optional<size_t> call_length;
+  const auto count = cs_disasm(capstone, code.data(), length, address, 1, &insn);
+  if (count) {
+    if (cs_insn_group(capstone, insn, CS_GRP_CALL))
+      call_length = insn->size;
+    cs_free(insn, count);
+  }
+  cs_close(&capstone);
+
+  return call_length;
+}
+
+std::optional<Address> Debugger::step_over() {
+  const auto vcpu_id = _vcpu_id;
+  const auto context = _domain.get_cpu_context(vcpu_id);
+  const auto ip = reg::read_register<reg::x86_32::eip, reg::x86_64::rip>(context);
+
+  const auto call_length = get_call_length(ip);
+  if (!call_length) {
+    single_step();
+    return std::nullopt;
+  }
+
+  // Once the callee returns, the stack is back where it was before the call
+  const auto sp = reg::read_register<reg::x86_32::esp, reg::x86_64::rsp>(context);
+  const auto return_address = ip + *call_length;
+  run_to_return(vcpu_id, return_address, sp);
+  return return_address;
+}
+
+Address Debugger::finish() {
+  const auto vcpu_id = _vcpu_id;
+  const auto frames = backtrace(vcpu_id);
+  if (frames.size() < 2)
+    throw NoReturnAddressException("Failed to unwind to the caller's frame");
+
+  // The caller's SP is the callee's CFA, which is where the return leaves it
+  const auto &caller = frames.at(1);
+  run_to_return(vcpu_id, caller.pc, caller.sp);
+  return caller.pc;
+}
+
+void Debugger::run_to_return(xen::VCPU_ID vcpu_id, Address address, Address min_sp) {
+  clear_return_breakpoint();
+
+  const auto is_temporary = !_breakpoints.count(address);
+  if (is_temporary)
+    insert_breakpoint(address);
+
+  _return_breakpoint = ReturnBreakpoint{vcpu_id, address, min_sp, is_temporary};
+  continue_();
+}
+
+void Debugger::clear_return_breakpoint() {
+  if (!_return_breakpoint)
+    return;
+
+  if (_return_breakpoint->is_temporary && _breakpoints.count(_return_breakpoint->address))
+    remove_breakpoint(_return_breakpoint->address);
+  _return_breakpoint = std::nullopt;
+}
+
+bool Debugger::is_stop_in_deeper_frame(const StopReason &reason) {
+  const auto &target = *_return_breakpoint;
+  if (const auto bp = std::get_if<StopReasonBreakpoint>(&reason);
+      bp && bp->vcpu_id == target.vcpu_id)
+  {
+    // A recursive call reaches the same return site with a lower stack
+    const auto context = _domain.get_cpu_context(bp->vcpu_id);
+    const auto ip = reg::read_register<reg::x86_32::eip, reg::x86_64::rip>(context);
+    const auto sp = reg::read_register<reg::x86_32::esp, reg::x86_64::rsp>(context);
+    if (ip == target.address && sp < target.min_sp)
+      return true;
+  }
+
+  // Any other stop, including the user's breakpoints, ends the step
+  clear_return_breakpoint();
+  return false;
+}
+
 void Debugger::insert_watchpoint(Address address, uint32_t bytes, WatchpointType type) {
   throw FeatureNotSupportedException("insert watchpoint");
 }
@@ -112,18 +517,28 @@ void Debugger::remove_watchpoint(Address address, uint32_t bytes, WatchpointType
   throw FeatureNotSupportedException("remove watchpoint");
 }
 
+void Debugger::set_guest_request_mode(GuestRequestMode mode) {
+  throw FeatureNotSupportedException("guest requests");
+}
+
+void Debugger::start_trace(const EventTraceConfig &config, const std::string &path) {
+  throw FeatureNotSupportedException("event tracing");
+}
+
+std::unique_ptr<EventTrace> Debugger::stop_trace() {
+  throw FeatureNotSupportedException("event tracing");
+}
+
 xd::dbg::MaskedMemory Debugger::read_memory_masking_breakpoints(Address address, size_t length) {
   const auto mem_handle = _domain.map_memory<char>(
-      address, length, PROT_READ);
+      address, length, PROT_READ, get_paging_mode(_vcpu_id));
   const auto mem_masked = (unsigned char*)malloc(length);
   memcpy(mem_masked, mem_handle.get(), length);
 
   const auto address_end = address + length;
-  for (const auto [bp_address, bp_orig_bytes] : _breakpoints) {
-    if (bp_address >= address && bp_address < address_end) {
-      const auto dist = bp_address - address;
-      *((uint16_t*)(mem_masked + dist)) = bp_orig_bytes;
-    }
+  for (const auto [bp_address, bp_orig_byte] : _breakpoints) {
+    if (bp_address >= address && bp_address < address_end)
+      mem_masked[bp_address - address] = bp_orig_byte;
   }
 
   return MaskedMemory(mem_masked);
@@ -150,12 +565,66 @@ void Debugger::write_memory_retaining_breakpoints(Address address, size_t length
     }
   }
 
-  const auto mem_handle = _domain.map_memory<char>(address, length, PROT_WRITE);
+  const auto mem_handle = _domain.map_memory<char>(address, length, PROT_WRITE,
+      get_paging_mode(_vcpu_id));
   const auto mem_orig = (char*)mem_handle.get() + (length - length_orig);
   memcpy((void*)mem_orig, data, length_orig);
+  did_write(address, length);
+  invalidate_memory_maps();
+  _current_checkpoint = std::nullopt;
 
   spdlog::get(LOGNAME_ERROR)->info("Wrote {0:d} bytes to {1:x}.", length_orig, address);
 
   for (const auto &bp_address : bp_addresses)
     insert_breakpoint(bp_address);
 }
+
+xd::xen::XenForeignMemory::MappedMemory<unsigned char> Debugger::map_physical_memory(
+    xen_pfn_t gfn, size_t offset, size_t length, int prot)
+{
+  const auto num_pages = (offset + length + XC_PAGE_SIZE - 1) >> XC_PAGE_SHIFT;
+
+  std::vector<xen_pfn_t> gfns(num_pages);
+  std::iota(gfns.begin(), gfns.end(), gfn + (offset >> XC_PAGE_SHIFT));
+
+  std::vector<int> errors;
+  auto mem = _domain.map_memory_by_mfns<unsigned char>(gfns, prot, errors);
+  for (size_t i = 0; i < num_pages; ++i)
+    if (errors[i])
+      throw XenException("Failed to map GFN " + std::to_string(gfns[i]), -errors[i]);
+
+  return mem;
+}
+
+std::vector<unsigned char> Debugger::read_physical_memory(
+    xen_pfn_t gfn, size_t offset, size_t length)
+{
+  if (!length)
+    return {};
+
+  const auto mem = map_physical_memory(gfn, offset, length, PROT_READ);
+  const auto begin = mem.get() + (offset & ~XC_PAGE_MASK);
+  return std::vector<unsigned char>(begin, begin + length);
+}
+
+void Debugger::write_physical_memory(xen_pfn_t gfn, size_t offset,
+    const std::vector<unsigned char> &data)
+{
+  if (data.empty())
+    return;
+
+  const auto mem = map_physical_memory(gfn, offset, data.size(), PROT_WRITE);
+  std::copy(data.begin(), data.end(), mem.get() + (offset & ~XC_PAGE_MASK));
+
+  if (_checkpoints) {
+    const auto first = gfn + (offset >> XC_PAGE_SHIFT);
+    const auto last = gfn + ((offset + data.size() - 1) >> XC_PAGE_SHIFT);
+    for (auto page = first; page <= last; ++page)
+      _written_gfns.insert(page);
+  }
+  invalidate_memory_maps();
+  _current_checkpoint = std::nullopt;
+
+  spdlog::get(LOGNAME_ERROR)->info("Wrote {0:d} bytes to GFN {1:x} + {2:x}.",
+      data.size(), gfn, offset);
+}
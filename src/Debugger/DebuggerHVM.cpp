@@ -19,6 +19,8 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <stdexcept>
 #include <sys/mman.h>
@@ -31,6 +33,11 @@
 #include <Util/overloaded.hpp>
 
 using xd::dbg::DebuggerHVM;
+using xd::dbg::EventTrace;
+using xd::dbg::EventTraceConfig;
+using xd::dbg::EventTraceException;
+using xd::dbg::GuestRequestMode;
+using xd::dbg::Marker;
 using xd::xen::Address;
 using xd::xen::Domain;
 using xd::xen::DomainHVM;
@@ -41,7 +48,8 @@ DebuggerHVM::DebuggerHVM(uvw::Loop &loop, DomainHVM domain,
     bool non_stop_mode)
   : Debugger(_domain), _domain(std::move(domain)),
     _monitor(std::make_shared<HVMMonitor>(xendevicemodel, xenevtchn, loop, _domain)),
-    _is_continuing(false), _non_stop_mode(non_stop_mode)
+    _watchpoints(_domain, [this](auto vcpu_id) { return get_paging_mode(vcpu_id); }),
+    _is_continuing(false), _non_stop_mode(non_stop_mode), _word_size(0)
 {
 }
 
@@ -55,6 +63,33 @@ void DebuggerHVM::on_event(vm_event_st event) {
     domain.unpause();
   };
 
+  // Neither traced events nor markers may disturb an in-progress step or
+  // continue. Traced events can still arrive just after a trace stops.
+  if (event.reason == VM_EVENT_REASON_WRITE_CTRLREG ||
+      event.reason == VM_EVENT_REASON_MOV_TO_MSR ||
+      event.reason == VM_EVENT_REASON_CPUID ||
+      event.reason == VM_EVENT_REASON_DESCRIPTOR_ACCESS)
+  {
+    if (_trace)
+      _trace->record(event);
+    if (_address_space_tracker &&
+        event.reason == VM_EVENT_REASON_WRITE_CTRLREG &&
+        event.u.write_ctrlreg.index == VM_EVENT_X86_CR3)
+    {
+      const auto &regs = event.data.regs.x86;
+      _address_space_tracker->did_switch(event.vcpu_id, Domain::get_hvm_paging_mode(
+            regs.cr0, event.u.write_ctrlreg.new_value, regs.cr4, regs.msr_efer));
+    }
+    return;
+  }
+
+  if (event.reason == VM_EVENT_REASON_GUEST_REQUEST &&
+      _guest_request_mode == GuestRequestMode::Marker)
+  {
+    record_marker(event);
+    return;
+  }
+
   if (_last_single_step_breakpoint_addr) {
     insert_breakpoint(*_last_single_step_breakpoint_addr);
     _last_single_step_breakpoint_addr = std::nullopt;
@@ -69,13 +104,24 @@ void DebuggerHVM::on_event(vm_event_st event) {
       did_stop(StopReasonBreakpoint(SIGTRAP, event.vcpu_id));
     }
     _domain.set_singlestep(false, get_vcpu_id());
-  } else if (event.reason == VM_EVENT_REASON_SOFTWARE_BREAKPOINT) {
+  } else if (event.reason == VM_EVENT_REASON_SOFTWARE_BREAKPOINT ||
+             event.reason == VM_EVENT_REASON_GUEST_REQUEST)
+  {
+    if (event.reason == VM_EVENT_REASON_SOFTWARE_BREAKPOINT)
+      ++_num_breakpoint_hits;
     pause_domain(_domain);
     did_stop(StopReasonBreakpoint(SIGTRAP, event.vcpu_id));
   } else if (event.reason == VM_EVENT_REASON_MEM_ACCESS) {
     pause_domain(_domain);
     const auto ma = event.u.mem_access;
-    const auto address = (ma.gfn << XC_PAGE_SHIFT) + ma.offset;
+
+    // The event is by GFN, but the client set the watchpoint by virtual address
+    auto address = _watchpoints.find(ma.gfn, ma.offset, event.vcpu_id);
+    if (!address) {
+      spdlog::get(LOGNAME_ERROR)->warn(
+          "No watched virtual address maps GFN {0:x}", ma.gfn);
+      address = (ma.gfn << XC_PAGE_SHIFT) + ma.offset;
+    }
 
     WatchpointType type;
     if (ma.flags & MEM_ACCESS_R) {
@@ -86,12 +132,31 @@ void DebuggerHVM::on_event(vm_event_st event) {
       type = WatchpointType::Access;
     }
 
-    did_stop(StopReasonWatchpoint(SIGTRAP, event.vcpu_id, address, type));
+    did_stop(StopReasonWatchpoint(SIGTRAP, event.vcpu_id, *address, type));
   }
 }
 
+void DebuggerHVM::record_marker(const vm_event_st &event) {
+  const auto &regs = event.data.regs.x86;
+  const auto now = std::chrono::steady_clock::now().time_since_epoch();
+  const bool is_64_bit = _word_size == sizeof(uint64_t);
+
+  Marker marker;
+  marker.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+  marker.vcpu_id = event.vcpu_id;
+  marker.rip = regs.rip;
+  marker.cr3 = regs.cr3;
+  marker.id = regs.rdx;
+  marker.args[0] = is_64_bit ? regs.r10 : regs.rsi;
+  marker.args[1] = is_64_bit ? regs.r8 : regs.rdi;
+
+  _markers.record(marker);
+}
+
 void DebuggerHVM::attach() {
   Debugger::attach();
+  // Looked up once so recording a marker needs no hypercalls
+  _word_size = _domain.get_word_size();
   _monitor->on_event([this](auto event) {
     on_event(event);
   });
@@ -99,16 +164,88 @@ void DebuggerHVM::attach() {
 }
 
 void DebuggerHVM::detach() {
+  _watchpoints.clear();
+  if (_trace)
+    stop_trace();
+  set_track_address_spaces(false);
   _monitor->stop();
   Debugger::detach();
 }
 
+void DebuggerHVM::set_guest_request_mode(GuestRequestMode mode) {
+  // Stopping needs the requesting VCPU held until we have paused the domain
+  _monitor->set_guest_request_sync(mode == GuestRequestMode::Stop);
+  _guest_request_mode = mode;
+}
+
+void DebuggerHVM::start_trace(const EventTraceConfig &config, const std::string &path) {
+  if (_trace)
+    throw EventTraceException("A trace is already running");
+
+  _trace = std::make_unique<EventTrace>(path, _domain.get_domid());
+  _trace_config = config;
+  monitor_trace_events(config, true);
+}
+
+std::unique_ptr<EventTrace> DebuggerHVM::stop_trace() {
+  if (!_trace)
+    throw EventTraceException("No trace is running");
+
+  auto trace = std::move(_trace);
+  monitor_trace_events(_trace_config, false);
+  trace->flush();
+  return trace;
+}
+
+void DebuggerHVM::monitor_trace_events(const EventTraceConfig &config, bool enable) {
+  if (config.cpuid)
+    _domain.monitor_cpuid(enable);
+  if (config.descriptor_access)
+    _domain.monitor_descriptor_access(enable);
+  for (const auto msr : config.msrs)
+    _domain.monitor_mov_to_msr(msr, enable);
+  for (const auto index : config.ctrlregs) {
+    if (index == VM_EVENT_X86_CR3)
+      monitor_cr3_writes(enable);
+    else
+      _domain.monitor_write_ctrlreg(index, enable, false, true);
+  }
+}
+
+void DebuggerHVM::set_track_address_spaces(bool enabled) {
+  if (enabled == (bool)_address_space_tracker)
+    return;
+
+  // Subscribe first, so that no switch can fall between the two
+  if (enabled) {
+    monitor_cr3_writes(true);
+    reset_address_space_tracker();
+  } else {
+    _address_space_tracker.reset();
+    monitor_cr3_writes(false);
+  }
+}
+
+void DebuggerHVM::monitor_cr3_writes(bool enable) {
+  // Both tracing and address space tracking want CR3 writes; only
+  // unsubscribe once neither does
+  const auto is_traced = _trace && std::count(_trace_config.ctrlregs.begin(),
+      _trace_config.ctrlregs.end(), VM_EVENT_X86_CR3);
+  if (!enable && (is_traced || _address_space_tracker))
+    return;
+
+  // Asynchronous, so CR3 writes are seen without pausing the VCPU
+  _domain.monitor_write_ctrlreg(VM_EVENT_X86_CR3, enable, false, true);
+}
+
 void DebuggerHVM::continue_() {
   _is_continuing = true;
   single_step();
 }
 
 void DebuggerHVM::single_step() {
+  invalidate_memory_maps();
+
   const auto vcpu = get_vcpu_id();
 
   const auto context = _domain.get_cpu_context(vcpu);
@@ -131,20 +268,9 @@ void DebuggerHVM::single_step() {
 }
 
 void DebuggerHVM::insert_watchpoint(xen::Address address, uint32_t bytes, WatchpointType type) {
-  xenmem_access_t access = [type]() {
-    switch (type) {
-      case WatchpointType::Access:
-        return XENMEM_access_n;
-      case WatchpointType::Read:
-        return XENMEM_access_wx;
-      case WatchpointType::Write:
-        return XENMEM_access_rx;
-    }
-  }();
-
-  _domain.set_mem_access(access, address, bytes);
+  _watchpoints.insert(address, bytes, type, get_vcpu_id());
 }
 
-void DebuggerHVM::remove_watchpoint(xen::Address address, uint32_t bytes, WatchpointType /*type*/) {
-  _domain.set_mem_access(XENMEM_access_rwx, address, bytes); // TODO: NOT SAFE
+void DebuggerHVM::remove_watchpoint(xen::Address address, uint32_t bytes, WatchpointType type) {
+  _watchpoints.remove(address, bytes, type);
 }
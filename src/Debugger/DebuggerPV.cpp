@@ -86,6 +86,7 @@ void DebuggerPV::attach() {
        */
       if (self->_is_continuing) {
         self->_is_continuing = false;
+        ++self->_num_breakpoint_hits;
 
         auto context_any = domain.get_cpu_context(vcpu);
         std::visit(util::overloaded{
@@ -119,6 +120,8 @@ void DebuggerPV::continue_() {
 }
 
 void DebuggerPV::single_step() {
+  invalidate_memory_maps();
+
   auto vcpu = get_vcpu_id();
 
   const auto context = _domain.get_cpu_context(vcpu);
@@ -0,0 +1,165 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <cstring>
+#include <sstream>
+
+#include <Debugger/EventTrace.hpp>
+
+using xd::dbg::EventTrace;
+using xd::dbg::EventTraceConfig;
+using xd::dbg::EventTraceException;
+using xd::dbg::EventTraceHeader;
+using xd::dbg::EventTraceRecord;
+
+static const std::vector<uint32_t> default_msrs = {
+  0x00000174, // IA32_SYSENTER_CS
+  0x00000175, // IA32_SYSENTER_ESP
+  0x00000176, // IA32_SYSENTER_EIP
+  0x00000277, // IA32_PAT
+  0x000006E0, // IA32_TSC_DEADLINE
+  0xC0000080, // IA32_EFER
+  0xC0000081, // IA32_STAR
+  0xC0000082, // IA32_LSTAR
+  0xC0000100, // IA32_FS_BASE
+  0xC0000101, // IA32_GS_BASE
+  0xC0000102, // IA32_KERNEL_GS_BASE
+};
+
+EventTraceConfig EventTraceConfig::parse(const std::string &classes) {
+  EventTraceConfig config{false, false, {}, {}};
+
+  std::istringstream ss(classes);
+  for (std::string name; std::getline(ss, name, ',');) {
+    if (name == "cpuid")
+      config.cpuid = true;
+    else if (name == "desc")
+      config.descriptor_access = true;
+    else if (name == "msr")
+      config.msrs = default_msrs;
+    else if (name == "cr")
+      config.ctrlregs = {VM_EVENT_X86_CR0, VM_EVENT_X86_CR3, VM_EVENT_X86_CR4};
+    else
+      throw EventTraceException("Unknown event class: " + name);
+  }
+
+  return config;
+}
+
+static uint64_t to_ns(std::chrono::steady_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      time.time_since_epoch()).count();
+}
+
+EventTrace::EventTrace(const std::string &path, xen::DomID domid, size_t capacity)
+  : _file(path, std::ios::binary | std::ios::trunc), _ring(capacity),
+    _num_buffered(0), _num_records(0),
+    _start(std::chrono::steady_clock::now()), _last_flush(_start)
+{
+  if (!_file)
+    throw EventTraceException("Failed to open " + path);
+
+  EventTraceHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, EVENT_TRACE_MAGIC, sizeof(EVENT_TRACE_MAGIC));
+  header.version = EVENT_TRACE_VERSION;
+  header.domid = domid;
+  header.start_ns = to_ns(_start);
+
+  _file.write((const char*)&header, sizeof(header));
+}
+
+EventTrace::~EventTrace() {
+  try {
+    flush();
+  } catch (const EventTraceException &) {
+  }
+}
+
+void EventTrace::record(const vm_event_request_t &event) {
+  const auto now = std::chrono::steady_clock::now();
+
+  auto &record = _ring[_num_buffered++];
+  memset(&record, 0, sizeof(record));
+  record.timestamp_ns = to_ns(now);
+  record.rip = event.data.regs.x86.rip;
+  record.vcpu_id = event.vcpu_id;
+  record.reason = event.reason;
+
+  switch (event.reason) {
+    case VM_EVENT_REASON_WRITE_CTRLREG:
+      record.index = event.u.write_ctrlreg.index;
+      record.new_value = event.u.write_ctrlreg.new_value;
+      record.old_value = event.u.write_ctrlreg.old_value;
+      break;
+    case VM_EVENT_REASON_MOV_TO_MSR:
+      record.index = (uint32_t)event.u.mov_to_msr.msr;
+      record.new_value = event.u.mov_to_msr.new_value;
+      record.old_value = event.u.mov_to_msr.old_value;
+      break;
+    case VM_EVENT_REASON_CPUID:
+      record.index = event.u.cpuid.leaf;
+      record.subindex = event.u.cpuid.subleaf;
+      record.new_value = event.data.regs.x86.rax;
+      break;
+    case VM_EVENT_REASON_DESCRIPTOR_ACCESS:
+      record.index = event.u.desc_access.descriptor;
+      record.subindex = event.u.desc_access.is_write;
+      break;
+    default:
+      break;
+  }
+
+  ++_num_records;
+  ++_counts[event.reason];
+
+  if (_num_buffered == _ring.size() || now - _last_flush >= EVENT_TRACE_FLUSH_INTERVAL)
+    flush();
+}
+
+void EventTrace::flush() {
+  _file.write((const char*)_ring.data(), _num_buffered * sizeof(EventTraceRecord));
+  _file.flush();
+  _num_buffered = 0;
+  _last_flush = std::chrono::steady_clock::now();
+
+  if (!_file)
+    throw EventTraceException("Failed to write trace");
+}
+
+std::chrono::nanoseconds EventTrace::get_duration() const {
+  return std::chrono::steady_clock::now() - _start;
+}
+
+const char *EventTrace::reason_name(uint32_t reason) {
+  switch (reason) {
+    case VM_EVENT_REASON_WRITE_CTRLREG:
+      return "cr write";
+    case VM_EVENT_REASON_MOV_TO_MSR:
+      return "msr write";
+    case VM_EVENT_REASON_CPUID:
+      return "cpuid";
+    case VM_EVENT_REASON_DESCRIPTOR_ACCESS:
+      return "descriptor access";
+    default:
+      return "other";
+  }
+}
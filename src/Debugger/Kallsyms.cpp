@@ -0,0 +1,465 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+#include <Debugger/Kallsyms.hpp>
+#include <Xen/PageTableWalker.hpp>
+
+#define KALLSYMS_NUM_TOKENS 256
+#define KALLSYMS_MARKER_STRIDE 256
+#define KALLSYMS_MAX_MARKERS 0x10000
+// How far before the last marked name to look for the symbol count
+#define KALLSYMS_MAX_NAMES_TAIL 0x10000
+#define KALLSYMS_MAP_BATCH_PAGES 1024
+
+// The ranges the kernel image is mapped in, wherever KASLR puts it
+#define KALLSYMS_IMAGE_START_64 0xffffffff80000000ull
+#define KALLSYMS_IMAGE_END_64   0xffffffffc0000000ull
+#define KALLSYMS_IMAGE_START_32 0xc0000000ull
+#define KALLSYMS_IMAGE_END_32   0xc8000000ull
+
+using xd::dbg::Kallsyms;
+using xd::dbg::KallsymsException;
+using xd::dbg::KernelSymbol;
+using xd::xen::Address;
+using xd::xen::PageTableLeaf;
+using xd::xen::PageTableWalker;
+
+namespace {
+
+  using Tokens = std::array<std::string_view, KALLSYMS_NUM_TOKENS>;
+
+  // A snapshot of guest memory. Tables are placed at word-aligned
+  // addresses, so alignment is computed from the guest address.
+  class Image {
+  public:
+    Image(const unsigned char *data, size_t size, Address address, size_t word_size)
+      : _data(data), _size(size), _address(address), _word_size(word_size) {};
+
+    const unsigned char *data() const { return _data; };
+    size_t size() const { return _size; };
+    size_t word_size() const { return _word_size; };
+
+    bool is_aligned(size_t offset) const {
+      return !((_address + offset) % _word_size);
+    };
+    size_t align_up(size_t offset) const {
+      return offset + (_word_size - (_address + offset) % _word_size) % _word_size;
+    };
+    size_t align_down(size_t offset) const {
+      return offset - (_address + offset) % _word_size;
+    };
+
+    template <typename Value_t>
+    Value_t read(size_t offset) const {
+      if (offset > _size || _size - offset < sizeof(Value_t))
+        throw KallsymsException("Kallsyms tables run past the end of the image");
+      Value_t value;
+      std::memcpy(&value, _data + offset, sizeof(Value_t));
+      return value;
+    }
+
+    uint64_t read_word(size_t offset) const {
+      return (_word_size == sizeof(uint32_t)) ? read<uint32_t>(offset) : read<uint64_t>(offset);
+    }
+
+  private:
+    const unsigned char *_data;
+    size_t _size;
+    Address _address;
+    size_t _word_size;
+  };
+
+  struct Name {
+    char type;
+    std::string name;
+  };
+
+  // Given the offset of the "0" token, finds the start of the token table
+  // and checks it against the token index that follows it. Returns the
+  // offset of the table and fills in the tokens.
+  std::optional<size_t> find_token_table(const Image &image, size_t zero_token,
+      Tokens &tokens, size_t &token_index)
+  {
+    const auto data = image.data();
+
+    auto start = zero_token;
+    for (size_t i = 0; i < '0'; ++i) {
+      if (start < 2)
+        return std::nullopt;
+      const auto end = start - 1;
+      auto begin = end;
+      while (begin > 0 && data[begin - 1])
+        --begin;
+      if (begin == end)
+        return std::nullopt;
+      start = begin;
+    }
+
+    if (!image.is_aligned(start))
+      return std::nullopt;
+
+    auto offset = start;
+    for (auto &token : tokens) {
+      const auto end = (const unsigned char*)std::memchr(
+          data + offset, 0, image.size() - offset);
+      if (!end || end == data + offset)
+        return std::nullopt;
+      for (auto it = data + offset; it != end; ++it)
+        if (!std::isprint(*it))
+          return std::nullopt;
+      token = std::string_view((const char*)data + offset, end - (data + offset));
+      offset = (end - data) + 1;
+    }
+
+    token_index = image.align_up(offset);
+    if (token_index + KALLSYMS_NUM_TOKENS * sizeof(uint16_t) > image.size())
+      return std::nullopt;
+    for (size_t i = 0; i < KALLSYMS_NUM_TOKENS; ++i) {
+      const auto expected = (const unsigned char*)tokens[i].data() - (data + start);
+      if (image.read<uint16_t>(token_index + i * sizeof(uint16_t)) != expected)
+        return std::nullopt;
+    }
+
+    return start;
+  }
+
+  // Reads the markers backwards from the end of the table, which lies
+  // just before the token table; the first marker is always zero
+  std::optional<std::vector<uint64_t>> read_markers(const Image &image,
+      size_t end, size_t marker_size, size_t &start)
+  {
+    const auto read = [&](size_t offset) -> uint64_t {
+      return (marker_size == sizeof(uint32_t))
+        ? image.read<uint32_t>(offset)
+        : image.read<uint64_t>(offset);
+    };
+
+    // Skip the padding left when the table isn't a multiple of a word
+    if (end >= marker_size && !read(end - marker_size))
+      end -= marker_size;
+
+    std::vector<uint64_t> markers;
+    auto prev = UINT64_MAX;
+    while (end >= marker_size && markers.size() < KALLSYMS_MAX_MARKERS) {
+      const auto marker = read(end - marker_size);
+      if (marker >= prev)
+        return std::nullopt;
+      markers.push_back(marker);
+      end -= marker_size;
+      prev = marker;
+      if (!marker)
+        break;
+    }
+
+    if (markers.empty() || markers.back() || !image.is_aligned(end))
+      return std::nullopt;
+
+    std::reverse(markers.begin(), markers.end());
+    start = end;
+    return markers;
+  }
+
+  std::optional<std::vector<Name>> decode_names(const Image &image, size_t offset,
+      size_t num_syms, const std::vector<uint64_t> &markers, const Tokens &tokens,
+      size_t &end)
+  {
+    std::vector<Name> names;
+    names.reserve(num_syms);
+
+    const auto start = offset;
+    std::string expanded;
+    for (size_t i = 0; i < num_syms; ++i) {
+      if (!(i % KALLSYMS_MARKER_STRIDE) &&
+          offset - start != markers[i / KALLSYMS_MARKER_STRIDE])
+        return std::nullopt;
+
+      // Lengths of 128 and above take a second byte
+      size_t length = image.read<uint8_t>(offset++);
+      if (length & 0x80)
+        length = (length & 0x7f) | ((size_t)image.read<uint8_t>(offset++) << 7);
+      if (!length || offset + length > image.size())
+        return std::nullopt;
+
+      expanded.clear();
+      for (size_t j = 0; j < length; ++j)
+        expanded += tokens[image.data()[offset + j]];
+      offset += length;
+
+      if (expanded.size() < 2)
+        return std::nullopt;
+      names.push_back(Name{expanded.front(), expanded.substr(1)});
+    }
+
+    end = offset;
+    return names;
+  }
+
+  std::optional<std::vector<Address>> read_relative_addresses(const Image &image,
+      size_t offsets, size_t relative_base, size_t num_syms)
+  {
+    if (offsets + num_syms * sizeof(int32_t) > relative_base ||
+        relative_base + image.word_size() > image.size())
+      return std::nullopt;
+
+    const auto base = image.read_word(relative_base);
+    if (!base || (image.word_size() == sizeof(uint64_t) && base < 0xffff800000000000ull))
+      return std::nullopt;
+
+    std::vector<int32_t> values(num_syms);
+    std::memcpy(values.data(), image.data() + offsets, num_syms * sizeof(int32_t));
+
+    // With absolute per-CPU symbols, those are stored as positive values and
+    // everything else as a negative offset from the base
+    const bool absolute_percpu = std::any_of(values.begin(), values.end(),
+      [](const auto value) {
+        return value < 0;
+      });
+
+    std::vector<Address> addresses;
+    addresses.reserve(num_syms);
+    for (const auto value : values) {
+      if (!absolute_percpu)
+        addresses.push_back(base + (uint32_t)value);
+      else if (value >= 0)
+        addresses.push_back((uint32_t)value);
+      else
+        addresses.push_back(base - 1 - value);
+    }
+
+    return addresses;
+  }
+
+  std::optional<std::vector<Address>> read_absolute_addresses(const Image &image,
+      size_t addresses_offset, size_t num_syms)
+  {
+    std::vector<Address> addresses;
+    addresses.reserve(num_syms);
+    for (size_t i = 0; i < num_syms; ++i)
+      addresses.push_back(image.read_word(addresses_offset + i * image.word_size()));
+    return addresses;
+  }
+
+  bool is_sorted_nonzero(const std::optional<std::vector<Address>> &addresses) {
+    return addresses && !addresses->empty() && addresses->back() &&
+      std::is_sorted(addresses->begin(), addresses->end());
+  }
+
+  // Finds the symbol count before the names, decodes the names, and then
+  // looks for their addresses wherever each kernel version puts them
+  std::optional<std::vector<KernelSymbol>> decode_from_markers(const Image &image,
+      const Tokens &tokens, size_t token_index, size_t markers_start,
+      const std::vector<uint64_t> &markers)
+  {
+    const auto word_size = image.word_size();
+    const auto num_markers = markers.size();
+    const auto last_marker = markers.back();
+    if (last_marker + word_size > markers_start)
+      return std::nullopt;
+
+    const auto highest = image.align_down(markers_start - last_marker - word_size);
+    const auto lowest = (highest > KALLSYMS_MAX_NAMES_TAIL) ? highest - KALLSYMS_MAX_NAMES_TAIL : 0;
+
+    for (auto num_syms_offset = highest; num_syms_offset >= lowest && num_syms_offset < image.size();
+        num_syms_offset -= word_size)
+    {
+      const size_t num_syms = image.read<uint32_t>(num_syms_offset);
+      if (num_syms && (num_syms + KALLSYMS_MARKER_STRIDE - 1) / KALLSYMS_MARKER_STRIDE == num_markers) {
+        size_t names_end;
+        const auto names = decode_names(image, num_syms_offset + word_size, num_syms,
+            markers, tokens, names_end);
+
+        if (names && names_end <= markers_start && image.align_up(names_end) == markers_start) {
+          const auto offsets_size =
+            (num_syms * sizeof(int32_t) + word_size - 1) / word_size * word_size;
+          std::optional<std::vector<Address>> addresses;
+
+          // Newer kernels put the offsets and base after the token index...
+          const auto after_index = image.align_up(token_index + KALLSYMS_NUM_TOKENS * sizeof(uint16_t));
+          addresses = read_relative_addresses(image, after_index,
+              image.align_up(after_index + num_syms * sizeof(int32_t)), num_syms);
+
+          // ...older ones before the symbol count, and without a relative
+          // base, there is a table of absolute addresses there instead
+          if (!is_sorted_nonzero(addresses) && num_syms_offset >= word_size + offsets_size)
+            addresses = read_relative_addresses(image,
+                num_syms_offset - word_size - offsets_size, num_syms_offset - word_size, num_syms);
+          if (!is_sorted_nonzero(addresses) && num_syms_offset >= num_syms * word_size)
+            addresses = read_absolute_addresses(image,
+                num_syms_offset - num_syms * word_size, num_syms);
+
+          if (!is_sorted_nonzero(addresses))
+            return std::nullopt;
+
+          std::vector<KernelSymbol> symbols;
+          symbols.reserve(num_syms);
+          for (size_t i = 0; i < num_syms; ++i)
+            symbols.push_back(KernelSymbol{(*addresses)[i], (*names)[i].type,
+                std::move((*names)[i].name)});
+          return symbols;
+        }
+      }
+
+      if (num_syms_offset < word_size)
+        break;
+    }
+
+    return std::nullopt;
+  }
+
+}
+
+std::vector<KernelSymbol> Kallsyms::decode(const unsigned char *data, size_t size,
+    Address address, size_t word_size)
+{
+  const Image image(data, size, address, word_size);
+
+  // Digits are too rare in symbol names to be merged into other tokens,
+  // so the table always maps them to themselves, in order
+  static const char digits[] = "0\0" "1\0" "2\0" "3\0" "4\0" "5\0" "6\0" "7\0" "8\0" "9";
+  const auto digits_end = digits + sizeof(digits);
+
+  for (auto it = data; (it = std::search(it, data + size, digits, digits_end)) != data + size; ++it) {
+    Tokens tokens;
+    size_t token_index;
+    const auto token_table = find_token_table(image, it - data, tokens, token_index);
+    if (!token_table)
+      continue;
+
+    for (const auto marker_size : {sizeof(uint32_t), word_size}) {
+      size_t markers_start;
+      const auto markers = read_markers(image, *token_table, marker_size, markers_start);
+      if (!markers)
+        continue;
+
+      auto symbols = decode_from_markers(image, tokens, token_index, markers_start, *markers);
+      if (symbols)
+        return std::move(*symbols);
+    }
+  }
+
+  throw KallsymsException("No kallsyms tables found");
+}
+
+std::vector<KernelSymbol> Kallsyms::read(const xen::Domain &domain,
+    const xen::PagingMode &paging_mode, Stats *stats)
+{
+  if (!paging_mode.levels)
+    throw KallsymsException("Paging is disabled; the kernel has not started yet");
+
+  const auto read_start = std::chrono::steady_clock::now();
+  const auto word_size = (paging_mode.levels >= 4) ? sizeof(uint64_t) : sizeof(uint32_t);
+  const Address begin = (word_size == sizeof(uint64_t)) ? KALLSYMS_IMAGE_START_64 : KALLSYMS_IMAGE_START_32;
+  const Address last = ((word_size == sizeof(uint64_t)) ? KALLSYMS_IMAGE_END_64 : KALLSYMS_IMAGE_END_32) - 1;
+
+  // Runs of virtually contiguous supervisor pages in the image range
+  struct Run {
+    Address address;
+    std::vector<xen_pfn_t> frames;
+  };
+  std::vector<Run> runs;
+
+  PageTableWalker(domain).walk(paging_mode, [&](const PageTableLeaf &leaf) {
+    const auto leaf_last = leaf.virtual_address + (leaf.size - 1);
+    if (leaf.user || leaf_last < begin || leaf.virtual_address > last)
+      return;
+
+    const auto from = std::max(leaf.virtual_address, begin);
+    const auto to = std::min(leaf_last, last);
+    for (auto page = from; page <= to && page >= from; page += XC_PAGE_SIZE) {
+      if (runs.empty() ||
+          runs.back().address + runs.back().frames.size() * XC_PAGE_SIZE != page)
+        runs.push_back(Run{page, {}});
+      runs.back().frames.push_back(
+          leaf.frame + ((page - leaf.virtual_address) >> XC_PAGE_SHIFT));
+    }
+  });
+
+  // The largest run is almost always the image itself
+  std::sort(runs.begin(), runs.end(), [](const auto &a, const auto &b) {
+    return a.frames.size() > b.frames.size();
+  });
+
+  size_t num_pages = 0;
+  auto read_time = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - read_start);
+  std::chrono::microseconds decode_time(0);
+  std::vector<unsigned char> buffer;
+  std::vector<int> errors;
+
+  for (const auto &run : runs) {
+    auto phase_start = std::chrono::steady_clock::now();
+
+    // Frames are mapped in large batches rather than page by page; holes
+    // are left zeroed
+    buffer.assign(run.frames.size() * XC_PAGE_SIZE, 0);
+    for (size_t base = 0; base < run.frames.size(); base += KALLSYMS_MAP_BATCH_PAGES) {
+      const auto end = std::min(run.frames.size(), base + KALLSYMS_MAP_BATCH_PAGES);
+      const std::vector<xen_pfn_t> batch(run.frames.begin() + base, run.frames.begin() + end);
+      const auto mem = domain.map_memory_by_mfns<unsigned char>(batch, PROT_READ, errors);
+
+      for (size_t i = 0; i < batch.size(); ++i) {
+        if (!errors[i])
+          std::memcpy(buffer.data() + (base + i) * XC_PAGE_SIZE,
+              mem.get() + i * XC_PAGE_SIZE, XC_PAGE_SIZE);
+      }
+    }
+    num_pages += run.frames.size();
+
+    auto now = std::chrono::steady_clock::now();
+    read_time += std::chrono::duration_cast<std::chrono::microseconds>(now - phase_start);
+    phase_start = now;
+
+    try {
+      auto symbols = decode(buffer.data(), buffer.size(), run.address, word_size);
+      std::stable_sort(symbols.begin(), symbols.end(), [](const auto &a, const auto &b) {
+        return a.address < b.address;
+      });
+
+      decode_time += std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - phase_start);
+      if (stats)
+        *stats = Stats{num_pages, read_time, decode_time};
+      return symbols;
+    } catch (const KallsymsException &) {
+      decode_time += std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - phase_start);
+    }
+  }
+
+  throw KallsymsException("No kallsyms tables found in the kernel's mappings");
+}
+
+const KernelSymbol *Kallsyms::lookup(const std::vector<KernelSymbol> &symbols,
+    Address address)
+{
+  const auto it = std::upper_bound(symbols.begin(), symbols.end(), address,
+    [](const auto address, const auto &symbol) {
+      return address < symbol.address;
+    });
+  return (it == symbols.begin()) ? nullptr : &*(it - 1);
+}
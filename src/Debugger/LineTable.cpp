@@ -0,0 +1,543 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <cstring>
+
+#include <Debugger/LineTable.hpp>
+#include <Util/ElfFile.hpp>
+
+#define DW_LNS_copy               0x01
+#define DW_LNS_advance_pc         0x02
+#define DW_LNS_advance_line       0x03
+#define DW_LNS_set_file           0x04
+#define DW_LNS_set_column         0x05
+#define DW_LNS_negate_stmt        0x06
+#define DW_LNS_set_basic_block    0x07
+#define DW_LNS_const_add_pc       0x08
+#define DW_LNS_fixed_advance_pc   0x09
+#define DW_LNS_set_prologue_end   0x0a
+#define DW_LNS_set_epilogue_begin 0x0b
+#define DW_LNS_set_isa            0x0c
+
+#define DW_LNE_end_sequence       0x01
+#define DW_LNE_set_address        0x02
+#define DW_LNE_define_file        0x03
+#define DW_LNE_set_discriminator  0x04
+
+#define DW_LNCT_path              0x01
+#define DW_LNCT_directory_index   0x02
+
+#define DW_FORM_block2            0x03
+#define DW_FORM_block4            0x04
+#define DW_FORM_data2             0x05
+#define DW_FORM_data4             0x06
+#define DW_FORM_data8             0x07
+#define DW_FORM_string            0x08
+#define DW_FORM_block             0x09
+#define DW_FORM_block1            0x0a
+#define DW_FORM_data1             0x0b
+#define DW_FORM_sdata             0x0d
+#define DW_FORM_strp              0x0e
+#define DW_FORM_udata             0x0f
+#define DW_FORM_data16            0x1e
+#define DW_FORM_line_strp         0x1f
+
+using xd::dbg::LineTable;
+using xd::dbg::LineTableException;
+using xd::dbg::SourceLocation;
+using xd::xen::Address;
+
+namespace {
+
+  class Cursor {
+  public:
+    Cursor(const unsigned char *begin, size_t size)
+      : _begin(begin), _it(begin), _end(begin + size) {};
+
+    size_t offset() const { return _it - _begin; };
+    bool at_end() const { return _it >= _end; };
+    void seek(size_t offset) { _it = _begin + offset; };
+    void skip(size_t n) { expect(n); _it += n; };
+
+    template <typename Value_t>
+    Value_t read() {
+      expect(sizeof(Value_t));
+      Value_t value;
+      std::memcpy(&value, _it, sizeof(Value_t));
+      _it += sizeof(Value_t);
+      return value;
+    }
+
+    uint64_t read_uleb128() {
+      uint64_t value = 0;
+      size_t shift = 0;
+      uint8_t byte;
+      do {
+        byte = read<uint8_t>();
+        if (shift < 64)
+          value |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+      } while (byte & 0x80);
+      return value;
+    }
+
+    int64_t read_sleb128() {
+      int64_t value = 0;
+      size_t shift = 0;
+      uint8_t byte;
+      do {
+        byte = read<uint8_t>();
+        if (shift < 64)
+          value |= (int64_t)(byte & 0x7f) << shift;
+        shift += 7;
+      } while (byte & 0x80);
+      if (shift < 64 && (byte & 0x40))
+        value |= -((int64_t)1 << shift);
+      return value;
+    }
+
+    std::string read_string() {
+      const auto nul = std::find(_it, _end, 0);
+      if (nul == _end)
+        throw LineTableException("Unterminated string");
+      std::string s((const char*)_it, nul - _it);
+      _it = nul + 1;
+      return s;
+    }
+
+    uint64_t read_sized(size_t size) {
+      switch (size) {
+        case 1: return read<uint8_t>();
+        case 2: return read<uint16_t>();
+        case 4: return read<uint32_t>();
+        case 8: return read<uint64_t>();
+        default:
+          throw LineTableException("Unsupported field size");
+      }
+    }
+
+  private:
+    const unsigned char *_begin, *_it, *_end;
+
+    void expect(size_t n) {
+      if ((size_t)(_end - _it) < n)
+        throw LineTableException("Truncated line program");
+    }
+  };
+
+  // Reads a unit header's length field, returning the unit's total size
+  // including the length field itself and setting the DWARF offset size
+  size_t read_unit_length(Cursor &cursor, size_t &offset_size) {
+    const auto begin = cursor.offset();
+    uint64_t length = cursor.read<uint32_t>();
+    offset_size = sizeof(uint32_t);
+    if (length == 0xffffffff) {
+      length = cursor.read<uint64_t>();
+      offset_size = sizeof(uint64_t);
+    } else if (length >= 0xfffffff0) {
+      throw LineTableException("Reserved unit length");
+    }
+    return (cursor.offset() - begin) + length;
+  }
+
+  std::string read_string_table(const char *table, size_t size, uint64_t offset) {
+    if (!table || offset >= size)
+      throw LineTableException("String offset out of range");
+    return std::string(table + offset, strnlen(table + offset, size - offset));
+  }
+
+  std::string join_path(const std::string &dir, const std::string &name) {
+    if (dir.empty() || name.empty() || name.front() == '/')
+      return name;
+    return dir + "/" + name;
+  }
+
+}
+
+LineTable::LineTable()
+  : _debug_line(nullptr), _debug_line_size(0),
+    _debug_str(nullptr), _debug_line_str(nullptr),
+    _debug_str_size(0), _debug_line_str_size(0),
+    _address_size(sizeof(uint64_t)), _is_indexed(false),
+    _index_build_time(0), _lookup_counter(0)
+{
+}
+
+LineTable LineTable::from_elf(const std::string &path) {
+  LineTable table;
+  try {
+    table._elf = std::make_shared<const util::ElfFile>(path);
+  } catch (const util::ElfFileException &e) {
+    throw LineTableException(e.what());
+  }
+
+  const auto &elf = *table._elf;
+  table._address_size = elf.is_64_bit() ? sizeof(uint64_t) : sizeof(uint32_t);
+
+  for (const auto &section : elf.get_sections()) {
+    if (!section.data)
+      continue;
+    if (section.name == ".debug_line") {
+      table._debug_line = (const unsigned char*)section.data;
+      table._debug_line_size = section.size;
+    } else if (section.name == ".debug_str") {
+      table._debug_str = section.data;
+      table._debug_str_size = section.size;
+    } else if (section.name == ".debug_line_str") {
+      table._debug_line_str = section.data;
+      table._debug_line_str_size = section.size;
+    }
+  }
+
+  if (!table._debug_line)
+    throw LineTableException("No .debug_line section");
+
+  // Only the unit lengths are read here; the programs are run on first use
+  Cursor cursor(table._debug_line, table._debug_line_size);
+  while (!cursor.at_end()) {
+    const auto offset = cursor.offset();
+    size_t offset_size;
+    const auto length = read_unit_length(cursor, offset_size);
+    if (length > table._debug_line_size - offset)
+      throw LineTableException("Truncated line program");
+    table._unit_offsets.push_back(offset);
+    cursor.seek(offset + length);
+  }
+
+  return table;
+}
+
+std::optional<SourceLocation> LineTable::lookup(Address address) const {
+  if (!_is_indexed)
+    build_index();
+
+  auto seq = std::upper_bound(_sequences.begin(), _sequences.end(), address,
+    [](const auto &address, const auto &sequence) {
+      return address < sequence.begin;
+    });
+  if (seq == _sequences.begin() || address >= (--seq)->end)
+    return std::nullopt;
+
+  const auto &unit = get_unit(seq->unit);
+  auto row = std::upper_bound(unit.rows.begin(), unit.rows.end(), address,
+    [](const auto &address, const auto &row) {
+      return address < row.address;
+    });
+  if (row == unit.rows.begin() || (--row)->end_sequence)
+    return std::nullopt;
+
+  const auto &file = (row->file < unit.files.size()) ? unit.files[row->file] : "";
+  return SourceLocation{file, row->line};
+}
+
+LineTable::Stats LineTable::get_stats() const {
+  size_t num_rows = 0, cached_bytes = 0;
+  for (const auto &[offset, unit] : _units) {
+    num_rows += unit.rows.size();
+    cached_bytes += unit.rows.size() * sizeof(Row);
+    for (const auto &file : unit.files)
+      cached_bytes += sizeof(std::string) + file.size();
+  }
+
+  return Stats{
+    _is_indexed,
+    _unit_offsets.size(),
+    _sequences.size(),
+    _sequences.size() * sizeof(Sequence) + _unit_offsets.size() * sizeof(size_t),
+    _units.size(),
+    num_rows,
+    cached_bytes,
+    _index_build_time
+  };
+}
+
+void LineTable::build_index() const {
+  const auto start = std::chrono::steady_clock::now();
+
+  // A unit that fails to decode is left out, rather than costing the whole
+  // table; only its own sequences are dropped
+  std::vector<Sequence> sequences, unit_sequences;
+  for (uint32_t unit = 0; unit < _unit_offsets.size(); ++unit) {
+    std::optional<uint64_t> begin;
+    unit_sequences.clear();
+    try {
+      run_program(_unit_offsets[unit], nullptr, [&](const Row &row) {
+        if (!begin)
+          begin = row.address;
+        if (row.end_sequence) {
+          // Sequences at zero are functions discarded by the linker
+          if (*begin != 0 && row.address > *begin)
+            unit_sequences.push_back(Sequence{*begin, row.address, unit});
+          begin.reset();
+        }
+      });
+    } catch (const LineTableException &) {
+      continue;
+    }
+    sequences.insert(sequences.end(), unit_sequences.begin(), unit_sequences.end());
+  }
+
+  std::sort(sequences.begin(), sequences.end(),
+    [](const auto &a, const auto &b) {
+      return a.begin < b.begin;
+    });
+  sequences.shrink_to_fit();
+  _sequences = std::move(sequences);
+
+  _is_indexed = true;
+  _index_build_time = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+}
+
+const LineTable::Unit &LineTable::get_unit(uint32_t index) const {
+  const auto found = _units.find(index);
+  if (found != _units.end()) {
+    found->second.last_used = ++_lookup_counter;
+    return found->second;
+  }
+
+  if (_units.size() >= LINE_TABLE_MAX_CACHED_UNITS) {
+    const auto lru = std::min_element(_units.begin(), _units.end(),
+      [](const auto &a, const auto &b) {
+        return a.second.last_used < b.second.last_used;
+      });
+    _units.erase(lru);
+  }
+
+  Unit unit;
+  run_program(_unit_offsets[index], &unit.files, [&](const Row &row) {
+    unit.rows.push_back(row);
+  });
+
+  // Where one sequence ends at the address another begins, the end row
+  // sorts first so the lookup lands on the new sequence
+  std::stable_sort(unit.rows.begin(), unit.rows.end(),
+    [](const auto &a, const auto &b) {
+      if (a.address != b.address)
+        return a.address < b.address;
+      return a.end_sequence && !b.end_sequence;
+    });
+  unit.rows.shrink_to_fit();
+  unit.last_used = ++_lookup_counter;
+
+  return _units.emplace(index, std::move(unit)).first->second;
+}
+
+void LineTable::run_program(size_t offset, std::vector<std::string> *files,
+    const std::function<void(const Row&)> &on_row) const
+{
+  Cursor cursor(_debug_line, _debug_line_size);
+  cursor.seek(offset);
+
+  size_t offset_size;
+  const auto unit_end = offset + read_unit_length(cursor, offset_size);
+
+  const auto version = cursor.read<uint16_t>();
+  if (version < 2 || version > 5)
+    throw LineTableException("Unsupported line table version");
+
+  auto address_size = _address_size;
+  if (version >= 5) {
+    address_size = cursor.read<uint8_t>();
+    cursor.read<uint8_t>(); // segment_selector_size
+  }
+
+  const auto header_length = cursor.read_sized(offset_size);
+  const auto program_offset = cursor.offset() + header_length;
+  if (program_offset > unit_end)
+    throw LineTableException("Truncated line program");
+
+  const auto min_instruction_length = cursor.read<uint8_t>();
+  if (version >= 4)
+    cursor.read<uint8_t>(); // maximum_operations_per_instruction
+  const bool default_is_stmt = cursor.read<uint8_t>();
+  const auto line_base = cursor.read<int8_t>();
+  const auto line_range = cursor.read<uint8_t>();
+  const auto opcode_base = cursor.read<uint8_t>();
+  if (!line_range)
+    throw LineTableException("Invalid line range");
+
+  std::vector<uint8_t> opcode_lengths;
+  for (size_t i = 1; i < opcode_base; ++i)
+    opcode_lengths.push_back(cursor.read<uint8_t>());
+
+  // File names are only needed when rows are being kept
+  if (files && version >= 5) {
+    const auto read_entries = [&](const auto &on_entry) {
+      std::vector<std::pair<uint64_t, uint64_t>> format;
+      const auto format_count = cursor.read<uint8_t>();
+      for (size_t i = 0; i < format_count; ++i) {
+        const auto type = cursor.read_uleb128();
+        format.emplace_back(type, cursor.read_uleb128());
+      }
+
+      const auto count = cursor.read_uleb128();
+      for (size_t i = 0; i < count; ++i) {
+        std::string path;
+        uint64_t dir = 0;
+        for (const auto &[type, form] : format) {
+          std::string str;
+          uint64_t value = 0;
+          switch (form) {
+            case DW_FORM_string: str = cursor.read_string(); break;
+            case DW_FORM_line_strp:
+              str = read_string_table(_debug_line_str, _debug_line_str_size,
+                  cursor.read_sized(offset_size));
+              break;
+            case DW_FORM_strp:
+              str = read_string_table(_debug_str, _debug_str_size,
+                  cursor.read_sized(offset_size));
+              break;
+            case DW_FORM_udata: value = cursor.read_uleb128(); break;
+            case DW_FORM_sdata: value = cursor.read_sleb128(); break;
+            case DW_FORM_data1: value = cursor.read<uint8_t>(); break;
+            case DW_FORM_data2: value = cursor.read<uint16_t>(); break;
+            case DW_FORM_data4: value = cursor.read<uint32_t>(); break;
+            case DW_FORM_data8: value = cursor.read<uint64_t>(); break;
+            case DW_FORM_data16: cursor.skip(16); break;
+            case DW_FORM_block: cursor.skip(cursor.read_uleb128()); break;
+            case DW_FORM_block1: cursor.skip(cursor.read<uint8_t>()); break;
+            case DW_FORM_block2: cursor.skip(cursor.read<uint16_t>()); break;
+            case DW_FORM_block4: cursor.skip(cursor.read<uint32_t>()); break;
+            default:
+              throw LineTableException("Unsupported form in line table header");
+          }
+          if (type == DW_LNCT_path)
+            path = std::move(str);
+          else if (type == DW_LNCT_directory_index)
+            dir = value;
+        }
+        on_entry(std::move(path), dir);
+      }
+    };
+
+    std::vector<std::string> dirs;
+    read_entries([&](std::string path, uint64_t) {
+      dirs.push_back(std::move(path));
+    });
+    read_entries([&](std::string path, uint64_t dir) {
+      files->push_back(join_path(dir < dirs.size() ? dirs[dir] : "", path));
+    });
+  } else if (files) {
+    // Directory 0 and file 0 are implicit before DWARF 5
+    std::vector<std::string> dirs{""};
+    for (auto dir = cursor.read_string(); !dir.empty(); dir = cursor.read_string())
+      dirs.push_back(std::move(dir));
+
+    files->emplace_back();
+    for (auto name = cursor.read_string(); !name.empty(); name = cursor.read_string()) {
+      const auto dir = cursor.read_uleb128();
+      cursor.read_uleb128(); // mtime
+      cursor.read_uleb128(); // length
+      files->push_back(join_path(dir < dirs.size() ? dirs[dir] : "", name));
+    }
+  }
+
+  cursor.seek(program_offset);
+
+  const Row initial{0, 1, 1, false};
+  Row row = initial;
+  bool is_stmt = default_is_stmt;
+
+  const auto emit = [&]() {
+    if (is_stmt || row.end_sequence)
+      on_row(row);
+  };
+
+  while (cursor.offset() < unit_end) {
+    const auto opcode = cursor.read<uint8_t>();
+
+    if (opcode >= opcode_base) {
+      const auto adjusted = opcode - opcode_base;
+      row.address += (adjusted / line_range) * min_instruction_length;
+      row.line += line_base + (adjusted % line_range);
+      emit();
+      continue;
+    }
+
+    switch (opcode) {
+      case 0: {
+        const auto length = cursor.read_uleb128();
+        const auto next = cursor.offset() + length;
+        if (!length || next > unit_end)
+          throw LineTableException("Truncated extended opcode");
+
+        switch (cursor.read<uint8_t>()) {
+          case DW_LNE_end_sequence:
+            row.end_sequence = true;
+            emit();
+            row = initial;
+            is_stmt = default_is_stmt;
+            break;
+          case DW_LNE_set_address:
+            row.address = cursor.read_sized(std::min<size_t>(length - 1, address_size));
+            break;
+          case DW_LNE_define_file: {
+            auto name = cursor.read_string();
+            cursor.read_uleb128(); // directory
+            cursor.read_uleb128(); // mtime
+            cursor.read_uleb128(); // length
+            if (files)
+              files->push_back(std::move(name));
+            break;
+          }
+          case DW_LNE_set_discriminator:
+          default:
+            break;
+        }
+        cursor.seek(next);
+        break;
+      }
+      case DW_LNS_copy:
+        emit();
+        break;
+      case DW_LNS_advance_pc:
+        row.address += cursor.read_uleb128() * min_instruction_length;
+        break;
+      case DW_LNS_advance_line:
+        row.line += cursor.read_sleb128();
+        break;
+      case DW_LNS_set_file:
+        row.file = cursor.read_uleb128();
+        break;
+      case DW_LNS_negate_stmt:
+        is_stmt = !is_stmt;
+        break;
+      case DW_LNS_const_add_pc:
+        row.address += ((255 - opcode_base) / line_range) * min_instruction_length;
+        break;
+      case DW_LNS_fixed_advance_pc:
+        row.address += cursor.read<uint16_t>();
+        break;
+      case DW_LNS_set_column:
+      case DW_LNS_set_basic_block:
+      case DW_LNS_set_prologue_end:
+      case DW_LNS_set_epilogue_begin:
+      case DW_LNS_set_isa:
+      default:
+        // Unknown standard opcodes declare how many ULEB operands to skip
+        for (size_t i = 0; i < opcode_lengths[opcode - 1]; ++i)
+          cursor.read_uleb128();
+        break;
+    }
+  }
+}
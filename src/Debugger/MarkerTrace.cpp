@@ -0,0 +1,46 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <Debugger/MarkerTrace.hpp>
+
+using xd::dbg::Marker;
+using xd::dbg::MarkerTrace;
+
+MarkerTrace::MarkerTrace(size_t capacity)
+  : _ring(capacity), _num_recorded(0)
+{
+}
+
+void MarkerTrace::record(const Marker &marker) {
+  _ring[_num_recorded % _ring.size()] = marker;
+  ++_num_recorded;
+}
+
+std::vector<Marker> MarkerTrace::get_markers() const {
+  std::vector<Marker> markers;
+  markers.reserve(get_num_markers());
+
+  const auto first = _num_recorded - get_num_markers();
+  for (auto i = first; i < _num_recorded; ++i)
+    markers.push_back(_ring[i % _ring.size()]);
+
+  return markers;
+}
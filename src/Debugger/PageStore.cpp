@@ -0,0 +1,74 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <cstring>
+
+#include <Debugger/PageStore.hpp>
+
+using xd::dbg::PageStore;
+
+uint64_t PageStore::hash(const void *data) {
+  // FNV-1a over 64-bit words; collisions are resolved by a full compare
+  const auto words = (const uint64_t*)data;
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < XC_PAGE_SIZE / sizeof(uint64_t); ++i) {
+    h ^= words[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+PageStore::PageStore()
+  : _pages(std::make_shared<Index>())
+{
+}
+
+PageStore::Page PageStore::intern(const void *data) {
+  const auto h = hash(data);
+
+  const auto [begin, end] = _pages->equal_range(h);
+  for (auto it = begin; it != end; ++it) {
+    const auto page = it->second.lock();
+    if (page && !std::memcmp(page->data(), data, XC_PAGE_SIZE))
+      return page;
+  }
+
+  // Only the page that was just released can have expired, as every other
+  // page's entry was erased when it was
+  const auto erase = [pages = std::weak_ptr<Index>(_pages), h](const PageData *page) {
+    if (const auto index = pages.lock()) {
+      const auto [begin, end] = index->equal_range(h);
+      for (auto it = begin; it != end; ++it) {
+        if (it->second.expired()) {
+          index->erase(it);
+          break;
+        }
+      }
+    }
+    delete page;
+  };
+
+  const auto page = std::shared_ptr<PageData>(new PageData, erase);
+  std::memcpy(page->data(), data, XC_PAGE_SIZE);
+  _pages->emplace(h, page);
+
+  return page;
+}
@@ -0,0 +1,159 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <iomanip>
+#include <sstream>
+
+#include <spdlog/spdlog.h>
+
+#include <Globals.hpp>
+#include <Debugger/Sampler.hpp>
+#include <Registers/RegistersX86Any.hpp>
+#include <Xen/PageCache.hpp>
+#include <Xen/XenException.hpp>
+
+#define SAMPLER_MAX_FRAME_SIZE 0x100000
+
+using xd::dbg::Sampler;
+using xd::xen::Address;
+using xd::xen::PageCache;
+using xd::xen::XenException;
+
+Sampler::Sampler(uvw::Loop &loop, const xen::Domain &domain,
+    size_t frequency, size_t max_depth)
+  : _domain(domain), _timer(loop.resource<uvw::TimerHandle>()),
+    _frequency(std::max<size_t>(frequency, 1)), _max_depth(max_depth),
+    _max_vcpu_id(0), _word_size(0),
+    _num_samples(0), _total_pause_time(0), _max_pause_time(0)
+{
+}
+
+Sampler::~Sampler() {
+  _timer->stop();
+  _timer->close();
+}
+
+void Sampler::start() {
+  const auto interval = uvw::TimerHandle::Time(std::max<size_t>(1000 / _frequency, 1));
+
+  _max_vcpu_id = _domain.get_dominfo().max_vcpu_id;
+  _word_size = _domain.get_word_size();
+
+  _timer->on<uvw::TimerEvent>([this](const auto&, auto&) {
+    try {
+      take_sample();
+    } catch (const XenException &e) {
+      spdlog::get(LOGNAME_ERROR)->warn("Dropped sample: {0}", e.what());
+    }
+  });
+  _timer->start(interval, interval);
+}
+
+void Sampler::stop() {
+  _timer->stop();
+}
+
+void Sampler::take_sample() {
+  const auto pause = _max_depth > 0;
+
+  struct VCPUSample {
+    uint64_t cr3;
+    Stack stack;
+  };
+  std::vector<VCPUSample> samples;
+
+  const auto begin = std::chrono::steady_clock::now();
+  if (pause)
+    _domain.pause();
+
+  try {
+    for (xen::VCPU_ID vcpu_id = 0; vcpu_id <= _max_vcpu_id; ++vcpu_id) {
+      const auto regs = _domain.get_cpu_context(vcpu_id);
+      const auto ip = reg::read_register<reg::x86_32::eip, reg::x86_64::rip>(regs);
+      const auto fp = reg::read_register<reg::x86_32::ebp, reg::x86_64::rbp>(regs);
+      const auto cr3 = reg::read_register<reg::x86::cr3, reg::x86::cr3>(regs);
+
+      samples.push_back(VCPUSample{cr3, pause
+          ? unwind(_domain.get_paging_mode(regs), ip, fp, _word_size)
+          : Stack{ip}});
+    }
+  } catch (...) {
+    if (pause)
+      _domain.unpause();
+    throw;
+  }
+
+  if (pause)
+    _domain.unpause();
+  const auto elapsed = std::chrono::duration_cast<Duration>(
+      std::chrono::steady_clock::now() - begin);
+
+  for (auto &sample : samples)
+    ++_stacks[StackKey{sample.cr3, std::move(sample.stack)}];
+
+  ++_num_samples;
+  _total_pause_time += elapsed;
+  _max_pause_time = std::max(_max_pause_time, elapsed);
+}
+
+void Sampler::write_folded(std::ostream &out, const SymbolizeFn &symbolize) const {
+  std::unordered_map<Address, std::string> names;
+  const auto name_of = [&](Address address) -> const std::string& {
+    auto it = names.find(address);
+    if (it == names.end())
+      it = names.emplace(address, symbolize(address)).first;
+    return it->second;
+  };
+
+  for (const auto &[key, count] : _stacks) {
+    std::stringstream ss;
+    ss << "cr3_" << std::hex << key.cr3;
+    for (auto it = key.stack.rbegin(); it != key.stack.rend(); ++it)
+      ss << ";" << name_of(*it);
+    out << ss.str() << " " << std::dec << count << std::endl;
+  }
+}
+
+Sampler::Stack Sampler::unwind(const xen::PagingMode &paging_mode, Address ip, Address fp,
+    size_t word_size) const
+{
+  PageCache pages(_domain, paging_mode);
+  Stack stack{ip};
+
+  while (stack.size() <= _max_depth && fp) {
+    uint64_t next_fp, return_address;
+    if (!pages.read_word(fp, word_size, next_fp) ||
+        !pages.read_word(fp + word_size, word_size, return_address) ||
+        !return_address)
+    {
+      break;
+    }
+
+    stack.push_back(return_address);
+
+    // Callers' frames are strictly higher on the stack
+    if (next_fp <= fp || next_fp - fp > SAMPLER_MAX_FRAME_SIZE)
+      break;
+    fp = next_fp;
+  }
+
+  return stack;
+}
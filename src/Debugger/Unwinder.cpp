@@ -0,0 +1,167 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <Debugger/Unwinder.hpp>
+#include <Registers/RegistersX86Any.hpp>
+#include <Util/overloaded.hpp>
+
+using xd::dbg::StackFrame;
+using xd::dbg::Unwinder;
+using xd::xen::PageCache;
+
+// DWARF register numbers
+#define DWARF_X86_64_RSP 7
+#define DWARF_X86_64_RBP 6
+#define DWARF_X86_64_RIP 16
+#define DWARF_I386_ESP 4
+#define DWARF_I386_EBP 5
+#define DWARF_I386_EIP 8
+
+std::vector<StackFrame> Unwinder::backtrace(xen::VCPU_ID vcpu_id, size_t max_frames) const {
+  Registers regs{};
+  Layout layout;
+
+  const auto context = _domain.get_cpu_context(vcpu_id);
+  std::visit(util::overloaded {
+    [&](const reg::x86_64::RegistersX86_64 &ctx) {
+      using namespace reg::x86_64;
+      regs.values = {
+        ctx.get<rax>(), ctx.get<rdx>(), ctx.get<rcx>(), ctx.get<rbx>(),
+        ctx.get<rsi>(), ctx.get<rdi>(), ctx.get<rbp>(), ctx.get<rsp>(),
+        ctx.get<r8>(),  ctx.get<r9>(),  ctx.get<r10>(), ctx.get<r11>(),
+        ctx.get<r12>(), ctx.get<r13>(), ctx.get<r14>(), ctx.get<r15>(),
+        ctx.get<rip>(),
+      };
+      regs.valid.set();
+      layout = Layout{sizeof(uint64_t), DWARF_X86_64_RSP, DWARF_X86_64_RBP, DWARF_X86_64_RIP};
+    },
+    [&](const reg::x86_32::RegistersX86_32 &ctx) {
+      using namespace reg::x86_32;
+      regs.values = {
+        ctx.get<eax>(), ctx.get<ecx>(), ctx.get<edx>(), ctx.get<ebx>(),
+        ctx.get<esp>(), ctx.get<ebp>(), ctx.get<esi>(), ctx.get<edi>(),
+        ctx.get<eip>(),
+      };
+      for (size_t i = 0; i <= DWARF_I386_EIP; ++i)
+        regs.valid.set(i);
+      layout = Layout{sizeof(uint32_t), DWARF_I386_ESP, DWARF_I386_EBP, DWARF_I386_EIP};
+    }
+  }, context);
+
+  // The context just fetched is the only one the whole walk needs
+  PageCache pages(_domain, _domain.get_paging_mode(context));
+  std::vector<StackFrame> frames;
+  frames.push_back(StackFrame{regs.values[layout.pc], regs.values[layout.sp], false});
+
+  while (frames.size() < max_frames) {
+    Registers next;
+    const bool from_cfi = step_cfi(layout, regs, frames.size() > 1, pages, next);
+    if (!from_cfi && !step_frame_pointer(layout, regs, pages, next))
+      break;
+
+    const auto pc = next.values[layout.pc];
+    const auto sp = next.values[layout.sp];
+
+    // Callers' frames are strictly higher on the stack
+    if (!pc || sp <= regs.values[layout.sp])
+      break;
+
+    frames.back().from_cfi = from_cfi;
+    frames.push_back(StackFrame{pc, sp, false});
+    regs = next;
+  }
+
+  return frames;
+}
+
+bool Unwinder::step_cfi(const Layout &layout, const Registers &regs, bool is_caller,
+    PageCache &pages, Registers &next) const
+{
+  // A return address may be just past the end of a noreturn call's
+  // function, so look up the call instruction instead
+  const auto pc = regs.values[layout.pc];
+  const auto row = _cfi.get_row(is_caller ? pc - 1 : pc);
+  if (!row || row->cfa_is_expression ||
+      row->cfa_register >= CFI_NUM_REGISTERS || !regs.valid[row->cfa_register])
+  {
+    return false;
+  }
+
+  const auto cfa = regs.values[row->cfa_register] + row->cfa_offset;
+
+  next.valid.reset();
+  for (size_t i = 0; i < CFI_NUM_REGISTERS; ++i) {
+    const auto &rule = row->registers[i];
+    switch (rule.type) {
+      case CFIRule::Type::SameValue:
+        next.values[i] = regs.values[i];
+        next.valid[i] = regs.valid[i];
+        break;
+      case CFIRule::Type::Offset:
+        next.valid[i] = pages.read_word(cfa + rule.value, layout.word_size, next.values[i]);
+        break;
+      case CFIRule::Type::ValOffset:
+        next.values[i] = cfa + rule.value;
+        next.valid[i] = true;
+        break;
+      case CFIRule::Type::Register:
+        if ((size_t)rule.value < CFI_NUM_REGISTERS) {
+          next.values[i] = regs.values[rule.value];
+          next.valid[i] = regs.valid[rule.value];
+        }
+        break;
+      case CFIRule::Type::Undefined:
+      case CFIRule::Type::Unsupported:
+        break;
+    }
+  }
+
+  const auto ra = row->return_address_register;
+  if (ra >= CFI_NUM_REGISTERS || !next.valid[ra])
+    return false;
+
+  next.values[layout.pc] = next.values[ra];
+  next.valid[layout.pc] = true;
+  next.values[layout.sp] = cfa;
+  next.valid[layout.sp] = true;
+  return true;
+}
+
+bool Unwinder::step_frame_pointer(const Layout &layout, const Registers &regs,
+    PageCache &pages, Registers &next) const
+{
+  if (!regs.valid[layout.fp])
+    return false;
+
+  const auto fp = regs.values[layout.fp];
+  uint64_t next_fp, return_address;
+  if (!pages.read_word(fp, layout.word_size, next_fp) ||
+      !pages.read_word(fp + layout.word_size, layout.word_size, return_address))
+  {
+    return false;
+  }
+
+  next = regs;
+  next.values[layout.fp] = next_fp;
+  next.values[layout.sp] = fp + 2*layout.word_size;
+  next.values[layout.pc] = return_address;
+  return true;
+}
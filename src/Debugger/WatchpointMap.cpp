@@ -0,0 +1,202 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <unordered_set>
+
+#include <spdlog/spdlog.h>
+
+#include <Globals.hpp>
+#include <Debugger/WatchpointMap.hpp>
+
+using xd::dbg::WatchpointMap;
+using xd::dbg::WatchpointType;
+using xd::xen::Address;
+
+void WatchpointMap::insert(Address address, uint32_t bytes, WatchpointType type,
+    xen::VCPU_ID vcpu_id)
+{
+  Watchpoint watchpoint{address, bytes, type, vcpu_id, 0, {}};
+  translate(watchpoint);
+
+  for (const auto &[virtual_page, gfn] : watchpoint.pages)
+    _reverse.emplace(gfn, Mapping{virtual_page, watchpoint.cr3});
+
+  _watchpoints.push_back(std::move(watchpoint));
+
+  for (const auto &[virtual_page, gfn] : _watchpoints.back().pages)
+    apply_access(gfn);
+}
+
+void WatchpointMap::remove(Address address, uint32_t bytes, WatchpointType type) {
+  const auto it = std::find_if(_watchpoints.begin(), _watchpoints.end(),
+    [&](const auto &wp) {
+      return wp.address == address && wp.bytes == bytes && wp.type == type;
+    });
+
+  if (it == _watchpoints.end())
+    return;
+
+  const auto pages = std::move(it->pages);
+  _watchpoints.erase(it);
+  rebuild_reverse();
+
+  for (const auto &[virtual_page, gfn] : pages)
+    apply_access(gfn);
+}
+
+void WatchpointMap::clear() {
+  std::unordered_set<xen_pfn_t> gfns;
+  for (const auto &wp : _watchpoints)
+    for (const auto &[virtual_page, gfn] : wp.pages)
+      gfns.insert(gfn);
+
+  _watchpoints.clear();
+  _reverse.clear();
+
+  for (const auto gfn : gfns)
+    apply_access(gfn);
+}
+
+std::optional<Address> WatchpointMap::find(xen_pfn_t gfn, size_t offset,
+    xen::VCPU_ID vcpu_id)
+{
+  const auto cr3 = _get_paging_mode(vcpu_id).cr3;
+
+  if (const auto address = lookup(gfn, offset, cr3))
+    return address;
+
+  refresh();
+  return lookup(gfn, offset, cr3);
+}
+
+void WatchpointMap::translate(Watchpoint &watchpoint) const {
+  const auto paging_mode = _get_paging_mode(watchpoint.vcpu_id);
+  watchpoint.cr3 = paging_mode.cr3;
+  watchpoint.pages.clear();
+
+  const auto first = watchpoint.address & XC_PAGE_MASK;
+  const auto last = (watchpoint.address + std::max(watchpoint.bytes, 1u) - 1) & XC_PAGE_MASK;
+
+  for (auto virtual_page = first; virtual_page <= last; virtual_page += XC_PAGE_SIZE) {
+    const auto gfn = _domain.translate_foreign_address(virtual_page, paging_mode);
+    if (!gfn) {
+      spdlog::get(LOGNAME_ERROR)->warn(
+          "Watched page {0:x} is not mapped; it will not be watched", virtual_page);
+      continue;
+    }
+    watchpoint.pages.emplace_back(virtual_page, gfn);
+  }
+}
+
+void WatchpointMap::rebuild_reverse() {
+  _reverse.clear();
+  for (const auto &wp : _watchpoints)
+    for (const auto &[virtual_page, gfn] : wp.pages)
+      _reverse.emplace(gfn, Mapping{virtual_page, wp.cr3});
+}
+
+void WatchpointMap::refresh() {
+  std::unordered_set<xen_pfn_t> gfns;
+  for (auto &wp : _watchpoints) {
+    for (const auto &[virtual_page, gfn] : wp.pages)
+      gfns.insert(gfn);
+    translate(wp);
+    for (const auto &[virtual_page, gfn] : wp.pages)
+      gfns.insert(gfn);
+  }
+
+  rebuild_reverse();
+
+  // Restrictions follow the pages: lift them where a watched page used to
+  // be and place them where it is now
+  for (const auto gfn : gfns)
+    apply_access(gfn);
+
+  spdlog::get(LOGNAME_CONSOLE)->debug("Refreshed {0} watchpoint mappings", _reverse.size());
+}
+
+void WatchpointMap::apply_access(xen_pfn_t gfn) const {
+  bool read = true, write = true, execute = true;
+
+  for (const auto &wp : _watchpoints) {
+    const auto covers = std::any_of(wp.pages.begin(), wp.pages.end(),
+      [gfn](const auto &page) { return page.second == gfn; });
+    if (!covers)
+      continue;
+
+    switch (wp.type) {
+      case WatchpointType::Access:
+        read = write = execute = false;
+        break;
+      case WatchpointType::Read:
+        read = false;
+        break;
+      case WatchpointType::Write:
+        write = false;
+        break;
+    }
+  }
+
+  xenmem_access_t access;
+  if (!execute)
+    access = XENMEM_access_n;
+  else if (!read && !write)
+    access = XENMEM_access_x;
+  else if (!read)
+    access = XENMEM_access_wx;
+  else if (!write)
+    access = XENMEM_access_rx;
+  else
+    access = XENMEM_access_rwx;
+
+  _domain.set_mem_access(access, gfn, 1);
+}
+
+std::optional<Address> WatchpointMap::lookup(xen_pfn_t gfn, size_t offset,
+    uint64_t cr3) const
+{
+  const auto [begin, end] = _reverse.equal_range(gfn);
+  if (begin == end)
+    return std::nullopt;
+
+  // Several watched virtual pages may alias this frame. Prefer one in the
+  // stopping vCPU's address space whose watched range contains the access.
+  const auto contains = [this](Address address) {
+    return std::any_of(_watchpoints.begin(), _watchpoints.end(),
+      [address](const auto &wp) {
+        return address >= wp.address && address - wp.address < wp.bytes;
+      });
+  };
+
+  std::optional<Address> best;
+  int best_score = -1;
+  for (auto it = begin; it != end; ++it) {
+    const auto address = it->second.virtual_page + offset;
+    const int score = 2*(it->second.cr3 == cr3) + contains(address);
+    if (score > best_score) {
+      best = address;
+      best_score = score;
+    }
+  }
+
+  return best;
+}
@@ -19,6 +19,7 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <algorithm>
 #include <iostream>
 #include <numeric>
 #include <stdexcept>
@@ -28,18 +29,23 @@
 #include <Globals.hpp>
 #include <GDBServer/GDBConnection.hpp>
 #include <Util/string.hpp>
+#include <Xen/XenStats.hpp>
 
 using xd::gdb::GDBConnection;
 using xd::gdb::GDBPacket;
+using xd::gdb::GDBPacketTiming;
 using xd::gdb::req::GDBRequest;
 using xd::gdb::rsp::GDBResponse;
+using xd::util::string::escape_json;
 using xd::util::string::is_prefix;
+using xd::xen::XenStats;
 
 static char ACK_OK[] = "+";
 static char ACK_ERROR[] = "-";
 
 GDBConnection::GDBConnection(std::shared_ptr<uvw::TcpHandle> tcp)
-  : _tcp(std::move(tcp)), _ack_mode(true), _is_initializing(false), _error_strings(false)
+  : _tcp(std::move(tcp)), _ack_mode(true), _is_initializing(false), _error_strings(false),
+    _trace_domid(0)
 {
 }
 
@@ -75,6 +81,7 @@ void GDBConnection::read(OnReceiveFn on_receive, OnCloseFn on_close,
 
   _tcp->template on<uvw::DataEvent>([](const auto &event, auto &tcp) {
     auto self = tcp.template data<GDBConnection>();
+    const auto received = XenStats::read_clock();
 
     std::vector<char> data(event.data.get(), event.data.get() + event.length);
 
@@ -95,20 +102,7 @@ void GDBConnection::read(OnReceiveFn on_receive, OnCloseFn on_close,
         }
 
         if (valid) {
-          try {
-            spdlog::get(LOGNAME_CONSOLE)->debug("RECV: {0}", raw_packet.to_string());
-            const auto packet = parse_packet(raw_packet);
-            self->_on_receive(*self, packet);
-          } catch (const UnknownPacketTypeException &e) {
-            spdlog::get(LOGNAME_ERROR)->warn(
-              "Got packet of unknown type: \"{0}\"", e.what());
-            self->send(rsp::NotSupportedResponse());
-          } catch (const req::RequestPacketParseException &e) {
-            spdlog::get(LOGNAME_ERROR)->error(
-                "Failed to parse packet ({0}): \"{1}\"",
-                e.what(), raw_packet.get_contents());
-            self->send(rsp::NotSupportedResponse());
-          }
+          self->receive(raw_packet, received);
         } else {
           spdlog::get(LOGNAME_ERROR)->warn(
               "Invalid checksum for packet: \"{0}\"", raw_packet.get_contents());
@@ -120,14 +114,80 @@ void GDBConnection::read(OnReceiveFn on_receive, OnCloseFn on_close,
   _tcp->read();
 }
 
+void GDBConnection::receive(const GDBPacket &raw_packet, uint64_t received) {
+  std::string type = "unknown";
+  if (_packet_stats || _trace)
+    _timing = GDBPacketTiming{received, 0, 0, 0, 0, 0};
+
+  try {
+    spdlog::get(LOGNAME_CONSOLE)->debug("RECV: {0}", raw_packet.to_string());
+    const auto packet = parse_packet(raw_packet, type);
+    if (_timing)
+      _timing->parsed = XenStats::read_clock();
+    _on_receive(*this, packet);
+  } catch (const UnknownPacketTypeException &e) {
+    spdlog::get(LOGNAME_ERROR)->warn(
+      "Got packet of unknown type: \"{0}\"", e.what());
+    send(rsp::NotSupportedResponse());
+  } catch (const req::RequestPacketParseException &e) {
+    spdlog::get(LOGNAME_ERROR)->error(
+        "Failed to parse packet ({0}): \"{1}\"",
+        e.what(), raw_packet.get_contents());
+    send(rsp::NotSupportedResponse());
+  }
+
+  if (_timing)
+    finish_timing(type, raw_packet);
+}
+
+void GDBConnection::finish_timing(const std::string &type, const GDBPacket &raw_packet) {
+  auto &timing = *_timing;
+  timing.handled = XenStats::read_clock();
+
+  // A packet that failed to parse is counted as parsed when it was rejected
+  if (!timing.parsed)
+    timing.parsed = timing.num_sent ? timing.send_begin : timing.handled;
+
+  if (_packet_stats)
+    _packet_stats->record(type, timing);
+
+  if (_trace) {
+    auto contents = raw_packet.get_contents();
+    if (contents.size() > GDB_TRACE_MAX_PACKET_CHARS)
+      contents = contents.substr(0, GDB_TRACE_MAX_PACKET_CHARS) + "...";
+    std::replace_if(contents.begin(), contents.end(),
+        [](unsigned char c) { return c >= 0x80; }, '.');
+
+    _trace->add_span("parse", "gdb", timing.received, timing.parsed);
+    _trace->add_span("handle", "gdb", timing.parsed, timing.handled);
+    _trace->add_span(type, "packet", timing.received, timing.handled,
+        "\"domid\":" + std::to_string(_trace_domid) +
+        ",\"packet\":\"" + escape_json(contents) + "\"");
+  }
+
+  _timing.reset();
+}
+
 void GDBConnection::send(const rsp::GDBResponse &packet)
 {
+  const auto begin = _timing ? XenStats::read_clock() : 0;
+
   const auto raw_packet = GDBPacket(packet.to_string());
   const auto &contents = raw_packet.to_string();
 
   spdlog::get(LOGNAME_CONSOLE)->debug("SEND: {0}", contents);
 
   _tcp->write((char*)contents.c_str(), contents.size());
+
+  // Stop replies sent outside of any packet's handler aren't timed
+  if (_timing) {
+    const auto end = XenStats::read_clock();
+    if (!_timing->num_sent++)
+      _timing->send_begin = begin;
+    _timing->send_ticks += end - begin;
+    if (_trace)
+      _trace->add_span("send", "gdb", begin, end);
+  }
 }
 
 void GDBConnection::send_error(uint8_t code, std::string message) {
@@ -142,7 +202,7 @@ static auto make_parser() {
   return [](const auto &s) { return T(s); };
 }
 
-GDBRequest GDBConnection::parse_packet(const GDBPacket &packet) {
+GDBRequest GDBConnection::parse_packet(const GDBPacket &packet, std::string &type) {
   using namespace xd::gdb::req;
   using ParseRequestFn = std::function<GDBRequest(const std::string&)>;
 
@@ -156,6 +216,8 @@ GDBRequest GDBConnection::parse_packet(const GDBPacket &packet) {
       { "qProcessInfo",             make_parser<QueryProcessInfoRequest>() },
       { "qRegisterInfo",            make_parser<QueryRegisterInfoRequest>() },
       { "qMemoryRegionInfo",        make_parser<QueryMemoryRegionInfoRequest>() },
+      { "qXfer:memory-map:read:",   make_parser<QueryXferMemoryMapReadRequest>() },
+      { "qRcmd",                    make_parser<QueryMonitorCommandRequest>() },
       { "QStartNoAckMode",          make_parser<StartNoAckModeRequest>() },
       { "QThreadSuffixSupported",   make_parser<QueryThreadSuffixSupportedRequest>() },
       { "QListThreadsInStopReply",  make_parser<QueryListThreadsInStopReplySupportedRequest>() },
@@ -174,15 +236,20 @@ GDBRequest GDBConnection::parse_packet(const GDBPacket &packet) {
       { "C",                        make_parser<ContinueSignalRequest>() },
       { "s",                        make_parser<StepRequest>() },
       { "S",                        make_parser<StepSignalRequest>() },
+      { "bc",                       make_parser<ReverseContinueRequest>() },
+      { "bs",                       make_parser<ReverseStepRequest>() },
       { "z",                        make_parser<BreakpointRemoveRequest>() },
       { "Z",                        make_parser<BreakpointInsertRequest>() },
       { "R",                        make_parser<RestartRequest>() },
       { "D",                        make_parser<DetachRequest>() },
   };
 
-  for (const auto &pair : request_parsers)
-    if (packet.starts_with(pair.first))
+  for (const auto &pair : request_parsers) {
+    if (packet.starts_with(pair.first)) {
+      type = pair.first;
       return pair.second(packet.get_contents());
+    }
+  }
 
   throw UnknownPacketTypeException(packet.get_contents());
 }
@@ -0,0 +1,458 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+#include <GDBServer/GDBMonitor.hpp>
+#include <Xen/PageTableWalker.hpp>
+#include <Xen/XenStats.hpp>
+
+using xd::dbg::EventTrace;
+using xd::dbg::EventTraceConfig;
+using xd::dbg::EventTraceException;
+using xd::dbg::GuestRequestMode;
+using xd::dbg::Kallsyms;
+using xd::dbg::KallsymsException;
+using xd::gdb::GDBMonitor;
+using xd::gdb::MonitorCommandException;
+using xd::xen::PageTableEntry;
+using xd::xen::PageTableWalker;
+using xd::xen::XenStats;
+
+#define MONITOR_HEXDUMP_WIDTH 16
+// Keeps both the mapping and the O packet reply bounded
+#define MONITOR_MAX_PHYS_READ XC_PAGE_SIZE
+
+static uint64_t parse_number(const std::string &s) {
+  try {
+    size_t end;
+    const auto n = std::stoull(s, &end, 0);
+    if (end == s.size())
+      return n;
+  } catch (const std::logic_error &) {
+  }
+  throw MonitorCommandException("Invalid number: " + s);
+}
+
+static std::vector<unsigned char> parse_hex_bytes(const std::string &s) {
+  if (s.size() % 2)
+    throw MonitorCommandException("Odd number of hex digits: " + s);
+
+  std::vector<unsigned char> bytes;
+  for (size_t i = 0; i < s.size(); i += 2) {
+    const auto byte = s.substr(i, 2);
+    if (!std::isxdigit((unsigned char)byte[0]) || !std::isxdigit((unsigned char)byte[1]))
+      throw MonitorCommandException("Invalid hex byte: " + byte);
+    bytes.push_back((unsigned char)std::stoul(byte, nullptr, 16));
+  }
+  return bytes;
+}
+
+static std::string describe_pte(const PageTableEntry &pte) {
+  std::string s;
+  const auto add = [&s](bool set, const char *flag) {
+    if (set) {
+      s += " ";
+      s += flag;
+    }
+  };
+
+  add(pte.is_present(), "P");
+  add(pte.is_rw(), "RW");
+  add(pte.is_user(), "US");
+  add(pte.is_pwt(), "PWT");
+  add(pte.is_pcd(), "PCD");
+  add(pte.is_accessed(), "A");
+  add(pte.is_dirty(), "D");
+  add(pte.is_pse(), "PS");
+  add(pte.is_global(), "G");
+  add(pte.is_nx(), "NX");
+  return s;
+}
+
+std::string GDBMonitor::run(const std::string &command) {
+  std::istringstream ss(command);
+  Args args;
+  for (std::string arg; ss >> arg;)
+    args.push_back(arg);
+
+  if (args.empty() || args[0] == "help")
+    return help();
+
+  const auto name = args[0];
+  args.erase(args.begin());
+
+  if (name == "phys")
+    return phys(args);
+  else if (name == "translate")
+    return translate(args);
+  else if (name == "stats")
+    return stats(args);
+  else if (name == "packets")
+    return packets(args);
+  else if (name == "backtrace")
+    return backtrace(args);
+  else if (name == "unwind-info")
+    return unwind_info(args);
+  else if (name == "markers")
+    return markers(args);
+  else if (name == "trace")
+    return trace(args);
+  else if (name == "processes")
+    return processes(args);
+  else if (name == "kallsyms")
+    return kallsyms(args);
+
+  throw MonitorCommandException("Unknown command: " + name);
+}
+
+std::string GDBMonitor::help() const {
+  return
+    "phys read <gfn> <offset> <length>  Read guest-physical memory\n"
+    "phys write <gfn> <offset> <hex>    Write guest-physical memory\n"
+    "translate <vaddr> [vcpu]           Show each level of a page walk\n"
+    "stats [reset]                      Show debugger and this domain's Xen call statistics\n"
+    "packets [reset]                    Show the latency of each packet type\n"
+    "backtrace [vcpu|all]               Unwind the stack of one or all vCPUs\n"
+    "unwind-info <path>                 Load CFI for backtraces from an ELF\n"
+    "markers [clear|record|stop]        List guest-request markers, or set the mode\n"
+    "trace start <classes> <path>       Trace cpuid,msr,cr,desc events to a file\n"
+    "trace stop                         Stop tracing and summarise event rates\n"
+    "processes [on|off]                 List address spaces, or toggle tracking them\n"
+    "kallsyms [load|<vaddr>]            Read kernel symbols from memory, or look one up\n";
+}
+
+std::string GDBMonitor::phys(const Args &args) {
+  if (args.size() != 4 || (args[0] != "read" && args[0] != "write"))
+    throw MonitorCommandException("Usage: phys read <gfn> <offset> <length> "
+                                  "| phys write <gfn> <offset> <hex>");
+
+  const auto gfn = parse_number(args[1]);
+  const auto offset = parse_number(args[2]);
+
+  std::stringstream ss;
+  if (args[0] == "write") {
+    const auto data = parse_hex_bytes(args[3]);
+    _debugger.write_physical_memory(gfn, offset, data);
+    ss << "Wrote " << data.size() << " bytes." << std::endl;
+    return ss.str();
+  }
+
+  const auto length = parse_number(args[3]);
+  if (length > MONITOR_MAX_PHYS_READ)
+    throw MonitorCommandException("Length must be at most " +
+        std::to_string(MONITOR_MAX_PHYS_READ) + " bytes");
+
+  const auto data = _debugger.read_physical_memory(gfn, offset, length);
+  const auto base = (gfn << XC_PAGE_SHIFT) + offset;
+
+  ss << std::hex << std::setfill('0');
+  for (size_t i = 0; i < data.size(); i += MONITOR_HEXDUMP_WIDTH) {
+    ss << std::setw(16) << (base + i) << ":";
+    const auto end = std::min(data.size(), i + MONITOR_HEXDUMP_WIDTH);
+    for (auto j = i; j < end; ++j)
+      ss << " " << std::setw(2) << (unsigned)data[j];
+    ss << std::endl;
+  }
+  return ss.str();
+}
+
+std::string GDBMonitor::translate(const Args &args) {
+  if (args.empty() || args.size() > 2)
+    throw MonitorCommandException("Usage: translate <vaddr> [vcpu]");
+
+  const auto address = parse_number(args[0]);
+  const auto vcpu_id = (args.size() > 1)
+    ? parse_number(args[1])
+    : _debugger.get_vcpu_id();
+
+  const auto walk = PageTableWalker(_debugger.get_domain()).translate(
+      address, _debugger.get_paging_mode(vcpu_id));
+
+  std::stringstream ss;
+  ss << std::hex << std::setfill('0');
+  if (!walk.levels) {
+    ss << "Paging is disabled." << std::endl;
+  } else {
+    ss << "cr3 " << std::setw(16) << walk.cr3
+       << ", " << std::dec << walk.levels << "-level paging" << std::hex << std::endl;
+  }
+
+  for (const auto &step : walk.steps) {
+    ss << "L" << step.level
+       << " [" << std::setw(3) << step.index << "]"
+       << " @ " << std::setw(16) << step.table
+       << ": " << std::setw(16) << step.entry.get_raw()
+       << describe_pte(step.entry) << std::endl;
+  }
+
+  ss << std::setw(16) << address << " -> ";
+  if (walk.physical_address)
+    ss << std::setw(16) << *walk.physical_address << std::endl;
+  else
+    ss << "not mapped" << std::endl;
+
+  return ss.str();
+}
+
+std::string GDBMonitor::stats(const Args &args) const {
+  if (args.size() > 1 || (args.size() == 1 && args[0] != "reset"))
+    throw MonitorCommandException("Usage: stats [reset]");
+
+  std::stringstream ss;
+  ss << "breakpoints: " << _debugger.get_num_breakpoints() << std::endl
+     << "checkpoints: " << _debugger.get_checkpoints().size()
+     << " (" << _debugger.get_num_checkpoint_pages() << " pages)" << std::endl
+     << "cached memory maps: " << _debugger.get_num_memory_maps() << std::endl
+     << "unwind entries: " << _debugger.get_num_unwind_entries() << std::endl
+     << "markers: " << _debugger.get_markers().get_num_markers()
+     << " (" << _debugger.get_markers().get_num_dropped() << " dropped)" << std::endl;
+  if (const auto trace = _debugger.get_trace())
+    ss << "traced events: " << trace->get_num_records() << std::endl;
+  if (const auto tracker = _debugger.get_address_space_tracker()) {
+    ss << "address spaces: " << tracker->get_address_spaces().size()
+       << " (" << tracker->get_num_switches() << " switches)" << std::endl;
+  }
+
+  // Calls not tied to a domain (e.g. xenstore reads) are shared by all
+  // of the server's domains, so they're left out here, and only this
+  // domain's counters are reset
+  const auto domid = _debugger.get_domain().get_domid();
+  ss << std::endl;
+  XenStats::print(ss, XenStats::collect(domid));
+  if (!args.empty())
+    XenStats::reset(domid);
+
+  return ss.str();
+}
+
+std::string GDBMonitor::packets(const Args &args) {
+  if (args.size() > 1 || (args.size() == 1 && args[0] != "reset"))
+    throw MonitorCommandException("Usage: packets [reset]");
+  if (!_packet_stats)
+    throw MonitorCommandException("Packets are not being timed.");
+
+  std::stringstream ss;
+  _packet_stats->print(ss);
+  if (!args.empty())
+    _packet_stats->reset();
+  return ss.str();
+}
+
+std::string GDBMonitor::backtrace(const Args &args) {
+  if (args.size() > 1)
+    throw MonitorCommandException("Usage: backtrace [vcpu|all]");
+
+  const auto all = !args.empty() && args[0] == "all";
+  const auto max_vcpu_id = _debugger.get_domain().get_dominfo().max_vcpu_id;
+  const auto vcpu_id = (args.empty() || all)
+    ? _debugger.get_vcpu_id()
+    : parse_number(args[0]);
+
+  if (vcpu_id > max_vcpu_id)
+    throw MonitorCommandException("No such vCPU: " + std::to_string(vcpu_id));
+
+  const auto first = all ? 0 : vcpu_id;
+  const auto last = all ? max_vcpu_id : vcpu_id;
+
+  std::stringstream ss;
+  for (auto id = first; id <= last; ++id) {
+    const auto begin = std::chrono::steady_clock::now();
+    const auto frames = _debugger.backtrace(id);
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+
+    ss << "vCPU " << std::dec << id << ":" << std::endl;
+    for (size_t i = 0; i < frames.size(); ++i) {
+      ss << "  #" << std::dec << std::left << std::setw(3) << std::setfill(' ') << i
+         << std::right << std::hex << std::setfill('0')
+         << "pc 0x" << std::setw(16) << frames[i].pc
+         << " sp 0x" << std::setw(16) << frames[i].sp
+         << (frames[i].from_cfi ? " (cfi)" : "")
+         << symbolize(frames[i].pc) << std::endl;
+    }
+    ss << std::dec << frames.size() << " frames in " << elapsed << "us" << std::endl;
+  }
+  return ss.str();
+}
+
+std::string GDBMonitor::unwind_info(const Args &args) {
+  if (args.size() != 1)
+    throw MonitorCommandException("Usage: unwind-info <path>");
+
+  try {
+    _debugger.load_unwind_info(args[0]);
+  } catch (const dbg::CFIParseException &e) {
+    throw MonitorCommandException(e.what());
+  }
+
+  return "Loaded " + std::to_string(_debugger.get_num_unwind_entries()) + " CFI entries.\n";
+}
+
+std::string GDBMonitor::markers(const Args &args) {
+  if (args.size() > 1)
+    throw MonitorCommandException("Usage: markers [clear|record|stop]");
+
+  if (!args.empty()) {
+    if (args[0] == "clear") {
+      _debugger.clear_markers();
+      return "Cleared markers.\n";
+    } else if (args[0] != "record" && args[0] != "stop") {
+      throw MonitorCommandException("Unknown marker mode: " + args[0]);
+    }
+
+    try {
+      _debugger.set_guest_request_mode((args[0] == "stop")
+          ? GuestRequestMode::Stop : GuestRequestMode::Marker);
+    } catch (const dbg::FeatureNotSupportedException &) {
+      throw MonitorCommandException("Guest requests are only supported on HVM guests.");
+    }
+    return "Guest requests will " + std::string(args[0] == "stop"
+        ? "stop the guest.\n" : "be recorded as markers.\n");
+  }
+
+  // Timestamps are relative to the oldest marker still held
+  const auto markers = _debugger.get_markers().get_markers();
+  const auto base_ns = markers.empty() ? 0 : markers.front().timestamp_ns;
+
+  std::stringstream ss;
+  for (const auto &marker : markers) {
+    ss << std::dec << std::setfill(' ') << std::setw(12) << (marker.timestamp_ns - base_ns)
+       << "ns vCPU " << marker.vcpu_id
+       << std::hex << std::setfill('0')
+       << " id 0x" << marker.id
+       << " args 0x" << marker.args[0] << " 0x" << marker.args[1]
+       << " pc 0x" << std::setw(16) << marker.rip
+       << " cr3 0x" << std::setw(16) << marker.cr3 << std::endl;
+  }
+  ss << std::dec << markers.size() << " markers, "
+     << _debugger.get_markers().get_num_dropped() << " dropped" << std::endl;
+  return ss.str();
+}
+
+std::string GDBMonitor::trace(const Args &args) {
+  const auto is_start = args.size() == 3 && args[0] == "start";
+  const auto is_stop = args.size() == 1 && args[0] == "stop";
+  if (!is_start && !is_stop)
+    throw MonitorCommandException("Usage: trace start <classes> <path> | trace stop");
+
+  try {
+    if (is_start) {
+      _debugger.start_trace(EventTraceConfig::parse(args[1]), args[2]);
+      return "Tracing to " + args[2] + ".\n";
+    }
+
+    const auto trace = _debugger.stop_trace();
+    const auto elapsed_s = std::chrono::duration<double>(trace->get_duration()).count();
+
+    std::stringstream ss;
+    ss << trace->get_num_records() << " events in " << elapsed_s << "s" << std::endl;
+    for (const auto &[reason, count] : trace->get_counts()) {
+      ss << EventTrace::reason_name(reason) << ": " << count
+         << " (" << (uint64_t)(count / elapsed_s) << "/s)" << std::endl;
+    }
+    return ss.str();
+  } catch (const EventTraceException &e) {
+    throw MonitorCommandException(e.what());
+  } catch (const dbg::FeatureNotSupportedException &) {
+    throw MonitorCommandException("Event tracing is only supported on HVM guests.");
+  }
+}
+
+std::string GDBMonitor::processes(const Args &args) {
+  if (args.size() > 1 || (!args.empty() && args[0] != "on" && args[0] != "off"))
+    throw MonitorCommandException("Usage: processes [on|off]");
+
+  if (!args.empty()) {
+    try {
+      _debugger.set_track_address_spaces(args[0] == "on");
+    } catch (const dbg::FeatureNotSupportedException &) {
+      throw MonitorCommandException("Address space tracking is only supported on HVM guests.");
+    }
+    return std::string("Address space tracking ") + (args[0] == "on" ? "enabled" : "disabled") + ".\n";
+  }
+
+  const auto tracker = _debugger.get_address_space_tracker();
+  if (!tracker)
+    throw MonitorCommandException("Not tracking address spaces; use 'processes on'.");
+
+  const auto &vcpu_modes = tracker->get_vcpu_modes();
+
+  std::stringstream ss;
+  for (const auto &[root, address_space] : tracker->get_address_spaces()) {
+    ss << std::hex << std::setfill('0') << "root 0x" << std::setw(16) << root
+       << std::dec << " switches " << address_space.num_switches;
+    for (size_t id = 0; id < vcpu_modes.size(); ++id) {
+      if (vcpu_modes[id].root == root)
+        ss << " vCPU " << id;
+    }
+    ss << std::endl;
+  }
+  ss << tracker->get_address_spaces().size() << " address spaces, "
+     << tracker->get_num_switches() << " switches" << std::endl;
+  return ss.str();
+}
+
+std::string GDBMonitor::kallsyms(const Args &args) {
+  if (args.size() > 1)
+    throw MonitorCommandException("Usage: kallsyms [load|<vaddr>]");
+
+  if (args.empty() || args[0] == "load") {
+    Kallsyms::Stats stats;
+    try {
+      _debugger.load_kernel_symbols(&stats);
+    } catch (const KallsymsException &e) {
+      throw MonitorCommandException(e.what());
+    }
+
+    std::stringstream ss;
+    ss << "Read " << _debugger.get_kernel_symbols().size() << " symbols from "
+       << stats.num_pages << " pages (read " << stats.read_time.count()
+       << "us, decode " << stats.decode_time.count() << "us)" << std::endl;
+    return ss.str();
+  }
+
+  if (_debugger.get_kernel_symbols().empty())
+    throw MonitorCommandException("No kernel symbols; use 'kallsyms load'.");
+
+  const auto address = parse_number(args[0]);
+  std::stringstream ss;
+  ss << std::hex << std::setfill('0') << std::setw(16) << address;
+  const auto symbol = symbolize(address);
+  ss << (symbol.empty() ? " not found" : symbol) << std::endl;
+  return ss.str();
+}
+
+// " name+0xoffset", or empty if no kernel symbols are loaded or none
+// lies at or below the address
+std::string GDBMonitor::symbolize(xen::Address address) const {
+  const auto symbol = Kallsyms::lookup(_debugger.get_kernel_symbols(), address);
+  if (!symbol)
+    return "";
+
+  std::stringstream ss;
+  ss << " " << symbol->name;
+  if (address != symbol->address)
+    ss << "+0x" << std::hex << (address - symbol->address);
+  return ss.str();
+}
@@ -0,0 +1,95 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <iomanip>
+
+#include <GDBServer/GDBPacketStats.hpp>
+#include <Util/string.hpp>
+#include <Xen/XenStats.hpp>
+
+using xd::gdb::GDBPacketStats;
+using xd::gdb::GDBPacketTiming;
+using xd::gdb::LatencyHistogram;
+using xd::util::string::format_duration_ns;
+using xd::xen::XenStats;
+
+void LatencyHistogram::add(uint64_t ns) {
+  const size_t bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+  ++_buckets[std::min(bucket, _buckets.size() - 1)];
+  ++_count;
+  _total_ns += ns;
+  _max_ns = std::max(_max_ns, ns);
+}
+
+uint64_t LatencyHistogram::get_percentile_ns(double fraction) const {
+  const auto target = (uint64_t)(fraction * (double)_count);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < _buckets.size(); ++i) {
+    seen += _buckets[i];
+    if (seen > target || seen == _count)
+      return std::min(1ULL << i, (unsigned long long)_max_ns);
+  }
+  return _max_ns;
+}
+
+void GDBPacketStats::record(const std::string &type, const GDBPacketTiming &timing) {
+  auto &stats = _types[type];
+  const auto handle_end = timing.num_sent ? timing.send_begin : timing.handled;
+
+  stats.parse.add(XenStats::ticks_to_ns(timing.parsed - timing.received));
+  stats.handle.add(XenStats::ticks_to_ns(handle_end - timing.parsed));
+  if (timing.num_sent)
+    stats.send.add(XenStats::ticks_to_ns(timing.send_ticks));
+  stats.total.add(XenStats::ticks_to_ns(timing.handled - timing.received));
+}
+
+void GDBPacketStats::print(std::ostream &out) const {
+  if (_types.empty()) {
+    out << "No packets received." << std::endl;
+    return;
+  }
+
+  out << std::left << std::setw(24) << "packet"
+      << std::right
+      << std::setw(10) << "count"
+      << std::setw(10) << "parse"
+      << std::setw(10) << "handle"
+      << std::setw(10) << "send"
+      << std::setw(10) << "mean"
+      << std::setw(10) << "p50"
+      << std::setw(10) << "p99"
+      << std::setw(10) << "max" << std::endl;
+
+  // Stage columns are means; the rest are of the total
+  for (const auto &[type, stats] : _types) {
+    out << std::left << std::setw(24) << type
+        << std::right << std::dec
+        << std::setw(10) << stats.total.get_count()
+        << std::setw(10) << format_duration_ns(stats.parse.get_mean_ns())
+        << std::setw(10) << format_duration_ns(stats.handle.get_mean_ns())
+        << std::setw(10) << format_duration_ns(stats.send.get_mean_ns())
+        << std::setw(10) << format_duration_ns(stats.total.get_mean_ns())
+        << std::setw(10) << format_duration_ns(stats.total.get_percentile_ns(0.5))
+        << std::setw(10) << format_duration_ns(stats.total.get_percentile_ns(0.99))
+        << std::setw(10) << format_duration_ns(stats.total.get_max_ns()) << std::endl;
+  }
+}
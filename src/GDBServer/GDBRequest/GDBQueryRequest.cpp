@@ -55,3 +55,23 @@ QueryMemoryRegionInfoRequest::QueryMemoryRegionInfoRequest(const std::string &da
   _address = read_hex_number<uint64_t>();
   expect_end();
 };
+
+QueryMonitorCommandRequest::QueryMonitorCommandRequest(const std::string &data)
+  : GDBRequestBase(data, "qRcmd")
+{
+  expect_char(',');
+  while (has_more())
+    _command.push_back((char)read_byte());
+  expect_end();
+};
+
+QueryXferMemoryMapReadRequest::QueryXferMemoryMapReadRequest(const std::string &data)
+  : GDBRequestBase(data, "qXfer:memory-map:read:")
+{
+  // The annex is always empty for memory-map
+  expect_char(':');
+  _offset = read_hex_number<size_t>();
+  expect_char(',');
+  _length = read_hex_number<size_t>();
+  expect_end();
+};
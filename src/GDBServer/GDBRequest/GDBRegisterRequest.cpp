@@ -19,6 +19,8 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <cstring>
+
 #include <GDBServer/GDBRequest/GDBRegisterRequest.hpp>
 
 using namespace xd::gdb::req;
@@ -51,44 +53,58 @@ RegisterReadRequest::RegisterReadRequest(const std::string &data)
 };
 
 RegisterWriteRequest::RegisterWriteRequest(const std::string &data)
-  : GDBRequestBase(data, 'P')
+  : GDBRequestBase(data, 'P'), _width(0), _value(0)
 {
   _register_id = read_hex_number<uint16_t>();
   expect_char('=');
-  _value = read_hex_number_respecting_endianness<uint64_t>();
-  if (check_char(';')) {
-    expect_string("thread:");
+
+  // In guest byte order, as wide as the register
+  while (has_more() && peek() != ';') {
+    if (_width == MAX_WIDTH)
+      throw RequestPacketParseException("Register value too wide");
+    _bytes[_width++] = read_byte();
+  }
+  memcpy(&_value, _bytes.data(), std::min(_width, sizeof(_value)));
+
+  if (has_more()) {
+    expect_string(";thread:");
     _thread_id = read_hex_number<size_t>();
     expect_char(';');
+  } else {
+    _thread_id = (size_t)-1;
   }
   expect_end();
 };
 
 GeneralRegistersBatchWriteRequest::GeneralRegistersBatchWriteRequest(const std::string &data)
-  : GDBRequestBase(data, 'g')
+  : GDBRequestBase(data, 'G'), _size(0)
 {
-  using Regs64 = xd::reg::x86_64::RegistersX86_64;
-  using Regs32 = xd::reg::x86_32::RegistersX86_32;
+  while (has_more() && peek() != ';') {
+    if (_size == MAX_SIZE)
+      throw RequestPacketParseException("Invalid register packet size");
 
-  size_t index = 0;
-  const auto size = get_num_remaining()/2;
+    if (check_string("xx")) {
+      _specified[_size] = false;
+    } else {
+      _bytes[_size] = read_byte();
+      _specified[_size] = true;
+    }
+    ++_size;
+  }
 
-  if (size == Regs64::size) {
-    Regs64::for_each_metadata([this, &index](const auto md) {
-      const auto word = read_word(md);
-      if (word)
-        _values.push_back(std::make_pair(index, *word));
-      ++index;
-    });
-  } else if (size == Regs32::size) {
-    Regs32::for_each_metadata([this, &index](const auto md) {
-      const auto word = read_word(md);
-      if (word)
-        _values.push_back(std::make_pair(index, *word));
-      ++index;
-    });
+  if (has_more()) {
+    expect_string(";thread:");
+    _thread_id = read_hex_number<size_t>();
+    expect_char(';');
   } else {
-    throw RequestPacketParseException("Invalid register packet size");
+    _thread_id = (size_t)-1;
   }
   expect_end();
 };
+
+void GeneralRegistersBatchWriteRequest::apply(unsigned char *buffer) const {
+  for (size_t i = 0; i < _size; ++i) {
+    if (_specified[i])
+      buffer[i] = _bytes[i];
+  }
+}
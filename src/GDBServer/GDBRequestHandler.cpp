@@ -19,9 +19,14 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <cstring>
+
+#include <GDBServer/GDBMonitor.hpp>
 #include <GDBServer/GDBRequestHandler.hpp>
 
+using xd::gdb::GDBMonitor;
 using xd::gdb::GDBRequestHandler;
+using xd::gdb::MonitorCommandException;
 
 std::vector<size_t> GDBRequestHandler::get_thread_ids() const {
   const auto max_vcpu_id = _debugger.get_domain().get_dominfo().max_vcpu_id;
@@ -31,6 +36,33 @@ std::vector<size_t> GDBRequestHandler::get_thread_ids() const {
   return thread_ids;
 }
 
+const xd::reg::x86::ExtendedRegisterInfo *GDBRequestHandler::find_extended_register(
+    size_t id, size_t *packet_offset) const
+{
+  const auto find = [&](const auto &infos, size_t first_id, size_t offset)
+    -> const reg::x86::ExtendedRegisterInfo*
+  {
+    if (id < first_id || id - first_id >= infos.size())
+      return nullptr;
+
+    const auto index = id - first_id;
+    if (packet_offset) {
+      for (size_t i = 0; i < index; ++i)
+        offset += infos[i].width;
+      *packet_offset = offset;
+    }
+    return &infos[index];
+  };
+
+  if (_debugger.get_domain().get_word_size() == sizeof(uint64_t)) {
+    using Registers = reg::x86_64::RegistersX86_64;
+    return find(reg::x86::EXTENDED_REGISTERS_64, Registers::num_registers, Registers::size);
+  } else {
+    using Registers = reg::x86_32::RegistersX86_32;
+    return find(reg::x86::EXTENDED_REGISTERS_32, Registers::num_registers, Registers::size);
+  }
+}
+
 template <>
 void GDBRequestHandler::operator()(
     const req::InterruptRequest &) const
@@ -63,6 +95,9 @@ void GDBRequestHandler::operator()(
     "QStartNoAckMode+",
     "QThreadSuffixSupported+",
     "QListThreadsInStopReplySupported+",
+    "ReverseContinue+",
+    "ReverseStep+",
+    "qXfer:memory-map:read+",
   }));
 }
 
@@ -102,6 +137,15 @@ void GDBRequestHandler::operator()(
   const auto id = req.get_register_id();
   const auto word_size = _debugger.get_domain().get_word_size();
 
+  size_t offset;
+  if (const auto info = find_extended_register(id, &offset)) {
+    send(rsp::QueryRegisterInfoResponse(info->name, 8*info->width, offset, (size_t)-1,
+          info->is_vector ? "vector" : "uint",
+          info->is_vector ? "vector-uint8" : "hex",
+          info->set));
+    return;
+  }
+
   if (word_size == sizeof(uint64_t)) {
     reg::x86_64::RegistersX86_64::find_metadata_by_id(id,
       [&](const auto &md) {
@@ -130,43 +174,74 @@ void GDBRequestHandler::operator()(
   send(rsp::QueryProcessInfoResponse(1));
 }
 
-// TODO: impl is PV-specific for now
 template <>
 void GDBRequestHandler::operator()(
     const req::QueryMemoryRegionInfoRequest &req) const
 {
-  send(rsp::NotSupportedResponse());
-
-  /*
   const auto address = req.get_address();
+  const auto &map = _debugger.get_memory_map(_debugger.get_vcpu_id());
 
-  auto perms = _debugger.get_domain().get_page_permissions(address);
-  if (perms) {
-
+  const auto region = map.find(address);
+  if (region) {
+    const auto &perms = region->permissions;
     send(rsp::QueryMemoryRegionInfoResponse(
-          address & XC_PAGE_MASK, XC_PAGE_SIZE,
-          perms->read, perms->write, perms->execute));
-
-  } else {
-
-    \* If the current region (page) isn't present, LLDB expects that we
-     * provide a region that represents the space before the next
-     * one that IS present.
-     *\
+          region->start, region->size,
+          perms.read, perms.write, perms.execute));
+    return;
+  }
 
-    const auto MAX_ADDRESS = _debugger.get_domain().get_max_gpfn() << XC_PAGE_SHIFT;
-    auto address_end = address;
+  /*
+   * If the address isn't mapped, LLDB expects that we provide a region
+   * that represents the space before the next one that IS mapped.
+   */
+  const auto next = map.find_next(address);
+  const auto size = next
+    ? next->start - address
+    : std::numeric_limits<xen::Address>::max() - address;
+
+  send(rsp::QueryMemoryRegionInfoResponse(address, size, false, false, false));
+}
 
-    do {
-      address_end += std::min(XC_PAGE_SIZE, MAX_ADDRESS - address);
-      perms = _debugger.get_domain().get_page_permissions(address_end);
-    } while (address_end < MAX_ADDRESS && !perms);
+template <>
+void GDBRequestHandler::operator()(
+    const req::QueryXferMemoryMapReadRequest &req) const
+{
+  const auto &map = _debugger.get_memory_map(_debugger.get_vcpu_id());
+
+  std::stringstream ss;
+  ss << "<?xml version=\"1.0\"?>"
+     << "<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\" "
+     << "\"http://sourceware.org/gdb/gdb-memory-map.dtd\">"
+     << "<memory-map>" << std::hex;
+  for (const auto &[start, region] : map.get_regions())
+    ss << "<memory type=\"ram\" start=\"0x" << start
+       << "\" length=\"0x" << region.size << "\"/>";
+  ss << "</memory-map>";
+
+  const auto xml = ss.str();
+  const auto offset = std::min(req.get_offset(), xml.size());
+  const auto length = std::min(req.get_length(), xml.size() - offset);
+
+  send(rsp::QueryXferResponse(xml.substr(offset, length),
+        offset + length == xml.size()));
+}
 
-    send(rsp::QueryMemoryRegionInfoResponse(
-          address & XC_PAGE_MASK, address_end - address,
-          false, false, false));
+template <>
+void GDBRequestHandler::operator()(
+    const req::QueryMonitorCommandRequest &req) const
+{
+  std::string output;
+  try {
+    output = GDBMonitor(_debugger, _connection.get_packet_stats()).run(req.get_command());
+  } catch (const MonitorCommandException &e) {
+    output = std::string("error: ") + e.what() + "\n";
+  } catch (const xen::XenException &e) {
+    output = std::string("error: ") + e.what() + ": " + std::strerror(e.get_err()) + "\n";
   }
-  */
+
+  // Console output must be followed by a final reply
+  send(rsp::ConsoleOutputResponse(output));
+  send(rsp::OKResponse());
 }
 
 template <>
@@ -199,10 +274,13 @@ void GDBRequestHandler::send_stop_reply(dbg::StopReason reason_any) const {
       switch (reason.type) {
         case dbg::WatchpointType::Access:
           type_str = "awatch";
+          break;
         case dbg::WatchpointType::Read:
           type_str = "rwatch";
+          break;
         case dbg::WatchpointType::Write:
           type_str = "watch";
+          break;
       };
 
       std::stringstream ss;
@@ -247,6 +325,16 @@ void GDBRequestHandler::operator()(
   const auto id = req.get_register_id();
   const auto thread_id = req.get_thread_id();
   const auto vcpu_id = (thread_id == (size_t)-1) ? 0 : thread_id-1;
+
+  if (const auto info = find_extended_register(id)) {
+    const auto &extended = _debugger.get_extended_registers(vcpu_id);
+    if (info->is_ymm && !extended.has_ymm)
+      send_error(0x45, "AVX is not enabled on this vCPU");
+    else
+      send(rsp::RegisterBytesReadResponse(extended.bytes.data() + info->offset, info->width));
+    return;
+  }
+
   const auto regs = _debugger.get_domain().get_cpu_context(vcpu_id);
 
   std::visit(util::overloaded {
@@ -269,6 +357,20 @@ void GDBRequestHandler::operator()(
   const auto thread_id = req.get_thread_id();
   const auto vcpu_id = (thread_id == (size_t)-1) ? 0 : thread_id-1;
 
+  if (const auto info = find_extended_register(id)) {
+    if (info->is_ymm) {
+      send_error(0x45, "AVX registers are read-only");
+    } else if (req.get_width() != info->width) {
+      send_error(0x45, "Expected " + std::to_string(info->width) + " bytes for " + info->name);
+    } else {
+      auto extended = _debugger.get_extended_registers(vcpu_id);
+      memcpy(extended.bytes.data() + info->offset, req.get_bytes(), info->width);
+      _debugger.set_extended_registers(extended, vcpu_id);
+      send(rsp::OKResponse());
+    }
+    return;
+  }
+
   auto regs = _debugger.get_domain().get_cpu_context(vcpu_id);
   std::visit(util::overloaded {
       [&](auto &regs) {
@@ -300,36 +402,31 @@ template <>
 void GDBRequestHandler::operator()(
     const req::GeneralRegistersBatchWriteRequest &req) const
 {
-  auto regs_any = _debugger.get_domain().get_cpu_context(_debugger.get_vcpu_id());
-  auto values = req.get_values();
-
-  std::visit(util::overloaded {
-      [&values](auto &orig_regs) {
-        size_t size = 0;
-        while (!values.empty()) {
-          const auto pair = values.back();
-          values.pop_back();
-
-          // For some reason, if I do [id, value] = values.back(),
-          // 'value' isn't available for the lambda capture below
-          const auto id = pair.first;
-          const auto value = pair.second;
-
-          orig_regs.find_by_id(id, [&](const auto &md, auto &reg) {
-            std::visit(util::overloaded {
-                [&](const auto &value) {
-                  reg = value;
-                  size = md.offset + md.width;
-                }
-            }, value);
-          }, [&]() {
-            throw PacketSizeException(size, orig_regs.size);
-          });
-        }
+  const auto thread_id = req.get_thread_id();
+  const auto vcpu_id = (thread_id == (size_t)-1) ? _debugger.get_vcpu_id() : thread_id-1;
+  auto regs_any = _debugger.get_domain().get_cpu_context(vcpu_id);
+
+  // Registers sent as "xx" keep their current values
+  const auto is_valid_size = std::visit(util::overloaded {
+      [&req](auto &regs) {
+        using Registers = std::decay_t<decltype(regs)>;
+        if (req.get_size() != Registers::size)
+          return false;
+
+        std::array<unsigned char, Registers::size> buffer;
+        regs.serialize(buffer.data());
+        req.apply(buffer.data());
+        regs.deserialize(buffer.data());
+        return true;
       }
   }, regs_any);
 
-  _debugger.get_domain().set_cpu_context(regs_any, _debugger.get_vcpu_id());
+  if (!is_valid_size) {
+    send_error(0x45, "Invalid register packet size " + std::to_string(req.get_size()));
+    return;
+  }
+
+  _debugger.get_domain().set_cpu_context(regs_any, vcpu_id);
 
   send(rsp::OKResponse());
 }
@@ -373,6 +470,35 @@ void GDBRequestHandler::operator()(
   _debugger.single_step();
 }
 
+void GDBRequestHandler::send_reverse_stop_reply(bool in_history) const {
+  if (in_history) {
+    send_stop_reply(_debugger.get_last_stop_reason());
+  } else {
+    const auto vcpu_id = std::visit(util::overloaded {
+      [](const auto &reason) {
+        return reason.vcpu_id;
+      }
+    }, _debugger.get_last_stop_reason());
+
+    send(rsp::StopReasonSignalResponse(SIGTRAP, vcpu_id, get_thread_ids(),
+          "replaylog", "begin"));
+  }
+}
+
+template <>
+void GDBRequestHandler::operator()(
+    const req::ReverseContinueRequest &) const
+{
+  send_reverse_stop_reply(_debugger.reverse_continue());
+}
+
+template <>
+void GDBRequestHandler::operator()(
+    const req::ReverseStepRequest &) const
+{
+  send_reverse_stop_reply(_debugger.reverse_step());
+}
+
 template <>
 void GDBRequestHandler::operator()(
     const req::BreakpointInsertRequest &req) const
@@ -132,9 +132,9 @@ std::string QueryRegisterInfoResponse::to_string() const {
   add_map_entry(ss, "name", _name);
   add_map_entry(ss, "bitsize", _width);
   add_map_entry(ss, "offset", _offset);
-  add_map_entry(ss, "encoding", "uint");
-  add_map_entry(ss, "format", "hex");
-  add_map_entry(ss, "set", "General Purpose Registers");
+  add_map_entry(ss, "encoding", _encoding);
+  add_map_entry(ss, "format", _format);
+  add_map_entry(ss, "set", _set);
   if (_gcc_register_id != (size_t)-1) {
     add_map_entry(ss, "ehframe", _gcc_register_id);
     add_map_entry(ss, "dwarf", _gcc_register_id); // TODO
@@ -19,6 +19,8 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <array>
+
 #include <GDBServer/GDBResponse/GDBRegisterResponse.hpp>
 
 using namespace xd::gdb::rsp;
@@ -30,21 +32,14 @@ std::string RegisterReadResponse::to_string() const {
 };
 
 std::string GeneralRegistersBatchReadResponse::to_string() const {
-  std::stringstream ss;
+  return std::visit(util::overloaded {
+      [](const auto &regs) {
+        using Registers = std::decay_t<decltype(regs)>;
 
-  ss << std::hex << std::setfill('0');
-  std::visit(util::overloaded {
-      [&ss](const xd::reg::x86_64::RegistersX86_64& regs) {
-        regs.for_each([&ss](const auto&, const auto &reg) {
-          write_register(ss, reg);
-        });
-      },
-      [&ss](const xd::reg::x86_32::RegistersX86_32& regs) {
-        regs.for_each([&ss](const auto&, const auto &reg) {
-          write_register(ss, reg);
-        });
-      },
+        // Values are in guest (little-endian) byte order, as for 'p'
+        std::array<unsigned char, Registers::size> buffer;
+        regs.serialize(buffer.data());
+        return hex_encode(buffer.data(), buffer.size());
+      }
   }, _registers);
-
-  return ss.str();
 }
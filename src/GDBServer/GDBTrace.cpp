@@ -0,0 +1,131 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <iomanip>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <GDBServer/GDBTrace.hpp>
+
+using xd::gdb::GDBTrace;
+using xd::gdb::GDBTraceException;
+using xd::xen::DomID;
+using xd::xen::XenOp;
+using xd::xen::XenStats;
+
+GDBTrace *GDBTrace::_instance = nullptr;
+
+GDBTrace::GDBTrace(const std::string &path)
+  : _start(XenStats::read_clock()), _pid(getpid()), _tid(syscall(SYS_gettid)),
+    _is_empty(true)
+{
+  if (_instance)
+    throw GDBTraceException("A trace is already open");
+
+  _file.open(path);
+  if (!_file)
+    throw GDBTraceException("Failed to open " + path);
+
+  _file << "[" << std::endl;
+  _spans.reserve(GDB_TRACE_FLUSH_EVENTS);
+
+  _instance = this;
+  XenStats::set_call_observer(&GDBTrace::on_xen_call);
+}
+
+GDBTrace::~GDBTrace() {
+  close();
+}
+
+void GDBTrace::close() {
+  if (_instance == this) {
+    XenStats::set_call_observer(nullptr);
+    _instance = nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!_file.is_open())
+    return;
+
+  flush_locked();
+  _file << std::endl << "]" << std::endl;
+  _file.close();
+}
+
+void GDBTrace::add_span(std::string name, const char *category,
+    uint64_t begin, uint64_t end, std::string args)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!_file.is_open())
+    return;
+
+  _spans.push_back(Span{std::move(name), category, begin, end, std::move(args)});
+  if (_spans.size() >= GDB_TRACE_FLUSH_EVENTS)
+    flush_locked();
+}
+
+void GDBTrace::flush() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  flush_locked();
+}
+
+void GDBTrace::flush_locked() {
+  const auto to_us = [this](uint64_t ticks) {
+    return (double)XenStats::ticks_to_ns(ticks - _start) / 1e3;
+  };
+
+  _file << std::fixed << std::setprecision(3);
+  for (const auto &span : _spans) {
+    if (!_is_empty)
+      _file << "," << std::endl;
+    _is_empty = false;
+
+    // Spans that started before the trace did are clamped to its start
+    const auto begin = std::max(span.begin, _start);
+    _file << "{\"name\":\"" << span.name << "\""
+          << ",\"cat\":\"" << span.category << "\""
+          << ",\"ph\":\"X\""
+          << ",\"ts\":" << to_us(begin)
+          << ",\"dur\":" << to_us(std::max(span.end, begin)) - to_us(begin)
+          << ",\"pid\":" << _pid
+          << ",\"tid\":" << _tid;
+    if (!span.args.empty())
+      _file << ",\"args\":{" << span.args << "}";
+    _file << "}";
+  }
+  _file.flush();
+  _spans.clear();
+}
+
+void GDBTrace::on_xen_call(XenOp op, DomID domid, uint64_t begin,
+    uint64_t end, bool error)
+{
+  if (!_instance)
+    return;
+
+  std::string args = error ? "\"error\":true" : "";
+  if (domid != XEN_STATS_NO_DOMAIN)
+    args += std::string(args.empty() ? "" : ",") + "\"domid\":" + std::to_string(domid);
+
+  _instance->add_span(xen::get_xen_op_name(op), "xen", begin, end, std::move(args));
+}
@@ -0,0 +1,160 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include <spdlog/spdlog.h>
+
+#include <Globals.hpp>
+
+#include "MetricsServer.hpp"
+
+using xd::MetricsServer;
+
+MetricsServer::MetricsServer(uvw::Loop &loop, WriteMetricsFn write_metrics)
+  : _server(loop.resource<uvw::TcpHandle>()),
+    _lag_timer(loop.resource<uvw::TimerHandle>()),
+    _write_metrics(std::move(write_metrics)),
+    _start(Clock::now()), _next_tick(_start),
+    _lag(Clock::duration::zero()), _max_lag(Clock::duration::zero())
+{
+}
+
+MetricsServer::~MetricsServer() {
+  stop();
+}
+
+void MetricsServer::stop() {
+  if (!_lag_timer->closing())
+    _lag_timer->close();
+  if (!_server->closing())
+    _server->close();
+}
+
+void MetricsServer::listen(const std::string &address, uint16_t port) {
+  _server->once<uvw::ErrorEvent>([address, port](const auto &event, auto &server) {
+    spdlog::get(LOGNAME_ERROR)->error("Metrics server on {0}:{1:d} failed: {2}",
+        address, port, event.what());
+    server.close();
+  });
+
+  _server->on<uvw::ListenEvent>([this](const auto&, auto &server) {
+    auto client = server.loop().template resource<uvw::TcpHandle>();
+    auto request = std::make_shared<std::string>();
+
+    client->template on<uvw::DataEvent>([this, request](const auto &event, auto &client) {
+      request->append(event.data.get(), event.length);
+      if (request->find("\r\n\r\n") != std::string::npos)
+        respond(client, *request);
+      else if (request->size() > METRICS_MAX_REQUEST_SIZE)
+        client.close();
+    });
+    client->template on<uvw::EndEvent>([](const auto&, auto &client) { client.close(); });
+    client->template on<uvw::ErrorEvent>([](const auto&, auto &client) { client.close(); });
+
+    server.accept(*client);
+    client->read();
+  });
+
+  _lag_timer->on<uvw::TimerEvent>([this](const auto&, auto&) {
+    const auto now = Clock::now();
+    _lag = std::max(now - _next_tick, Clock::duration::zero());
+    _max_lag = std::max(_max_lag, _lag);
+    _next_tick = now + METRICS_LAG_INTERVAL;
+  });
+
+  _next_tick = Clock::now() + METRICS_LAG_INTERVAL;
+  _lag_timer->start(uvw::TimerHandle::Time(METRICS_LAG_INTERVAL),
+      uvw::TimerHandle::Time(METRICS_LAG_INTERVAL));
+
+  _server->bind(address, port);
+  _server->listen();
+}
+
+void MetricsServer::respond(uvw::TcpHandle &client, const std::string &request) {
+  client.stop();
+
+  std::stringstream body;
+  std::string status = "200 OK";
+  if (request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET / ", 0) == 0) {
+    write_own_metrics(body);
+    _write_metrics(body);
+  } else {
+    status = "404 Not Found";
+  }
+
+  std::stringstream ss;
+  ss << "HTTP/1.0 " << status << "\r\n"
+     << "Content-Type: text/plain; version=0.0.4\r\n"
+     << "Content-Length: " << body.str().size() << "\r\n"
+     << "Connection: close\r\n\r\n"
+     << body.str();
+
+  const auto response = ss.str();
+  auto data = std::make_unique<char[]>(response.size());
+  std::memcpy(data.get(), response.data(), response.size());
+
+  client.once<uvw::WriteEvent>([](const auto&, auto &client) { client.close(); });
+  client.write(std::move(data), response.size());
+}
+
+void MetricsServer::write_own_metrics(std::ostream &out) {
+  const auto to_seconds = [](Clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+  };
+
+  write_header(out, "xendbg_uptime_seconds", "gauge",
+      "Time since the server started.");
+  out << "xendbg_uptime_seconds " << to_seconds(Clock::now() - _start) << "\n";
+
+  write_header(out, "xendbg_loop_lag_seconds", "gauge",
+      "How late the event loop last ran a periodic timer.");
+  out << "xendbg_loop_lag_seconds " << to_seconds(_lag) << "\n";
+
+  write_header(out, "xendbg_loop_lag_max_seconds", "gauge",
+      "The worst event loop lag since the previous scrape.");
+  out << "xendbg_loop_lag_max_seconds " << to_seconds(_max_lag) << "\n";
+
+  _max_lag = _lag;
+}
+
+void MetricsServer::write_header(std::ostream &out, const std::string &name,
+    const std::string &type, const std::string &help)
+{
+  out << "# HELP " << name << " " << help << "\n"
+      << "# TYPE " << name << " " << type << "\n";
+}
+
+std::string MetricsServer::escape_label(const std::string &value) {
+  std::string escaped;
+  escaped.reserve(value.size());
+  for (const auto c : value) {
+    if (c == '\\' || c == '"')
+      escaped += '\\';
+    if (c == '\n')
+      escaped += "\\n";
+    else
+      escaped += c;
+  }
+  return escaped;
+}
@@ -0,0 +1,76 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_METRICSSERVER_HPP
+#define XENDBG_METRICSSERVER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include <uvw.hpp>
+
+#define METRICS_LAG_INTERVAL std::chrono::milliseconds(100)
+#define METRICS_MAX_REQUEST_SIZE 0x2000
+
+namespace xd {
+
+  // Serves metrics in the Prometheus text format over plain HTTP, from the
+  // event loop. Building a response only reads counters that are already
+  // kept in memory, without calling into Xen, so scrapes don't hold up
+  // the debug sessions sharing the loop. Also measures the loop's own
+  // lag, as how late a periodic timer fires.
+  class MetricsServer {
+  public:
+    using WriteMetricsFn = std::function<void(std::ostream&)>;
+
+    MetricsServer(uvw::Loop &loop, WriteMetricsFn write_metrics);
+    ~MetricsServer();
+
+    void listen(const std::string &address, uint16_t port);
+    void stop();
+
+    // Writes the HELP and TYPE lines that precede a metric's samples
+    static void write_header(std::ostream &out, const std::string &name,
+        const std::string &type, const std::string &help);
+    static std::string escape_label(const std::string &value);
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    std::shared_ptr<uvw::TcpHandle> _server;
+    std::shared_ptr<uvw::TimerHandle> _lag_timer;
+    WriteMetricsFn _write_metrics;
+
+    Clock::time_point _start;
+    Clock::time_point _next_tick;
+    Clock::duration _lag, _max_lag;
+
+    void respond(uvw::TcpHandle &client, const std::string &request);
+    void write_own_metrics(std::ostream &out);
+  };
+
+}
+
+#endif //XENDBG_METRICSSERVER_HPP
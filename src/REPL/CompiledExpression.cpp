@@ -0,0 +1,95 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+
+#include <Util/overloaded.hpp>
+
+#include "CompiledExpression.hpp"
+
+using xd::parser::expr::Constant;
+using xd::parser::expr::Expression;
+using xd::parser::expr::Label;
+using xd::parser::expr::Variable;
+using xd::repl::CompiledExpression;
+using xd::repl::InvalidExpressionException;
+
+using namespace xd::parser::expr::op;
+
+CompiledExpression CompiledExpression::compile(const Expression &expr,
+    const ResolveLabelFn &resolve_label, const ResolveRegisterFn &resolve_register)
+{
+  CompiledExpression compiled;
+  if (compiled.emit(expr, resolve_label, resolve_register) > COMPILED_EXPRESSION_MAX_DEPTH)
+    throw InvalidExpressionException("Expression is too deeply nested.");
+  return compiled;
+}
+
+size_t CompiledExpression::emit(const Expression &expr,
+    const ResolveLabelFn &resolve_label, const ResolveRegisterFn &resolve_register)
+{
+  return expr.visit<size_t>(util::overloaded {
+      [this](const Constant &ex) {
+        _program.push_back(Instruction{Opcode::Constant, ex.value});
+        return (size_t)1;
+      },
+      [this, &resolve_label](const Label &ex) {
+        _program.push_back(Instruction{Opcode::Constant, resolve_label(ex.value)});
+        return (size_t)1;
+      },
+      [this, &resolve_register](const Variable &ex) {
+        if (const auto id = resolve_register(ex.value)) {
+          _program.push_back(Instruction{Opcode::Register, *id});
+          _uses_registers = true;
+        } else {
+          const auto it = std::find(_names.begin(), _names.end(), ex.value);
+          _program.push_back(Instruction{Opcode::Variable, (uint64_t)(it - _names.begin())});
+          if (it == _names.end())
+            _names.push_back(ex.value);
+        }
+        return (size_t)1;
+      },
+      [&](const Expression::UnaryExpressionPtr &ex) {
+        const auto depth = emit(ex->x, resolve_label, resolve_register);
+        _program.push_back(Instruction{std::visit(util::overloaded {
+            [](Dereference) { return Opcode::Dereference; },
+            [](Negate) { return Opcode::Negate; },
+        }, ex->op), 0});
+        return depth;
+      },
+      [&](const Expression::BinaryExpressionPtr &ex) {
+        if (std::holds_alternative<Equals>(ex->op))
+          throw InvalidExpressionException("Use 'set' to modify variables.");
+
+        // y is evaluated with x's result still on the stack
+        const auto x_depth = emit(ex->x, resolve_label, resolve_register);
+        const auto y_depth = emit(ex->y, resolve_label, resolve_register);
+        _program.push_back(Instruction{std::visit(util::overloaded {
+            [](Equals) { return Opcode::Add; }, // unreachable
+            [](Add) { return Opcode::Add; },
+            [](Subtract) { return Opcode::Subtract; },
+            [](Multiply) { return Opcode::Multiply; },
+            [](Divide) { return Opcode::Divide; },
+        }, ex->op), 0});
+        return std::max(x_depth, y_depth + 1);
+      },
+  });
+}
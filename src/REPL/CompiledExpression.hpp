@@ -0,0 +1,144 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_COMPILEDEXPRESSION_HPP
+#define XENDBG_COMPILEDEXPRESSION_HPP
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Parser/Expression/Expression.hpp"
+
+#define COMPILED_EXPRESSION_MAX_DEPTH 64
+
+namespace xd::repl {
+
+  class InvalidExpressionException : public std::runtime_error {
+  public:
+    explicit InvalidExpressionException(const std::string &what)
+        : std::runtime_error(what.c_str()) {};
+  };
+
+  // An expression flattened into a postfix program for a small stack
+  // machine. Labels are resolved to constants and register names to
+  // register IDs when compiling, so evaluating it involves no tree walk
+  // and no name lookups, save for user variables, which may change
+  // between evaluations.
+  class CompiledExpression {
+  public:
+    enum class Opcode : uint8_t {
+      Constant,     // push operand
+      Register,     // push the register with ID operand
+      Variable,     // push the user variable named by get_name(operand)
+      Dereference,  // pop address, push the word there
+      Negate,
+      Add,
+      Subtract,
+      Multiply,
+      Divide,
+    };
+
+    struct Instruction {
+      Opcode opcode;
+      uint64_t operand;
+    };
+
+    using ResolveLabelFn = std::function<uint64_t(const std::string&)>;
+    // The register's ID, or nothing if the name is a user variable
+    using ResolveRegisterFn = std::function<std::optional<size_t>(const std::string&)>;
+
+    static CompiledExpression compile(const parser::expr::Expression &expr,
+        const ResolveLabelFn &resolve_label, const ResolveRegisterFn &resolve_register);
+
+    const std::vector<Instruction> &get_program() const { return _program; };
+    const std::string &get_name(size_t index) const { return _names.at(index); };
+    bool uses_registers() const { return _uses_registers; };
+
+    // get_register(id), get_variable(name) and read_word(address) supply
+    // the leaves; the caller decides how each is fetched and cached
+    template <typename GetRegisterFn, typename GetVariableFn, typename ReadWordFn>
+    uint64_t evaluate(GetRegisterFn get_register, GetVariableFn get_variable,
+        ReadWordFn read_word) const
+    {
+      uint64_t stack[COMPILED_EXPRESSION_MAX_DEPTH];
+      size_t top = 0;
+
+      for (const auto &in : _program) {
+        switch (in.opcode) {
+          case Opcode::Constant:
+            stack[top++] = in.operand;
+            break;
+          case Opcode::Register:
+            stack[top++] = get_register(in.operand);
+            break;
+          case Opcode::Variable:
+            stack[top++] = get_variable(_names[in.operand]);
+            break;
+          case Opcode::Dereference:
+            stack[top-1] = read_word(stack[top-1]);
+            break;
+          case Opcode::Negate:
+            stack[top-1] = -stack[top-1];
+            break;
+          case Opcode::Add:
+            --top;
+            stack[top-1] += stack[top];
+            break;
+          case Opcode::Subtract:
+            --top;
+            stack[top-1] -= stack[top];
+            break;
+          case Opcode::Multiply:
+            --top;
+            stack[top-1] *= stack[top];
+            break;
+          case Opcode::Divide:
+            --top;
+            if (!stack[top])
+              throw InvalidExpressionException("Division by zero.");
+            stack[top-1] /= stack[top];
+            break;
+        }
+      }
+
+      return stack[0];
+    }
+
+  private:
+    CompiledExpression()
+      : _uses_registers(false) {};
+
+    std::vector<Instruction> _program;
+    std::vector<std::string> _names;
+    bool _uses_registers;
+
+    // Returns the stack depth needed to evaluate expr
+    size_t emit(const parser::expr::Expression &expr,
+        const ResolveLabelFn &resolve_label, const ResolveRegisterFn &resolve_register);
+  };
+
+}
+
+#endif //XENDBG_COMPILEDEXPRESSION_HPP
@@ -19,17 +19,25 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <experimental/filesystem>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <stdexcept>
 #include <regex>
+#include <sstream>
+#include <unordered_map>
 
 #include <elfio/elfio.hpp>
 
+#include <Debugger/Sampler.hpp>
 #include <Util/string.hpp>
 #include <Xen/XenException.hpp>
 #include <Xen/Xen.hpp>
+#include <Xen/XenStats.hpp>
 
 #include "DebuggerREPL.hpp"
 #include "Parser/Parser.hpp"
@@ -41,10 +49,27 @@
 #include "Command/Verb.hpp"
 
 #define STEP_PRINT_INSTRS 4
-
+#define NEXT_MAX_STEPS 100000
+#define PROFILE_DEFAULT_FREQUENCY 99
+#define TRACE_DEFAULT_CLASSES "cpuid,msr,cr,desc"
+#define EXAMINE_BUFFER_SIZE 0x100000
+#define THROUGHPUT_MIN_BYTES 0x100000
+
+using xd::dbg::AddressSpace;
+using xd::dbg::AddressSpaceTracker;
 using xd::dbg::Debugger;
 using xd::dbg::DebuggerREPL;
+using xd::dbg::EventTrace;
+using xd::dbg::EventTraceConfig;
+using xd::dbg::EventTraceException;
+using xd::dbg::GuestRequestMode;
 using xd::dbg::InvalidInputException;
+using xd::dbg::Kallsyms;
+using xd::dbg::KallsymsException;
+using xd::dbg::LineTable;
+using xd::dbg::NoReturnAddressException;
+using xd::dbg::Sampler;
+using xd::dbg::SourceLocation;
 using xd::parser::Parser;
 using xd::parser::expr::Constant;
 using xd::parser::expr::Expression;
@@ -58,15 +83,19 @@ using xd::parser::expr::op::Subtract;
 using xd::parser::expr::op::Multiply;
 using xd::parser::expr::op::Divide;
 using xd::repl::NoSuchVariableException;
+using xd::repl::ScriptException;
 using xd::repl::cmd::Argument;
 using xd::repl::cmd::Flag;
 using xd::repl::cmd::make_command;
 using xd::repl::cmd::match::make_match_one_of;
 using xd::repl::cmd::match::match_everything;
 using xd::repl::cmd::match::match_number_unsigned;
+using xd::repl::cmd::match::match_word;
 using xd::repl::cmd::Verb;
+using xd::util::string::escape_json;
 using xd::util::string::next_whitespace;
 using xd::util::string::match_optionally_quoted_string;
+using xd::xen::XenStats;
 
 namespace fs = std::experimental::filesystem;
 
@@ -74,7 +103,7 @@ DebuggerREPL::DebuggerREPL(bool non_stop_mode)
   : _loop(uvw::Loop::getDefault()),
     _signal(_loop->resource<uvw::SignalHandle>()),
     _dwrap(repl::DebuggerWrapper(_loop, non_stop_mode)),
-    _vcpu_id(0)
+    _vcpu_id(0), _interrupted(false)
 {
   setup_repl();
 }
@@ -87,50 +116,125 @@ void DebuggerREPL::stop() {
 
   _loop->run();
   _loop->close();
+}
+
+void DebuggerREPL::run() {
+  repl::REPL::run(_repl, [this](const auto &action) {
+    run_action(action, std::cout);
+  });
 
+  stop();
   std::cout << "Goodbye!" << std::endl;
+  exit(0);
 }
 
-void DebuggerREPL::run() {
-  repl::REPL::run(_repl, [](const auto &action) {
+int DebuggerREPL::run_batch(std::istream &in, bool json) {
+  // The real stdout; commands write to std::cout, which is pointed at a
+  // buffer for each step, and only whole steps are written here, without
+  // flushing between them
+  const auto out_buf = std::cout.rdbuf();
+  std::ostream out(out_buf);
+
+  repl::REPL::Script script;
+  try {
+    script = _repl.parse_script(in);
+  } catch (const ScriptException &e) {
+    if (json)
+      out << "{\"line\":" << e.get_line() << ",\"ok\":false,\"error\":\""
+          << escape_json(e.what()) << "\"}" << std::endl;
+    else
+      std::cerr << e.what() << std::endl;
+    stop();
+    return 1;
+  }
+
+  bool ok = true;
+  std::stringstream output, error;
+  _repl.run_script(script, [&](const repl::ScriptStep &step, size_t iteration) {
+    output.str("");
+    error.str("");
+
+    // 'output' dies with this frame, so std::cout can't be left pointing at it
+    std::cout.rdbuf(output.rdbuf());
     try {
-      action();
-    } catch (const xen::XenException &e) {
-      std::cout << e.what();
-      if (e.get_err())
-        std::cout << " (" << std::strerror(e.get_err()) << ")";
-      std::cout << std::endl;
-    } catch (const InvalidInputException &e) {
-      std::cout << e.what() << std::endl;
-    } catch (const NoSuchDomainException&e) {
-      std::cout << "No such domain: " << e.what() << std::endl;
-    } catch (const parser::except::ParserException &e) {
-      std::cout << "Invalid input! Parse failed at:" << std::endl;
-      std::cout << e.input() << std::endl;
-      std::cout << std::string(e.pos(), ' ') << "^" << std::endl;
-    } catch (const parser::except::ExpectException &e) {
-      std::cout << "Invalid input! Parse failed at:" << std::endl;
-      std::cout << e.input() << std::endl;
-      std::cout << std::string(e.pos(), ' ') << "^" << std::endl;
-    } catch (const NoSuchVariableException &e) {
-      std::cout << "No such variable: " << e.what() << std::endl;
-    } catch (const NotSupportedException &e) {
-      std::cout << "Unsupported feature: " << e.what() << std::endl;
-    } catch (const repl::NoGuestAttachedException &e) {
-      std::cout << "Not attached to a guest! Use 'guest attach <domid/name>'." << std::endl;
-    } catch (const repl::NoSuchBreakpointException &e) {
-      std::cout << "No such breakpoint!" << std::endl;
-    } catch (const repl::NoSuchWatchpointException &e) {
-      std::cout << "No such breakpoint!" << std::endl;
-    } catch (const repl::NoSuchSymbolException &e) {
-      std::cout << "No such symbol!" << std::endl;
-    } catch (const repl::FileLoadException &e) {
-      std::cout << "Failed to load file: " << e.what() << std::endl;
+      ok = run_action(*step.action, error);
+    } catch (...) {
+      std::cout.rdbuf(out_buf);
+      throw;
+    }
+    std::cout.rdbuf(out_buf);
+
+    if (json) {
+      out << "{\"line\":" << step.line
+          << ",\"iteration\":" << iteration
+          << ",\"command\":\"" << escape_json(step.text)
+          << "\",\"ok\":" << (ok ? "true" : "false")
+          << ",\"output\":\"" << escape_json(output.str()) << "\"";
+      if (!ok)
+        out << ",\"error\":\"" << escape_json(error.str()) << "\"";
+      out << "}\n";
+    } else {
+      out << output.str();
+      if (!ok)
+        std::cerr << "Line " << step.line << ": " << error.str();
     }
+
+    // Stop on the first failure, or if anything resuming the guest was interrupted
+    return ok && !_interrupted;
   });
 
+  out.flush();
   stop();
-  exit(0);
+  return ok ? 0 : 1;
+}
+
+bool DebuggerREPL::run_action(const repl::cmd::Action &action, std::ostream &err) {
+  try {
+    action();
+    return true;
+  } catch (const xen::XenException &e) {
+    err << e.what();
+    if (e.get_err())
+      err << " (" << std::strerror(e.get_err()) << ")";
+    err << std::endl;
+  } catch (const InvalidInputException &e) {
+    err << e.what() << std::endl;
+  } catch (const NoSuchDomainException&e) {
+    err << "No such domain: " << e.what() << std::endl;
+  } catch (const parser::except::ParserException &e) {
+    err << "Invalid input! Parse failed at:" << std::endl;
+    err << e.input() << std::endl;
+    err << std::string(e.pos(), ' ') << "^" << std::endl;
+  } catch (const parser::except::ExpectException &e) {
+    err << "Invalid input! Parse failed at:" << std::endl;
+    err << e.input() << std::endl;
+    err << std::string(e.pos(), ' ') << "^" << std::endl;
+  } catch (const NoSuchVariableException &e) {
+    err << "No such variable: " << e.what() << std::endl;
+  } catch (const NotSupportedException &e) {
+    err << "Unsupported feature: " << e.what() << std::endl;
+  } catch (const repl::NoGuestAttachedException &e) {
+    err << "Not attached to a guest! Use 'guest attach <domid/name>'." << std::endl;
+  } catch (const repl::NoSuchBreakpointException &e) {
+    err << "No such breakpoint!" << std::endl;
+  } catch (const repl::NoSuchWatchpointException &e) {
+    err << "No such breakpoint!" << std::endl;
+  } catch (const repl::NoSuchSymbolException &e) {
+    err << "No such symbol!" << std::endl;
+  } catch (const NoSuchCheckpointException &e) {
+    err << "No such checkpoint!" << std::endl;
+  } catch (const repl::FileLoadException &e) {
+    err << "Failed to load file: " << e.what() << std::endl;
+  } catch (const EventTraceException &e) {
+    err << "Trace failed: " << e.what() << std::endl;
+  } catch (const repl::InvalidExpressionException &e) {
+    err << e.what() << std::endl;
+  } catch (const KallsymsException &e) {
+    err << "Failed to read kernel symbols: " << e.what() << std::endl;
+  } catch (const NoReturnAddressException &e) {
+    err << e.what() << "; use 'backtrace' to inspect the stack." << std::endl;
+  }
+  return false;
 }
 
 void DebuggerREPL::setup_repl() {
@@ -157,13 +261,9 @@ void DebuggerREPL::setup_repl() {
       return ret;
 
     if (*(last_ws_pos-1) == '&') {
-      const auto symbol_map = _dwrap.get_symbols();
-      std::vector<std::string> options;
-      std::transform(symbol_map.begin(), symbol_map.end(), std::back_inserter(options),
-        [](const auto &pair) {
-          return std::string("&") + pair.first;
-        });
-      ret = std::move(options);
+      // Only the symbols readline would keep anyway
+      const auto prefix = std::string(last_ws_pos.base() + 1, line.end());
+      ret = complete_symbols(prefix, "&");
     }
     return ret;
   });
@@ -232,16 +332,27 @@ void DebuggerREPL::setup_repl() {
       })));
 
   _repl.add_command(make_command("symbol", "Load symbols.", {
-    Verb("list", "List all symbols.",
-      {}, {},
-      [this](auto &/*flags*/, auto &/*args*/) {
-        return [this]() {
-          const auto &symbols = _dwrap.get_symbols();
-          for (const auto &pair : symbols) {
-            const auto [name, symbol] = pair;
-            std::cout << std::hex << std::showbase << symbol.address
-              << "\t" << name << std::endl;
+    Verb("list", "List all symbols, or those starting with a prefix.",
+      {},
+      {
+        Argument("prefix", "The prefix of the symbols to list.",
+            match_word<std::string::const_iterator>, "",
+            [this](const auto begin, const auto end) {
+              return complete_symbols(std::string(begin, end));
+            }),
+      },
+      [this](auto &/*flags*/, auto &args) {
+        const auto prefix = args.get(0);
+        return [this, prefix]() {
+          const auto symbols = _dwrap.get_symbols();
+          if (!symbols)
+            return;
+          const auto [first, last] = symbols->find_prefix(prefix);
+          for (auto i = first; i < last; ++i) {
+            std::cout << std::hex << std::showbase << symbols->get_address(i)
+              << "\t" << symbols->get_name(i) << "\n";
           }
+          std::cout << std::dec << std::flush;
         };
       }),
 
@@ -278,6 +389,17 @@ void DebuggerREPL::setup_repl() {
         };
       }),
 
+    Verb("kallsyms", "Load kernel symbols from the guest's kallsyms tables.",
+      {}, {},
+      [this](auto &/*flags*/, auto &/*args*/) {
+        return [this]() {
+          const auto stats = _dwrap.load_symbols_from_kallsyms();
+          std::cout << "Read " << _dwrap.get_symbols()->size() << " symbols from "
+            << stats.num_pages << " pages (read " << stats.read_time.count()
+            << "us, decode " << stats.decode_time.count() << "us)" << std::endl;
+        };
+      }),
+
     Verb("clear", "Clear all loaded symbols.",
       {}, {},
       [this](auto &/*flags*/, auto &/*args*/) {
@@ -355,15 +477,7 @@ void DebuggerREPL::setup_repl() {
 
           auto &d = _dwrap.get_domain_or_fail();
           _max_vcpu_id = d.get_dominfo().max_vcpu_id;
-          auto word_size = d.get_word_size();
-
-          const auto mode =
-              (word_size == sizeof(uint64_t)) ? CS_MODE_64 : CS_MODE_32;
-
-          if (cs_open(CS_ARCH_X86, mode, &_capstone) != CS_ERR_OK)
-            throw CapstoneException("Failed to open Capstone handle!");
-
-          cs_option(_capstone, CS_OPT_DETAIL, CS_OPT_ON);
+          _instructions = make_instruction_cache();
 
           std::cout << "Attached to guest " << domid << " (" << xen::Xen::get_name_any(*domain) << ")." << std::endl;
         };
@@ -378,7 +492,7 @@ void DebuggerREPL::setup_repl() {
           const auto name = domain.get_name();
 
           _dwrap.detach();
-          cs_close(&_capstone);
+          _instructions.reset();
 
           std::cout << "Detached from guest " << domid << " (" << name << ")." << std::endl;
         };
@@ -396,9 +510,27 @@ void DebuggerREPL::setup_repl() {
       {}, {},
       [this](auto &/*flags*/, auto &/*args*/) {
         return [this]() {
+          _dwrap.get_debugger_or_fail()->invalidate_memory_maps();
           _dwrap.get_domain_or_fail().unpause();
         };
       }),
+
+    Verb("track", "Follow the guest's address spaces as it writes to CR3.",
+      {},
+      {
+        Argument("on/off", "Whether to track address spaces.",
+            make_match_one_of<std::string::const_iterator,
+              std::vector<std::string>>({"on", "off"})),
+      },
+      [this](auto &/*flags*/, auto &args) {
+        const auto enable = (args.get(0) == "on");
+        return [this, enable]() {
+          if (!_dwrap.is_hvm())
+            throw NotSupportedException("Address space tracking is only supported on HVM guests.");
+
+          _dwrap.get_debugger_or_fail()->set_track_address_spaces(enable);
+        };
+      }),
   }));
 
   _repl.add_command(make_command("info", "Query the state of Xen, the attached guest and its registers.", {
@@ -419,6 +551,57 @@ void DebuggerREPL::setup_repl() {
             print_registers(regs);
           };
         }),
+      Verb("mappings", "Query the current CPU's virtual memory mappings.",
+        {}, {},
+        [this](auto &/*flags*/, auto &/*args*/) {
+          return [this]() {
+            const auto &map = _dwrap.get_debugger_or_fail()->get_memory_map(_vcpu_id);
+            print_memory_map(map);
+          };
+        }),
+      Verb("processes", "Query the address spaces seen since 'guest track on'.",
+        {}, {},
+        [this](auto &/*flags*/, auto &/*args*/) {
+          return [this]() {
+            const auto tracker = _dwrap.get_debugger_or_fail()->get_address_space_tracker();
+            if (!tracker)
+              throw InvalidInputException("Not tracking address spaces; use 'guest track on'.");
+            print_address_spaces(*tracker);
+          };
+        }),
+      Verb("instructions", "Query the decoded instruction cache.",
+        {}, {},
+        [this](auto &/*flags*/, auto &/*args*/) {
+          return [this]() {
+            _dwrap.get_debugger_or_fail();
+            const auto stats = _instructions->get_stats();
+            std::cout << stats.num_decoded << " instructions decoded, "
+              << stats.num_pages << "/" << INSTRUCTION_CACHE_MAX_PAGES << " pages cached" << std::endl
+              << stats.hits << " hits, " << stats.misses << " misses" << std::endl;
+          };
+        }),
+      Verb("lines", "Query the source line index of the loaded symbol file.",
+        {}, {},
+        [this](auto &/*flags*/, auto &/*args*/) {
+          return [this]() {
+            const auto lines = _dwrap.get_line_table();
+            if (!lines)
+              throw InvalidInputException("No line information loaded.");
+            print_line_table_stats(lines->get_stats());
+          };
+        }),
+      Verb("stats", "Query the number and latency of calls into Xen.",
+        {
+          Flag('r', "reset", "Clear the counters after showing them.", {}),
+        }, {},
+        [this](auto &flags, auto &/*args*/) {
+          const auto reset = flags.has('r');
+          return [reset]() {
+            XenStats::print(std::cout, XenStats::collect());
+            if (reset)
+              XenStats::reset();
+          };
+        }),
       Verb("variables", "Query variables.",
         {}, {},
         [this](auto &/*flags*/, auto &/*args*/) {
@@ -489,9 +672,7 @@ void DebuggerREPL::setup_repl() {
 
           const auto expr_str = args.get("expr");
           return [this, expr_str, printer]() {
-            Parser parser;
-            const auto expr = parser.parse(expr_str);
-            const auto result = _dwrap.evaluate_expression(expr);
+            const auto result = _dwrap.evaluate_expression(expr_str);
             printer(std::cout, result);
             std::cout << std::endl;
           };
@@ -539,7 +720,7 @@ void DebuggerREPL::setup_repl() {
             Parser parser;
             const auto expr = parser.parse(expr_str);
             _dwrap.evaluate_set_expression(expr,
-                word_size ? word_size : _dwrap.get_domain_or_fail().get_word_size());
+                word_size ? word_size : _dwrap.get_word_size());
           };
         })));
 
@@ -578,12 +759,8 @@ void DebuggerREPL::setup_repl() {
         const auto len_str = args.get(1);
 
         return [this, address_str, len_str]() {
-          Parser parser;
-          const auto address_expr = parser.parse(address_str);
-          const auto address = _dwrap.evaluate_expression(address_expr);
-
-          const auto len_expr = parser.parse(len_str);
-          const auto len = _dwrap.evaluate_expression(len_expr);
+          const auto address = _dwrap.evaluate_expression(address_str);
+          const auto len = _dwrap.evaluate_expression(len_str);
 
           disassemble(address, len);
         };
@@ -637,17 +814,55 @@ void DebuggerREPL::setup_repl() {
           }
 
           return [this, expr_str, word_size, num_words]() {
-            Parser parser;
-            const auto expr = parser.parse(expr_str);
-            const auto addr = _dwrap.evaluate_expression(expr);
+            const auto addr = _dwrap.evaluate_expression(expr_str);
 
             examine(
                 addr,
-                word_size ? word_size : _dwrap.get_domain_or_fail().get_word_size(),
+                word_size ? word_size : _dwrap.get_word_size(),
                 num_words);
           };
         })));
 
+  _repl.add_command(make_command("dump", "Write guest memory to a file.", {
+    Verb("memory", "Write the raw bytes of a range of memory to a file.",
+      {},
+      {
+        Argument("file", "The file to write.",
+            match_optionally_quoted_string<std::string::const_iterator>),
+        Argument("addr", "The start address.",
+            match_optionally_quoted_string<std::string::const_iterator>),
+        Argument("len", "The number of bytes to write.",
+            match_optionally_quoted_string<std::string::const_iterator>),
+      },
+      [this](auto &/*flags*/, auto &args) {
+        const auto filename = args.get(0);
+        const auto address_str = args.get(1);
+        const auto len_str = args.get(2);
+
+        return [this, filename, address_str, len_str]() {
+          const auto address = _dwrap.evaluate_expression(address_str);
+          const auto len = _dwrap.evaluate_expression(len_str);
+
+          std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+          if (!file)
+            throw InvalidInputException("Failed to write " + filename + ".");
+
+          const auto start = std::chrono::steady_clock::now();
+          _dwrap.read_memory_chunked(address, len,
+            [&file](auto /*address*/, const unsigned char *data, size_t size) {
+              file.write((const char*)data, size);
+            });
+          file.close();
+          if (!file)
+            throw InvalidInputException("Failed to write " + filename + ".");
+
+          std::cout << "Wrote " << len << " bytes to " << filename << "." << std::endl;
+          if (len >= THROUGHPUT_MIN_BYTES)
+            print_throughput(len, std::chrono::steady_clock::now() - start);
+        };
+      }),
+  }));
+
   _repl.add_command(make_command("breakpoint", "Manage breakpoints.", {
     Verb("create", "Create a breakpoint.",
       {},
@@ -659,9 +874,7 @@ void DebuggerREPL::setup_repl() {
         const auto address_str = args.get(0);
 
         return [this, address_str]() {
-          Parser parser;
-          const auto address_expr = parser.parse(address_str);
-          const auto address = _dwrap.evaluate_expression(address_expr);
+          const auto address = _dwrap.evaluate_expression(address_str);
           const auto id = _dwrap.insert_breakpoint(address);
           std::cout << "Created breakpoint #" << id << "." << std::endl;
         };
@@ -686,10 +899,8 @@ void DebuggerREPL::setup_repl() {
           std::cout << std::showbase;
           for (const auto pair : bps) {
             std::cout << std::dec << pair.first << ":\t" << std::hex << pair.second;
-            for (const auto &sym : _dwrap.get_symbols()) {
-              if (sym.second.address == pair.second)
-                std::cout << " (" << sym.first << ")";
-            }
+            if (_dwrap.lookup_address(pair.second))
+              std::cout << " (" << _dwrap.symbolize(pair.second) << ")";
             std::cout << std::endl;
           }
           std::cout << std::dec;
@@ -702,12 +913,12 @@ void DebuggerREPL::setup_repl() {
         {}, {},
         [this](auto &/*flags*/, auto &/*args*/) {
           return [this]() {
-            bool interrupted = false;
+            _interrupted = false;
             _dwrap.get_debugger_or_fail()->on_stop([this](auto /*reason*/) {
               _loop->stop();
             });
-            _signal->once<uvw::SignalEvent>([&interrupted](const auto &event, auto &handle) {
-              interrupted = true;
+            _signal->once<uvw::SignalEvent>([this](const auto &event, auto &handle) {
+              _interrupted = true;
               handle.loop().stop();
             });
             _signal->start(SIGINT);
@@ -731,12 +942,16 @@ void DebuggerREPL::setup_repl() {
                 return addr == ip;
               });
 
-            if (interrupted)
-              std::cout << "Interrupted." << std::endl;
+            if (_interrupted)
+              std::cout << "Interrupted";
             else if (it != bps.end())
-              std::cout << "Hit breakpoint #" << it->first << "." << std::endl;
+              std::cout << "Hit breakpoint #" << it->first;
             else
-              std::cout << "Hit a breakpoint, but no ID is associated with it." << std::endl;
+              std::cout << "Hit a breakpoint, but no ID is associated with it";
+            std::cout << " at " << _dwrap.symbolize(ip);
+            if (const auto line = _dwrap.lookup_line(ip))
+              std::cout << " (" << line->file << ":" << line->line << ")";
+            std::cout << "." << std::endl;
 
             disassemble(ip, X86_MAX_INSTRUCTION_SIZE*STEP_PRINT_INSTRS, STEP_PRINT_INSTRS);
           };
@@ -762,6 +977,302 @@ void DebuggerREPL::setup_repl() {
           };
         })));
 
+  _repl.add_command(make_command(
+      Verb("next", "Step over calls until the source line changes, or over one instruction without line info.",
+        {}, {},
+        [this](auto &/*flags*/, auto &/*args*/) {
+          return [this]() {
+            const auto debugger = _dwrap.get_debugger_or_fail();
+            const auto start = _dwrap.lookup_line(get_instruction_pointer());
+
+            _interrupted = false;
+            debugger->on_stop([this](auto /*reason*/) {
+              _loop->stop();
+            });
+            _signal->once<uvw::SignalEvent>([this](const auto &event, auto &handle) {
+              _interrupted = true;
+              handle.loop().stop();
+            });
+            _signal->start(SIGINT);
+
+            // Each step is waited on here, so the whole line is stepped
+            // without returning to the prompt in between. A call is run
+            // to its return site in one continue rather than stepped into.
+            uint64_t ip;
+            std::optional<SourceLocation> line;
+            size_t num_steps = 0;
+            do {
+              debugger->step_over();
+              _loop->run();
+              ++num_steps;
+              ip = get_instruction_pointer();
+              line = _dwrap.lookup_line(ip);
+            } while (start && !_interrupted && line == start && num_steps < NEXT_MAX_STEPS);
+            _signal->stop();
+
+            if (_interrupted) {
+              debugger->clear_return_breakpoint();
+              std::cout << "Interrupted after " << num_steps << " steps";
+            } else if (start && line == start) {
+              std::cout << "Still on the same line after " << num_steps << " steps";
+            } else {
+              std::cout << num_steps << " steps";
+            }
+            std::cout << " at " << _dwrap.symbolize(ip);
+            if (line)
+              std::cout << " (" << line->file << ":" << line->line << ")";
+            std::cout << "." << std::endl;
+
+            disassemble(ip, X86_MAX_INSTRUCTION_SIZE*STEP_PRINT_INSTRS, STEP_PRINT_INSTRS);
+          };
+        })));
+
+  _repl.add_command(make_command(
+      Verb("finish", "Continue until the current function returns to its caller.",
+        {}, {},
+        [this](auto &/*flags*/, auto &/*args*/) {
+          return [this]() {
+            const auto debugger = _dwrap.get_debugger_or_fail();
+
+            _interrupted = false;
+            debugger->on_stop([this](auto /*reason*/) {
+              _loop->stop();
+            });
+
+            // Throws before resuming if there is no caller to return to
+            const auto return_address = debugger->finish();
+            _signal->once<uvw::SignalEvent>([this](const auto &event, auto &handle) {
+              _interrupted = true;
+              handle.loop().stop();
+            });
+            _signal->start(SIGINT);
+            _loop->run();
+            _signal->stop();
+
+            const auto ip = get_instruction_pointer();
+            if (_interrupted) {
+              debugger->clear_return_breakpoint();
+              std::cout << "Interrupted";
+            } else if (ip == return_address) {
+              std::cout << "Returned";
+            } else {
+              std::cout << "Stopped before returning";
+            }
+            std::cout << " at " << _dwrap.symbolize(ip);
+            if (const auto line = _dwrap.lookup_line(ip))
+              std::cout << " (" << line->file << ":" << line->line << ")";
+            std::cout << "." << std::endl;
+
+            disassemble(ip, X86_MAX_INSTRUCTION_SIZE*STEP_PRINT_INSTRS, STEP_PRINT_INSTRS);
+          };
+        })));
+
+  _repl.add_command(make_command(
+      Verb("backtrace", "Show the call stack of the current vCPU.",
+        {
+          Flag('a', "all", "Show the call stacks of all vCPUs.", {}),
+        },
+        {},
+        [this](auto &flags, auto &/*args*/) {
+          const auto all = flags.has('a');
+          return [this, all]() {
+            const auto debugger = _dwrap.get_debugger_or_fail();
+            const auto first = all ? 0 : _vcpu_id;
+            const auto last = all ? _max_vcpu_id : _vcpu_id;
+
+            for (auto vcpu_id = first; vcpu_id <= last; ++vcpu_id) {
+              const auto begin = std::chrono::steady_clock::now();
+              const auto frames = debugger->backtrace(vcpu_id);
+              const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::steady_clock::now() - begin).count();
+
+              std::cout << "vCPU " << vcpu_id << ":" << std::endl;
+              for (size_t i = 0; i < frames.size(); ++i) {
+                std::cout << "  #" << std::left << std::setw(3) << std::setfill(' ') << i
+                  << std::right << std::hex << std::setfill('0')
+                  << "0x" << std::setw(16) << frames[i].pc << " "
+                  << _dwrap.symbolize(frames[i].pc) << std::dec << std::endl;
+              }
+              std::cout << std::setfill(' ') << frames.size()
+                << " frames in " << elapsed << "us." << std::endl;
+            }
+          };
+        })));
+
+  _repl.add_command(make_command(
+      Verb("profile", "Sample where the guest's vCPUs spend their time.",
+        {
+          Flag('f', "frequency", "Samples per second (default 99).", {
+              Argument("hz", "The sampling frequency.",
+                  match_number_unsigned<std::string::const_iterator>),
+          }),
+          Flag('d', "depth", "Frames to unwind via frame pointers (default 0).", {
+              Argument("depth", "The maximum number of caller frames.",
+                  match_number_unsigned<std::string::const_iterator>),
+          }),
+        },
+        {
+          Argument("seconds", "How long to sample for.",
+              match_number_unsigned<std::string::const_iterator>),
+          Argument("file", "The file to which to write folded stacks.",
+              match_everything<std::string::const_iterator>),
+        },
+        [this](auto &flags, auto &args) {
+          const auto seconds = std::stoul(args.get(0));
+          const auto filename = std::regex_replace(args.get(1), std::regex(" +$"), "");
+
+          size_t frequency = PROFILE_DEFAULT_FREQUENCY;
+          const auto frequency_flag = flags.get('f');
+          if (frequency_flag)
+            frequency = std::stoul(frequency_flag.value().get(0));
+
+          size_t depth = 0;
+          const auto depth_flag = flags.get('d');
+          if (depth_flag)
+            depth = std::stoul(depth_flag.value().get(0));
+
+          return [this, seconds, filename, frequency, depth]() {
+            const auto debugger = _dwrap.get_debugger_or_fail();
+            const auto &domain = debugger->get_domain();
+
+            std::ofstream out(filename);
+            if (!out)
+              throw InvalidInputException("Failed to open " + filename);
+
+            Sampler sampler(*_loop, domain, frequency, depth);
+
+            auto timer = _loop->resource<uvw::TimerHandle>();
+            timer->once<uvw::TimerEvent>([](const auto &/*event*/, auto &handle) {
+              handle.loop().stop();
+            });
+            _interrupted = false;
+            _signal->once<uvw::SignalEvent>([this](const auto &/*event*/, auto &handle) {
+              _interrupted = true;
+              handle.loop().stop();
+            });
+            _signal->start(SIGINT);
+            debugger->on_stop([this](auto /*reason*/) {
+              _loop->stop();
+            });
+
+            std::cout << "Sampling for " << seconds << "s at " << frequency
+              << " Hz, CTRL-C to stop early..." << std::endl;
+
+            debugger->resume();
+            sampler.start();
+            timer->start(uvw::TimerHandle::Time(1000 * seconds), uvw::TimerHandle::Time(0));
+            _loop->run();
+            sampler.stop();
+            debugger->pause();
+
+            timer->stop();
+            timer->close();
+            _signal->stop();
+
+            sampler.write_folded(out, [this](auto address) {
+              return _dwrap.symbolize(address);
+            });
+
+            const auto num_samples = sampler.get_num_samples();
+            const auto total_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                sampler.get_total_pause_time()).count();
+            const auto max_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                sampler.get_max_pause_time()).count();
+
+            std::cout << "Wrote " << num_samples << " samples to " << filename << "." << std::endl;
+            if (num_samples) {
+              std::cout << (depth ? "Pause" : "Read") << " time per sample: "
+                << (total_us / num_samples) << "us mean, "
+                << max_us << "us max." << std::endl;
+            }
+          };
+        })));
+
+  _repl.add_command(make_command(
+      Verb("trace", "Record hypervisor events while the guest runs.",
+        {
+          Flag('e', "events", "Comma-separated event classes: cpuid, msr, cr, desc (default all).", {
+              Argument("classes", "The event classes to trace.",
+                  match_word<std::string::const_iterator>),
+          }),
+          Flag('m', "msr", "Trace writes to only this MSR.", {
+              Argument("msr", "The MSR index.",
+                  match_number_unsigned<std::string::const_iterator>),
+          }),
+        },
+        {
+          Argument("seconds", "How long to trace for.",
+              match_number_unsigned<std::string::const_iterator>),
+          Argument("file", "The file to which to write the binary trace.",
+              match_everything<std::string::const_iterator>),
+        },
+        [this](auto &flags, auto &args) {
+          const auto seconds = std::stoul(args.get(0));
+          const auto filename = std::regex_replace(args.get(1), std::regex(" +$"), "");
+
+          std::string classes = TRACE_DEFAULT_CLASSES;
+          const auto events_flag = flags.get('e');
+          if (events_flag)
+            classes = events_flag.value().get(0);
+
+          std::optional<uint32_t> msr;
+          const auto msr_flag = flags.get('m');
+          if (msr_flag)
+            msr = std::stoul(msr_flag.value().get(0), nullptr, 0);
+
+          return [this, seconds, filename, classes, msr]() {
+            if (!_dwrap.is_hvm())
+              throw NotSupportedException("Event tracing is only supported on HVM guests.");
+
+            const auto debugger = _dwrap.get_debugger_or_fail();
+
+            EventTraceConfig config;
+            try {
+              config = EventTraceConfig::parse(classes);
+            } catch (const EventTraceException &e) {
+              throw InvalidInputException(e.what());
+            }
+            if (msr)
+              config.msrs = { *msr };
+
+            debugger->start_trace(config, filename);
+
+            auto timer = _loop->resource<uvw::TimerHandle>();
+            timer->once<uvw::TimerEvent>([](const auto &/*event*/, auto &handle) {
+              handle.loop().stop();
+            });
+            _interrupted = false;
+            _signal->once<uvw::SignalEvent>([this](const auto &/*event*/, auto &handle) {
+              _interrupted = true;
+              handle.loop().stop();
+            });
+            _signal->start(SIGINT);
+            debugger->on_stop([this](auto /*reason*/) {
+              _loop->stop();
+            });
+
+            std::cout << "Tracing for " << seconds << "s, CTRL-C to stop early..." << std::endl;
+
+            debugger->resume();
+            timer->start(uvw::TimerHandle::Time(1000 * seconds), uvw::TimerHandle::Time(0));
+            _loop->run();
+            debugger->pause();
+            const auto trace = debugger->stop_trace();
+
+            timer->stop();
+            timer->close();
+            _signal->stop();
+
+            const auto elapsed_s = std::chrono::duration<double>(trace->get_duration()).count();
+            std::cout << "Wrote " << trace->get_num_records() << " events to "
+              << filename << " in " << elapsed_s << "s." << std::endl;
+            for (const auto &[reason, count] : trace->get_counts()) {
+              std::cout << EventTrace::reason_name(reason) << ":\t" << count
+                << " (" << (uint64_t)(count / elapsed_s) << "/s)" << std::endl;
+            }
+          };
+        })));
+
   _repl.add_command(make_command("watchpoint", "Manage watchpoints.", {
     Verb("create", "Create a watchpoint.",
       {},
@@ -783,12 +1294,8 @@ void DebuggerREPL::setup_repl() {
           if (!_dwrap.is_hvm())
             throw NotSupportedException("Watchpoints are only supported on HVM guests.");
 
-          Parser parser;
-          const auto address_expr = parser.parse(address_str);
-          const auto address = _dwrap.evaluate_expression(address_expr);
-
-          const auto len_expr = parser.parse(len_str);
-          const auto len = _dwrap.evaluate_expression(len_expr);
+          const auto address = _dwrap.evaluate_expression(address_str);
+          const auto len = _dwrap.evaluate_expression(len_str);
 
           if (type_str.size() != 1)
             throw InvalidInputException("Type must be one of: r, w, a");
@@ -861,6 +1368,163 @@ void DebuggerREPL::setup_repl() {
       }),
     }));
 
+  _repl.add_command(make_command("checkpoint", "Manage checkpoints of the guest's state.", {
+    Verb("create", "Save the current registers and memory.",
+      {}, {},
+      [this](auto &/*flags*/, auto &/*args*/) {
+        return [this]() {
+          if (!_dwrap.is_hvm())
+            throw NotSupportedException("Checkpoints are only supported on HVM guests.");
+
+          const auto &checkpoint = _dwrap.get_debugger_or_fail()->create_checkpoint();
+          std::cout << "Created checkpoint #" << checkpoint.id << " ("
+            << checkpoint.pages.size() << " pages)." << std::endl;
+        };
+      }),
+    Verb("list", "List checkpoints.",
+      {}, {},
+      [this](auto &/*flags*/, auto &/*args*/) {
+        return [this]() {
+          const auto debugger = _dwrap.get_debugger_or_fail();
+          const auto current = debugger->get_current_checkpoint();
+
+          for (const auto &checkpoint : debugger->get_checkpoints()) {
+            std::cout << (current && *current == checkpoint.id ? "*" : " ")
+              << std::dec << checkpoint.id << ":\t";
+            if (_vcpu_id < checkpoint.vcpu_contexts.size()) {
+              const auto ip = reg::read_register<reg::x86_32::eip, reg::x86_64::rip>(
+                  checkpoint.vcpu_contexts.at(_vcpu_id));
+              std::cout << std::showbase << std::hex << ip << std::dec << " ";
+            }
+            std::cout << "+" << checkpoint.pages.size() << " pages" << std::endl;
+          }
+          std::cout << debugger->get_num_checkpoint_pages()
+            << " unique pages stored." << std::endl;
+        };
+      }),
+    Verb("clear", "Delete all checkpoints.",
+      {}, {},
+      [this](auto &/*flags*/, auto &/*args*/) {
+        return [this]() {
+          _dwrap.get_debugger_or_fail()->clear_checkpoints();
+        };
+      }),
+    Verb("auto", "Take a checkpoint whenever the guest stops.",
+      {},
+      {
+        Argument("on/off", "Whether to checkpoint at each stop.",
+            make_match_one_of<std::string::const_iterator,
+              std::vector<std::string>>({"on", "off"})),
+      },
+      [this](auto &/*flags*/, auto &args) {
+        const auto enable = (args.get(0) == "on");
+        return [this, enable]() {
+          if (!_dwrap.is_hvm())
+            throw NotSupportedException("Checkpoints are only supported on HVM guests.");
+
+          _dwrap.get_debugger_or_fail()->set_auto_checkpoint(enable);
+        };
+      }),
+    }));
+
+  _repl.add_command(make_command("marker", "Manage markers raised by the guest via guest requests.", {
+    Verb("list", "List recorded markers, oldest first.",
+      {}, {},
+      [this](auto &/*flags*/, auto &/*args*/) {
+        return [this]() {
+          const auto &trace = _dwrap.get_debugger_or_fail()->get_markers();
+          const auto markers = trace.get_markers();
+
+          // Deltas are per VCPU, as that is what an in-guest probe pair measures
+          std::unordered_map<xen::VCPU_ID, uint64_t> last_timestamps;
+          for (size_t i = 0; i < markers.size(); ++i) {
+            const auto &marker = markers.at(i);
+            const auto last = last_timestamps.find(marker.vcpu_id);
+            const auto delta_ns = (last == last_timestamps.end())
+              ? 0 : marker.timestamp_ns - last->second;
+            last_timestamps[marker.vcpu_id] = marker.timestamp_ns;
+
+            std::cout << std::dec << i << ":\tcpu " << marker.vcpu_id
+              << "\t+" << delta_ns / 1000 << "." << std::setfill('0') << std::setw(3)
+              << delta_ns % 1000 << std::setfill(' ') << "us"
+              << std::hex << std::showbase
+              << "\tid " << marker.id
+              << " (" << marker.args[0] << ", " << marker.args[1] << ")"
+              << "\tat " << _dwrap.symbolize(marker.rip)
+              << std::noshowbase << std::dec << std::endl;
+          }
+          if (trace.get_num_dropped())
+            std::cout << trace.get_num_dropped() << " older markers were overwritten." << std::endl;
+        };
+      }),
+    Verb("clear", "Delete all recorded markers.",
+      {}, {},
+      [this](auto &/*flags*/, auto &/*args*/) {
+        return [this]() {
+          _dwrap.get_debugger_or_fail()->clear_markers();
+        };
+      }),
+    Verb("mode", "Record guest requests as markers, or stop on them.",
+      {},
+      {
+        Argument("mode", "Either 'record' or 'stop'.",
+            make_match_one_of<std::string::const_iterator,
+              std::vector<std::string>>({"record", "stop"})),
+      },
+      [this](auto &/*flags*/, auto &args) {
+        const auto mode = (args.get(0) == "stop")
+          ? GuestRequestMode::Stop : GuestRequestMode::Marker;
+        return [this, mode]() {
+          if (!_dwrap.is_hvm())
+            throw NotSupportedException("Guest requests are only supported on HVM guests.");
+
+          _dwrap.get_debugger_or_fail()->set_guest_request_mode(mode);
+        };
+      }),
+    }));
+
+  _repl.add_command(make_command(
+      Verb("restore", "Restore the guest to a checkpoint.",
+        {},
+        {
+          Argument("id", "The ID of the checkpoint to restore.",
+              match_number_unsigned<std::string::const_iterator>)
+        },
+        [this](auto &/*flags*/, auto &args) {
+          const auto id = std::stoul(args.get(0));
+          return [this, id]() {
+            if (!_dwrap.is_hvm())
+              throw NotSupportedException("Checkpoints are only supported on HVM guests.");
+
+            _dwrap.get_debugger_or_fail()->restore_checkpoint(id);
+            std::cout << "Restored checkpoint #" << id << "." << std::endl;
+
+            auto ctx = _dwrap.get_debugger_or_fail()->get_domain().get_cpu_context(_vcpu_id);
+            auto ip = reg::read_register<reg::x86_32::eip, reg::x86_64::rip>(ctx);
+            disassemble(ip, X86_MAX_INSTRUCTION_SIZE*STEP_PRINT_INSTRS, STEP_PRINT_INSTRS);
+          };
+        })));
+
+}
+
+std::vector<std::string> DebuggerREPL::complete_symbols(const std::string &prefix,
+    const std::string &decoration) const
+{
+  std::vector<std::string> options;
+  const auto symbols = _dwrap.get_symbols();
+  if (!symbols)
+    return options;
+
+  const auto [first, last] = symbols->find_prefix(prefix);
+  options.reserve(last - first);
+  for (auto i = first; i < last; ++i)
+    options.push_back(decoration + std::string(symbols->get_name(i)));
+  return options;
+}
+
+uint64_t DebuggerREPL::get_instruction_pointer() {
+  const auto ctx = _dwrap.get_debugger_or_fail()->get_domain().get_cpu_context(_vcpu_id);
+  return reg::read_register<reg::x86_32::eip, reg::x86_64::rip>(ctx);
 }
 
 void DebuggerREPL::print_domain_info(const xen::Domain &domain) {
@@ -892,48 +1556,206 @@ void DebuggerREPL::print_registers(const reg::RegistersX86Any& regs) {
   std::cout << std::dec;
 }
 
+void DebuggerREPL::print_address_spaces(const AddressSpaceTracker& tracker) {
+  const auto &vcpu_modes = tracker.get_vcpu_modes();
+
+  // Most recently switched to first
+  std::vector<AddressSpace> address_spaces;
+  for (const auto &[root, address_space] : tracker.get_address_spaces())
+    address_spaces.push_back(address_space);
+  std::sort(address_spaces.begin(), address_spaces.end(),
+    [](const auto &a, const auto &b) {
+      return a.last_switch_ns > b.last_switch_ns;
+    });
+
+  std::cout << "Page table root     Switches  vCPUs" << std::endl;
+  for (const auto &address_space : address_spaces) {
+    std::cout << std::hex << std::setfill('0') << std::setw(16) << address_space.root
+      << std::dec << std::setfill(' ') << "  " << std::setw(10) << address_space.num_switches
+      << " ";
+    for (size_t id = 0; id < vcpu_modes.size(); ++id) {
+      if (vcpu_modes[id].root == address_space.root)
+        std::cout << " " << id;
+    }
+    std::cout << std::endl;
+  }
+  std::cout << address_spaces.size() << " address spaces, "
+    << tracker.get_num_switches() << " switches." << std::endl;
+}
+
+void DebuggerREPL::print_memory_map(const xen::MemoryMap &map) {
+  std::cout << std::hex << std::setfill('0');
+
+  for (const auto &[start, region] : map.get_regions()) {
+    const auto &perms = region.permissions;
+    std::cout
+      << std::setw(16) << start << "-" << std::setw(16) << region.end() << " "
+      << (perms.read ? "r" : "-")
+      << (perms.write ? "w" : "-")
+      << (perms.execute ? "x" : "-") << " "
+      << (region.user ? "user  " : "kernel") << " "
+      << std::dec << (region.size >> 10) << "K" << std::hex << std::endl;
+  }
+
+  std::cout << std::dec << std::setfill(' ')
+    << map.get_regions().size() << " regions." << std::endl;
+}
+
+void DebuggerREPL::print_line_table_stats(const LineTable::Stats &stats) {
+  std::cout << stats.num_units << " units" << std::endl;
+  if (stats.is_indexed) {
+    std::cout << stats.num_sequences << " address ranges, "
+      << stats.index_bytes / 1024 << " KiB, indexed in "
+      << stats.index_build_time.count() << "us" << std::endl;
+  } else {
+    std::cout << "Not indexed yet; the index is built on the first lookup" << std::endl;
+  }
+  std::cout << stats.num_cached_units << "/" << LINE_TABLE_MAX_CACHED_UNITS
+    << " units decoded, " << stats.num_cached_rows << " rows, "
+    << stats.cached_bytes / 1024 << " KiB" << std::endl;
+}
+
 void DebuggerREPL::print_xen_info(const xen::Xen &xen) {
   auto version = xen.xenctrl.get_xen_version();
   std::cout << "Xen " << version.major << "." << version.minor << std::endl;
 }
 
-void DebuggerREPL::disassemble(uint64_t address, size_t length, size_t max_instrs) {
-  auto mem_handle = _dwrap.examine(address, 1, length);
-  auto mem = mem_handle.get();
-
-  cs_insn *insn;
-  auto count = cs_disasm(_capstone, mem, length, address, 0, &insn);
-  max_instrs = max_instrs ? max_instrs : count;
-  if (count > 0) {
-    size_t j;
-    for (j = 0; j < count && (j < max_instrs); j++) {
-      printf("0x%lx:\t%s\t\t%s\n", insn[j].address, insn[j].mnemonic,
-          insn[j].op_str);
-    }
+std::optional<uint64_t> DebuggerREPL::parse_branch_target(const std::string &mnemonic,
+    const std::string &op_str)
+{
+  if (mnemonic != "call" && mnemonic.front() != 'j')
+    return std::nullopt;
+  if (op_str.size() <= 2 || op_str.compare(0, 2, "0x") ||
+      op_str.find_first_not_of("0123456789abcdef", 2) != std::string::npos)
+  {
+    return std::nullopt;
+  }
+  return std::stoull(op_str, nullptr, 16);
+}
 
-    cs_free(insn, count);
-  } else
+std::unique_ptr<xd::repl::InstructionCache> DebuggerREPL::make_instruction_cache() {
+  return std::make_unique<repl::InstructionCache>(_dwrap.get_word_size(),
+    [this](xen::Address address, size_t length) {
+      std::vector<unsigned char> code;
+      code.reserve(length);
+      _dwrap.read_memory_chunked(address, length,
+        [&code](auto /*address*/, const unsigned char *data, size_t size) {
+          code.insert(code.end(), data, data + size);
+        });
+      return code;
+    },
+    [this](xen::Address page) {
+      // Through the selected vCPU, as the bytes themselves are read
+      const auto debugger = _dwrap.get_debugger_or_fail();
+      return (xen_pfn_t)debugger->get_domain().translate_foreign_address(
+          page, debugger->get_paging_mode(_vcpu_id));
+    },
+    [this](xen::Address address) -> std::optional<std::pair<xen::Address, size_t>> {
+      const auto sym = _dwrap.lookup_address(address);
+      if (!sym || !sym->size)
+        return std::nullopt;
+      return std::make_pair(address - sym->offset, sym->size);
+    });
+}
+
+void DebuggerREPL::disassemble(uint64_t address, size_t length, size_t max_instrs) {
+  _dwrap.get_debugger_or_fail();
+  const auto instructions = _instructions->disassemble(address, length, max_instrs);
+  if (instructions.empty()) {
     printf("ERROR: Failed to disassemble given code!\n");
+    return;
+  }
+
+  // Other commands may have left std::showbase set
+  const auto flags = std::cout.flags();
+  std::cout << std::noshowbase;
+
+  std::optional<SourceLocation> last_line;
+  for (const auto &in : instructions) {
+    if (const auto sym = _dwrap.lookup_address(in.address); sym && !sym->offset)
+      std::cout << _dwrap.symbolize(in.address) << ":" << std::endl;
+
+    // Label each run of instructions from the same source line
+    const auto line = _dwrap.lookup_line(in.address);
+    if (line && line != last_line)
+      std::cout << line->file << ":" << line->line << std::endl;
+    last_line = line;
+
+    std::cout << std::hex << "0x" << in.address;
+    if (const auto sym = _dwrap.lookup_address(in.address))
+      std::cout << " <+" << std::dec << sym->offset << ">";
+    std::cout << ":\t" << in.mnemonic << "\t\t" << in.op_str;
+
+    // Name the targets of direct calls and jumps
+    const auto target = parse_branch_target(in.mnemonic, in.op_str);
+    if (target && _dwrap.lookup_address(*target))
+      std::cout << " <" << _dwrap.symbolize(*target) << ">";
+    std::cout << std::dec << std::endl;
+  }
+
+  std::cout.flags(flags);
 }
 
-void DebuggerREPL::examine(uint64_t address, size_t word_size, size_t num_words) {
-  auto mem_handle = _dwrap.examine(address, word_size, num_words);
-  auto mem = (char*)mem_handle.get();
+// "00" through "ff", so each byte is formatted by copying two characters
+static const std::array<std::array<char, 2>, 0x100> hex_digits = []() {
+  static const char digits[] = "0123456789abcdef";
+  std::array<std::array<char, 2>, 0x100> table;
+  for (size_t i = 0; i < table.size(); ++i)
+    table[i] = {digits[i >> 4], digits[i & 0xf]};
+  return table;
+}();
 
+void DebuggerREPL::examine(uint64_t address, size_t word_size, size_t num_words) {
+  const auto length = word_size*num_words;
   const auto newline_limit = 3*sizeof(uint64_t)/word_size;
 
   std::cout << std::hex << std::showbase;
-  std::cout << address << " to " << address + word_size*num_words << ":" << std::endl;
-  std::cout << std::noshowbase << std::setfill('0');
-  for (size_t i = 0; i < num_words; ++i) {
-    char *target = mem+(i+1)*word_size;
-    for (size_t j = 0; j < word_size; ++j) {
-      std::cout << std::setw(2) << (((uint32_t)(*--target)) & 0xFF);
-    }
-    std::cout << " ";
+  std::cout << address << " to " << address + length << ":" << std::endl;
+  std::cout << std::noshowbase << std::dec;
+
+  // Words are formatted into one large buffer as pages arrive; a word
+  // split across two pages is held in 'word' until it is complete
+  std::string out;
+  out.reserve(EXAMINE_BUFFER_SIZE + 3*XC_PAGE_SIZE);
+  unsigned char word[sizeof(uint64_t)];
+  size_t word_fill = 0, word_index = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+  _dwrap.read_memory_chunked(address, length,
+    [&](auto /*address*/, const unsigned char *data, size_t size) {
+      for (size_t i = 0; i < size; ++i) {
+        word[word_fill++] = data[i];
+        if (word_fill < word_size)
+          continue;
+        word_fill = 0;
+
+        // Little-endian, so the most significant byte is last
+        for (auto j = word_size; j-- > 0;)
+          out.append(hex_digits[word[j]].data(), 2);
+        out += ' ';
+
+        if (word_index != num_words-1 && (word_index % newline_limit) == newline_limit-1)
+          out += '\n';
+        ++word_index;
+      }
+
+      if (out.size() >= EXAMINE_BUFFER_SIZE) {
+        std::cout.write(out.data(), out.size());
+        out.clear();
+      }
+    });
+
+  out += '\n';
+  std::cout.write(out.data(), out.size());
+  std::cout.flush();
+
+  if (length >= THROUGHPUT_MIN_BYTES)
+    print_throughput(length, std::chrono::steady_clock::now() - start);
+}
 
-    if (i != num_words-1 && (i % newline_limit) == newline_limit-1)
-      std::cout << std::endl;
-  }
-  std::cout << std::dec << std::endl;
+void DebuggerREPL::print_throughput(size_t bytes, std::chrono::nanoseconds elapsed) {
+  const auto seconds = std::chrono::duration<double>(elapsed).count();
+  std::cout << bytes << " bytes in "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << "ms ("
+    << (uint64_t)(seconds ? bytes / seconds / (1024*1024) : 0) << " MiB/s)" << std::endl;
 }
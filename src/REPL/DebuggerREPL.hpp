@@ -22,13 +22,18 @@
 #ifndef XENDBG_DEBUGGERREPL_HPP
 #define XENDBG_DEBUGGERREPL_HPP
 
+#include <chrono>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <ostream>
 #include <stdexcept>
 #include <string>
 
-#include <capstone/capstone.h>
 #include <uvw.hpp>
 
 #include "DebuggerWrapper.hpp"
+#include "InstructionCache.hpp"
 #include "REPL.hpp"
 
 namespace xd::dbg {
@@ -58,15 +63,32 @@ namespace xd::dbg {
     DebuggerREPL& operator=(const DebuggerREPL &other) = delete;
 
     void run();
+    // Runs a script without readline or a prompt, stopping at the first
+    // failing command; with json, each command's output is written as one
+    // JSON object per line. Returns the process's exit status.
+    int run_batch(std::istream &in, bool json);
 
   private:
     void setup_repl();
+    // Returns false, after describing the failure to err, if action throws
+    bool run_action(const repl::cmd::Action &action, std::ostream &err);
 
     static void print_domain_info(const xen::Domain& domain);
     static void print_registers(const reg::RegistersX86Any& regs);
+    static void print_memory_map(const xen::MemoryMap& map);
+    static void print_address_spaces(const AddressSpaceTracker& tracker);
     static void print_xen_info(const xen::Xen& xen);
+    static void print_line_table_stats(const LineTable::Stats& stats);
+    static void print_throughput(size_t bytes, std::chrono::nanoseconds elapsed);
+    // The loaded symbols starting with prefix, each prefixed by decoration
+    std::vector<std::string> complete_symbols(const std::string &prefix,
+        const std::string &decoration = "") const;
+    uint64_t get_instruction_pointer();
     void examine(uint64_t address, size_t word_size, size_t num_words);
+    std::unique_ptr<repl::InstructionCache> make_instruction_cache();
     void disassemble(uint64_t address, size_t length, size_t max_instrs = 0);
+    static std::optional<uint64_t> parse_branch_target(const std::string &mnemonic,
+        const std::string &op_str);
     void stop();
 
   private:
@@ -75,7 +97,8 @@ namespace xd::dbg {
     std::shared_ptr<uvw::SignalHandle> _signal;
     repl::DebuggerWrapper _dwrap;
     size_t _vcpu_id, _max_vcpu_id;
-    csh _capstone;
+    bool _interrupted;
+    std::unique_ptr<repl::InstructionCache> _instructions;
   };
 
 }
@@ -19,18 +19,26 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
-#include <elfio/elfio.hpp>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include <Util/ElfFile.hpp>
 
 #include "DebuggerWrapper.hpp"
+#include "Parser/Parser.hpp"
 
 #include <Debugger/DebuggerHVM.hpp>
 #include <Debugger/DebuggerPV.hpp>
 
+#define EXPRESSION_CACHE_MAX_SIZE 256
+
 using xd::parser::expr::Expression;
 using xd::parser::expr::Constant;
 using xd::parser::expr::Label;
 using xd::parser::expr::Variable;
 using xd::repl::DebuggerWrapper;
+using xd::repl::SymbolStore;
 using xd::xen::Xen;
 
 using namespace xd::parser::expr::op;
@@ -39,7 +47,7 @@ DebuggerWrapper::DebuggerWrapper(std::shared_ptr<uvw::Loop> loop, bool non_stop_
   : _xen(Xen::create()),
     _loop(loop),
     _non_stop_mode(non_stop_mode),
-    _breakpoint_id(0), _watchpoint_id(0), _vcpu_id(0)
+    _breakpoint_id(0), _watchpoint_id(0), _vcpu_id(0), _word_size(0)
 {
 }
 
@@ -90,6 +98,8 @@ void DebuggerWrapper::attach(xd::xen::DomainAny domain_any) {
 
   _debugger->attach();
   _vcpu_id = 0;
+  _word_size = _debugger->get_domain().get_word_size();
+  _compiled_expressions.clear();
 }
 
 void DebuggerWrapper::detach() {
@@ -97,7 +107,7 @@ void DebuggerWrapper::detach() {
 
   _debugger.reset();
   _variables.clear();
-  _symbols.clear();
+  clear_symbols();
 }
 
 bool DebuggerWrapper::is_hvm() {
@@ -109,41 +119,84 @@ void DebuggerWrapper::assert_attached() {
     throw NoGuestAttachedException();
 }
 
-void DebuggerWrapper::load_symbols_from_file(const std::string &filename) {
-  ELFIO::elfio reader;
+// Shared by every session in the process, so each ELF is indexed only once
+static SymbolStore &get_symbol_store() {
+  static SymbolStore store(SymbolStore::get_default_cache_dir());
+  return store;
+}
 
-  if (!reader.load(filename))
+void DebuggerWrapper::load_symbols_from_file(const std::string &filename) {
+  try {
+    _symbols = get_symbol_store().load(filename);
+  } catch (const util::ElfFileException &e) {
     throw FileLoadException(filename);
+  }
 
-  _symbols.clear();
-
-  for (const auto section : reader.sections) {
-    if (section->get_type() == SHT_SYMTAB) {
-      const ELFIO::symbol_section_accessor symbols(reader, section);
-      const size_t num_symbols = symbols.get_symbols_num();
-      for (size_t i = 0; i < num_symbols; ++i) {
-        std::string       name;
-        ELFIO::Elf64_Addr address;
-        ELFIO::Elf_Xword  size;
-        unsigned char     bind;
-        unsigned char     type;
-        ELFIO::Elf_Half   section_index;
-        unsigned char     other;
-
-        symbols.get_symbol(i, name, address, size, bind, type, section_index, other);
-
-        // TODO: very basic for now; just load functions with known addresses
-        if ((type == STT_FUNC || type == STT_OBJECT) && address > 0)
-          _symbols[name] = Symbol{address};
-      }
-    }
+  // Line information is optional; only the section is located here
+  try {
+    _lines = std::make_unique<dbg::LineTable>(dbg::LineTable::from_elf(filename));
+  } catch (const dbg::LineTableException &e) {
+    _lines.reset();
   }
+
+  if (_debugger)
+    _debugger->load_unwind_info(filename);
+  _compiled_expressions.clear();
 }
 
-const DebuggerWrapper::Symbol &DebuggerWrapper::lookup_symbol(const std::string &name) {
-  if (!_symbols.count(name))
+xd::dbg::Kallsyms::Stats DebuggerWrapper::load_symbols_from_kallsyms() {
+  dbg::Kallsyms::Stats stats;
+  const auto &kernel_symbols = get_debugger_or_fail()->load_kernel_symbols(&stats);
+
+  std::vector<SymbolIndex::Symbol> symbols;
+  symbols.reserve(kernel_symbols.size());
+  for (const auto &symbol : kernel_symbols)
+    symbols.push_back(SymbolIndex::Symbol{symbol.name, symbol.address, 0});
+
+  const auto owner = std::make_shared<std::vector<unsigned char>>(
+      SymbolIndex::serialize(std::move(symbols)));
+  _symbols = std::make_shared<SymbolIndex>(owner, owner->data(), owner->size());
+  _lines.reset();
+  _compiled_expressions.clear();
+
+  return stats;
+}
+
+DebuggerWrapper::Symbol DebuggerWrapper::lookup_symbol(const std::string &name) {
+  const auto address = _symbols ? _symbols->find(name) : std::nullopt;
+  if (!address)
     throw NoSuchSymbolException(name);
-  return _symbols.at(name);
+  return Symbol{*address};
+}
+
+std::optional<xd::repl::SymbolIndex::Match> DebuggerWrapper::lookup_address(
+    xen::Address address) const
+{
+  if (!_symbols)
+    return std::nullopt;
+  return _symbols->lookup(address);
+}
+
+std::string DebuggerWrapper::symbolize(xen::Address address) const {
+  if (!_symbols) {
+    std::stringstream ss;
+    ss << "0x" << std::hex << address;
+    return ss.str();
+  }
+  return _symbols->symbolize(address);
+}
+
+std::optional<xd::dbg::SourceLocation> DebuggerWrapper::lookup_line(
+    xen::Address address) const
+{
+  if (!_lines)
+    return std::nullopt;
+
+  try {
+    return _lines->lookup(address);
+  } catch (const dbg::LineTableException &e) {
+    return std::nullopt;
+  }
 }
 
 uint64_t DebuggerWrapper::get_var(const std::string &name) {
@@ -186,10 +239,8 @@ void DebuggerWrapper::evaluate_set_expression(const Expression &expr, size_t wor
     auto regs = _debugger->get_domain().get_cpu_context(_vcpu_id); // TODO
 
     std::visit(util::overloaded {
-      [&](auto regs) {
-        regs.find([&](auto reg) {
-          return reg.name == var_name;
-        }, [&](const auto &md, auto &reg) {
+      [&](auto &regs) {
+        regs.find_by_name(var_name, [&](const auto &md, auto &reg) {
           reg = value;
         }, [&]() {
           set_var(var_name, value); // not a register
@@ -209,85 +260,90 @@ void DebuggerWrapper::evaluate_set_expression(const Expression &expr, size_t wor
   }
 }
 
-uint64_t DebuggerWrapper::evaluate_expression(const Expression& expr) {
-  return expr.visit<uint64_t>(util::overloaded {
-      [](const Constant& ex) {
-        return ex.value;
-      },
-      [this](const Label& ex) {
-        const auto label = ex.value;
-        return lookup_symbol(label).address;
-      },
-      [this](const Variable& ex) {
-        const std::string &var_name = ex.value;
+xd::repl::CompiledExpression DebuggerWrapper::compile_expression(const Expression& expr) {
+  // Register IDs depend on which register set the guest's context comes
+  // in (always 64-bit for HVM); without a guest, every $name is a user
+  // variable
+  const auto word_size = !_debugger ? 0
+    : is_hvm() ? sizeof(uint64_t)
+    : _word_size;
+
+  return CompiledExpression::compile(expr,
+    [this](const std::string &label) {
+      return lookup_symbol(label).address;
+    },
+    [word_size](const std::string &name) -> std::optional<size_t> {
+      if (word_size == sizeof(uint64_t))
+        return reg::x86_64::RegistersX86_64::find_id_by_name(name);
+      else if (word_size == sizeof(uint32_t))
+        return reg::x86_32::RegistersX86_32::find_id_by_name(name);
+      return std::nullopt;
+    });
+}
+
+uint64_t DebuggerWrapper::evaluate_expression(const std::string& expr_str) {
+  auto it = _compiled_expressions.find(expr_str);
+  if (it == _compiled_expressions.end()) {
+    auto compiled = compile_expression(parser::Parser().parse(expr_str));
+    if (_compiled_expressions.size() >= EXPRESSION_CACHE_MAX_SIZE)
+      _compiled_expressions.clear();
+    it = _compiled_expressions.emplace(expr_str, std::move(compiled)).first;
+  }
+  return evaluate_expression(it->second);
+}
+
+uint64_t DebuggerWrapper::evaluate_expression(const CompiledExpression& expr) {
+  // Filled in by register ID on first use
+  std::vector<uint64_t> registers;
+
+  struct Page {
+    xen::Address address;
+    dbg::MaskedMemory data;
+  };
+  std::vector<Page> pages;
 
+  const auto get_page = [this, &pages](xen::Address address) {
+    const auto it = std::find_if(pages.begin(), pages.end(), [address](const auto &page) {
+      return page.address == address;
+    });
+    if (it != pages.end())
+      return it->data.get();
+
+    assert_attached();
+    pages.push_back(Page{address,
+        _debugger->read_memory_masking_breakpoints(address, XC_PAGE_SIZE)});
+    return pages.back().data.get();
+  };
+
+  return expr.evaluate(
+    [this, &registers](size_t id) {
+      if (registers.empty()) {
         assert_attached();
-        auto regs = _debugger->get_domain().get_cpu_context(_vcpu_id); // TODO
-
-        uint64_t ret;
-
-        std::visit(util::overloaded {
-            [&](const auto &regs) {
-              regs.find([&](auto reg) {
-                return reg.name == var_name;
-              }, [&](const auto &md, auto &reg) {
-                ret = reg;
-              }, [&]() {
-                ret = get_var(var_name); // not a register
-              });
-            },
+        const auto regs = _debugger->get_domain().get_cpu_context(_vcpu_id);
+        std::visit([&registers](const auto &regs) {
+          regs.for_each([&registers](const auto &md, const auto &reg) {
+            registers.push_back(reg);
+          });
         }, regs);
-
-        return ret;
-      },
-      [this](const Expression::UnaryExpressionPtr& ex) {
-        const auto& op = ex->op;
-        const auto& x_value = evaluate_expression(ex->x);
-
-        return std::visit(util::overloaded {
-            [this, x_value](Dereference) {
-              assert_attached();
-              // TODO: only reads 64-bit values for now
-              const auto mem = _debugger->read_memory_masking_breakpoints(x_value, sizeof(uint64_t));
-              return *((uint64_t*)mem.get());
-            },
-            [x_value](Negate) {
-              return -x_value;
-            },
-        }, op);
-      },
-      [this](const Expression::BinaryExpressionPtr& ex) {
-        const auto& op = ex->op;
-        const auto get_xy = [this, &ex]() {
-          return std::make_pair(
-              evaluate_expression(ex->x),
-              evaluate_expression(ex->y));
-        };
-
-        return std::visit(util::overloaded {
-            [](Equals) {
-              throw InvalidExpressionException("Use 'set' to modify variables.");
-              return 0UL; // satisfy the compiler's type-inference
-            },
-            [get_xy](Add) {
-              const auto [x, y] = get_xy();
-              return x + y;
-            },
-            [get_xy](Subtract) {
-              const auto [x, y] = get_xy();
-              return x - y;
-            },
-            [get_xy](Multiply) {
-              const auto [x, y] = get_xy();
-              return x * y;
-            },
-            [get_xy](Divide) {
-              const auto [x, y] = get_xy();
-              return x / y;
-            },
-        }, op);
-      },
-  });
+      }
+      return registers.at(id);
+    },
+    [this](const std::string &name) {
+      return get_var(name);
+    },
+    // TODO: only reads 64-bit values for now
+    [&get_page](xen::Address address) {
+      uint64_t value;
+      const auto page_address = address & ~(xen::Address)(XC_PAGE_SIZE - 1);
+      const auto offset = address - page_address;
+      const auto in_first = std::min(sizeof(value), (size_t)(XC_PAGE_SIZE - offset));
+
+      std::memcpy(&value, get_page(page_address) + offset, in_first);
+      if (in_first < sizeof(value))
+        std::memcpy((unsigned char*)&value + in_first,
+            get_page(page_address + XC_PAGE_SIZE), sizeof(value) - in_first);
+      return value;
+    });
 }
 
 xd::dbg::MaskedMemory DebuggerWrapper::examine(uint64_t address, size_t word_size, size_t num_words) {
@@ -298,3 +354,18 @@ xd::dbg::MaskedMemory DebuggerWrapper::examine(uint64_t address, size_t word_siz
   const uintptr_t end = word_size*num_words;
   return _debugger->read_memory_masking_breakpoints(address, end);
 }
+
+void DebuggerWrapper::read_memory_chunked(xen::Address address, size_t length,
+    const MemoryChunkFn &on_chunk)
+{
+  assert_attached();
+
+  while (length) {
+    const auto chunk_length = std::min(length, (size_t)(XC_PAGE_SIZE - address % XC_PAGE_SIZE));
+    const auto mem = _debugger->read_memory_masking_breakpoints(address, chunk_length);
+    on_chunk(address, mem.get(), chunk_length);
+
+    address += chunk_length;
+    length -= chunk_length;
+  }
+}
@@ -22,14 +22,19 @@
 #ifndef XENDBG_DEBUGGERWRAPPER_HPP
 #define XENDBG_DEBUGGERWRAPPER_HPP
 
+#include <functional>
 #include <memory>
 
 #include <uvw.hpp>
 
 #include <Debugger/Debugger.hpp>
+#include <Debugger/LineTable.hpp>
 #include <Xen/Xen.hpp>
 
+#include "CompiledExpression.hpp"
 #include "Parser/Expression/Expression.hpp"
+#include "SymbolIndex.hpp"
+#include "SymbolStore.hpp"
 
 namespace xd::repl {
 
@@ -60,12 +65,6 @@ namespace xd::repl {
     {};
   };
 
-  class InvalidExpressionException : public std::runtime_error {
-  public:
-    explicit InvalidExpressionException(const std::string &what)
-        : std::runtime_error(what.c_str()) {};
-  };
-
   class NoGuestAttachedException : public std::exception {
   };
 
@@ -76,7 +75,6 @@ namespace xd::repl {
     };
 
     using BreakpointMap = std::unordered_map<size_t, uint64_t>;
-    using SymbolMap = std::unordered_map<std::string, Symbol>;
     using VarMap = std::unordered_map<std::string, uint64_t>;
 
   private:
@@ -115,25 +113,59 @@ namespace xd::repl {
     void detach();
 
     bool is_hvm();
+    // Read once per attach
+    size_t get_word_size() {
+      assert_attached();
+      return _word_size;
+    };
 
     uint64_t get_var(const std::string &name);
     void set_var(const std::string &name, uint64_t value);
     void delete_var(const std::string &name);
 
-    uint64_t evaluate_expression(const parser::expr::Expression& expr);
+    // Labels are resolved when compiling, so a compiled expression keeps
+    // the addresses of the symbols loaded at the time
+    CompiledExpression compile_expression(const parser::expr::Expression& expr);
+    // Reads the vCPU's registers at most once, and each page of memory
+    // dereferenced at most once, per evaluation
+    uint64_t evaluate_expression(const CompiledExpression& expr);
+    uint64_t evaluate_expression(const parser::expr::Expression& expr) {
+      return evaluate_expression(compile_expression(expr));
+    };
+    // Parsed and compiled on first use, then reused until the guest or the
+    // loaded symbols change, so re-running a command skips both
+    uint64_t evaluate_expression(const std::string& expr_str);
     void evaluate_set_expression(const parser::expr::Expression& expr, size_t word_size);
     xd::dbg::MaskedMemory examine(uint64_t address, size_t word_size, size_t num_words);
 
-    const Symbol &lookup_symbol(const std::string &name);
+    using MemoryChunkFn = std::function<void(xen::Address, const unsigned char*, size_t)>;
+    // Reads up to one page at a time, never across a page boundary, so the
+    // range needn't fit in memory or be physically contiguous
+    void read_memory_chunked(xen::Address address, size_t length, const MemoryChunkFn &on_chunk);
+
+    Symbol lookup_symbol(const std::string &name);
+    std::optional<SymbolIndex::Match> lookup_address(xen::Address address) const;
+    std::string symbolize(xen::Address address) const;
+    std::optional<dbg::SourceLocation> lookup_line(xen::Address address) const;
     const BreakpointMap &get_breakpoints() { return _breakpoints; };
     const WatchpointMap &get_watchpoints() { return _watchpoints; };
-    const SymbolMap &get_symbols() { return _symbols; };
+    // nullptr if no symbols are loaded
+    const SymbolIndex *get_symbols() const { return _symbols.get(); };
+    // nullptr if the symbol file had no .debug_line
+    const dbg::LineTable *get_line_table() const { return _lines.get(); };
     const VarMap &get_variables() { return _variables; };
 
     const xen::Xen &get_xen_handle() { return *_xen; };
 
     void load_symbols_from_file(const std::string &name);
-    void clear_symbols() { _symbols.clear(); };
+    // For guests without a matching vmlinux; kallsyms has no sizes, so each
+    // symbol covers addresses up to the next one
+    dbg::Kallsyms::Stats load_symbols_from_kallsyms();
+    void clear_symbols() {
+      _symbols.reset();
+      _lines.reset();
+      _compiled_expressions.clear();
+    };
 
     void set_vcpu_id(size_t id) {
       _vcpu_id = id;
@@ -155,10 +187,13 @@ namespace xd::repl {
 
     BreakpointMap _breakpoints;
     WatchpointMap _watchpoints;
-    SymbolMap _symbols;
+    std::shared_ptr<const SymbolIndex> _symbols;
+    std::unique_ptr<dbg::LineTable> _lines;
     VarMap _variables;
+    std::unordered_map<std::string, CompiledExpression> _compiled_expressions;
 
     xen::VCPU_ID _vcpu_id;
+    size_t _word_size;
   };
 
 }
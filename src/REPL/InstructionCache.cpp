@@ -0,0 +1,172 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <cstring>
+
+#include <Xen/XenException.hpp>
+
+#include "InstructionCache.hpp"
+
+using xd::dbg::CapstoneException;
+using xd::repl::DecodedInstruction;
+using xd::repl::InstructionCache;
+using xd::xen::Address;
+
+InstructionCache::InstructionCache(size_t word_size, ReadFn read, TranslateFn translate,
+    FunctionBoundsFn get_function_bounds)
+  : _read(std::move(read)), _translate(std::move(translate)),
+    _get_function_bounds(std::move(get_function_bounds)),
+    _hits(0), _misses(0), _num_decoded(0)
+{
+  const auto mode = (word_size == sizeof(uint64_t)) ? CS_MODE_64 : CS_MODE_32;
+  if (cs_open(CS_ARCH_X86, mode, &_capstone) != CS_ERR_OK)
+    throw CapstoneException("Failed to open Capstone handle!");
+
+  // Only the mnemonic and operand string are shown, so the per-instruction
+  // detail capstone would otherwise allocate is never needed
+  cs_option(_capstone, CS_OPT_DETAIL, CS_OPT_OFF);
+}
+
+InstructionCache::~InstructionCache() {
+  cs_close(&_capstone);
+}
+
+std::vector<DecodedInstruction> InstructionCache::disassemble(
+    Address address, size_t length, size_t max_instrs)
+{
+  std::vector<DecodedInstruction> instructions;
+  if (!length)
+    return instructions;
+
+  if (_pages.size() >= INSTRUCTION_CACHE_MAX_PAGES)
+    _pages.clear();
+
+  const auto code = _read(address, length);
+  const auto end = address + length;
+
+  auto page = address & XC_PAGE_MASK;
+  auto gfn = _translate(page);
+  bool decoded = false, decoded_from_here = false;
+
+  for (auto it = address; it < end && (!max_instrs || instructions.size() < max_instrs);) {
+    if ((it & XC_PAGE_MASK) != page) {
+      page = it & XC_PAGE_MASK;
+      gfn = _translate(page);
+    }
+
+    auto in = find(it, gfn);
+    if (in && it + in->size > end)
+      break;
+
+    // The code has changed since it was decoded
+    if (in && std::memcmp(in->bytes.data(), code.data() + (it - address), in->size)) {
+      _pages.erase(gfn);
+      in = nullptr;
+    }
+
+    if (!in) {
+      // Whatever follows isn't valid code
+      if (decoded_from_here)
+        break;
+
+      // The function's instruction boundaries may not include this address
+      // (e.g. data or padding inside it), so failing those, decode from here
+      ++_misses;
+      decoded_from_here = decode(it, end - it, !decoded);
+      decoded = true;
+      continue;
+    }
+
+    ++_hits;
+    decoded = decoded_from_here = false;
+    instructions.push_back(*in);
+    it += in->size;
+  }
+
+  return instructions;
+}
+
+InstructionCache::Stats InstructionCache::get_stats() const {
+  return Stats{_hits, _misses, _num_decoded, _pages.size()};
+}
+
+const DecodedInstruction *InstructionCache::find(Address address, xen_pfn_t gfn) const {
+  const auto page = _pages.find(gfn);
+  if (page == _pages.end())
+    return nullptr;
+
+  const auto in = page->second.find(address & ~XC_PAGE_MASK);
+  if (in == page->second.end() || in->second.address != address)
+    return nullptr;
+  return &in->second;
+}
+
+bool InstructionCache::decode(Address address, size_t length, bool from_function_start) {
+  // Decoding from the function's start keeps to its instruction boundaries
+  auto begin = address;
+  auto size = length;
+  const auto bounds = from_function_start
+    ? _get_function_bounds(address)
+    : std::nullopt;
+  if (bounds) {
+    const auto [start, function_size] = *bounds;
+    if (start <= address && address - start < function_size &&
+        address - start < INSTRUCTION_CACHE_MAX_DECODE)
+    {
+      begin = start;
+      size = std::max(length + (address - start), function_size);
+    }
+  }
+  size = std::min(size, std::max(length, (size_t)INSTRUCTION_CACHE_MAX_DECODE));
+
+  std::vector<unsigned char> code;
+  try {
+    code = _read(begin, size);
+  } catch (const xen::XenException &e) {
+    // Part of the function isn't mapped; fall back to just what was asked for
+    begin = address;
+    code = _read(address, length);
+  }
+
+  cs_insn *insn;
+  const auto count = cs_disasm(_capstone, code.data(), code.size(), begin, 0, &insn);
+
+  auto page = begin & XC_PAGE_MASK;
+  auto gfn = _translate(page);
+  for (size_t i = 0; i < count; ++i) {
+    const auto &in = insn[i];
+    if ((in.address & XC_PAGE_MASK) != page) {
+      page = in.address & XC_PAGE_MASK;
+      gfn = _translate(page);
+    }
+
+    DecodedInstruction decoded{in.address, (uint8_t)in.size, {}, in.mnemonic, in.op_str};
+    std::memcpy(decoded.bytes.data(), in.bytes, std::min((size_t)in.size, decoded.bytes.size()));
+    _pages[gfn][in.address & ~XC_PAGE_MASK] = std::move(decoded);
+  }
+
+  if (count)
+    cs_free(insn, count);
+  _num_decoded += count;
+
+  return begin == address;
+}
@@ -0,0 +1,109 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_INSTRUCTIONCACHE_HPP
+#define XENDBG_INSTRUCTIONCACHE_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <capstone/capstone.h>
+
+#include <Debugger/Debugger.hpp>
+#include <Xen/Common.hpp>
+
+#define INSTRUCTION_CACHE_MAX_PAGES 1024
+#define INSTRUCTION_CACHE_MAX_DECODE 0x10000
+
+namespace xd::repl {
+
+  struct DecodedInstruction {
+    xen::Address address;
+    uint8_t size;
+    std::array<unsigned char, X86_MAX_INSTRUCTION_SIZE> bytes;
+    std::string mnemonic;
+    std::string op_str;
+  };
+
+  // Decoded instructions for one guest, keyed by the frame and offset they
+  // were decoded from. On a miss, the whole function around the address
+  // (or, without a sized symbol, just the range asked for) is decoded in a
+  // single capstone pass, so stepping through code already seen does no
+  // decoding at all.
+  //
+  // Every hit is checked against the current (breakpoint-masked) bytes,
+  // and a mismatch drops the whole page; that catches code rewritten by
+  // the guest as well as by the debugger.
+  class InstructionCache {
+  public:
+    struct Stats {
+      size_t hits;
+      size_t misses;
+      size_t num_decoded;
+      size_t num_pages;
+    };
+
+    // The bytes at an address, reading across pages as needed
+    using ReadFn = std::function<std::vector<unsigned char>(xen::Address, size_t)>;
+    // The frame a virtual page is mapped to
+    using TranslateFn = std::function<xen_pfn_t(xen::Address)>;
+    // The start and size of the function containing an address, if known
+    using FunctionBoundsFn = std::function<std::optional<std::pair<xen::Address, size_t>>(xen::Address)>;
+
+    InstructionCache(size_t word_size, ReadFn read, TranslateFn translate,
+        FunctionBoundsFn get_function_bounds);
+    ~InstructionCache();
+
+    InstructionCache(const InstructionCache &other) = delete;
+    InstructionCache& operator=(const InstructionCache &other) = delete;
+
+    // Up to max_instrs (0 for no limit) instructions lying entirely within
+    // [address, address + length)
+    std::vector<DecodedInstruction> disassemble(xen::Address address,
+        size_t length, size_t max_instrs = 0);
+
+    void clear() { _pages.clear(); };
+    Stats get_stats() const;
+
+  private:
+    using Page = std::unordered_map<uint16_t, DecodedInstruction>;
+
+    csh _capstone;
+    ReadFn _read;
+    TranslateFn _translate;
+    FunctionBoundsFn _get_function_bounds;
+    std::unordered_map<xen_pfn_t, Page> _pages;
+    size_t _hits, _misses, _num_decoded;
+
+    const DecodedInstruction *find(xen::Address address, xen_pfn_t gfn) const;
+    // Returns whether decoding began at the address itself
+    bool decode(xen::Address address, size_t length, bool from_function_start);
+  };
+
+}
+
+#endif //XENDBG_INSTRUCTIONCACHE_HPP
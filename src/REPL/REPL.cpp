@@ -19,8 +19,11 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <algorithm>
 #include <cctype>
+#include <cwctype>
 #include <iostream>
+#include <sstream>
 #include <string>
 
 #include <Util/IndentHelper.hpp>
@@ -157,39 +160,17 @@ void REPL::run(ActionHandlerFn action_handler) {
       continue;
     }
 
-    try {
-      const auto action = interpret_line(line);
-      add_history(line.c_str());
-      if (action) {
-        action_handler(action.value());
-      } else if (_no_match_handler) {
-        _no_match_handler(line);
-      } else {
-        std::cout << "Invalid input." << std::endl;
-      }
-    } catch (const ExtraArgumentException &e) {
-      std::cout << "Too many arguments: " << e.what() << std::endl;
-      continue;
-    } catch (const ArgMatchFailedException &e) {
-      std::cout << "Invalid value '" << 
-        std::string(e.get_pos(), next_whitespace<std::string::const_iterator>(
-              e.get_pos(), line.end()))
-        << "' for argument '" << e.get_argument().get_name()
-        << "'!" << std::endl;;
-      continue;
-    } catch (const FlagArgMatchFailedException &e) {
-      std::cout << "Invalid value '" << 
-        std::string(e.get_pos(), next_whitespace<std::string::const_iterator>(
-              e.get_pos(), line.end()))
-        << "' for argument '" << e.get_argument().get_name()
-        << "' of flag '" << e.get_flag().get_long_name() << "'!" << std::endl;;
-      continue;
-    } catch (const UnknownFlagException &e) {
-      std::cout << "No such flag: " <<
-        std::string(e.get_pos(), next_whitespace<std::string::const_iterator>(
-              e.get_pos(), line.end()))
-        << std::endl;
+    std::optional<Action> action;
+    if (!try_interpret_line(line, action, std::cout))
       continue;
+
+    add_history(line.c_str());
+    if (action) {
+      action_handler(action.value());
+    } else if (_no_match_handler) {
+      _no_match_handler(line);
+    } else {
+      std::cout << "Invalid input." << std::endl;
     }
   };
 }
@@ -217,6 +198,35 @@ std::vector<std::string> REPL::complete(const std::string &s) {
   return options;
 }
 
+bool REPL::try_interpret_line(const std::string &line, std::optional<Action> &action,
+    std::ostream &err)
+{
+  try {
+    action = interpret_line(line);
+    return true;
+  } catch (const ExtraArgumentException &e) {
+    err << "Too many arguments: " << e.what() << std::endl;
+  } catch (const ArgMatchFailedException &e) {
+    err << "Invalid value '" <<
+      std::string(e.get_pos(), next_whitespace<std::string::const_iterator>(
+            e.get_pos(), line.end()))
+      << "' for argument '" << e.get_argument().get_name()
+      << "'!" << std::endl;
+  } catch (const FlagArgMatchFailedException &e) {
+    err << "Invalid value '" <<
+      std::string(e.get_pos(), next_whitespace<std::string::const_iterator>(
+            e.get_pos(), line.end()))
+      << "' for argument '" << e.get_argument().get_name()
+      << "' of flag '" << e.get_flag().get_long_name() << "'!" << std::endl;
+  } catch (const UnknownFlagException &e) {
+    err << "No such flag: " <<
+      std::string(e.get_pos(), next_whitespace<std::string::const_iterator>(
+            e.get_pos(), line.end()))
+      << std::endl;
+  }
+  return false;
+}
+
 std::optional<Action> REPL::interpret_line(const std::string& line) {
   for (const auto &cmd : _commands) {
     const auto action = cmd->match(line.begin(), line.end());
@@ -234,6 +244,80 @@ void REPL::print_help(std::ostream &out) {
   }
 }
 
+REPL::Script REPL::parse_script(std::istream &in) {
+  Script script;
+  std::vector<size_t> open_blocks;
+
+  size_t line_number = 0;
+  for (std::string line; std::getline(in, line);) {
+    ++line_number;
+
+    const auto begin = skip_whitespace(line.begin(), line.end());
+    if (begin == line.end() || *begin == '#')
+      continue;
+    line.erase(line.begin(), begin);
+    line.erase(std::find_if_not(line.rbegin(), line.rend(), std::iswspace).base(), line.end());
+
+    const auto word_end = next_whitespace<std::string::const_iterator>(line.begin(), line.end());
+    const auto word = std::string(line.cbegin(), word_end);
+
+    if (word == "repeat") {
+      const auto count_str = std::string(skip_whitespace(word_end, line.cend()), line.cend());
+      if (count_str.empty() || !std::all_of(count_str.begin(), count_str.end(), ::isdigit))
+        throw ScriptException(line_number, "Usage: repeat <count>");
+
+      open_blocks.push_back(script.size());
+      script.push_back(ScriptStep{line_number, line, std::nullopt, std::stoul(count_str), 0});
+    } else if (line == "end") {
+      if (open_blocks.empty())
+        throw ScriptException(line_number, "'end' without 'repeat'");
+      script.at(open_blocks.back()).block_end = script.size();
+      open_blocks.pop_back();
+    } else {
+      std::optional<Action> action;
+      std::stringstream err;
+      if (!try_interpret_line(line, action, err)) {
+        auto msg = err.str();
+        msg.erase(std::find_if_not(msg.rbegin(), msg.rend(), std::iswspace).base(), msg.end());
+        throw ScriptException(line_number, msg);
+      }
+      if (!action)
+        throw ScriptException(line_number, "Invalid input: " + line);
+      script.push_back(ScriptStep{line_number, line, std::move(action), 0, 0});
+    }
+  }
+
+  if (!open_blocks.empty())
+    throw ScriptException(script.at(open_blocks.back()).line, "'repeat' without 'end'");
+
+  return script;
+}
+
+void REPL::run_script(const Script &script, ScriptHandlerFn handler) {
+  _running = true;
+  run_script(script, 0, script.size(), 0, handler);
+}
+
+bool REPL::run_script(const Script &script, size_t begin, size_t end,
+    size_t iteration, const ScriptHandlerFn &handler)
+{
+  for (auto i = begin; i < end && _running; ++i) {
+    const auto &step = script[i];
+    if (step.action) {
+      if (!handler(step, iteration))
+        return false;
+      continue;
+    }
+
+    for (size_t n = 0; n < step.count && _running; ++n) {
+      if (!run_script(script, i + 1, step.block_end, n, handler))
+        return false;
+    }
+    i = step.block_end - 1;
+  }
+  return _running;
+}
+
 std::string REPL::read_line() {
   auto line = readline(_prompt.c_str());
   if (line)
@@ -25,7 +25,9 @@
 #include <cassert>
 #include <memory>
 #include <optional>
+#include <istream>
 #include <ostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -34,6 +36,27 @@
 
 namespace xd::repl {
 
+  class ScriptException : public std::runtime_error {
+  public:
+    ScriptException(size_t line, const std::string &msg)
+      : std::runtime_error("Line " + std::to_string(line) + ": " + msg), _line(line) {};
+
+    size_t get_line() const { return _line; };
+
+  private:
+    size_t _line;
+  };
+
+  // One command of a script, or the start of a "repeat <count>" block,
+  // whose body runs up to (not including) the step at block_end
+  struct ScriptStep {
+    size_t line;
+    std::string text;
+    std::optional<cmd::Action> action;
+    size_t count;
+    size_t block_end;
+  };
+
   class REPL {
   private:
     using CommandPtr = std::unique_ptr<cmd::CommandBase>;
@@ -41,6 +64,11 @@ namespace xd::repl {
     using NoMatchHandlerFn = std::function<void(const std::string &)>;
     using ActionHandlerFn = std::function<void(const cmd::Action &)>;
     using CompleterFn = std::function<std::optional<std::vector<std::string>>(const std::string &)>;
+    // Gets the innermost loop's iteration; returns false to stop the script
+    using ScriptHandlerFn = std::function<bool(const ScriptStep &, size_t)>;
+
+  public:
+    using Script = std::vector<ScriptStep>;
 
   public:
     static void run(REPL& repl, ActionHandlerFn action_handler);
@@ -68,6 +96,12 @@ namespace xd::repl {
     const std::string &get_prompt() { return _prompt; };
     void print_help(std::ostream &out);
 
+    // Matches every line up front, so a script with a typo fails before
+    // any of it runs. Blank lines and lines starting with '#' are skipped.
+    Script parse_script(std::istream &in);
+    // Runs until the end, until the handler says to stop, or until exit()
+    void run_script(const Script &script, ScriptHandlerFn handler);
+
     void set_prompt_configurator(PromptConfiguratorFn f) {
       _prompt_configurator = std::move(f);
     }
@@ -90,6 +124,12 @@ namespace xd::repl {
     std::vector<std::string> complete(
         const std::string &s);
     std::optional<cmd::Action> interpret_line(const std::string& line);
+    // Returns false, after describing why to err, if a command matched but
+    // its arguments did not
+    bool try_interpret_line(const std::string &line, std::optional<cmd::Action> &action,
+        std::ostream &err);
+    bool run_script(const Script &script, size_t begin, size_t end,
+        size_t iteration, const ScriptHandlerFn &handler);
     std::string read_line();
 
     void run(ActionHandlerFn action_handler);
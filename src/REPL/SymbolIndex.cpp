@@ -0,0 +1,171 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <sstream>
+
+#include "SymbolIndex.hpp"
+
+using xd::repl::SymbolIndex;
+using xd::repl::SymbolIndexException;
+
+std::vector<unsigned char> SymbolIndex::serialize(std::vector<Symbol> symbols) {
+  std::sort(symbols.begin(), symbols.end(), [](const auto &a, const auto &b) {
+    return a.address < b.address || (a.address == b.address && a.size > b.size);
+  });
+
+  Header header;
+  memcpy(header.magic, SYMBOL_INDEX_MAGIC, sizeof(header.magic));
+  header.version = SYMBOL_INDEX_VERSION;
+  header.num_symbols = symbols.size();
+  header.names_size = 0;
+
+  std::vector<Entry> entries;
+  entries.reserve(symbols.size());
+  for (const auto &symbol : symbols) {
+    entries.push_back(Entry{symbol.address, symbol.size,
+        (uint32_t)header.names_size, (uint32_t)symbol.name.size()});
+    header.names_size += symbol.name.size();
+  }
+
+  std::vector<uint32_t> by_name(symbols.size());
+  std::iota(by_name.begin(), by_name.end(), 0);
+  std::sort(by_name.begin(), by_name.end(), [&symbols](const auto a, const auto b) {
+    return symbols[a].name < symbols[b].name;
+  });
+
+  std::vector<unsigned char> data;
+  data.reserve(sizeof(Header) + entries.size() * sizeof(Entry) +
+      by_name.size() * sizeof(uint32_t) + header.names_size);
+
+  const auto append = [&data](const void *p, size_t size) {
+    data.insert(data.end(), (const unsigned char*)p, (const unsigned char*)p + size);
+  };
+  append(&header, sizeof(header));
+  append(entries.data(), entries.size() * sizeof(Entry));
+  append(by_name.data(), by_name.size() * sizeof(uint32_t));
+  for (const auto &symbol : symbols)
+    append(symbol.name.data(), symbol.name.size());
+
+  return data;
+}
+
+SymbolIndex::SymbolIndex(std::shared_ptr<const void> owner,
+    const unsigned char *data, size_t size)
+  : _owner(std::move(owner))
+{
+  Header header;
+  if (size < sizeof(header))
+    throw SymbolIndexException("Truncated symbol index");
+
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, SYMBOL_INDEX_MAGIC, sizeof(header.magic)) ||
+      header.version != SYMBOL_INDEX_VERSION)
+  {
+    throw SymbolIndexException("Not a symbol index, or an incompatible version");
+  }
+
+  const auto entries_size = (uint64_t)header.num_symbols * sizeof(Entry);
+  const auto by_name_size = (uint64_t)header.num_symbols * sizeof(uint32_t);
+  if (size - sizeof(header) < entries_size + by_name_size + header.names_size)
+    throw SymbolIndexException("Truncated symbol index");
+
+  _num_symbols = header.num_symbols;
+  _entries = (const Entry*)(data + sizeof(header));
+  _by_name = (const uint32_t*)(data + sizeof(header) + entries_size);
+  _names = (const char*)(data + sizeof(header) + entries_size + by_name_size);
+
+  // The file may be stale or corrupt, and is trusted by every lookup after this
+  for (size_t i = 0; i < _num_symbols; ++i) {
+    const auto &entry = _entries[i];
+    if ((uint64_t)entry.name_offset + entry.name_length > header.names_size)
+      throw SymbolIndexException("Symbol name out of bounds in symbol index");
+    if (_by_name[i] >= _num_symbols)
+      throw SymbolIndexException("Symbol number out of bounds in symbol index");
+  }
+}
+
+std::optional<SymbolIndex::Match> SymbolIndex::lookup(xen::Address address) const {
+  const auto end = _entries + _num_symbols;
+  auto it = std::upper_bound(_entries, end, address,
+    [](const auto address, const auto &entry) {
+      return address < entry.address;
+    });
+
+  if (it == _entries)
+    return std::nullopt;
+  --it;
+
+  // Of several symbols at one address, the largest comes first
+  while (it != _entries && (it - 1)->address == it->address)
+    --it;
+
+  const auto offset = address - it->address;
+  if (it->size && offset >= it->size)
+    return std::nullopt;
+
+  return Match{get_name(*it), offset, it->size};
+}
+
+std::optional<xd::xen::Address> SymbolIndex::find(std::string_view name) const {
+  const auto end = _by_name + _num_symbols;
+  const auto it = std::lower_bound(_by_name, end, name,
+    [this](const auto i, const auto name) {
+      return get_name(_entries[i]) < name;
+    });
+
+  if (it == end || get_name(_entries[*it]) != name)
+    return std::nullopt;
+  return _entries[*it].address;
+}
+
+std::pair<size_t, size_t> SymbolIndex::find_prefix(std::string_view prefix) const {
+  const auto end = _by_name + _num_symbols;
+  const auto first = std::lower_bound(_by_name, end, prefix,
+    [this](const auto i, const auto prefix) {
+      return get_name(_entries[i]) < prefix;
+    });
+
+  // Names with the prefix sort together, starting from the first one
+  const auto last = std::partition_point(first, end,
+    [this, prefix](const auto i) {
+      return get_name(_entries[i]).substr(0, prefix.size()) == prefix;
+    });
+
+  return std::make_pair(first - _by_name, last - _by_name);
+}
+
+std::string SymbolIndex::symbolize(xen::Address address) const {
+  std::stringstream ss;
+  ss << std::hex;
+
+  const auto match = lookup(address);
+  if (!match)
+    ss << "0x" << address;
+  else if (!match->offset)
+    ss << match->name;
+  else
+    ss << match->name << "+0x" << match->offset;
+
+  return ss.str();
+}
@@ -0,0 +1,122 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_SYMBOLINDEX_HPP
+#define XENDBG_SYMBOLINDEX_HPP
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <Xen/Common.hpp>
+
+#define SYMBOL_INDEX_MAGIC "XDSYMIDX"
+#define SYMBOL_INDEX_VERSION 1
+
+namespace xd::repl {
+
+  class SymbolIndexException : public std::runtime_error {
+  public:
+    explicit SymbolIndexException(const std::string &msg)
+      : std::runtime_error(msg) {};
+  };
+
+  // Symbols in a flat, position-independent format that is used as-is
+  // whether built in memory or mapped from a cache file:
+  //
+  //   Header
+  //   Entry    entries[num_symbols];  by address, then by size descending
+  //   uint32_t by_name[num_symbols];  indices into entries, by name
+  //   char     names[names_size];
+  //
+  // Address lookups binary search the entries; name lookups binary search
+  // by_name. Nothing is copied out of the data to build either.
+  class SymbolIndex {
+  public:
+    struct Symbol {
+      std::string name;
+      xen::Address address;
+      uint64_t size;
+    };
+
+    struct Match {
+      std::string_view name;
+      uint64_t offset;
+      uint64_t size;  // 0 if unknown
+    };
+
+    static std::vector<unsigned char> serialize(std::vector<Symbol> symbols);
+
+    // The data must outlive the index; 'owner' is held to ensure that
+    SymbolIndex(std::shared_ptr<const void> owner, const unsigned char *data, size_t size);
+
+    // The symbol containing the address; for symbols of unknown size, the
+    // nearest one at or below it
+    std::optional<Match> lookup(xen::Address address) const;
+    std::optional<xen::Address> find(std::string_view name) const;
+
+    // "name+0xoffset", or just the hex address if no symbol contains it
+    std::string symbolize(xen::Address address) const;
+
+    size_t size() const { return _num_symbols; };
+
+    // The [first, last) range, in name order, of the names starting with
+    // prefix; the whole index for an empty prefix
+    std::pair<size_t, size_t> find_prefix(std::string_view prefix) const;
+
+    // In name order
+    std::string_view get_name(size_t i) const { return get_name(_entries[_by_name[i]]); };
+    xen::Address get_address(size_t i) const { return _entries[_by_name[i]].address; };
+
+  private:
+    struct Header {
+      char magic[8];
+      uint32_t version;
+      uint32_t num_symbols;
+      uint64_t names_size;
+    };
+
+    struct Entry {
+      xen::Address address;
+      uint64_t size;
+      uint32_t name_offset;
+      uint32_t name_length;
+    };
+
+    std::shared_ptr<const void> _owner;
+    const Entry *_entries;
+    const uint32_t *_by_name;
+    const char *_names;
+    size_t _num_symbols;
+
+    std::string_view get_name(const Entry &entry) const {
+      return std::string_view(_names + entry.name_offset, entry.name_length);
+    };
+  };
+
+}
+
+#endif //XENDBG_SYMBOLINDEX_HPP
@@ -0,0 +1,185 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <elf.h>
+#include <experimental/filesystem>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+#include <Globals.hpp>
+#include <Util/ElfFile.hpp>
+
+#include "SymbolStore.hpp"
+
+using xd::repl::SymbolIndex;
+using xd::repl::SymbolIndexException;
+using xd::repl::SymbolStore;
+using xd::util::ElfFile;
+
+namespace fs = std::experimental::filesystem;
+
+#define SYMBOL_CACHE_SUFFIX ".symidx"
+
+template <typename Sym_t>
+static void read_symtab(const ElfFile::Section &symtab, const ElfFile::Section &strtab,
+    std::vector<SymbolIndex::Symbol> &symbols)
+{
+  const auto num_symbols = symtab.size / sizeof(Sym_t);
+  for (size_t i = 0; i < num_symbols; ++i) {
+    Sym_t sym;
+    memcpy(&sym, symtab.data + i * sizeof(Sym_t), sizeof(sym));
+
+    // TODO: very basic for now; just load functions with known addresses
+    const auto type = ELF64_ST_TYPE(sym.st_info);
+    if ((type != STT_FUNC && type != STT_OBJECT) || !sym.st_value)
+      continue;
+    if (sym.st_name >= strtab.size)
+      continue;
+
+    const auto name = strtab.data + sym.st_name;
+    symbols.push_back(SymbolIndex::Symbol{
+        std::string(name, strnlen(name, strtab.size - sym.st_name)),
+        sym.st_value, sym.st_size});
+  }
+}
+
+static std::vector<SymbolIndex::Symbol> read_symbols(const ElfFile &elf) {
+  const auto &sections = elf.get_sections();
+
+  std::vector<SymbolIndex::Symbol> symbols;
+  for (const auto &section : sections) {
+    if (section.type != SHT_SYMTAB || !section.data || section.link >= sections.size())
+      continue;
+
+    const auto &strtab = sections.at(section.link);
+    if (!strtab.data)
+      continue;
+
+    if (elf.is_64_bit())
+      read_symtab<Elf64_Sym>(section, strtab, symbols);
+    else
+      read_symtab<Elf32_Sym>(section, strtab, symbols);
+  }
+  return symbols;
+}
+
+std::string SymbolStore::get_default_cache_dir() {
+  if (const auto xdg_cache_home = std::getenv("XDG_CACHE_HOME"))
+    return std::string(xdg_cache_home) + "/xendbg/symbols";
+  if (const auto home = std::getenv("HOME"))
+    return std::string(home) + "/.cache/xendbg/symbols";
+  return "";
+}
+
+std::shared_ptr<const SymbolIndex> SymbolStore::load(const std::string &elf_path) {
+  const ElfFile elf(elf_path);
+  const auto build_id = elf.get_build_id();
+
+  if (build_id) {
+    const auto it = _loaded.find(*build_id);
+    if (it != _loaded.end()) {
+      if (auto index = it->second.lock())
+        return index;
+    }
+  }
+
+  // Without a build ID there is nothing to tell two builds apart by
+  const auto cache_path = (build_id && !_cache_dir.empty())
+    ? _cache_dir + "/" + *build_id + SYMBOL_CACHE_SUFFIX
+    : "";
+
+  std::shared_ptr<const SymbolIndex> index;
+  if (!cache_path.empty())
+    index = map_cached(cache_path);
+
+  if (!index) {
+    auto data = SymbolIndex::serialize(read_symbols(elf));
+    if (!cache_path.empty()) {
+      save_cached(cache_path, data);
+      index = map_cached(cache_path);
+    }
+    if (!index) {
+      const auto owner = std::make_shared<std::vector<unsigned char>>(std::move(data));
+      index = std::make_shared<SymbolIndex>(owner, owner->data(), owner->size());
+    }
+  }
+
+  if (build_id)
+    _loaded[*build_id] = index;
+  return index;
+}
+
+std::shared_ptr<const SymbolIndex> SymbolStore::map_cached(const std::string &path) const {
+  const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return nullptr;
+
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (!fstat(fd, &st) && st.st_size > 0)
+    data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+    return nullptr;
+
+  const size_t size = st.st_size;
+  const std::shared_ptr<const void> owner(data, [size](const void *p) {
+    munmap(const_cast<void*>(p), size);
+  });
+
+  try {
+    return std::make_shared<SymbolIndex>(owner, (const unsigned char*)data, size);
+  } catch (const SymbolIndexException &e) {
+    spdlog::get(LOGNAME_ERROR)->warn("Ignoring symbol cache {0}: {1}", path, e.what());
+    return nullptr;
+  }
+}
+
+void SymbolStore::save_cached(const std::string &path,
+    const std::vector<unsigned char> &data) const
+{
+  // Written under a temporary name, so other sessions never map a partial file
+  const auto temp_path = path + "." + std::to_string(getpid());
+
+  try {
+    fs::create_directories(_cache_dir);
+
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write((const char*)data.data(), data.size());
+    out.close();
+    if (!out)
+      throw std::runtime_error("write failed");
+
+    fs::rename(temp_path, path);
+  } catch (const std::exception &e) {
+    spdlog::get(LOGNAME_ERROR)->warn("Failed to cache symbols to {0}: {1}", path, e.what());
+    std::error_code ec;
+    fs::remove(temp_path, ec);
+  }
+}
@@ -0,0 +1,57 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef XENDBG_SYMBOLSTORE_HPP
+#define XENDBG_SYMBOLSTORE_HPP
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "SymbolIndex.hpp"
+
+namespace xd::repl {
+
+  // Loads symbol indices, sharing one per ELF build ID across every session
+  // and domain. With a cache directory, each index is also saved there on
+  // first load and mapped straight from it afterwards, so reloading an ELF
+  // reads only its headers and build ID note.
+  class SymbolStore {
+  public:
+    explicit SymbolStore(std::string cache_dir)
+      : _cache_dir(std::move(cache_dir)) {};
+
+    // $XDG_CACHE_HOME/xendbg/symbols, or ~/.cache/xendbg/symbols
+    static std::string get_default_cache_dir();
+
+    std::shared_ptr<const SymbolIndex> load(const std::string &elf_path);
+
+  private:
+    std::string _cache_dir;
+    std::unordered_map<std::string, std::weak_ptr<const SymbolIndex>> _loaded;
+
+    std::shared_ptr<const SymbolIndex> map_cached(const std::string &path) const;
+    void save_cached(const std::string &path, const std::vector<unsigned char> &data) const;
+  };
+
+}
+
+#endif //XENDBG_SYMBOLSTORE_HPP
@@ -21,10 +21,12 @@
 
 #include <csignal>
 #include <iostream>
+#include <map>
 
 #include <spdlog/spdlog.h>
 
 #include <Globals.hpp>
+#include <Xen/XenStats.hpp>
 
 #include "Debugger/Debugger.hpp"
 #include "Debugger/DebuggerHVM.hpp"
@@ -32,19 +34,35 @@
 #include "DebugSession.hpp"
 #include "ServerModeController.hpp"
 
+using xd::MetricsServer;
 using xd::ServerModeController;
 using xd::DebugSession;
 using xd::xen::Xen;
+using xd::xen::XenOp;
+using xd::xen::XenStats;
 
-ServerModeController::ServerModeController(std::string address, uint16_t base_port, bool non_stop_mode)
+ServerModeController::ServerModeController(std::string address, uint16_t base_port,
+    bool non_stop_mode, bool record, std::shared_ptr<gdb::GDBTrace> trace)
   : _xen(Xen::create()),
     _loop(uvw::Loop::getDefault()),
     _signal(_loop->resource<uvw::SignalHandle>()),
     _poll(_loop->resource<uvw::PollHandle>(_xen->xenstore.get_fileno())),
-    _address(std::move(address)), _next_port(base_port), _non_stop_mode(non_stop_mode)
+    _address(std::move(address)), _next_port(base_port), _non_stop_mode(non_stop_mode),
+    _record(record),
+    _trace(std::move(trace))
 {
 }
 
+void ServerModeController::serve_metrics(uint16_t port) {
+  _metrics = std::make_unique<MetricsServer>(*_loop, [this](auto &out) {
+    write_metrics(out);
+  });
+  _metrics->listen(_address, port);
+
+  spdlog::get(LOGNAME_CONSOLE)->info(
+      "Metrics @ port {0:d}", port);
+}
+
 void ServerModeController::run_single(const std::string &name) {
   const auto domains = _xen->get_domains();
 
@@ -118,6 +136,10 @@ void ServerModeController::stop() {
 
   _loop->run();
   _loop->close();
+
+  // The process exits right after this, so the trace must be finished here
+  if (_trace)
+    _trace->close();
 }
 
 size_t ServerModeController::add_new_instances() {
@@ -168,9 +190,10 @@ void ServerModeController::add_instance(xen::DomainAny domain_any) {
 
   auto debugger = std::visit(util::overloaded {
     [&](xen::DomainHVM domain) {
-      return std::static_pointer_cast<dbg::Debugger>(
-          std::make_shared<dbg::DebuggerHVM>(
-              *_loop, std::move(domain), _xen->xendevicemodel, _xen->xenevtchn, _non_stop_mode));
+      auto debugger = std::make_shared<dbg::DebuggerHVM>(
+          *_loop, std::move(domain), _xen->xendevicemodel, _xen->xenevtchn, _non_stop_mode);
+      debugger->set_auto_checkpoint(_record);
+      return std::static_pointer_cast<dbg::Debugger>(debugger);
     },
     [&](xen::DomainPV domain) {
       return std::static_pointer_cast<dbg::Debugger>(
@@ -178,7 +201,7 @@ void ServerModeController::add_instance(xen::DomainAny domain_any) {
     },
   }, domain_any);
 
-  auto [kv, _] = _instances.emplace(domid, std::make_unique<DebugSession>(*_loop, std::move(debugger)));
+  auto [kv, _] = _instances.emplace(domid, std::make_unique<DebugSession>(*_loop, std::move(debugger), _trace));
   kv->second->run(_address, _next_port++, [this, domid](auto error) {
     spdlog::get(LOGNAME_CONSOLE)->info(
         "ERROR: Domain {0:d}", domid);
@@ -186,3 +209,89 @@ void ServerModeController::add_instance(xen::DomainAny domain_any) {
     add_new_instances();
   });
 }
+
+void ServerModeController::write_metrics(std::ostream &out) const {
+  // Sorted, so that scrapes list domains in a stable order
+  std::map<xen::DomID, const DebugSession*> sessions;
+  for (const auto &[domid, session] : _instances)
+    sessions.emplace(domid, session.get());
+
+  const auto per_session = [&](const std::string &name, const std::string &type,
+      const std::string &help, const auto &get_value)
+  {
+    MetricsServer::write_header(out, name, type, help);
+    for (const auto &[domid, session] : sessions)
+      out << name << "{domid=\"" << domid << "\"} " << get_value(*session) << "\n";
+  };
+
+  MetricsServer::write_header(out, "xendbg_sessions", "gauge",
+      "Number of domains being served.");
+  out << "xendbg_sessions " << sessions.size() << "\n";
+
+  per_session("xendbg_session_port", "gauge",
+      "Port the domain's debug stub listens on.",
+      [](const auto &session) { return session.get_port(); });
+  per_session("xendbg_session_clients", "gauge",
+      "Debugger clients connected to the domain's stub (0 or 1).",
+      [](const auto &session) { return session.has_client() ? 1 : 0; });
+  per_session("xendbg_stops_total", "counter",
+      "Stops reported to the client.",
+      [](const auto &session) { return session.get_debugger().get_num_stops(); });
+  per_session("xendbg_breakpoint_hits_total", "counter",
+      "Software breakpoints hit.",
+      [](const auto &session) { return session.get_debugger().get_num_breakpoint_hits(); });
+  per_session("xendbg_breakpoints", "gauge",
+      "Breakpoints currently inserted.",
+      [](const auto &session) { return session.get_debugger().get_num_breakpoints(); });
+  per_session("xendbg_markers_dropped_total", "counter",
+      "Guest-request markers overwritten before being read.",
+      [](const auto &session) { return session.get_debugger().get_markers().get_num_dropped(); });
+
+  // Xen calls are recorded regardless of sessions, so domains that have
+  // since gone away still appear here
+  const auto summaries = XenStats::collect();
+  const auto per_xen_op = [&](const std::string &name, const std::string &help,
+      const auto &get_value)
+  {
+    MetricsServer::write_header(out, name, "counter", help);
+    for (const auto &summary : summaries) {
+      out << name << "{";
+      if (summary.domid != XEN_STATS_NO_DOMAIN)
+        out << "domid=\"" << summary.domid << "\",";
+      out << "op=\"" << xen::get_xen_op_name(summary.op) << "\"} "
+          << get_value(summary) << "\n";
+    }
+  };
+
+  MetricsServer::write_header(out, "xendbg_mappings_created_total", "counter",
+      "Foreign memory mappings of guest pages.");
+  for (const auto &summary : summaries) {
+    if (summary.op == XenOp::ForeignMap)
+      out << "xendbg_mappings_created_total{domid=\"" << summary.domid << "\"} "
+          << summary.count << "\n";
+  }
+
+  per_xen_op("xendbg_xen_calls_total", "Calls into Xen.",
+      [](const auto &summary) { return summary.count; });
+  per_xen_op("xendbg_xen_call_errors_total", "Calls into Xen that failed.",
+      [](const auto &summary) { return summary.errors; });
+  per_xen_op("xendbg_xen_call_seconds_total", "Time spent in calls into Xen.",
+      [](const auto &summary) { return (double)summary.total_ns / 1e9; });
+
+  const auto per_packet_type = [&](const std::string &name, const std::string &help,
+      const auto &get_value)
+  {
+    MetricsServer::write_header(out, name, "counter", help);
+    for (const auto &[domid, session] : sessions) {
+      for (const auto &[type, stats] : session->get_packet_stats().get_types()) {
+        out << name << "{domid=\"" << domid << "\",type=\""
+            << MetricsServer::escape_label(type) << "\"} " << get_value(stats) << "\n";
+      }
+    }
+  };
+
+  per_packet_type("xendbg_packets_total", "GDB packets handled, by type.",
+      [](const auto &stats) { return stats.total.get_count(); });
+  per_packet_type("xendbg_packet_seconds_total", "Time spent handling GDB packets, by type.",
+      [](const auto &stats) { return (double)stats.total.get_total_ns() / 1e9; });
+}
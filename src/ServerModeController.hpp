@@ -23,6 +23,7 @@
 #define XENDBG_SERVER_HPP
 
 #include <cstdint>
+#include <ostream>
 #include <stdexcept>
 #include <unordered_map>
 
@@ -31,6 +32,7 @@
 #include <Xen/Xen.hpp>
 
 #include "DebugSession.hpp"
+#include "MetricsServer.hpp"
 
 namespace xd {
 
@@ -47,7 +49,13 @@ namespace xd {
 
   class ServerModeController {
   public:
-    explicit ServerModeController(std::string address, uint16_t base_port, bool non_stop_mode);
+    // If trace is given, every domain's packets are traced to it
+    explicit ServerModeController(std::string address, uint16_t base_port,
+        bool non_stop_mode, bool record, std::shared_ptr<gdb::GDBTrace> trace = nullptr);
+
+    // Serves Prometheus metrics for all domains on the given port, on the
+    // same address as the debug sessions
+    void serve_metrics(uint16_t port);
 
     void run_single(const std::string &name);
     void run_single(xen::DomID domid);
@@ -64,7 +72,10 @@ namespace xd {
     std::string _address;
     uint16_t _next_port;
     bool _non_stop_mode;
+    bool _record;
     std::unordered_map<xen::DomID, std::unique_ptr<DebugSession>> _instances;
+    std::shared_ptr<gdb::GDBTrace> _trace;
+    std::unique_ptr<MetricsServer> _metrics;
 
   private:
     void run();
@@ -74,6 +85,7 @@ namespace xd {
     size_t prune_instances();
 
     void add_instance(xen::DomainAny domain);
+    void write_metrics(std::ostream &out) const;
   };
 
 }
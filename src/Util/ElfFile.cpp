@@ -0,0 +1,159 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <sstream>
+#include <iomanip>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Util/ElfFile.hpp>
+
+using xd::util::ElfFile;
+using xd::util::ElfFileException;
+
+#define ELF_NOTE_ALIGN 4
+
+ElfFile::ElfFile(const std::string &path)
+  : _size(0), _is_64_bit(false)
+{
+  const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw ElfFileException("Failed to open " + path);
+
+  struct stat st;
+  if (fstat(fd, &st) || (size_t)st.st_size < EI_NIDENT) {
+    close(fd);
+    throw ElfFileException("Not an ELF file: " + path);
+  }
+
+  _size = st.st_size;
+  const auto data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    throw ElfFileException("Failed to map " + path);
+
+  const auto size = _size;
+  _data = std::unique_ptr<char, std::function<void(char*)>>((char*)data,
+    [size](char *p) {
+      munmap(p, size);
+    });
+
+  if (memcmp(_data.get(), ELFMAG, SELFMAG))
+    throw ElfFileException("Not an ELF file: " + path);
+
+  _is_64_bit = (_data.get()[EI_CLASS] == ELFCLASS64);
+  if (_is_64_bit)
+    read_sections<Elf64_Ehdr, Elf64_Shdr>();
+  else
+    read_sections<Elf32_Ehdr, Elf32_Shdr>();
+}
+
+template <typename Ehdr_t, typename Shdr_t>
+void ElfFile::read_sections() {
+  const auto in_bounds = [this](uint64_t offset, uint64_t size) {
+    return offset <= _size && size <= _size - offset;
+  };
+
+  if (!in_bounds(0, sizeof(Ehdr_t)))
+    throw ElfFileException("Truncated ELF header");
+
+  Ehdr_t ehdr;
+  memcpy(&ehdr, _data.get(), sizeof(ehdr));
+  if (!ehdr.e_shoff || ehdr.e_shentsize != sizeof(Shdr_t) ||
+      !in_bounds(ehdr.e_shoff, (uint64_t)ehdr.e_shnum * sizeof(Shdr_t)))
+  {
+    throw ElfFileException("Invalid section header table");
+  }
+
+  std::vector<Shdr_t> shdrs(ehdr.e_shnum);
+  memcpy(shdrs.data(), _data.get() + ehdr.e_shoff, shdrs.size() * sizeof(Shdr_t));
+
+  const Shdr_t *shstrtab = (ehdr.e_shstrndx < shdrs.size())
+    ? &shdrs[ehdr.e_shstrndx]
+    : nullptr;
+  if (shstrtab && !in_bounds(shstrtab->sh_offset, shstrtab->sh_size))
+    shstrtab = nullptr;
+
+  for (const auto &shdr : shdrs) {
+    std::string name;
+    if (shstrtab && shdr.sh_name < shstrtab->sh_size) {
+      const auto names = _data.get() + shstrtab->sh_offset;
+      name = std::string(names + shdr.sh_name,
+          strnlen(names + shdr.sh_name, shstrtab->sh_size - shdr.sh_name));
+    }
+
+    const auto has_data = shdr.sh_type != SHT_NOBITS &&
+      in_bounds(shdr.sh_offset, shdr.sh_size);
+
+    _sections.push_back(Section{name, shdr.sh_type, shdr.sh_addr,
+        has_data ? _data.get() + shdr.sh_offset : nullptr,
+        has_data ? (size_t)shdr.sh_size : 0,
+        shdr.sh_link, (size_t)shdr.sh_entsize});
+  }
+}
+
+std::optional<ElfFile::Section> ElfFile::get_section(const std::string &name) const {
+  for (const auto &section : _sections) {
+    if (section.name == name)
+      return section;
+  }
+  return std::nullopt;
+}
+
+std::optional<std::string> ElfFile::get_build_id() const {
+  const auto align = [](size_t n) {
+    return (n + ELF_NOTE_ALIGN - 1) & ~(size_t)(ELF_NOTE_ALIGN - 1);
+  };
+
+  // Notes have the same layout in 32- and 64-bit files
+  for (const auto &section : _sections) {
+    if (section.type != SHT_NOTE || !section.data)
+      continue;
+
+    size_t offset = 0;
+    while (offset + sizeof(Elf64_Nhdr) <= section.size) {
+      Elf64_Nhdr nhdr;
+      memcpy(&nhdr, section.data + offset, sizeof(nhdr));
+      const auto name_offset = offset + sizeof(nhdr);
+      const auto desc_offset = name_offset + align(nhdr.n_namesz);
+      if (desc_offset + nhdr.n_descsz > section.size)
+        break;
+
+      if (nhdr.n_type == NT_GNU_BUILD_ID && nhdr.n_namesz == sizeof(ELF_NOTE_GNU) &&
+          !memcmp(section.data + name_offset, ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU)))
+      {
+        std::stringstream ss;
+        ss << std::hex << std::setfill('0');
+        for (size_t i = 0; i < nhdr.n_descsz; ++i)
+          ss << std::setw(2) << (unsigned)(unsigned char)section.data[desc_offset + i];
+        return ss.str();
+      }
+
+      offset = desc_offset + align(nhdr.n_descsz);
+    }
+  }
+
+  return std::nullopt;
+}
@@ -20,21 +20,23 @@
 //
 
 #include <Xen/Domain.hpp>
+#include <Xen/PageTableWalker.hpp>
 #include <Xen/Xen.hpp>
 #include <Xen/XenForeignMemory.hpp>
-#include <Util/overloaded.hpp>
+#include <Xen/XenStats.hpp>
 #include <Registers/RegistersX86.hpp>
 
-using xd::reg::RegistersX86Any;
 using xd::xen::Address;
 using xd::xen::Domain;
 using xd::xen::DomInfo;
 using xd::xen::MemInfo;
+using xd::xen::PageTableWalker;
 using xd::xen::Xen;
 using xd::xen::XenCall;
 using xd::xen::XenForeignMemory;
 
 #define CR0_PG 0x80000000
+#define CR3_NOFLUSH (1ull << 63)
 #define CR4_PAE 0x2
 #define PTE_PSE 0x80
 #define EFER_LMA 0x400
@@ -72,7 +74,8 @@ void Domain::set_debugging(bool enable, VCPU_ID vcpu_id) const {
         " on domain " + std::to_string(_domid));
 
   int err;
-  if ((err = xc_domain_setdebugging(_xen->xenctrl.get(), _domid, (unsigned int)enable))) {
+  if ((err = XEN_STATS_MEASURE(SetDebugging, _domid,
+        xc_domain_setdebugging(_xen->xenctrl.get(), _domid, (unsigned int)enable)))) {
     throw XenException(
         "Failed to enable debugging on domain " +
         std::to_string(_domid), -err);
@@ -105,7 +108,8 @@ DomInfo Domain::get_dominfo() const {
 int Domain::get_word_size() const {
   int err;
   unsigned int word_size;
-  if ((err = xc_domain_get_guest_width(_xen->xenctrl.get(), _domid, &word_size))) {
+  if ((err = XEN_STATS_MEASURE(GetGuestWidth, _domid,
+        xc_domain_get_guest_width(_xen->xenctrl.get(), _domid, &word_size)))) {
     throw XenException(
         "Failed to get word size for domain " + std::to_string(_domid),
         -err);
@@ -114,7 +118,13 @@ int Domain::get_word_size() const {
 }
 
 Address Domain::translate_foreign_address(Address vaddr, VCPU_ID vcpu_id) const {
-  return xc_translate_foreign_address(_xen->xenctrl.get(), _domid, vcpu_id, vaddr);
+  return XEN_STATS_MEASURE(TranslateAddress, _domid,
+      xc_translate_foreign_address(_xen->xenctrl.get(), _domid, vcpu_id, vaddr));
+}
+
+Address Domain::translate_foreign_address(Address vaddr, const PagingMode &paging_mode) const {
+  const auto walk = PageTableWalker(*this).translate(vaddr, paging_mode);
+  return walk.physical_address ? (*walk.physical_address >> XC_PAGE_SHIFT) : 0;
 }
 
 MemInfo Domain::map_meminfo() const {
@@ -129,7 +139,8 @@ MemInfo Domain::map_meminfo() const {
   std::memset(meminfo.get(), 0, sizeof(xc_domain_meminfo));
 
   int err;
-  if ((err = xc_map_domain_meminfo(_xen->xenctrl.get(), _domid, meminfo.get()))) {
+  if ((err = XEN_STATS_MEASURE(MapMemInfo, _domid,
+        xc_map_domain_meminfo(_xen->xenctrl.get(), _domid, meminfo.get())))) {
     throw XenException(
         "Failed to map meminfo for domain " + std::to_string(_domid),
         -err);
@@ -138,35 +149,29 @@ MemInfo Domain::map_meminfo() const {
   return meminfo;
 }
 
-// modified version of xc_translate_foreign_address in xc_pagetab.c
+xd::xen::PagingMode Domain::get_hvm_paging_mode(uint64_t cr0, uint64_t cr3,
+    uint64_t cr4, uint64_t msr_efer)
+{
+  if (!(cr0 & CR0_PG))
+    return PagingMode{0, 0, cr3};
+
+  // A value written to CR3 may carry the no-flush bit, which is not part of the address
+  cr3 &= ~CR3_NOFLUSH;
+  const size_t pt_levels = (msr_efer & EFER_LMA) ? 4 : (cr4 & CR4_PAE) ? 3 : 2;
+  return PagingMode{pt_levels, cr3 & ((pt_levels == 3) ? ~0x1full : ~0xfffull), cr3};
+}
+
+xd::xen::PagingMode Domain::get_paging_mode(VCPU_ID vcpu_id) const {
+  return get_paging_mode(get_cpu_context(vcpu_id));
+}
+
 std::optional<xd::xen::PageTableEntry> Domain::get_page_table_entry(Address vaddr, VCPU_ID vcpu_id) const {
-  // FYI: "cr3" is the register that holds the base address of the page table
-  const auto [cr0, cr3, cr4, msr_efer] = std::visit(util::overloaded {
-    [](const auto &regs) {
-      return std::make_tuple(
-          regs.template get<reg::x86::cr0>(),
-          regs.template get<reg::x86::cr3>(),
-          regs.template get<reg::x86::cr4>(),
-          regs.template get<reg::x86::msr_efer>());
-    }}, get_cpu_context(vcpu_id));
-
-    uint64_t paddr, mask, pte;
-    size_t pt_levels;
-
-    if (get_dominfo().hvm) {
-      if (!(cr0 & CR0_PG))
-        return vaddr >> XC_PAGE_SHIFT;
-      pt_levels = (msr_efer & EFER_LMA) ? 4 : (cr4 & CR4_PAE) ? 3 : 2;
-      paddr = cr3 & ((pt_levels == 3) ? ~0x1full : ~0xfffull);
-    } else {
-      if (get_word_size() == sizeof(uint64_t)) {
-        pt_levels = 4;
-        paddr = cr3;
-      } else {
-        pt_levels = 3;
-        paddr = ((cr3 >> XC_PAGE_SHIFT) | (cr3 << 20)) << XC_PAGE_SHIFT;
-      }
-    }
+  const auto paging_mode = get_paging_mode(vcpu_id);
+  if (!paging_mode.levels)
+    return vaddr >> XC_PAGE_SHIFT;
+
+  const auto pt_levels = paging_mode.levels;
+  uint64_t paddr = paging_mode.root, mask, pte;
 
   if (pt_levels == 4) {
     vaddr &= 0x0000ffffffffffffull;
@@ -201,9 +206,9 @@ std::optional<xd::xen::PageTableEntry> Domain::get_page_table_entry(Address vadd
   return pte;
 }
 
-void Domain::set_mem_access(xenmem_access_t access, Address start_address, Address size) const {
-  if (const auto err = xc_set_mem_access( _xen->xenctrl.get(), _domid, access, 
-        start_address, size))
+void Domain::set_mem_access(xenmem_access_t access, xen_pfn_t first_pfn, uint32_t nr) const {
+  if (const auto err = XEN_STATS_MEASURE(SetMemAccess, _domid,
+        xc_set_mem_access(_xen->xenctrl.get(), _domid, access, first_pfn, nr)))
   {
     throw XenException("xc_set_mem_access", -err);
   }
@@ -211,8 +216,8 @@ void Domain::set_mem_access(xenmem_access_t access, Address start_address, Addre
 
 xenmem_access_t Domain::get_mem_access(Address address) const {
   xenmem_access_t access;
-  if (const auto err = xc_get_mem_access(_xen->xenctrl.get(), _domid,
-        address >> XC_PAGE_SHIFT, &access))
+  if (const auto err = XEN_STATS_MEASURE(GetMemAccess, _domid,
+        xc_get_mem_access(_xen->xenctrl.get(), _domid, address >> XC_PAGE_SHIFT, &access)))
   {
     throw XenException("xc_get_mem_access", -err);
   }
@@ -292,7 +297,8 @@ void Domain::pause() const {
     return;
 
   int err;
-  if ((err = xc_domain_pause(_xen->xenctrl.get(), _domid)))
+  if ((err = XEN_STATS_MEASURE(Pause, _domid,
+        xc_domain_pause(_xen->xenctrl.get(), _domid))))
     throw XenException(
         "Failed to pause domain " + std::to_string(_domid), -err);
 }
@@ -303,14 +309,16 @@ void Domain::unpause() const {
     return;
 
   int err;
-  if ((err = xc_domain_unpause(_xen->xenctrl.get(), _domid)))
+  if ((err = XEN_STATS_MEASURE(Unpause, _domid,
+        xc_domain_unpause(_xen->xenctrl.get(), _domid))))
     throw XenException(
         "Failed to unpause domain " + std::to_string(_domid), -err);
 }
 
 void Domain::shutdown(int reason) const {
   int err;
-  if ((err = xc_domain_shutdown(_xen->xenctrl.get(), _domid, reason)))
+  if ((err = XEN_STATS_MEASURE(Shutdown, _domid,
+        xc_domain_shutdown(_xen->xenctrl.get(), _domid, reason))))
     throw XenException(
         "Failed to shutdown domain " + std::to_string(_domid), -err);
 }
@@ -320,25 +328,85 @@ void Domain::destroy() const {
   shutdown(SHUTDOWN_poweroff);
 
   int err;
-  if ((err = xc_domain_destroy(_xen->xenctrl.get(), _domid)))
+  if ((err = XEN_STATS_MEASURE(Destroy, _domid,
+        xc_domain_destroy(_xen->xenctrl.get(), _domid))))
     throw XenException(
         "Failed to destroy domain " + std::to_string(_domid), -err);}
 
 xen_pfn_t Domain::get_max_gpfn() const {
   xen_pfn_t max_gpfn;
   int err;
-  if ((err = xc_domain_maximum_gpfn(_xen->xenctrl.get(), _domid, &max_gpfn)))
+  if ((err = XEN_STATS_MEASURE(MaximumGPFN, _domid,
+        xc_domain_maximum_gpfn(_xen->xenctrl.get(), _domid, &max_gpfn))))
     throw XenException(
         "Failed to destroy domain " + std::to_string(_domid), -err);
   return max_gpfn;
 }
 
+void Domain::set_log_dirty(bool enabled) const {
+  const auto op = enabled
+    ? XEN_DOMCTL_SHADOW_OP_ENABLE_LOGDIRTY
+    : XEN_DOMCTL_SHADOW_OP_OFF;
+
+  if (XEN_STATS_MEASURE(ShadowControl, _domid,
+        xc_shadow_control(_xen->xenctrl.get(), _domid, op,
+          nullptr, 0, nullptr, 0, nullptr)) < 0)
+  {
+    throw XenException(
+        "Failed to " + std::string(enabled ? "enable" : "disable") +
+        " log-dirty mode for domain " + std::to_string(_domid), errno);
+  }
+}
+
+std::vector<xen_pfn_t> Domain::get_and_clear_dirty_pages() const {
+  const auto xenctrl = _xen->xenctrl.get();
+  const auto num_pfns = get_max_gpfn() + 1;
+  const auto bits_per_word = 8 * sizeof(unsigned long);
+  const auto num_words = (num_pfns + bits_per_word - 1) / bits_per_word;
+  const auto num_bitmap_pages =
+    (num_words * sizeof(unsigned long) + XC_PAGE_SIZE - 1) >> XC_PAGE_SHIFT;
+
+  DECLARE_HYPERCALL_BUFFER(unsigned long, bitmap);
+  bitmap = (unsigned long*)xc_hypercall_buffer_alloc_pages(
+      xenctrl, bitmap, num_bitmap_pages);
+  if (!bitmap)
+    throw XenException("Failed to allocate dirty bitmap", errno);
+
+  const auto ret = XEN_STATS_MEASURE(ShadowControl, _domid,
+      xc_shadow_control(xenctrl, _domid,
+        XEN_DOMCTL_SHADOW_OP_CLEAN, HYPERCALL_BUFFER(bitmap), num_pfns,
+        nullptr, 0, nullptr));
+  if (ret < 0) {
+    const auto err = errno;
+    xc_hypercall_buffer_free_pages(xenctrl, bitmap, num_bitmap_pages);
+    throw XenException(
+        "Failed to read dirty bitmap for domain " + std::to_string(_domid), err);
+  }
+
+  // Scan a word at a time; the bitmap is usually very sparse
+  std::vector<xen_pfn_t> dirty;
+  for (size_t i = 0; i < num_words; ++i) {
+    auto word = bitmap[i];
+    while (word) {
+      const auto bit = __builtin_ctzl(word);
+      const auto pfn = i * bits_per_word + bit;
+      if (pfn < num_pfns)
+        dirty.push_back(pfn);
+      word &= word - 1;
+    }
+  }
+
+  xc_hypercall_buffer_free_pages(xenctrl, bitmap, num_bitmap_pages);
+  return dirty;
+}
+
 XenCall::DomctlUnion Domain::hypercall_domctl(uint32_t command, XenCall::InitFn init, XenCall::CleanupFn cleanup) const {
   return _xen->xenctrl.xencall.do_domctl(*this, command, std::move(init), std::move(cleanup));
 }
 
 void Domain::set_access_required(bool required) {
-  if (const auto err = xc_domain_set_access_required(_xen->xenctrl.get(), _domid, required))
+  if (const auto err = XEN_STATS_MEASURE(SetAccessRequired, _domid,
+        xc_domain_set_access_required(_xen->xenctrl.get(), _domid, required)))
     throw XenException("xc_domain_set_access_required", -err);
 }
 
@@ -19,12 +19,17 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <cstring>
+#include <vector>
+
 #include <Xen/DomainHVM.hpp>
 #include <Xen/BridgeHeaders/hvm_save.h>
 #include <Xen/BridgeHeaders/vm_event.h>
 #include <Xen/Xen.hpp>
+#include <Xen/XenStats.hpp>
 
 using xd::reg::RegistersX86Any;
+using xd::reg::x86::ExtendedRegisters;
 using xd::reg::x86_32::RegistersX86_32;
 using xd::reg::x86_64::RegistersX86_64;
 using xd::xen::DomainHVM;
@@ -32,6 +37,10 @@ using xd::xen::PagePermissions;
 using xd::xen::VCPU_ID;
 using xd::xen::Xen;
 
+// Large enough for an XSAVE area with every component Xen offers guests
+#define HVM_XSAVE_RECORD_MAX_SIZE 0x2000
+#define X86_XCR0_YMM (1ULL << 2)
+
 #define GET_HVM(_regs, _hvm, _reg) \
   _regs.get<_reg>() = _hvm._reg;
 #define GET_HVM2(_regs, _hvm, _reg, _hvm_reg) \
@@ -50,6 +59,16 @@ RegistersX86Any DomainHVM::get_cpu_context(VCPU_ID vcpu_id) const {
   return convert_regs_from_hvm(get_cpu_context_raw(vcpu_id));
 }
 
+xd::xen::PagingMode DomainHVM::get_paging_mode(const RegistersX86Any &regs) const {
+  return std::visit([](const auto &context) {
+    return get_hvm_paging_mode(
+        context.template get<reg::x86::cr0>(),
+        context.template get<reg::x86::cr3>(),
+        context.template get<reg::x86::cr4>(),
+        context.template get<reg::x86::msr_efer>());
+  }, regs);
+}
+
 void DomainHVM::set_cpu_context(RegistersX86Any regs, VCPU_ID vcpu_id) const {
   const auto regs64 = std::get<RegistersX86_64>(regs);
   const auto old_context = get_cpu_context_raw(vcpu_id);
@@ -58,6 +77,40 @@ void DomainHVM::set_cpu_context(RegistersX86Any regs, VCPU_ID vcpu_id) const {
   set_cpu_context_raw(new_context, vcpu_id);
 }
 
+ExtendedRegisters DomainHVM::get_extended_context(VCPU_ID vcpu_id) const {
+  ExtendedRegisters regs{};
+
+  const auto cpu = get_cpu_context_raw(vcpu_id);
+  memcpy(regs.bytes.data(), cpu.fpu_regs, X86_FXSAVE_SIZE);
+
+  // The XSAVE record is only present if the guest has enabled XSAVE
+  std::vector<uint8_t> record(HVM_XSAVE_RECORD_MAX_SIZE);
+  if (XEN_STATS_MEASURE(HVMGetContextPartial, _domid,
+      xc_domain_hvm_getcontext_partial(_xen->xenctrl.get(), _domid,
+        CPU_XSAVE_CODE, (uint16_t)vcpu_id, record.data(), record.size())))
+  {
+    return regs;
+  }
+
+  const auto xsave = (const struct hvm_hw_cpu_xsave*)record.data();
+  regs.has_ymm = (xsave->xcr0 & X86_XCR0_YMM) != 0;
+
+  // A component not marked in XSTATE_BV is in its initial (zeroed) state
+  if (regs.has_ymm && (xsave->save_area.xsave_hdr.xstate_bv & X86_XCR0_YMM)) {
+    memcpy(regs.bytes.data() + ExtendedRegisters::YMM_HI_OFFSET,
+        (const uint8_t*)&xsave->save_area + X86_XSAVE_AVX_OFFSET,
+        ExtendedRegisters::MAX_YMM * X86_YMM_HI_SIZE);
+  }
+
+  return regs;
+}
+
+void DomainHVM::set_extended_context(const ExtendedRegisters &regs, VCPU_ID vcpu_id) const {
+  auto cpu = get_cpu_context_raw(vcpu_id);
+  memcpy(cpu.fpu_regs, regs.bytes.data(), X86_FXSAVE_SIZE);
+  set_cpu_context_raw(cpu, vcpu_id);
+}
+
 void DomainHVM::set_singlestep(bool enable, VCPU_ID vcpu_id) const {
   uint32_t op = enable
                 ? XEN_DOMCTL_DEBUG_OP_SINGLE_STEP_ON
@@ -70,7 +123,8 @@ void DomainHVM::set_singlestep(bool enable, VCPU_ID vcpu_id) const {
         " on domain " + std::to_string(_domid));
 
   int err;
-  if ((err = xc_domain_debug_control(_xen->xenctrl.get(), _domid, op, vcpu_id))) {
+  if ((err = XEN_STATS_MEASURE(DebugControl, _domid,
+        xc_domain_debug_control(_xen->xenctrl.get(), _domid, op, vcpu_id)))) {
     throw XenException(
         "Failed to " + std::string(enable ? "enable" : "disable") +
         " single-step mode for VCPU " + std::to_string(vcpu_id) + " on domain " +
@@ -80,7 +134,8 @@ void DomainHVM::set_singlestep(bool enable, VCPU_ID vcpu_id) const {
 
 xd::xen::XenEventChannel::RingPageAndPort DomainHVM::enable_monitor() const {
   uint32_t port;
-  void *ring_page = xc_monitor_enable(_xen->xenctrl.get(), _domid, &port);
+  void *ring_page = XEN_STATS_MEASURE(MonitorEnable, _domid,
+      xc_monitor_enable(_xen->xenctrl.get(), _domid, &port));
 
   if (!ring_page) {
     switch (errno) {
@@ -101,12 +156,14 @@ xd::xen::XenEventChannel::RingPageAndPort DomainHVM::enable_monitor() const {
 }
 
 void DomainHVM::disable_monitor() const {
-  xc_monitor_disable(_xen->xenctrl.get(), _domid);
+  XEN_STATS_MEASURE(MonitorDisable, _domid,
+      xc_monitor_disable(_xen->xenctrl.get(), _domid));
 }
 
 DomainHVM::MonitorCapabilities DomainHVM::monitor_get_capabilities() {
   uint32_t capabilities;
-  xc_monitor_get_capabilities(_xen->xenctrl.get(), _domid, &capabilities);
+  XEN_STATS_MEASURE(MonitorControl, _domid,
+      xc_monitor_get_capabilities(_xen->xenctrl.get(), _domid, &capabilities));
 
   return MonitorCapabilities {
     .mov_to_msr = (bool) (capabilities & VM_EVENT_REASON_MOV_TO_MSR),
@@ -120,42 +177,59 @@ DomainHVM::MonitorCapabilities DomainHVM::monitor_get_capabilities() {
 }
 
 void DomainHVM::monitor_mov_to_msr(uint32_t msr, bool enable) {
-  xc_monitor_mov_to_msr(_xen->xenctrl.get(), _domid, msr, enable);
+  XEN_STATS_MEASURE(MonitorControl, _domid,
+      xc_monitor_mov_to_msr(_xen->xenctrl.get(), _domid, msr, enable));
+}
+
+void DomainHVM::monitor_write_ctrlreg(uint16_t index, bool enable, bool sync,
+    bool on_change_only)
+{
+  XEN_STATS_MEASURE(MonitorControl, _domid,
+      xc_monitor_write_ctrlreg(_xen->xenctrl.get(), _domid, index, enable, sync,
+        0, on_change_only));
 }
 
 void DomainHVM::monitor_singlestep(bool enable) {
-  xc_monitor_singlestep(_xen->xenctrl.get(), _domid, enable);
+  XEN_STATS_MEASURE(MonitorControl, _domid,
+      xc_monitor_singlestep(_xen->xenctrl.get(), _domid, enable));
 }
 
 void DomainHVM::monitor_software_breakpoint(bool enable) {
-  xc_monitor_software_breakpoint(_xen->xenctrl.get(), _domid, enable);
+  XEN_STATS_MEASURE(MonitorControl, _domid,
+      xc_monitor_software_breakpoint(_xen->xenctrl.get(), _domid, enable));
 }
 
 void DomainHVM::monitor_debug_exceptions(bool enable, bool sync) {
-  xc_monitor_debug_exceptions(_xen->xenctrl.get(), _domid, enable, sync);
+  XEN_STATS_MEASURE(MonitorControl, _domid,
+      xc_monitor_debug_exceptions(_xen->xenctrl.get(), _domid, enable, sync));
 }
 
 void DomainHVM::monitor_cpuid(bool enable) {
-  xc_monitor_cpuid(_xen->xenctrl.get(), _domid, enable);
+  XEN_STATS_MEASURE(MonitorControl, _domid,
+      xc_monitor_cpuid(_xen->xenctrl.get(), _domid, enable));
 }
 
 void DomainHVM::monitor_descriptor_access(bool enable) {
-  xc_monitor_descriptor_access(_xen->xenctrl.get(), _domid, enable);
+  XEN_STATS_MEASURE(MonitorControl, _domid,
+      xc_monitor_descriptor_access(_xen->xenctrl.get(), _domid, enable));
 }
 
 void DomainHVM::monitor_privileged_call(bool enable) {
-  xc_monitor_privileged_call(_xen->xenctrl.get(), _domid, enable);
+  XEN_STATS_MEASURE(MonitorControl, _domid,
+      xc_monitor_privileged_call(_xen->xenctrl.get(), _domid, enable));
 }
 
 void DomainHVM::monitor_guest_request(bool enable, bool sync) {
-  xc_monitor_guest_request(_xen->xenctrl.get(), _domid, enable, sync);
+  XEN_STATS_MEASURE(MonitorControl, _domid,
+      xc_monitor_guest_request(_xen->xenctrl.get(), _domid, enable, sync));
 }
 
 struct hvm_hw_cpu DomainHVM::get_cpu_context_raw(VCPU_ID vcpu_id) const {
   int err;
   struct hvm_hw_cpu context;
-  if ((err = xc_domain_hvm_getcontext_partial(_xen->xenctrl.get(), _domid,
-      HVM_SAVE_CODE(CPU), (uint16_t)vcpu_id, &context, sizeof(context))))
+  if ((err = XEN_STATS_MEASURE(HVMGetContextPartial, _domid,
+      xc_domain_hvm_getcontext_partial(_xen->xenctrl.get(), _domid,
+        HVM_SAVE_CODE(CPU), (uint16_t)vcpu_id, &context, sizeof(context)))))
   {
     throw XenException("Failed get HVM CPU context for VCPU " +
                        std::to_string(vcpu_id) + " of domain " +
@@ -177,13 +251,15 @@ void DomainHVM::set_cpu_context_raw(struct hvm_hw_cpu context, VCPU_ID vcpu_id)
       HVM_SAVE_TYPE(END) end;
   } context_update;
 
-  uint32_t size = xc_domain_hvm_getcontext(_xen->xenctrl.get(), _domid, nullptr, 0);
+  uint32_t size = XEN_STATS_MEASURE(HVMGetContext, _domid,
+      xc_domain_hvm_getcontext(_xen->xenctrl.get(), _domid, nullptr, 0));
   if (size == ((uint32_t)-1))
     throw std::runtime_error("Failed to get HVM domain context (1)!");
 
   std::unique_ptr<uint8_t> full_context((uint8_t*)calloc(1, size));
 
-  size = xc_domain_hvm_getcontext(_xen->xenctrl.get(), _domid, full_context.get(), size);
+  size = XEN_STATS_MEASURE(HVMGetContext, _domid,
+      xc_domain_hvm_getcontext(_xen->xenctrl.get(), _domid, full_context.get(), size));
   if (size == ((uint32_t)-1))
     throw std::runtime_error("Failed to get HVM domain context (2)!");
 
@@ -207,8 +283,9 @@ void DomainHVM::set_cpu_context_raw(struct hvm_hw_cpu context, VCPU_ID vcpu_id)
   context_update.end_d.instance = vcpu_id;
   context_update.end_d.length = HVM_SAVE_LENGTH(END);
 
-  const int ret = xc_domain_hvm_setcontext(_xen->xenctrl.get(), _domid,
-      (uint8_t*)&context_update, sizeof(context_update));
+  const int ret = XEN_STATS_MEASURE(HVMSetContext, _domid,
+      xc_domain_hvm_setcontext(_xen->xenctrl.get(), _domid,
+        (uint8_t*)&context_update, sizeof(context_update)));
   if (ret)
     throw std::runtime_error("Failed to set HVM domain context!");
 }
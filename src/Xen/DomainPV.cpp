@@ -21,9 +21,11 @@
 
 #include <Xen/DomainPV.hpp>
 #include <Xen/Xen.hpp>
+#include <Xen/XenStats.hpp>
 #include <Util/overloaded.hpp>
 
 using xd::reg::RegistersX86Any;
+using xd::reg::x86::ExtendedRegisters;
 using xd::reg::x86_32::RegistersX86_32;
 using xd::reg::x86_64::RegistersX86_64;
 using xd::xen::DomainPV;
@@ -49,7 +51,8 @@ DomainPV::DomainPV(DomID domid, std::shared_ptr<Xen> xen)
 vcpu_guest_context_any_t DomainPV::get_cpu_context_raw(VCPU_ID vcpu_id) const {
   int err;
   vcpu_guest_context_any_t context_any;
-  if ((err = xc_vcpu_getcontext(_xen->xenctrl.get(), _domid, (uint16_t)vcpu_id, &context_any))) {
+  if ((err = XEN_STATS_MEASURE(VCPUGetContext, _domid,
+        xc_vcpu_getcontext(_xen->xenctrl.get(), _domid, (uint16_t)vcpu_id, &context_any)))) {
     throw XenException("Failed to get PV CPU context for VCPU " +
                        std::to_string(vcpu_id) + " of domain " +
                        std::to_string(_domid), -err);
@@ -76,7 +79,8 @@ void DomainPV::set_cpu_context(xd::reg::RegistersX86Any regs, VCPU_ID vcpu_id) c
 }
 
 void DomainPV::set_cpu_context_raw(vcpu_guest_context_any_t context, VCPU_ID vcpu_id) const {
-  int err = xc_vcpu_setcontext(_xen->xenctrl.get(), _domid, vcpu_id, &context);
+  int err = XEN_STATS_MEASURE(VCPUSetContext, _domid,
+      xc_vcpu_setcontext(_xen->xenctrl.get(), _domid, vcpu_id, &context));
 
   if (err < 0) {
     throw XenException("Failed to set PV CPU context for VCPU " +
@@ -85,6 +89,29 @@ void DomainPV::set_cpu_context_raw(vcpu_guest_context_any_t context, VCPU_ID vcp
   }
 }
 
+// Xen keeps only the FXSAVE image in a PV guest's context, so there is no
+// YMM state to show
+ExtendedRegisters DomainPV::get_extended_context(VCPU_ID vcpu_id) const {
+  const auto context_any = get_cpu_context_raw(vcpu_id);
+  const char *fpu = (get_word_size() == sizeof(uint64_t))
+    ? context_any.x64.fpu_ctxt.x
+    : context_any.x32.fpu_ctxt.x;
+
+  ExtendedRegisters regs{};
+  memcpy(regs.bytes.data(), fpu, X86_FXSAVE_SIZE);
+  return regs;
+}
+
+void DomainPV::set_extended_context(const ExtendedRegisters &regs, VCPU_ID vcpu_id) const {
+  auto context_any = get_cpu_context_raw(vcpu_id);
+  char *fpu = (get_word_size() == sizeof(uint64_t))
+    ? context_any.x64.fpu_ctxt.x
+    : context_any.x32.fpu_ctxt.x;
+
+  memcpy(fpu, regs.bytes.data(), X86_FXSAVE_SIZE);
+  set_cpu_context_raw(context_any, vcpu_id);
+}
+
 RegistersX86Any DomainPV::get_cpu_context(VCPU_ID vcpu_id) const {
   const auto context_any = get_cpu_context_raw(vcpu_id);
   const int word_size = get_word_size();
@@ -100,6 +127,20 @@ RegistersX86Any DomainPV::get_cpu_context(VCPU_ID vcpu_id) const {
   }
 }
 
+// modified version of xc_translate_foreign_address in xc_pagetab.c; the
+// context's width matches the guest's, as get_cpu_context chose it by that
+xd::xen::PagingMode DomainPV::get_paging_mode(const RegistersX86Any &regs) const {
+  return std::visit(overloaded {
+    [](const RegistersX86_64 &regs64) {
+      const auto cr3 = regs64.get<reg::x86::cr3>();
+      return PagingMode{4, cr3, cr3};
+    },
+    [](const RegistersX86_32 &regs32) {
+      const uint64_t cr3 = regs32.get<reg::x86::cr3>();
+      return PagingMode{3, ((cr3 >> XC_PAGE_SHIFT) | (cr3 << 20)) << XC_PAGE_SHIFT, cr3};
+    }}, regs);
+}
+
 void DomainPV::set_singlestep(bool enable, VCPU_ID vcpu_id) const {
   auto context_any = get_cpu_context(vcpu_id);
   std::visit(util::overloaded {
@@ -34,7 +34,8 @@ HVMMonitor::HVMMonitor(xen::XenDeviceModel &xendevicemodel,
     xen::XenEventChannel &xenevtchn, uvw::Loop &loop, DomainHVM &domain)
   : _xendevicemodel(xendevicemodel), _xenevtchn(xenevtchn), _domain(domain),
     _port(0), _ring_page(nullptr, unmap_ring_page),
-    _poll(loop.resource<uvw::PollHandle>(xenevtchn.get_fd()))
+    _poll(loop.resource<uvw::PollHandle>(xenevtchn.get_fd())),
+    _guest_request_sync(false)
 {
 }
 
@@ -54,6 +55,7 @@ void HVMMonitor::start() {
 
   _domain.monitor_singlestep(true);
   _domain.monitor_software_breakpoint(true);
+  _domain.monitor_guest_request(true, _guest_request_sync);
   //_domain.monitor_debug_exceptions(true, true);
   //_domain.monitor_cpuid(true);
   //_domain.monitor_descriptor_access(true);
@@ -73,9 +75,16 @@ void HVMMonitor::start() {
   _poll->start(uvw::PollHandle::Event::READABLE);
 }
 
+void HVMMonitor::set_guest_request_sync(bool sync) {
+  _guest_request_sync = sync;
+  if (_poll->active())
+    _domain.monitor_guest_request(true, sync);
+}
+
 void HVMMonitor::stop() {
   _domain.monitor_singlestep(false);
   _domain.monitor_software_breakpoint(false);
+  _domain.monitor_guest_request(false, false);
   //_domain.monitor_debug_exceptions(false, false);
   //_domain.monitor_cpuid(false);
   //_domain.monitor_descriptor_access(false);
@@ -132,6 +141,16 @@ void HVMMonitor::read_events() {
     if (req.version != VM_EVENT_INTERFACE_VERSION)
       continue; // TODO: error
 
+    // Xen leaves these instructions for the monitor to complete; without
+    // this the VCPU would trap on the same instruction forever.
+    if (req.reason == VM_EVENT_REASON_CPUID) {
+      rsp.flags |= VM_EVENT_FLAG_SET_REGISTERS;
+      rsp.data = req.data;
+      rsp.data.regs.x86.rip += req.u.cpuid.insn_length;
+    } else if (req.reason == VM_EVENT_REASON_DESCRIPTOR_ACCESS) {
+      rsp.flags |= VM_EVENT_FLAG_EMULATE;
+    }
+
     if (_on_event)
       _on_event(req);
 
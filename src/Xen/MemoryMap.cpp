@@ -0,0 +1,74 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <Xen/Domain.hpp>
+#include <Xen/MemoryMap.hpp>
+#include <Xen/PageTableWalker.hpp>
+
+using xd::xen::MemoryMap;
+using xd::xen::MemoryRegion;
+using xd::xen::PagePermissions;
+using xd::xen::PageTableLeaf;
+using xd::xen::PageTableWalker;
+
+MemoryMap MemoryMap::read(const Domain &domain, const PagingMode &paging_mode) {
+  MemoryMap map;
+  map._cr3 = paging_mode.cr3;
+  PageTableWalker(domain).walk(paging_mode, [&map](const PageTableLeaf &leaf) {
+    map.add(leaf.virtual_address, leaf.size, leaf.permissions, leaf.user);
+  });
+  return map;
+}
+
+void MemoryMap::add(Address start, size_t size, PagePermissions permissions, bool user) {
+  if (!_regions.empty()) {
+    auto &last = _regions.rbegin()->second;
+    if (last.end() == start &&
+        last.user == user &&
+        last.permissions.read == permissions.read &&
+        last.permissions.write == permissions.write &&
+        last.permissions.execute == permissions.execute)
+    {
+      last.size += size;
+      return;
+    }
+  }
+
+  _regions.emplace(start, MemoryRegion{start, size, permissions, user});
+}
+
+std::optional<MemoryRegion> MemoryMap::find(Address address) const {
+  auto it = _regions.upper_bound(address);
+  if (it == _regions.begin())
+    return std::nullopt;
+
+  --it;
+  if (address - it->second.start < it->second.size)
+    return it->second;
+  return std::nullopt;
+}
+
+std::optional<MemoryRegion> MemoryMap::find_next(Address address) const {
+  const auto it = _regions.upper_bound(address);
+  if (it == _regions.end())
+    return std::nullopt;
+  return it->second;
+}
@@ -0,0 +1,76 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+
+#include <Xen/Domain.hpp>
+#include <Xen/PageCache.hpp>
+#include <Xen/XenException.hpp>
+
+using xd::xen::Address;
+using xd::xen::PageCache;
+
+bool PageCache::read(Address address, void *data, size_t size) {
+  auto out = (unsigned char*)data;
+
+  while (size) {
+    const auto page = address & XC_PAGE_MASK;
+    const auto offset = address - page;
+    const auto chunk = std::min<size_t>(size, XC_PAGE_SIZE - offset);
+
+    const auto mem = get_page(page);
+    if (!mem)
+      return false;
+
+    std::memcpy(out, mem + offset, chunk);
+    out += chunk;
+    address += chunk;
+    size -= chunk;
+  }
+
+  return true;
+}
+
+bool PageCache::read_word(Address address, size_t word_size, uint64_t &word) {
+  word = 0;
+  return read(address, &word, std::min(word_size, sizeof(word)));
+}
+
+const unsigned char *PageCache::get_page(Address page) {
+  auto it = _pages.find(page);
+  if (it != _pages.end())
+    return it->second.get();
+
+  const auto mfn = _domain.translate_foreign_address(page, _paging_mode);
+  if (!mfn)
+    return nullptr;
+
+  try {
+    it = _pages.emplace(page, _domain.map_memory_by_mfn<unsigned char>(
+          mfn, 0, XC_PAGE_SIZE, PROT_READ)).first;
+  } catch (const XenException &) {
+    return nullptr;
+  }
+
+  return it->second.get();
+}
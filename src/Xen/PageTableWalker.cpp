@@ -0,0 +1,189 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <cstring>
+#include <sys/mman.h>
+#include <vector>
+
+#include <Xen/Domain.hpp>
+#include <Xen/PageTableWalker.hpp>
+
+using xd::xen::Address;
+using xd::xen::PageTableEntry;
+using xd::xen::PageTableWalk;
+using xd::xen::PageTableWalker;
+using xd::xen::PagingMode;
+
+#define PTE_PRESENT 0x1ull
+#define PTE_RW      0x2ull
+#define PTE_USER    0x4ull
+#define PTE_PSE     0x80ull
+#define PTE_NX      (1ull << 63)
+#define PTE_ADDR_MASK 0x000ffffffffff000ull
+
+#define PAE_TOP_LEVEL_ENTRIES 4
+
+void PageTableWalker::walk(const PagingMode &paging_mode, const OnLeafFn &on_leaf) {
+  _levels = paging_mode.levels;
+
+  if (!_levels) {
+    const auto size = (_domain.get_max_gpfn() + 1) << XC_PAGE_SHIFT;
+    on_leaf(PageTableLeaf{0, size, 0, PagePermissions(true, true, true), true});
+    return;
+  }
+
+  const Inherited root{0, true, true, true};
+  const auto root_mfn = paging_mode.root >> XC_PAGE_SHIFT;
+  const auto root_offset = paging_mode.root & ~XC_PAGE_MASK;
+
+  const auto table = _domain.map_memory_by_mfn<unsigned char>(
+      root_mfn, 0, XC_PAGE_SIZE, PROT_READ);
+
+  // PAE's top level is a 32-byte table of four entries, not a full page
+  const auto num_entries = (_levels == 3)
+    ? PAE_TOP_LEVEL_ENTRIES
+    : XC_PAGE_SIZE / get_entry_size();
+
+  walk_table(table.get() + root_offset, num_entries, _levels, root, on_leaf);
+}
+
+PageTableWalk PageTableWalker::translate(Address address, const PagingMode &paging_mode) {
+  _levels = paging_mode.levels;
+
+  PageTableWalk walk{_levels, paging_mode.cr3, {}, std::nullopt};
+  if (!_levels) {
+    walk.physical_address = address;
+    return walk;
+  }
+
+  const auto entry_size = get_entry_size();
+  const auto index_mask = (XC_PAGE_SIZE / entry_size) - 1;
+  const auto address_mask = (entry_size == sizeof(uint32_t))
+    ? 0xfffff000ull
+    : PTE_ADDR_MASK;
+
+  auto table = paging_mode.root;
+  for (auto level = _levels; level > 0; --level) {
+    const auto shift = get_shift(level);
+    const auto index = (address >> shift) & index_mask;
+    const auto entry_address = table + index * entry_size;
+
+    const auto mem = _domain.map_memory_by_mfn<unsigned char>(
+        entry_address >> XC_PAGE_SHIFT, 0, XC_PAGE_SIZE, PROT_READ);
+
+    uint64_t pte = 0;
+    std::memcpy(&pte, mem.get() + (entry_address & ~XC_PAGE_MASK), entry_size);
+    walk.steps.push_back(PageTableWalkStep{level, table, index, PageTableEntry(pte)});
+
+    if (!(pte & PTE_PRESENT))
+      break;
+
+    if (level == 1 || (can_be_large(level) && (pte & PTE_PSE))) {
+      const auto size = (Address)1 << shift;
+      walk.physical_address = (pte & address_mask & ~(size - 1)) | (address & (size - 1));
+      break;
+    }
+
+    table = pte & address_mask;
+  }
+
+  return walk;
+}
+
+void PageTableWalker::walk_table(const unsigned char *table, size_t num_entries,
+    size_t level, Inherited inherited, const OnLeafFn &on_leaf)
+{
+  const auto entry_size = get_entry_size();
+  const auto shift = get_shift(level);
+
+  const auto read_entry = [&](size_t i) {
+    uint64_t pte = 0;
+    std::memcpy(&pte, table + i * entry_size, entry_size);
+    return pte;
+  };
+
+  const auto inherit = [&](size_t i, uint64_t pte) {
+    return Inherited{
+      inherited.base + ((Address)i << shift),
+      inherited.write && (pte & PTE_RW),
+      inherited.execute && !(pte & PTE_NX),
+      inherited.user && (pte & PTE_USER),
+    };
+  };
+
+  std::vector<xen_pfn_t> children;
+  std::vector<Inherited> children_inherited;
+
+  for (size_t i = 0; i < num_entries; ++i) {
+    const auto pte = read_entry(i);
+    if (!(pte & PTE_PRESENT))
+      continue;
+
+    // PAE top-level entries carry no permission bits
+    const auto next = (level == 3 && _levels == 3)
+      ? Inherited{inherited.base + ((Address)i << shift), true, true, true}
+      : inherit(i, pte);
+
+    if (level == 1 || (can_be_large(level) && (pte & PTE_PSE))) {
+      const auto size = (size_t)1 << shift;
+      const auto address_mask = (entry_size == sizeof(uint32_t))
+        ? 0xfffff000ull
+        : PTE_ADDR_MASK;
+      const auto frame = (pte & address_mask & ~(uint64_t)(size - 1)) >> XC_PAGE_SHIFT;
+
+      on_leaf(PageTableLeaf{make_canonical(next.base), size, frame,
+          PagePermissions(true, next.write, next.execute), next.user});
+    } else {
+      children.push_back((pte & PTE_ADDR_MASK) >> XC_PAGE_SHIFT);
+      children_inherited.push_back(next);
+    }
+  }
+
+  if (children.empty())
+    return;
+
+  std::vector<int> errors;
+  const auto mem = _domain.map_memory_by_mfns<unsigned char>(children, PROT_READ, errors);
+  const auto num_child_entries = XC_PAGE_SIZE / entry_size;
+
+  for (size_t i = 0; i < children.size(); ++i) {
+    if (errors[i])
+      continue;
+    walk_table(mem.get() + i * XC_PAGE_SIZE, num_child_entries, level - 1,
+        children_inherited[i], on_leaf);
+  }
+}
+
+size_t PageTableWalker::get_shift(size_t level) const {
+  if (_levels == 2)
+    return (level == 2) ? 22 : 12;
+  return XC_PAGE_SHIFT + 9 * (level - 1);
+}
+
+bool PageTableWalker::can_be_large(size_t level) const {
+  return level == 2 || (level == 3 && _levels == 4);
+}
+
+Address PageTableWalker::make_canonical(Address address) const {
+  if (_levels == 4 && (address & (1ull << 47)))
+    return address | 0xffff000000000000ull;
+  return address;
+}
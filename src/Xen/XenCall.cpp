@@ -27,6 +27,7 @@
 
 #include <Xen/Domain.hpp>
 #include <Xen/XenCall.hpp>
+#include <Xen/XenStats.hpp>
 
 using xd::xen::XenCall;
 using xd::xen::XenException;
@@ -57,7 +58,8 @@ XenCall::DomctlUnion XenCall::do_domctl(const Domain &domain,
   if (init)
     init(domctl->u);
 
-  const auto err = xencall1(_xencall.get(), __HYPERVISOR_domctl, HYPERCALL_BUFFER_AS_ARG(domctl));
+  const auto err = XEN_STATS_MEASURE(Domctl, domain.get_domid(),
+      xencall1(_xencall.get(), __HYPERVISOR_domctl, HYPERCALL_BUFFER_AS_ARG(domctl)));
   auto u = domctl->u;
 
   xc_hypercall_buffer_free(_xenctrl.get(), domctl);
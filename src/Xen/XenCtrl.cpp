@@ -21,6 +21,7 @@
 
 #include <Xen/XenCtrl.hpp>
 #include <Xen/XenException.hpp>
+#include <Xen/XenStats.hpp>
 
 using xd::xen::DomInfo ;
 using xd::xen::XenCtrl;
@@ -35,7 +36,8 @@ xd::xen::XenCtrl::XenCtrl()
 }
 
 XenCtrl::XenVersion XenCtrl::get_xen_version() const {
-  int version = xc_version(_xenctrl.get(), XENVER_version, NULL);
+  int version = XEN_STATS_MEASURE(GetVersion, XEN_STATS_NO_DOMAIN,
+      xc_version(_xenctrl.get(), XENVER_version, NULL));
   return XenVersion {
     version >> 16,
     version & ((1 << 16) - 1)
@@ -44,7 +46,8 @@ XenCtrl::XenVersion XenCtrl::get_xen_version() const {
 
 DomInfo XenCtrl::get_domain_info(DomID domid) const {
   xc_dominfo_t dominfo;
-  int ret = xc_domain_getinfo(_xenctrl.get(), domid, 1, &dominfo);
+  int ret = XEN_STATS_MEASURE(GetDomainInfo, domid,
+      xc_domain_getinfo(_xenctrl.get(), domid, 1, &dominfo));
 
   // TODO: Why do these get out of sync?! Can I ignore it?
   if (ret != 1) // || dominfo.domid != domid)
@@ -22,6 +22,7 @@
 #include <Xen/Domain.hpp>
 #include <Xen/XenDeviceModel.hpp>
 #include <Xen/XenException.hpp>
+#include <Xen/XenStats.hpp>
 
 using xd::xen::Domain;
 using xd::xen::VCPU_ID;
@@ -36,9 +37,10 @@ XenDeviceModel::XenDeviceModel()
 void XenDeviceModel::inject_event(const Domain &domain, VCPU_ID vcpu_id,
     uint8_t vector, uint8_t type, uint32_t error_code, uint8_t insn_len, uint64_t cr2)
 {
-  int err = xendevicemodel_inject_event(
-      _xendevicemodel.get(), domain.get_domid(), vcpu_id,
-      vector, type, error_code, insn_len, cr2);
+  int err = XEN_STATS_MEASURE(InjectEvent, domain.get_domid(),
+      xendevicemodel_inject_event(
+        _xendevicemodel.get(), domain.get_domid(), vcpu_id,
+        vector, type, error_code, insn_len, cr2));
 
   if (err < 0)
     throw XenException("Failed to inject event!");
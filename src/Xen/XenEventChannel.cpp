@@ -22,6 +22,7 @@
 #include <Xen/Domain.hpp>
 #include <Xen/XenEventChannel.hpp>
 #include <Xen/XenException.hpp>
+#include <Xen/XenStats.hpp>
 
 using xd::xen::XenEventChannel;
 
@@ -38,14 +39,16 @@ int XenEventChannel::get_fd() {
 }
 
 XenEventChannel::Port XenEventChannel::get_next_pending_channel() {
-  int ret = xenevtchn_pending(_xenevtchn.get());
+  int ret = XEN_STATS_MEASURE(EvtchnPending, XEN_STATS_NO_DOMAIN,
+      xenevtchn_pending(_xenevtchn.get()));
   if (ret < 0)
     throw XenException("Failed to get next pending event channel!", errno);
   return ret;
 }
 
 XenEventChannel::Port XenEventChannel::unmask_channel(Port port) {
-  int ret = xenevtchn_unmask(_xenevtchn.get(), port);
+  int ret = XEN_STATS_MEASURE(EvtchnUnmask, XEN_STATS_NO_DOMAIN,
+      xenevtchn_unmask(_xenevtchn.get(), port));
   if (ret < 0)
     throw XenException("Failed to get next pending event channel!", errno);
   return ret;
@@ -55,18 +58,21 @@ XenEventChannel::Port XenEventChannel::unmask_channel(Port port) {
 XenEventChannel::Port XenEventChannel::bind_interdomain(
     const Domain &domain, Port remote_port)
 {
-  int ret = xenevtchn_bind_interdomain(_xenevtchn.get(), domain.get_domid(), remote_port);
+  int ret = XEN_STATS_MEASURE(EvtchnBind, domain.get_domid(),
+      xenevtchn_bind_interdomain(_xenevtchn.get(), domain.get_domid(), remote_port));
   if (ret < 0)
     throw XenException("Failed to bind inter-domain!", errno);
   return ret;
 }
 
 void XenEventChannel::unbind(Port port) {
-  int ret = xenevtchn_unbind(_xenevtchn.get(), port);
+  int ret = XEN_STATS_MEASURE(EvtchnUnbind, XEN_STATS_NO_DOMAIN,
+      xenevtchn_unbind(_xenevtchn.get(), port));
   if (ret < 0)
     throw XenException("Failed to unbind!", errno);
 }
 
 void XenEventChannel::notify(Port port) {
-  xenevtchn_notify(_xenevtchn.get(), port);
+  XEN_STATS_MEASURE(EvtchnNotify, XEN_STATS_NO_DOMAIN,
+      xenevtchn_notify(_xenevtchn.get(), port));
 }
@@ -25,6 +25,7 @@
 #include <Xen/Domain.hpp>
 #include <Xen/XenForeignMemory.hpp>
 #include <Xen/XenException.hpp>
+#include <Xen/XenStats.hpp>
 
 using xd::xen::WordSize;
 using xd::xen::XenForeignMemory;
@@ -51,9 +52,9 @@ void *XenForeignMemory::map_by_mfn_raw(const Domain &domain, Address base_mfn, A
   for (size_t i = 0; i < num_pages; ++i)
     pages[i] = base_mfn + i;
 
-  char *mem_page_base =
-      (char*)xenforeignmemory_map(_xen_foreign_memory.get(),
-                                  domain.get_domid(), prot, num_pages, pages, errors);
+  char *mem_page_base = (char*)XEN_STATS_MEASURE(ForeignMap, domain.get_domid(),
+      xenforeignmemory_map(_xen_foreign_memory.get(),
+                           domain.get_domid(), prot, num_pages, pages, errors));
 
   for (size_t i = 0; i < num_pages; ++i)
     if (errors[i])
@@ -63,3 +64,16 @@ void *XenForeignMemory::map_by_mfn_raw(const Domain &domain, Address base_mfn, A
 
   return (void*)(mem_page_base + offset);
 }
+
+void *XenForeignMemory::map_by_mfns_raw(const Domain &domain, const std::vector<xen_pfn_t> &mfns, int prot, std::vector<int> &errors) const {
+  errors.resize(mfns.size());
+
+  void *mem = XEN_STATS_MEASURE(ForeignMap, domain.get_domid(),
+      xenforeignmemory_map(_xen_foreign_memory.get(),
+        domain.get_domid(), prot, mfns.size(), mfns.data(), errors.data()));
+
+  if (!mem)
+    throw XenException("Failed to map " + std::to_string(mfns.size()) + " pages", errno);
+
+  return mem;
+}
@@ -0,0 +1,333 @@
+//
+// Copyright (C) 2018-2019 NCC Group
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <algorithm>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <pthread.h>
+
+#include <Util/string.hpp>
+#include <Xen/XenStats.hpp>
+
+using xd::util::string::format_duration_ns;
+using xd::xen::DomID;
+using xd::xen::XenOp;
+using xd::xen::XenStats;
+
+#define XEN_STATS_MIN_CALIBRATION std::chrono::milliseconds(10)
+#define XEN_STATS_NUM_OPS ((size_t)XenOp::COUNT)
+
+namespace {
+
+  struct OpCounters {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> max;
+    std::array<std::atomic<uint64_t>, XEN_STATS_NUM_BUCKETS> buckets;
+  };
+
+  struct DomainCounters {
+    explicit DomainCounters(DomID domid)
+      : domid(domid), ops{} {};
+
+    DomID domid;
+    std::array<OpCounters, XEN_STATS_NUM_OPS> ops;
+  };
+
+  // Only the owning thread writes to these. The mutex only keeps readers
+  // from iterating over domains while the owner appends to it.
+  struct ThreadCounters {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<DomainCounters>> domains;
+    DomainCounters *last = nullptr;
+  };
+
+  // Counters outlive their threads, so that nothing is lost on exit
+  std::mutex registry_mutex;
+  std::vector<std::unique_ptr<ThreadCounters>> registry;
+  thread_local ThreadCounters *thread_counters = nullptr;
+
+#if defined(__x86_64__) || defined(__i386__)
+  const auto clock_start_ticks = __rdtsc();
+#endif
+  const auto clock_start = std::chrono::steady_clock::now();
+
+  void add(std::atomic<uint64_t> &counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+        std::memory_order_relaxed);
+  }
+
+  size_t get_bucket(uint64_t ticks) {
+    const size_t bucket = ticks ? 64 - __builtin_clzll(ticks) : 0;
+    return std::min(bucket, (size_t)XEN_STATS_NUM_BUCKETS - 1);
+  }
+
+  DomainCounters &get_domain_counters(DomID domid) {
+    auto counters = thread_counters;
+    if (!counters) {
+      std::lock_guard<std::mutex> lock(registry_mutex);
+      registry.push_back(std::make_unique<ThreadCounters>());
+      counters = thread_counters = registry.back().get();
+    }
+
+    if (counters->last && counters->last->domid == domid)
+      return *counters->last;
+
+    for (const auto &domain : counters->domains)
+      if (domain->domid == domid)
+        return *(counters->last = domain.get());
+
+    std::lock_guard<std::mutex> lock(counters->mutex);
+    counters->domains.push_back(std::make_unique<DomainCounters>(domid));
+    return *(counters->last = counters->domains.back().get());
+  }
+
+  // The TSC rate is measured once, against the steady clock since the
+  // process started, waiting a little if that is still too short.
+  double measure_ticks_per_ns() {
+#if defined(__x86_64__) || defined(__i386__)
+    auto elapsed = std::chrono::steady_clock::now() - clock_start;
+    if (elapsed < XEN_STATS_MIN_CALIBRATION) {
+      std::this_thread::sleep_for(XEN_STATS_MIN_CALIBRATION - elapsed);
+      elapsed = std::chrono::steady_clock::now() - clock_start;
+    }
+    const auto ticks = __rdtsc() - clock_start_ticks;
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    return (double)ticks / (double)ns;
+#else
+    return 1.0;
+#endif
+  }
+
+  double get_ticks_per_ns() {
+    static const auto ticks_per_ns = measure_ticks_per_ns();
+    return ticks_per_ns;
+  }
+
+}
+
+std::atomic<bool> XenStats::_enabled(true);
+std::atomic<XenStats::CallObserver> XenStats::_observer(nullptr);
+
+const char *xd::xen::get_xen_op_name(XenOp op) {
+  switch (op) {
+    case XenOp::Domctl: return "domctl";
+    case XenOp::GetDomainInfo: return "domain_getinfo";
+    case XenOp::GetVersion: return "version";
+    case XenOp::GetGuestWidth: return "domain_get_guest_width";
+    case XenOp::SetDebugging: return "domain_setdebugging";
+    case XenOp::DebugControl: return "domain_debug_control";
+    case XenOp::Pause: return "domain_pause";
+    case XenOp::Unpause: return "domain_unpause";
+    case XenOp::Shutdown: return "domain_shutdown";
+    case XenOp::Destroy: return "domain_destroy";
+    case XenOp::MaximumGPFN: return "domain_maximum_gpfn";
+    case XenOp::TranslateAddress: return "translate_foreign_address";
+    case XenOp::MapMemInfo: return "map_domain_meminfo";
+    case XenOp::SetMemAccess: return "set_mem_access";
+    case XenOp::GetMemAccess: return "get_mem_access";
+    case XenOp::SetAccessRequired: return "domain_set_access_required";
+    case XenOp::ShadowControl: return "shadow_control";
+    case XenOp::HVMGetContext: return "hvm_getcontext";
+    case XenOp::HVMGetContextPartial: return "hvm_getcontext_partial";
+    case XenOp::HVMSetContext: return "hvm_setcontext";
+    case XenOp::VCPUGetContext: return "vcpu_getcontext";
+    case XenOp::VCPUSetContext: return "vcpu_setcontext";
+    case XenOp::MonitorEnable: return "monitor_enable";
+    case XenOp::MonitorDisable: return "monitor_disable";
+    case XenOp::MonitorControl: return "monitor_control";
+    case XenOp::ForeignMap: return "foreignmemory_map";
+    case XenOp::ForeignUnmap: return "foreignmemory_unmap";
+    case XenOp::InjectEvent: return "inject_event";
+    case XenOp::EvtchnPending: return "evtchn_pending";
+    case XenOp::EvtchnUnmask: return "evtchn_unmask";
+    case XenOp::EvtchnBind: return "evtchn_bind_interdomain";
+    case XenOp::EvtchnUnbind: return "evtchn_unbind";
+    case XenOp::EvtchnNotify: return "evtchn_notify";
+    case XenOp::XenStoreRead: return "xenstore_read";
+    case XenOp::XenStoreWatch: return "xenstore_watch";
+    case XenOp::COUNT: break;
+  }
+  return "unknown";
+}
+
+uint64_t XenStats::Summary::get_bucket_upper_bound_ns(size_t bucket) {
+  return ticks_to_ns(1ULL << bucket);
+}
+
+uint64_t XenStats::Summary::get_percentile_ns(double fraction) const {
+  const auto target = (uint64_t)(fraction * (double)count);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    seen += buckets[i];
+    if (seen > target || seen == count)
+      return std::min(get_bucket_upper_bound_ns(i), max_ns);
+  }
+  return max_ns;
+}
+
+uint64_t XenStats::ticks_to_ns(uint64_t ticks) {
+  return (uint64_t)((double)ticks / get_ticks_per_ns());
+}
+
+void XenStats::record(XenOp op, DomID domid, uint64_t begin, uint64_t end, bool error) {
+  if (is_enabled()) {
+    const auto ticks = end - begin;
+    auto &counters = get_domain_counters(domid).ops[(size_t)op];
+    add(counters.count, 1);
+    add(counters.total, ticks);
+    add(counters.buckets[get_bucket(ticks)], 1);
+    if (error)
+      add(counters.errors, 1);
+    if (ticks > counters.max.load(std::memory_order_relaxed))
+      counters.max.store(ticks, std::memory_order_relaxed);
+  }
+
+  if (const auto observer = _observer.load(std::memory_order_relaxed))
+    observer(op, domid, begin, end, error);
+}
+
+std::vector<XenStats::Summary> XenStats::collect(std::optional<DomID> domid) {
+  std::map<std::pair<DomID, XenOp>, Summary> sums;
+
+  {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    for (const auto &thread : registry) {
+      std::lock_guard<std::mutex> lock(thread->mutex);
+      for (const auto &domain : thread->domains) {
+        if (domid && domain->domid != *domid)
+          continue;
+
+        for (size_t i = 0; i < XEN_STATS_NUM_OPS; ++i) {
+          const auto &counters = domain->ops[i];
+          const auto count = counters.count.load(std::memory_order_relaxed);
+          if (!count)
+            continue;
+
+          const auto op = (XenOp)i;
+          auto [it, _] = sums.emplace(std::make_pair(domain->domid, op),
+              Summary{op, domain->domid, 0, 0, 0, 0, {}});
+          auto &sum = it->second;
+
+          sum.count += count;
+          sum.errors += counters.errors.load(std::memory_order_relaxed);
+          sum.total_ns += counters.total.load(std::memory_order_relaxed);
+          sum.max_ns = std::max(sum.max_ns, counters.max.load(std::memory_order_relaxed));
+          for (size_t b = 0; b < XEN_STATS_NUM_BUCKETS; ++b)
+            sum.buckets[b] += counters.buckets[b].load(std::memory_order_relaxed);
+        }
+      }
+    }
+  }
+
+  // Everything was summed in ticks up to here
+  std::vector<Summary> summaries;
+  summaries.reserve(sums.size());
+  for (auto &[_, sum] : sums) {
+    sum.total_ns = ticks_to_ns(sum.total_ns);
+    sum.max_ns = ticks_to_ns(sum.max_ns);
+    summaries.push_back(sum);
+  }
+  return summaries;
+}
+
+void XenStats::reset(std::optional<DomID> domid) {
+  std::lock_guard<std::mutex> registry_lock(registry_mutex);
+  for (const auto &thread : registry) {
+    std::lock_guard<std::mutex> lock(thread->mutex);
+    for (const auto &domain : thread->domains) {
+      if (domid && domain->domid != *domid)
+        continue;
+
+      for (auto &counters : domain->ops) {
+        counters.count.store(0, std::memory_order_relaxed);
+        counters.errors.store(0, std::memory_order_relaxed);
+        counters.total.store(0, std::memory_order_relaxed);
+        counters.max.store(0, std::memory_order_relaxed);
+        for (auto &bucket : counters.buckets)
+          bucket.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+void XenStats::print(std::ostream &out, const std::vector<Summary> &summaries) {
+  if (summaries.empty()) {
+    out << "No calls into Xen recorded." << std::endl;
+    return;
+  }
+
+  out << std::left
+      << std::setw(8) << "domain"
+      << std::setw(28) << "operation"
+      << std::right
+      << std::setw(10) << "calls"
+      << std::setw(8) << "errors"
+      << std::setw(10) << "total"
+      << std::setw(10) << "mean"
+      << std::setw(10) << "p50"
+      << std::setw(10) << "p99"
+      << std::setw(10) << "max" << std::endl;
+
+  for (const auto &sum : summaries) {
+    out << std::left << std::setw(8);
+    if (sum.domid == XEN_STATS_NO_DOMAIN)
+      out << "-";
+    else
+      out << sum.domid;
+
+    out << std::setw(28) << get_xen_op_name(sum.op)
+        << std::right << std::dec
+        << std::setw(10) << sum.count
+        << std::setw(8) << sum.errors
+        << std::setw(10) << format_duration_ns(sum.total_ns)
+        << std::setw(10) << format_duration_ns(sum.total_ns / sum.count)
+        << std::setw(10) << format_duration_ns(sum.get_percentile_ns(0.5))
+        << std::setw(10) << format_duration_ns(sum.get_percentile_ns(0.99))
+        << std::setw(10) << format_duration_ns(sum.max_ns) << std::endl;
+  }
+}
+
+void XenStats::dump_on_signal(int signum) {
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, signum);
+  pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+  std::thread([set]() {
+    for (;;) {
+      int signal;
+      if (sigwait(&set, &signal))
+        continue;
+
+      std::stringstream ss;
+      print(ss, collect());
+      std::cerr << ss.str() << std::flush;
+    }
+  }).detach();
+}
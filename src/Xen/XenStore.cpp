@@ -23,11 +23,14 @@
 
 #include <Util/pop_ret.hpp>
 #include <Xen/XenException.hpp>
+#include <Xen/XenStats.hpp>
 #include <Xen/XenStore.hpp>
 
 using xd::util::pop_ret;
 using xd::xen::DomID;
 using xd::xen::XenException;
+using xd::xen::XenOp;
+using xd::xen::XenStats;
 using xd::xen::XenStore;
 
 XenStore::XenStore()
@@ -43,7 +46,8 @@ int XenStore::get_fileno() const {
 
 std::vector<std::string> XenStore::read_directory(const std::string &dir) const {
   unsigned int num_entries;
-  char **entries = xs_directory(_xenstore.get(), XBT_NULL, dir.c_str(), &num_entries);
+  char **entries = XEN_STATS_MEASURE(XenStoreRead, XEN_STATS_NO_DOMAIN,
+      xs_directory(_xenstore.get(), XBT_NULL, dir.c_str(), &num_entries));
 
   if (!entries)
     throw XenException("Read from directory \"" + dir + "\" failed!", errno);
@@ -61,10 +65,12 @@ std::vector<std::string> XenStore::read_directory(const std::string &dir) const
 }
 
 std::string XenStore::read(const std::string &file) const {
-
-  auto transaction = xs_transaction_start(_xenstore.get());
-  char *contents = (char*)xs_read(_xenstore.get(), transaction, file.c_str(), nullptr);
-  xs_transaction_end(_xenstore.get(), transaction, false);
+  char *contents = XenStats::measure(XenOp::XenStoreRead, XEN_STATS_NO_DOMAIN, [&]() {
+    auto transaction = xs_transaction_start(_xenstore.get());
+    auto contents = (char*)xs_read(_xenstore.get(), transaction, file.c_str(), nullptr);
+    xs_transaction_end(_xenstore.get(), transaction, false);
+    return contents;
+  });
 
   if (!contents)
     throw XenException("Read from \"" + file + "\" failed!", errno);
@@ -100,11 +106,13 @@ XenStore::Watch::Watch(XenStore &xenstore, std::string token)
 
 XenStore::Watch::~Watch() {
   for (const auto &path : _paths)
-    xs_unwatch(_xenstore._xenstore.get(), path.c_str(), _token.c_str());
+    XEN_STATS_MEASURE(XenStoreWatch, XEN_STATS_NO_DOMAIN,
+        xs_unwatch(_xenstore._xenstore.get(), path.c_str(), _token.c_str()));
 }
 
 void XenStore::Watch::add_path(Path path) {
-  xs_watch(_xenstore._xenstore.get(), path.c_str(), _token.c_str());
+  XEN_STATS_MEASURE(XenStoreWatch, XEN_STATS_NO_DOMAIN,
+      xs_watch(_xenstore._xenstore.get(), path.c_str(), _token.c_str()));
   _paths.push_back(std::move(path));
 }
 
@@ -19,16 +19,23 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#include <csignal>
+
 #include <spdlog/spdlog.h>
 #include <uvw.hpp>
 
 #include <Globals.hpp>
+#include <Xen/XenStats.hpp>
 
 #include "CommandLine.hpp"
 
 using xd::CommandLine;
+using xd::xen::XenStats;
 
 int main(int argc, char **argv) {
+  // Before anything else, so that no other thread can take the signal
+  XenStats::dump_on_signal(SIGUSR1);
+
   auto console = spdlog::stdout_color_mt(LOGNAME_CONSOLE);
   console->set_level(spdlog::level::info);
   console->set_pattern("[%H:%M:%S.%e] %v");